@@ -77,6 +77,13 @@ foreach (NCDFcomp IN LISTS NetCDF_FIND_VALID_COMPONENTS)
                              DEFINITIONS -I${NetCDF_C_INCLUDE_DIR}
                              COMMENT "whether NetCDF has parallel support")
 
+                # Check for parallel filter (compression) support
+                check_macro (NetCDF_C_HAS_PAR_FILTERS
+                             NAME TryNetCDF_PAR_FILTERS.c
+                             HINTS ${CMAKE_MODULE_PATH}
+                             DEFINITIONS -I${NetCDF_C_INCLUDE_DIR}
+                             COMMENT "whether NetCDF has parallel filter support")
+
                  # Check if logging enabled
 		 set(CMAKE_REQUIRED_INCLUDES ${NetCDF_C_INCLUDE_DIR})
 		 set(CMAKE_REQUIRED_LIBRARIES ${NetCDF_C_LIBRARIES})
@@ -0,0 +1,13 @@
+/*
+ * NetCDF C Test for parallel filter (compression) Support
+ */
+#include "netcdf_meta.h"
+
+int main()
+{
+#if NC_HAS_PAR_FILTERS==1
+	return 0;
+#else
+	XXX;
+#endif
+}
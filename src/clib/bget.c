@@ -478,6 +478,29 @@ extern char *sprintf();               /* Sun includes don't define sprintf */
 
 #include "bget.h"
 
+#if PIO_USE_THREADSAFE
+/* In the thread-safe mode of the library the interface functions,
+   defined at the end of this file, acquire the global lock and call
+   the functions below. */
+static void *bget_unlocked(bufsize size);
+static void *bgetz_unlocked(bufsize size);
+static void *bgetr_unlocked(void *buf, bufsize size);
+static void brel_unlocked(void *buf);
+static void bpool_unlocked(void *buf, bufsize len);
+#define bget bget_unlocked
+#define bgetz bgetz_unlocked
+#define bgetr bgetr_unlocked
+#define brel brel_unlocked
+#define bpool bpool_unlocked
+#ifdef BufStats
+static void bfreespace_unlocked(bufsize *totfree, bufsize *maxfree);
+static void bstats_unlocked(bufsize *curalloc, bufsize *totfree,
+    bufsize *maxfree, long *nget, long *nrel);
+#define bfreespace bfreespace_unlocked
+#define bstats bstats_unlocked
+#endif /* BufStats */
+#endif /* PIO_USE_THREADSAFE */
+
 #define MemSize     size_t            /* Type for size arguments to memxxx()
                                          functions such as memcmp(). */
 
@@ -1423,6 +1446,80 @@ int bpoolv(void *buf)
 }
 #endif /* BufValid */
 
+#if PIO_USE_THREADSAFE
+#undef bget
+#undef bgetz
+#undef bgetr
+#undef brel
+#undef bpool
+
+/*  Thread-safe interface functions, see the top of the file.  */
+
+void *bget(bufsize size)
+{
+    void *buf;
+
+    PIO_LOCK();
+    buf = bget_unlocked(size);
+    PIO_UNLOCK();
+    return buf;
+}
+
+void *bgetz(bufsize size)
+{
+    void *buf;
+
+    PIO_LOCK();
+    buf = bgetz_unlocked(size);
+    PIO_UNLOCK();
+    return buf;
+}
+
+void *bgetr(void *buf, bufsize size)
+{
+    void *nbuf;
+
+    PIO_LOCK();
+    nbuf = bgetr_unlocked(buf, size);
+    PIO_UNLOCK();
+    return nbuf;
+}
+
+void brel(void *buf)
+{
+    PIO_LOCK();
+    brel_unlocked(buf);
+    PIO_UNLOCK();
+}
+
+void bpool(void *buf, bufsize len)
+{
+    PIO_LOCK();
+    bpool_unlocked(buf, len);
+    PIO_UNLOCK();
+}
+
+#ifdef BufStats
+#undef bfreespace
+#undef bstats
+
+void bfreespace(bufsize *totfree, bufsize *maxfree)
+{
+    PIO_LOCK();
+    bfreespace_unlocked(totfree, maxfree);
+    PIO_UNLOCK();
+}
+
+void bstats(bufsize *curalloc, bufsize *totfree,
+    bufsize *maxfree, long *nget, long *nrel)
+{
+    PIO_LOCK();
+    bstats_unlocked(curalloc, totfree, maxfree, nget, nrel);
+    PIO_UNLOCK();
+}
+#endif /* BufStats */
+#endif /* PIO_USE_THREADSAFE */
+
 /***********************\
  *                      *
  * Built-in test program *
@@ -31,6 +31,9 @@
 #if PIO_USE_MICRO_TIMING
   #define PIO_MICRO_TIMING 1
 #endif
+#if PIO_USE_TRACE
+  #define PIO_TRACE 1
+#endif
 
 #ifdef _NETCDF
 #include <netcdf.h>
@@ -189,6 +192,19 @@ unsigned long get_adios2_io_cnt();
 #endif
 #define PIO_64BIT_OFFSET NC_64BIT_OFFSET
 
+/** Quantize modes (see PIOc_def_var_quantize()). The values match the
+ * netCDF NC_NOQUANTIZE, NC_QUANTIZE_BITGROOM and NC_QUANTIZE_BITROUND
+ * quantize modes. */
+#define PIO_NOQUANTIZE 0
+#define PIO_QUANTIZE_BITGROOM 1
+#define PIO_QUANTIZE_BITROUND 3
+
+/** Formats of the I/O performance reports written when files are
+ * closed (see PIOc_set_perf_report()). */
+#define PIO_PERF_REPORT_NONE 0
+#define PIO_PERF_REPORT_JSON 1
+#define PIO_PERF_REPORT_CSV 2
+
 /** NC_64BIT_DATA This is a problem - need to define directly instead
  * of using include file. */
 #define PIO_64BIT_DATA 0x0010
@@ -308,6 +324,113 @@ unsigned long get_adios2_io_cnt();
 typedef struct mtimer_info *mtimer_t;
 #endif
 
+/**
+ * I/O performance statistics of a variable, or of a file, on a task
+ * (see PIOc_set_perf_report()). The statistics are always collected,
+ * and are only reduced over the tasks when a report is written.
+ */
+typedef struct pio_perf_stats_t
+{
+    /** Number of distributed array writes and reads. Multiple
+     * variables written together count as a write of each var. */
+    PIO_Offset nwrites;
+    PIO_Offset nreads;
+
+    /** Number of bytes written and read on this (IO) task. */
+    PIO_Offset wr_bytes;
+    PIO_Offset rd_bytes;
+
+    /** Time (secs) spent rearranging data between the compute and
+     * IO tasks. For multiple variables written together the time is
+     * divided evenly between the variables. */
+    double wr_rearr_time;
+    double rd_rearr_time;
+
+    /** Time (secs) spent in the underlying I/O library. */
+    double wr_io_time;
+    double rd_io_time;
+
+    /** Number of flushes of the write multi buffers of the file, and
+     * of waits on pending PnetCDF requests (blocks of requests waited
+     * on with ncmpi_wait_all()). Only used for files. */
+    PIO_Offset nflushes;
+    PIO_Offset nwaits;
+
+    /** Time (secs) spent waiting on pending PnetCDF requests. Only
+     * used for files. */
+    double wait_time;
+} pio_perf_stats_t;
+
+/**
+ * Statistics of the asynchronous I/O service for a computation
+ * component, collected on the IO tasks serving the component (see
+ * pio_msg_handler2()). The queue depth and the wait time are only
+ * known on the IO root, that receives the messages.
+ */
+typedef struct pio_async_stats_t
+{
+    /** Number of messages of the component handled. */
+    PIO_Offset nmsgs;
+
+    /** Number of messages (of all the components served) received
+     * and waiting to be handled when a message of the component is
+     * picked, including it: sum (for the mean) and maximum. */
+    PIO_Offset queue_depth_sum;
+    int max_queue_depth;
+
+    /** Time (secs) between the reception of the messages and the
+     * start of their handling: total and maximum. */
+    double wait_time;
+    double max_wait_time;
+
+    /** Time (secs) spent handling the messages: total and maximum. */
+    double handle_time;
+    double max_handle_time;
+} pio_async_stats_t;
+
+/**
+ * Time (secs) spent on this task in each phase of the setup of a
+ * decomposition. The times are collected by PIOc_InitDecomp() (and
+ * by the first rearrangement of data, that defines the MPI
+ * datatypes), and can be used to measure the setup cost of the
+ * rearrangers.
+ */
+typedef struct pio_setup_stats_t
+{
+    /** Partitioning the data over the IO tasks: the start/count of
+     * the IO regions for the box rearranger, the subset communicators
+     * for the subset rearranger. */
+    double partition_time;
+
+    /** Determining whether the decomposition has holes, and (subset
+     * rearranger) finding the holes. */
+    double fill_time;
+
+    /** Exchanging the start/counts of the IO regions (box
+     * rearranger), or gathering the maps on the IO tasks (subset
+     * rearranger). */
+    double exchange_time;
+
+    /** Finding the destination of each element of the map (box
+     * rearranger), or sorting the gathered map and finding the IO
+     * regions (subset rearranger). */
+    double map_time;
+
+    /** Computing the counts of data exchanged and the sizes of the IO
+     * buffers. */
+    double counts_time;
+
+    /** Defining the MPI datatypes used to rearrange data. */
+    double datatypes_time;
+
+    /** Loading the setup from the rearranger plan cache (see
+     * PIOc_set_rearr_plan_cache()), 0 if the setup was computed. */
+    double load_time;
+
+    /** Total time of PIOc_InitDecomp(). */
+    double total_time;
+} pio_setup_stats_t;
+
 /**
  * Variable description structure.
  */
@@ -372,6 +495,31 @@ typedef struct var_desc_t
     /** Buffer that contains the holegrid fill values used to fill in
      * missing sections of data when using the subset rearranger. */
     void *fillbuf;
+
+    /** Quantize mode for this var, PIO_NOQUANTIZE (the default),
+     * PIO_QUANTIZE_BITGROOM or PIO_QUANTIZE_BITROUND. */
+    int quantize_mode;
+
+    /** Number of significant decimal digits (PIO_QUANTIZE_BITGROOM)
+     * or bits (PIO_QUANTIZE_BITROUND) kept when quantizing. */
+    int nsd;
+
+    /** Non-zero if the chunk sizes of this var were set with
+     * PIOc_def_var_chunking(). PIO does not change the chunk sizes
+     * of these vars. */
+    int user_chunking;
+
+    /** Non-zero if the chunk cache of this var was set with
+     * PIOc_set_var_chunk_cache(). */
+    int user_chunk_cache;
+
+    /** Non-zero if this var was defined since the last call to
+     * PIOc_enddef(). PIO chooses the chunk sizes of these vars when
+     * leaving define mode. */
+    int new_var;
+
+    /** I/O performance statistics of this var on this task. */
+    pio_perf_stats_t perf;
 } var_desc_t;
 
 /**
@@ -587,6 +735,14 @@ typedef struct io_desc_t
     /** Used when writing fill data. */
     io_region *fillregion;
 
+    /** Number of holes written with the data regions (SUBSET
+     * rearranger), these are not in fillregion. */
+    int mergedholes;
+
+    /** Array (length mergedholes) of the positions of the merged
+     * holes in the IO buffer, they get the fill value. */
+    PIO_Offset *holeindex;
+
     /** Rearranger flow control options
      *  (handshake, non-blocking sends, pending requests)
      */
@@ -597,6 +753,42 @@ typedef struct io_desc_t
      * group. */
     MPI_Comm subset_comm;
 
+    /** ID of a decomposition with the same map, created for writing
+     * user data converted (on the compute tasks) to the narrower type
+     * of the variable in the file. Decompositions for different types
+     * are chained through their conv_ioid. -1 if not created. */
+    int conv_ioid;
+
+    /** True if the IO regions of the box rearranger were provided by
+     * the user (iostart and iocount of PIOc_InitDecomp()). The data
+     * of such decompositions is not converted on the compute tasks,
+     * a decomposition created for the converted data would have
+     * other IO regions. */
+    bool user_ioregions;
+
+    /** ID of the IO system of this decomposition. */
+    int iosysid;
+
+    /** Smallest count, along each dimension, of the non-empty IO
+     * regions of the IO tasks. Only set on IO tasks for the box
+     * rearranger (NULL otherwise), used to choose chunk sizes of
+     * netCDF-4 variables that are aligned with the IO regions. */
+    PIO_Offset *ioregion_count;
+
+    /** Time spent in each phase of the setup of this decomposition. */
+    pio_setup_stats_t setup;
+
+    /** Fingerprint of the map and dimensions of this decomposition,
+     * 0 if its rearranger setup can not be shared (see
+     * pio_share_iodesc()). */
+    unsigned long long hash;
+
+    /** Number of decompositions sharing the rearranger setup (the
+     * regions, the counts and indices used to rearrange data, and the
+     * subset communicator) of this decomposition, NULL if the setup is
+     * not shared. The setup is freed with the last of them. */
+    int *nshared;
+
 #if PIO_SAVE_DECOMPS
     /* Indicates whether this iodesc has been saved to disk (the
      * decomposition is dumped to disk)
@@ -620,6 +812,10 @@ typedef struct iosystem_desc_t
      * calling PIOc_Init_Intercomm() or PIOc_Init_Intracomm(). */
     int iosysid;
 
+    /** Slot of the id of the next file opened or created on this
+     * iosystem (see pio_add_to_file_list()). */
+    int next_file_slot;
+
     /** This is an MPI intra communicator that includes all the tasks in
      * both the IO and the computation communicators. */
     MPI_Comm union_comm;
@@ -723,9 +919,39 @@ typedef struct iosystem_desc_t
     /** Index of this component in the list of components. */
     int comp_idx;
 
+    /** Statistics of the async I/O service for this component, on
+     * the IO tasks. */
+    pio_async_stats_t async_stats;
+
     /** Rearranger options. */
     rearr_opt_t rearr_opts;
 
+    /** Format of the I/O performance reports written when files are
+     * closed (see PIOc_set_perf_report()). */
+    int perf_report;
+
+    /** Directory of the rearranger plan cache, NULL if the cache is
+     * not used (see PIOc_set_rearr_plan_cache()). */
+    char *plan_cache_dir;
+
+    /** Non-zero if the thread-safe mode of the C API is turned on (see
+     * PIOc_set_threadsafe()). */
+    int threadsafe;
+
+    /** The I/O thread of this task, NULL if the I/O thread is not
+     * used (see PIOc_set_io_thread()). */
+    void *io_thread;
+
+    /** Budget, in bytes, of the data held on each IO task by the
+     * data buffers of the files of this IO system waiting for their
+     * PnetCDF requests to complete, 0 to use the buffer size limit
+     * (see PIOc_set_stage_limit()). */
+    PIO_Offset stage_limit;
+
+    /** Bytes of data held on this IO task by the data buffers of the
+     * files of this IO system until their next flush. */
+    PIO_Offset staged_bytes;
+
 #ifdef _ADIOS2
     /* ADIOS handle */
     adios2_adios *adiosH;
@@ -770,6 +996,11 @@ typedef struct wmulti_buffer
     /** Pointer to the data. */
     void *data;
 
+    /** Array of pointers to the user arrays (one per var or record),
+     * used instead of data when user data is not copied to the
+     * multi-buffer (see PIOc_set_darray_nocopy()). */
+    void **udata;
+
     /** Pointer to the next multi-buffer in the list. */
     struct wmulti_buffer *next;
 } wmulti_buffer;
@@ -920,6 +1151,11 @@ typedef struct file_desc_t
      * the same communication pattern prior to a write. */
     struct wmulti_buffer buffer;
 
+    /** Incremented when the write multi buffers of the list are
+     * freed, invalidates the buffers cached by the write handles (see
+     * PIOc_bind_darray()). */
+    int wmb_gen;
+
     /* Bytes pending to be read on this file*/
     PIO_Offset rb_pend;
 
@@ -929,12 +1165,54 @@ typedef struct file_desc_t
     /** Data buffer per IO decomposition for this file. */
     void *iobuf[PIO_IODESC_MAX_IDS];
 
+    /** Data buffers of the file with pending PnetCDF requests that
+     * were replaced by new buffers in iobuf, released on the next
+     * flush (see PIOc_set_stage_limit()). */
+    void **staged_iobufs;
+
+    /** Number of buffers in staged_iobufs. */
+    int num_staged_iobufs;
+
+    /** Allocated length of staged_iobufs. */
+    int staged_iobufs_sz;
+
+    /** Bytes of data, on this IO task, held by the data buffers of
+     * the file (iobuf and staged_iobufs) until the next flush. */
+    PIO_Offset staged_bytes;
+
     /** Pointer to the next file_desc_t in the list of open files. */
     struct file_desc_t *next;
 
     /** True if this task should participate in IO (only true for one
      * task with netcdf serial files. */
     int do_io;
+
+    /** Non-zero if PIOc_write_darray() caches pointers to the user
+     * arrays instead of copying the user data (see
+     * PIOc_set_darray_nocopy()). */
+    int darray_nocopy;
+
+    /** Lock protecting the write multi buffers of the file in the
+     * thread-safe mode (see PIOc_set_threadsafe()), NULL if the
+     * library is not configured with PIO_ENABLE_THREADSAFE. */
+    void *lock;
+
+    /** Number of jobs of the file queued on, or run by, the I/O
+     * thread (see PIOc_set_io_thread()). */
+    int io_thread_njobs;
+
+    /** Error code of the first job of the file that failed on the
+     * I/O thread, not reported yet. */
+    int io_thread_ierr;
+
+    /** Number of waits on pending PnetCDF requests, and time (secs)
+     * spent waiting, by the jobs of the file run on the I/O thread,
+     * not yet counted in perf (see pio_io_thread_finish()). */
+    PIO_Offset io_thread_nwaits;
+    double io_thread_wait_time;
+
+    /** I/O performance statistics of the file on this task. */
+    pio_perf_stats_t perf;
 } file_desc_t;
 
 /**
@@ -1069,6 +1347,10 @@ extern "C" {
                           void *fillvalue);
     int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars, PIO_Offset arraylen,
                                 void *array, const int *frame, void **fillvalue, bool flushtodisk);
+    int PIOc_set_darray_nocopy(int ncid, int nocopy);
+    int PIOc_bind_darray(int ncid, int varid, int ioid, void *fillvalue, int *handlep);
+    int PIOc_write_darray_handle(int handle, int frame, void *array);
+    int PIOc_unbind_darray(int handle);
     int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array);
     int PIOc_get_local_array_size(int ioid);
 
@@ -1078,9 +1360,13 @@ extern "C" {
     int PIOc_sync(int ncid);
     int PIOc_deletefile(int iosysid, const char *filename);
     int PIOc_createfile(int iosysid, int *ncidp,  int *iotype, const char *fname, int mode);
+    int PIOc_createfiles(int iosysid, int nfiles, int *ncids, int *iotype, const char **filenames,
+                         int mode);
     int PIOc_create(int iosysid, const char *path, int cmode, int *ncidp);
     int PIOc_openfile(int iosysid, int *ncidp, int *iotype, const char *fname, int mode);
     int PIOc_openfile2(int iosysid, int *ncidp, int *iotype, const char *fname, int mode);
+    int PIOc_openfiles(int iosysid, int nfiles, int *ncids, int *iotype, const char **filenames,
+                       int mode);
     int PIOc_open(int iosysid, const char *path, int mode, int *ncidp);
     int PIOc_closefile(int ncid);
     int PIOc_inq_format(int ncid, int *formatp);
@@ -1097,6 +1383,28 @@ extern "C" {
     /* Set the IO node data buffer size limit. */
     PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit);
 
+    /* Set the target size of the chunks chosen by PIO. */
+    PIO_Offset PIOc_set_chunk_size_target(PIO_Offset target);
+
+    /* Write I/O performance reports when files are closed. */
+    int PIOc_set_perf_report(int iosysid, int format);
+
+    /* Set the directory of the rearranger plan cache. */
+    int PIOc_set_rearr_plan_cache(int iosysid, const char *dirname);
+
+    /* Turn the event tracer on or off. */
+    int PIOc_set_trace(int enable);
+
+    /* Turn the thread-safe mode of an IO system on or off. */
+    int PIOc_set_threadsafe(int iosysid, int threadsafe);
+
+    /* Start or stop the I/O thread of an IO system. */
+    int PIOc_set_io_thread(int iosysid, int enable);
+    int PIOc_set_stage_limit(int iosysid, PIO_Offset limit);
+
+    /* Split the IO tasks of the async I/O service per component. */
+    int PIOc_set_async_split(int split);
+
     /* Set the error hanlding for a file. */
     int PIOc_Set_File_Error_Handling(int ncid, int method);
 
@@ -1128,6 +1436,8 @@ extern "C" {
     int PIOc_set_fill(int ncid, int fillmode, int *old_modep);
     int PIOc_def_var_fill(int ncid, int varid, int no_fill, const void *fill_value);
     int PIOc_inq_var_fill(int ncid, int varid, int *no_fill, void *fill_valuep);
+    int PIOc_def_var_quantize(int ncid, int varid, int quantize_mode, int nsd);
+    int PIOc_inq_var_quantize(int ncid, int varid, int *quantize_modep, int *nsdp);
     int PIOc_rename_var(int ncid, int varid, const char *name);
 
     /* These variable settings only apply to netCDF-4 files. */
@@ -0,0 +1,365 @@
+/**
+ * @file
+ * Type conversion kernels used to convert user data to the type of
+ * the variable in the file on the compute tasks, and quantization
+ * kernels used to quantize float/double data on the IO tasks.
+ *
+ * The kernels for the common narrowing conversions (double to float
+ * and double to int) have AVX2/AVX-512 implementations that are used
+ * when the library is compiled with support for these instruction
+ * sets (e.g. -mavx2 or -march=native), the remaining elements and all
+ * other conversions use scalar loops.
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/** Bounds (exclusive) of doubles/floats that can be converted to an int. */
+#define PIO_CONVERT_INT_LBOUND (-2147483649.0)
+#define PIO_CONVERT_INT_UBOUND (2147483648.0)
+
+/** Number of bits needed per decimal digit, log2(10). */
+#define PIO_QUANTIZE_BITS_PER_DIGIT (3.32192809488736234787)
+
+/* Scalar loop converting from from_type to to_type. Elements equal to
+ * the from_fill are set to to_fill, elements for which
+ * OUT_OF_RANGE(x) is true are set to to_fill (and counted) if to_fill
+ * is provided, else to CLAMP(x). */
+#define PIO_CONVERT_LOOP(from_type, to_type, OUT_OF_RANGE, CLAMP)       \
+{                                                                       \
+    const from_type *f = (const from_type *)from;                      \
+    to_type *t = (to_type *)to;                                         \
+    for (; i < len; i++)                                                \
+    {                                                                   \
+        from_type x = f[i];                                             \
+        if (from_fill && to_fill && x == *(const from_type *)from_fill) \
+            t[i] = *(const to_type *)to_fill;                           \
+        else if (OUT_OF_RANGE(x))                                       \
+        {                                                               \
+            t[i] = to_fill ? *(const to_type *)to_fill : CLAMP(x);      \
+            nr++;                                                       \
+        }                                                               \
+        else                                                            \
+            t[i] = (to_type)x;                                          \
+    }                                                                   \
+}
+
+#define PIO_CONVERT_NEVER_OUT_OF_RANGE(x) (0)
+#define PIO_CONVERT_NO_CLAMP(x) (x)
+
+/* double/float to float. NaN is not out of range. */
+#define PIO_CONVERT_FLOAT_OUT_OF_RANGE(x) (to_fill && ((x) > FLT_MAX || (x) < -FLT_MAX))
+
+/* double/float to int. NaN is out of range. */
+#define PIO_CONVERT_INT_OUT_OF_RANGE(x) \
+    (!((x) > PIO_CONVERT_INT_LBOUND && (x) < PIO_CONVERT_INT_UBOUND))
+#define PIO_CONVERT_INT_CLAMP(x) \
+    (((x) != (x)) ? 0 : (((x) > 0) ? INT_MAX : INT_MIN))
+
+/**
+ * Count the bits set in a SIMD comparison mask.
+ *
+ * @param m the mask.
+ * @returns the number of bits set.
+ */
+static inline int mask_bits(unsigned int m)
+{
+    int n = 0;
+    for (; m; m &= m - 1)
+        n++;
+    return n;
+}
+
+/**
+ * Convert doubles to floats.
+ *
+ * @param from the doubles to convert.
+ * @param to the converted floats.
+ * @param len the number of elements.
+ * @param from_fill pointer to the fill value of from. May be NULL.
+ * @param to_fill pointer to the fill value of to. May be NULL.
+ * @returns the number of elements out of range.
+ */
+static PIO_Offset convert_double_to_float(const double *from, float *to, PIO_Offset len,
+                                          const void *from_fill, const void *to_fill)
+{
+    PIO_Offset i = 0;
+    PIO_Offset nr = 0;
+
+#if defined(__AVX512F__)
+    if (to_fill)
+    {
+        /* NaN never compares equal, so no element matches a missing
+         * from_fill. */
+        const __m512d vfrom_fill = _mm512_set1_pd(from_fill ? *(const double *)from_fill : NAN);
+        const __m512d vto_fill = _mm512_set1_pd((double)*(const float *)to_fill);
+        const __m512d vmax = _mm512_set1_pd(FLT_MAX);
+        for (; i + 8 <= len; i += 8)
+        {
+            __m512d v = _mm512_loadu_pd(from + i);
+            __mmask8 isfill = _mm512_cmp_pd_mask(v, vfrom_fill, _CMP_EQ_OQ);
+            __mmask8 isrange = _mm512_cmp_pd_mask(_mm512_abs_pd(v), vmax, _CMP_GT_OQ) & ~isfill;
+            nr += mask_bits(isrange);
+            v = _mm512_mask_blend_pd(isfill | isrange, v, vto_fill);
+            _mm256_storeu_ps(to + i, _mm512_cvtpd_ps(v));
+        }
+    }
+    else
+    {
+        for (; i + 8 <= len; i += 8)
+            _mm256_storeu_ps(to + i, _mm512_cvtpd_ps(_mm512_loadu_pd(from + i)));
+    }
+#elif defined(__AVX2__)
+    if (to_fill)
+    {
+        const __m256d vfrom_fill = _mm256_set1_pd(from_fill ? *(const double *)from_fill : NAN);
+        const __m256d vto_fill = _mm256_set1_pd((double)*(const float *)to_fill);
+        const __m256d vmax = _mm256_set1_pd(FLT_MAX);
+        const __m256d vabs = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+        for (; i + 4 <= len; i += 4)
+        {
+            __m256d v = _mm256_loadu_pd(from + i);
+            __m256d isfill = _mm256_cmp_pd(v, vfrom_fill, _CMP_EQ_OQ);
+            __m256d isrange = _mm256_andnot_pd(isfill,
+                                               _mm256_cmp_pd(_mm256_and_pd(v, vabs), vmax, _CMP_GT_OQ));
+            nr += mask_bits(_mm256_movemask_pd(isrange));
+            v = _mm256_blendv_pd(v, vto_fill, _mm256_or_pd(isfill, isrange));
+            _mm_storeu_ps(to + i, _mm256_cvtpd_ps(v));
+        }
+    }
+    else
+    {
+        for (; i + 4 <= len; i += 4)
+            _mm_storeu_ps(to + i, _mm256_cvtpd_ps(_mm256_loadu_pd(from + i)));
+    }
+#endif /* __AVX512F__ / __AVX2__ */
+
+    /* Remaining elements. */
+    PIO_CONVERT_LOOP(double, float, PIO_CONVERT_FLOAT_OUT_OF_RANGE, PIO_CONVERT_NO_CLAMP);
+
+    return nr;
+}
+
+/**
+ * Convert doubles to ints (truncating towards zero, like a C cast).
+ *
+ * @param from the doubles to convert.
+ * @param to the converted ints.
+ * @param len the number of elements.
+ * @param from_fill pointer to the fill value of from. May be NULL.
+ * @param to_fill pointer to the fill value of to. May be NULL.
+ * @returns the number of elements out of range.
+ */
+static PIO_Offset convert_double_to_int(const double *from, int *to, PIO_Offset len,
+                                        const void *from_fill, const void *to_fill)
+{
+    PIO_Offset i = 0;
+    PIO_Offset nr = 0;
+
+#if defined(__AVX2__)
+    /* Out of range elements are clamped by the scalar loop, so only
+     * use the vector loop when they are replaced by to_fill. */
+    if (to_fill)
+    {
+        const __m256d vfrom_fill = _mm256_set1_pd(from_fill ? *(const double *)from_fill : NAN);
+        const __m256d vto_fill = _mm256_set1_pd((double)*(const int *)to_fill);
+        const __m256d vlbound = _mm256_set1_pd(PIO_CONVERT_INT_LBOUND);
+        const __m256d vubound = _mm256_set1_pd(PIO_CONVERT_INT_UBOUND);
+        for (; i + 4 <= len; i += 4)
+        {
+            __m256d v = _mm256_loadu_pd(from + i);
+            __m256d isfill = _mm256_cmp_pd(v, vfrom_fill, _CMP_EQ_OQ);
+            __m256d inrange = _mm256_and_pd(_mm256_cmp_pd(v, vlbound, _CMP_GT_OQ),
+                                            _mm256_cmp_pd(v, vubound, _CMP_LT_OQ));
+            __m256d isrange = _mm256_andnot_pd(_mm256_or_pd(isfill, inrange),
+                                               _mm256_castsi256_pd(_mm256_set1_epi64x(-1)));
+            nr += mask_bits(_mm256_movemask_pd(isrange));
+            v = _mm256_blendv_pd(v, vto_fill, _mm256_or_pd(isfill, isrange));
+            _mm_storeu_si128((__m128i *)(to + i), _mm256_cvttpd_epi32(v));
+        }
+    }
+#endif /* __AVX2__ */
+
+    /* Remaining elements. */
+    PIO_CONVERT_LOOP(double, int, PIO_CONVERT_INT_OUT_OF_RANGE, PIO_CONVERT_INT_CLAMP);
+
+    return nr;
+}
+
+/**
+ * Returns true if pio_convert_buffer() can convert data of type
+ * from_type to to_type and the converted data is smaller than the
+ * original data. These are the conversions that are worth doing on
+ * the compute tasks, before the data is rearranged.
+ *
+ * @param from_type the PIO type of the data.
+ * @param to_type the PIO type to convert the data to.
+ * @returns true if the conversion is supported and narrows the data.
+ */
+bool pio_convert_narrows(int from_type, int to_type)
+{
+    return (from_type == PIO_DOUBLE && (to_type == PIO_FLOAT || to_type == PIO_INT));
+}
+
+/**
+ * Convert an array of data from one PIO type to another. Conversions
+ * between PIO_DOUBLE, PIO_FLOAT and PIO_INT are supported.
+ *
+ * If to_fill is provided, elements equal to from_fill (if provided)
+ * are set to to_fill, and elements that cannot be represented in
+ * to_type are set to to_fill and counted as out of range. If to_fill
+ * is not provided, the elements are converted like a C cast, except
+ * that conversions to PIO_INT are clamped to the range of an int (NaN
+ * is converted to 0).
+ *
+ * @param from_type the PIO type of the data.
+ * @param from pointer to the data to convert.
+ * @param to_type the PIO type to convert the data to.
+ * @param to pointer to storage for len elements of to_type.
+ * @param len the number of elements to convert.
+ * @param from_fill pointer to a from_type fill value. May be NULL.
+ * @param to_fill pointer to a to_type fill value. May be NULL.
+ * @param nerangep pointer that gets the number of elements out of
+ * range. May be NULL.
+ * @returns 0 for success, PIO_EBADTYPE if the conversion is not
+ * supported.
+ */
+int pio_convert_buffer(int from_type, const void *from, int to_type, void *to,
+                       PIO_Offset len, const void *from_fill, const void *to_fill,
+                       PIO_Offset *nerangep)
+{
+    PIO_Offset i = 0;
+    PIO_Offset nr = 0;
+
+    pioassert(len == 0 || (from && to), "invalid input", __FILE__, __LINE__);
+
+    if (from_type == PIO_DOUBLE && to_type == PIO_FLOAT)
+        nr = convert_double_to_float(from, to, len, from_fill, to_fill);
+    else if (from_type == PIO_DOUBLE && to_type == PIO_INT)
+        nr = convert_double_to_int(from, to, len, from_fill, to_fill);
+    else if (from_type == PIO_FLOAT && to_type == PIO_INT)
+        PIO_CONVERT_LOOP(float, int, PIO_CONVERT_INT_OUT_OF_RANGE, PIO_CONVERT_INT_CLAMP)
+    else if (from_type == PIO_FLOAT && to_type == PIO_DOUBLE)
+        PIO_CONVERT_LOOP(float, double, PIO_CONVERT_NEVER_OUT_OF_RANGE, PIO_CONVERT_NO_CLAMP)
+    else if (from_type == PIO_INT && to_type == PIO_DOUBLE)
+        PIO_CONVERT_LOOP(int, double, PIO_CONVERT_NEVER_OUT_OF_RANGE, PIO_CONVERT_NO_CLAMP)
+    else if (from_type == PIO_INT && to_type == PIO_FLOAT)
+        PIO_CONVERT_LOOP(int, float, PIO_CONVERT_NEVER_OUT_OF_RANGE, PIO_CONVERT_NO_CLAMP)
+    else
+        return PIO_EBADTYPE;
+
+    LOG((3, "pio_convert_buffer from_type = %d to_type = %d len = %lld nerange = %lld",
+         from_type, to_type, (long long)len, (long long)nr));
+
+    if (nerangep)
+        *nerangep = nr;
+
+    return PIO_NOERR;
+}
+
+/* Quantize the len elements of type btype in buf as values of type
+ * ftype, using the unsigned integer type utype of the same size as
+ * ftype to access the bits. The nzro trailing bits of the
+ * significand are shaved (set to 0) or set (set to 1) by BitGroom,
+ * alternating between elements, or rounded to nearest by BitRound.
+ * Elements equal to *fill (of type btype), zeros (BitGroom set), NaNs
+ * and infinities are not changed. */
+#define PIO_QUANTIZE_LOOP(btype, ftype, utype)                          \
+{                                                                       \
+    btype *b = (btype *)buf;                                            \
+    const utype msk_zro = ~(utype)0 << nzro;                            \
+    const utype msk_one = ~msk_zro;                                     \
+    const utype msk_hshv = msk_one & (msk_zro >> 1);                    \
+    for (PIO_Offset i = 0; i < len; i++)                                \
+    {                                                                   \
+        ftype x = (ftype)b[i];                                          \
+        utype u;                                                        \
+        if ((fill && b[i] == *(const btype *)fill) || !isfinite(x))     \
+            continue;                                                   \
+        memcpy(&u, &x, sizeof(u));                                      \
+        if (quantize_mode == PIO_QUANTIZE_BITROUND)                     \
+            u = (u + msk_hshv) & msk_zro;                               \
+        else if (i % 2 == 0)                                            \
+            u &= msk_zro;                                               \
+        else if (x != 0)                                                \
+            u |= msk_one;                                               \
+        memcpy(&x, &u, sizeof(u));                                      \
+        b[i] = (btype)x;                                                \
+    }                                                                   \
+}
+
+/**
+ * Quantize an array of PIO_FLOAT or PIO_DOUBLE data in place (see
+ * PIOc_def_var_quantize()). The algorithms, and the number of bits
+ * kept for a given number of significant digits, are the same as the
+ * ones used by netCDF-C (nc_def_var_quantize()).
+ *
+ * The data is quantized as values of the narrower of its type and
+ * the type of the variable it is written to. PIO_DOUBLE data written
+ * to a PIO_FLOAT variable is rounded to float first, as it would be
+ * when written, so the bits set by BitGroom survive the conversion.
+ *
+ * @param pio_type the PIO type of the data.
+ * @param var_type the PIO type of the variable, PIO_FLOAT or
+ * PIO_DOUBLE.
+ * @param buf pointer to the data.
+ * @param len the number of elements in buf.
+ * @param quantize_mode PIO_QUANTIZE_BITGROOM or
+ * PIO_QUANTIZE_BITROUND. The data is not changed for
+ * PIO_NOQUANTIZE.
+ * @param nsd the number of significant decimal digits
+ * (PIO_QUANTIZE_BITGROOM) or bits (PIO_QUANTIZE_BITROUND) to keep.
+ * @param fill pointer to a pio_type fill value. Elements equal to the
+ * fill value are not quantized. May be NULL.
+ * @returns 0 for success, PIO_EBADTYPE if a type is not supported,
+ * PIO_EINVAL if the quantize mode is not supported.
+ */
+int pio_quantize_buffer(int pio_type, int var_type, void *buf, PIO_Offset len,
+                        int quantize_mode, int nsd, const void *fill)
+{
+    int qtype;      /* The type the data is quantized as. */
+    int mant_bits;  /* Number of explicit bits in the significand. */
+    int nkeep;      /* Number of bits of the significand to keep. */
+    int nzro;       /* Number of bits of the significand to quantize. */
+
+    pioassert(len == 0 || buf, "invalid input", __FILE__, __LINE__);
+
+    if ((pio_type != PIO_FLOAT && pio_type != PIO_DOUBLE) ||
+        (var_type != PIO_FLOAT && var_type != PIO_DOUBLE))
+        return PIO_EBADTYPE;
+
+    qtype = (pio_type == PIO_FLOAT || var_type == PIO_FLOAT) ? PIO_FLOAT : PIO_DOUBLE;
+    mant_bits = (qtype == PIO_FLOAT) ? FLT_MANT_DIG - 1 : DBL_MANT_DIG - 1;
+
+    if (quantize_mode == PIO_NOQUANTIZE)
+        return PIO_NOERR;
+    else if (quantize_mode == PIO_QUANTIZE_BITGROOM)
+        /* log2(10) bits per decimal digit, plus a guard bit. */
+        nkeep = (int)ceil(nsd * PIO_QUANTIZE_BITS_PER_DIGIT) + 1;
+    else if (quantize_mode == PIO_QUANTIZE_BITROUND)
+        nkeep = nsd;
+    else
+        return PIO_EINVAL;
+
+    nzro = mant_bits - nkeep;
+    LOG((3, "pio_quantize_buffer pio_type = %d var_type = %d len = %lld quantize_mode = %d nsd = %d nzro = %d",
+         pio_type, var_type, (long long)len, quantize_mode, nsd, nzro));
+    if (nzro <= 0)
+        return PIO_NOERR;
+
+    if (pio_type == PIO_FLOAT)
+        PIO_QUANTIZE_LOOP(float, float, uint32_t)
+    else if (qtype == PIO_FLOAT)
+        PIO_QUANTIZE_LOOP(double, float, uint32_t)
+    else
+        PIO_QUANTIZE_LOOP(double, double, uint64_t)
+
+    return PIO_NOERR;
+}
@@ -53,33 +53,151 @@ PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit)
 }
 
 /**
- * Write one or more arrays with the same IO decomposition to the
- * file.
+ * Set the budget of the data staged on the IO tasks of an IO system
+ * for PnetCDF writes.
  *
- * This funciton is similar to PIOc_write_darray(), but allows the
- * caller to use their own data buffering (instead of using the
- * buffering implemented in PIOc_write_darray()).
+ * The data of each write of variables with a decomposition is
+ * rearranged into a data buffer of the file on the IO tasks, and
+ * kept there until the PnetCDF requests writing it complete. When
+ * the buffer of the decomposition is still in use, the writes stage
+ * it and use a new buffer, so that the IO tasks (and, with async,
+ * the compute tasks waiting on them) do not wait for the previous
+ * requests. Once the data of the staged buffers of the IO system
+ * would exceed the budget on any IO task, the pending requests of the
+ * file are flushed before the write.
  *
- * When the user calls PIOc_write_darray() one or more times, then
- * PIO_write_darray_multi() will be called when the buffer is flushed.
+ * @param iosysid the IO system ID.
+ * @param limit the budget in bytes per IO task, 0 to use the buffer
+ * size limit (see PIOc_set_buffer_size_limit()).
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_set_stage_limit(int iosysid, PIO_Offset limit)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    int ierr = PIO_NOERR;  /* Return code. */
+
+    LOG((1, "PIOc_set_stage_limit iosysid = %d limit = %lld", iosysid, (long long)limit));
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the budget of the staged data buffers failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    if (limit < 0)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Setting the budget of the staged data buffers failed. Invalid budget (%lld bytes) provided for iosystem (iosysid=%d)", (long long)limit, iosysid);
+    }
+
+    /* If using async, and not an IO task, then send parameters. */
+    if (ios->async)
+    {
+        int msg = PIO_MSG_SET_STAGE_LIMIT;
+
+        PIO_SEND_ASYNC_MSG(ios, msg, &ierr, iosysid, limit);
+        if(ierr != PIO_NOERR)
+        {
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Setting the budget of the staged data buffers failed. Error sending async msg PIO_MSG_SET_STAGE_LIMIT (iosysid=%d)", iosysid);
+        }
+    }
+
+    ios->stage_limit = limit;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Add a data buffer, still in use by pending PnetCDF requests, to the
+ * buffers of a file that are released by the next flush of the file.
  *
- * Internally, this function will:
- * <ul>
- * <li>Find info about file, decomposition, and variable.
- * <li>Do a special flush for pnetcdf if needed.
- * <li>Allocates a buffer big enough to hold all the data in the
- * multi-buffer, for all tasks.
- * <li>Calls rearrange_comp2io() to move data from compute to IO
- * tasks.
- * <li>For parallel iotypes (pnetcdf and netCDF-4 parallel) call
- * pio_write_darray_multi_nc().
- * <li>For serial iotypes (netcdf classic and netCDF-4 serial) call
- * write_darray_multi_serial().
- * <li>For subset rearranger, create holegrid to write missing
- * data. Then call pio_write_darray_multi_nc() or
- * write_darray_multi_serial() to write the holegrid.
- * <li>Special buffer flush for pnetcdf.
- * </ul>
+ * @param file pointer to the file descriptor.
+ * @param buf the buffer.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+static int stage_buffer(file_desc_t *file, void *buf)
+{
+    if (file->num_staged_iobufs == file->staged_iobufs_sz)
+    {
+        int sz = file->staged_iobufs_sz + PIO_IODESC_MAX_IDS;
+        void **bufs;
+
+        if (!(bufs = realloc(file->staged_iobufs, sz * sizeof(void *))))
+        {
+            return pio_err(file->iosystem, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Staging a data buffer of file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for the list of staged buffers", pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long)(sz * sizeof(void *)));
+        }
+        file->staged_iobufs = bufs;
+        file->staged_iobufs_sz = sz;
+    }
+    file->staged_iobufs[file->num_staged_iobufs++] = buf;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Make room for the data buffer of a decomposition of a file that is
+ * still in use by pending PnetCDF requests. The buffer is staged
+ * until the next flush of the file if the data held by the staged
+ * buffers of the IO system stays within its budget on all the IO
+ * tasks (see PIOc_set_stage_limit()), otherwise the pending requests
+ * of the file are flushed. Collective on the IO tasks.
+ *
+ * @param file pointer to the file descriptor.
+ * @param ioid the ID of the decomposition.
+ * @param bufsize the size, in bytes, of the new buffer.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+static int stage_iobuf(file_desc_t *file, int ioid, PIO_Offset bufsize)
+{
+    iosystem_desc_t *ios = file->iosystem;
+    PIO_Offset limit = (ios->stage_limit > 0) ? ios->stage_limit : pio_buffer_size_limit;
+    PIO_Offset need;
+    int mpierr = MPI_SUCCESS;
+    int ierr = PIO_NOERR;
+
+    /* In the thread-safe mode the files of the IO system may be
+     * flushed by other threads. */
+    PIO_LOCK();
+    need = ios->staged_bytes + bufsize;
+    PIO_UNLOCK();
+
+    /* The IO tasks have to agree on staging the buffer, since the
+     * flush is collective. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &need, 1, MPI_OFFSET, MPI_MAX, ios->io_comm)))
+        return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+
+    if (need <= limit)
+    {
+        LOG((2, "staging the data buffer of ioid %d, %lld bytes staged", ioid, (long long)need));
+        if ((ierr = stage_buffer(file, file->iobuf[ioid - PIO_IODESC_START_ID])))
+            return ierr;
+        file->iobuf[ioid - PIO_IODESC_START_ID] = NULL;
+        return PIO_NOERR;
+    }
+
+    /* The budget is exhausted, wait for the pending requests. */
+    LOG((2, "staging budget exhausted (%lld > %lld bytes), flushing", (long long)need, (long long)limit));
+    if ((ierr = flush_output_buffer(file, true, 0)))
+        return ierr;
+
+    /* The buffers are released by the I/O thread, if there is one. */
+    pio_io_thread_wait(file);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write one or more arrays with the same IO decomposition to the
+ * file. This is the implementation of PIOc_write_darray_multi(), it
+ * also allows the data to be passed as an array of pointers to
+ * separate user arrays (used when flushing a multi-buffer that did
+ * not copy the user data, see PIOc_set_darray_nocopy()).
  *
  * @param ncid identifies the netCDF file.
  * @param varids an array of length nvars containing the variable ids to
@@ -88,14 +206,11 @@ PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit)
  * PIOc_InitDecomp().
  * @param nvars the number of variables to be written with this
  * call.
- * @param arraylen the length of the array to be written. This is the
- * length of the distrubited array. That is, the length of the portion
- * of the data that is on the processor. The same arraylen is used for
- * all variables in the call.
- * @param array pointer to the data to be written. This is a pointer
- * to an array of arrays with the distributed portion of the array
- * that is on this processor. There are nvars arrays of data, and each
- * array of data contains one record worth of data for that variable.
+ * @param arraylen the length of the array to be written.
+ * @param array pointer to the contiguous data (nvars arrays) to be
+ * written. Ignored if arrays is not NULL.
+ * @param arrays an array of nvars pointers to the data for each
+ * variable. NULL if the data is in array.
  * @param frame an array of length nvars with the frame or record
  * dimension for each of the nvars variables in IOBUF. NULL if this
  * iodesc contains non-record vars.
@@ -104,11 +219,10 @@ PIO_Offset PIOc_set_buffer_size_limit(PIO_Offset limit)
  * @param flushtodisk non-zero to cause buffers to be flushed to disk.
  * @return 0 for success, error code otherwise.
  * @ingroup PIO_write_darray
- * @author Jim Edwards, Ed Hartnett
  */
-int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
-                            PIO_Offset arraylen, void *array, const int *frame,
-                            void **fillvalue, bool flushtodisk)
+int write_darray_multi_int(int ncid, const int *varids, int ioid, int nvars,
+                           PIO_Offset arraylen, void *array, void **arrays,
+                           const int *frame, void **fillvalue, bool flushtodisk)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     file_desc_t *file;     /* Pointer to file information. */
@@ -116,6 +230,7 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     size_t rlen;           /* Total data buffer size. */
     var_desc_t *vdesc0;    /* Array of var_desc structure for each var. */
     int fndims = 0;        /* Number of dims in the var in the file. */
+    double perf_rearr_time, perf_io_time; /* Times for the perf stats. */
     int mpierr = MPI_SUCCESS;  /* Return code from MPI function calls. */
     int ierr = PIO_NOERR;              /* Return code. */
 
@@ -222,27 +337,28 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         LOG((3, "shared fndims = %d", fndims));
     }
 
-    /* if the buffer is already in use in pnetcdf we need to flush first */
+    /* Determine total size of aggregated data (all vars/records).
+     * For netcdf serial writes we collect the data on io nodes and
+     * then move that data one node at a time to the io master node
+     * and write (or read). The buffer size on io task 0 must be as
+     * large as the largest used to accommodate this serial io
+     * method.  */
+    rlen = iodesc->maxiobuflen * nvars;
+
+    /* if the buffer is already in use in pnetcdf, stage it, or flush
+     * first if the staging budget is exhausted */
     if (file->iotype == PIO_IOTYPE_PNETCDF && file->iobuf[ioid - PIO_IODESC_START_ID])
     {
-        ierr = flush_output_buffer(file, true, 0);
+        ierr = stage_iobuf(file, ioid, iodesc->mpitype_size * rlen);
         if (ierr != PIO_NOERR)
         {
             return pio_err(ios, file, ierr, __FILE__, __LINE__,
-                            "Writing multiple variables to file (%s, ncid=%d) failed. Flushing data to disk (PIO_IOTYPE_PNETCDF) failed", pio_get_fname_from_file(file), ncid);
+                            "Writing multiple variables to file (%s, ncid=%d) failed. Staging the data buffer or flushing data to disk (PIO_IOTYPE_PNETCDF) failed", pio_get_fname_from_file(file), ncid);
         }
     }
 
     pioassert(!file->iobuf[ioid - PIO_IODESC_START_ID], "buffer overwrite",__FILE__, __LINE__);
 
-    /* Determine total size of aggregated data (all vars/records).
-     * For netcdf serial writes we collect the data on io nodes and
-     * then move that data one node at a time to the io master node
-     * and write (or read). The buffer size on io task 0 must be as
-     * large as the largest used to accommodate this serial io
-     * method.  */
-    rlen = iodesc->maxiobuflen * nvars;
-
 #ifdef PIO_MICRO_TIMING
     bool var_mtimer_was_running[nvars];
     /* Use the timer on the first variable to capture the total
@@ -283,6 +399,15 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         }
         LOG((3, "allocated %lld bytes for variable buffer", rlen * iodesc->mpitype_size));
 
+        /* The buffer is held until the next flush of the file. */
+        if (file->iotype == PIO_IOTYPE_PNETCDF)
+        {
+            file->staged_bytes += iodesc->mpitype_size * rlen;
+            PIO_LOCK();
+            ios->staged_bytes += iodesc->mpitype_size * rlen;
+            PIO_UNLOCK();
+        }
+
         /* If fill values are desired, and we're using the BOX
          * rearranger, insert fill values. */
         if (iodesc->needsfill && iodesc->rearranger == PIO_REARR_BOX)
@@ -293,6 +418,17 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
                     memcpy(&((char *)file->iobuf[ioid - PIO_IODESC_START_ID])[iodesc->mpitype_size * (i + nv * iodesc->maxiobuflen)],
                            &((char *)fillvalue)[nv * iodesc->mpitype_size], iodesc->mpitype_size);
         }
+
+        /* The SUBSET rearranger only needs fill values at the holes
+         * merged into the data regions. */
+        if (iodesc->needsfill && iodesc->mergedholes > 0)
+        {
+            LOG((3, "inserting fill values iodesc->mergedholes = %d", iodesc->mergedholes));
+            for (int nv = 0; nv < nvars; nv++)
+                for (int i = 0; i < iodesc->mergedholes; i++)
+                    memcpy(&((char *)file->iobuf[ioid - PIO_IODESC_START_ID])[iodesc->mpitype_size * (iodesc->holeindex[i] + nv * iodesc->llen)],
+                           &((char *)fillvalue)[nv * iodesc->mpitype_size], iodesc->mpitype_size);
+        }
     }
     else if (file->iotype == PIO_IOTYPE_PNETCDF && ios->ioproc)
     {
@@ -308,11 +444,17 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     }
 
     /* Move data from compute to IO tasks. */
-    if ((ierr = rearrange_comp2io(ios, iodesc, array, file->iobuf[ioid - PIO_IODESC_START_ID], nvars)))
+    perf_rearr_time = MPI_Wtime();
+    if (arrays)
+        ierr = rearrange_comp2io_nocopy(ios, iodesc, arrays, file->iobuf[ioid - PIO_IODESC_START_ID], nvars);
+    else
+        ierr = rearrange_comp2io(ios, iodesc, array, file->iobuf[ioid - PIO_IODESC_START_ID], nvars);
+    if (ierr)
     {
         return pio_err(ios, file, ierr, __FILE__, __LINE__,
                         "Writing multiple variables to file (%s, ncid=%d) failed. Error rearranging and moving data from compute tasks to I/O tasks", pio_get_fname_from_file(file), ncid);
     }
+    perf_rearr_time = MPI_Wtime() - perf_rearr_time;
 
 #ifdef PIO_MICRO_TIMING
     double rearr_time = 0;
@@ -388,8 +530,55 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
         }
     }
 #endif
+
+    /* Quantize the rearranged data of the variables that have a
+     * quantize mode set (see PIOc_def_var_quantize()). This is done
+     * in parallel on the IO tasks, before the data is written. */
+    if (ios->ioproc && iodesc->llen > 0)
+    {
+#ifdef TIMING
+        GPTLstart("PIO:write_darray_quantize");
+#endif
+        for (int nv = 0; nv < nvars; nv++)
+        {
+            var_desc_t *qvdesc = &file->varlist[varids[nv]];
+            void *qfill = NULL;
+
+            if (qvdesc->quantize_mode == PIO_NOQUANTIZE)
+                continue;
+
+            /* Integer data written to a float or double variable is
+             * not quantized. */
+            if (iodesc->piotype != PIO_FLOAT && iodesc->piotype != PIO_DOUBLE)
+            {
+                LOG((2, "not quantizing data of type %d of variable %d", iodesc->piotype,
+                     varids[nv]));
+                continue;
+            }
+
+            /* Values equal to the fill value are not quantized. Use the
+             * fill value of the variable if none was provided. */
+            if (fillvalue)
+                qfill = (char *)fillvalue + nv * iodesc->mpitype_size;
+            else if (qvdesc->fillvalue && qvdesc->pio_type == iodesc->piotype)
+                qfill = qvdesc->fillvalue;
+
+            if ((ierr = pio_quantize_buffer(iodesc->piotype, qvdesc->pio_type,
+                                            (char *)file->iobuf[ioid - PIO_IODESC_START_ID] + iodesc->mpitype_size * nv * iodesc->llen,
+                                            iodesc->llen, qvdesc->quantize_mode, qvdesc->nsd, qfill)))
+            {
+                return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                "Writing multiple variables to file (%s, ncid=%d) failed. Quantizing data of variable %s (varid=%d) failed", pio_get_fname_from_file(file), ncid, pio_get_vname_from_file(file, varids[nv]), varids[nv]);
+            }
+        }
+#ifdef TIMING
+        GPTLstop("PIO:write_darray_quantize");
+#endif
+    }
+
     /* Write the darray based on the iotype. */
     LOG((2, "about to write darray for iotype = %d", file->iotype));
+    perf_io_time = MPI_Wtime();
     switch (file->iotype)
     {
     case PIO_IOTYPE_NETCDF4P:
@@ -433,12 +622,26 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
      * missing value a 'holegrid' is used to describe the missing
      * points. This is generally faster than the netcdf method of
      * filling the entire array with missing values before overwriting
-     * those values later. */
-    if (iodesc->rearranger == PIO_REARR_SUBSET && iodesc->needsfill)
+     * those values later. Holes merged into the data regions were
+     * written with the data, if all of them were there are no fill
+     * regions left (maxfillregions is 0 on all IO tasks). */
+    if (iodesc->rearranger == PIO_REARR_SUBSET && iodesc->needsfill &&
+        (!ios->ioproc || iodesc->maxfillregions > 0))
     {
         LOG((2, "nvars = %d holegridsize = %ld iodesc->needsfill = %d\n", nvars,
              iodesc->holegridsize, iodesc->needsfill));
 
+        /* The fill buffer of a previous write of the first variable
+         * may still be in use by pending PnetCDF requests, it is
+         * released with the data buffers staged until the next flush
+         * (it is small, and not counted against the staging budget). */
+        if (file->iotype == PIO_IOTYPE_PNETCDF && vdesc0->fillbuf)
+        {
+            if ((ierr = stage_buffer(file, vdesc0->fillbuf)))
+                return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                            "Writing multiple variables to file (%s, ncid=%d) failed. Staging the fill value buffer of a previous write failed", pio_get_fname_from_file(file), ncid);
+            vdesc0->fillbuf = NULL;
+        }
 	pioassert(!vdesc0->fillbuf, "buffer overwrite",__FILE__, __LINE__);
 
         /* Get a buffer. */
@@ -488,6 +691,20 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
             }
         }
     }
+    perf_io_time = MPI_Wtime() - perf_io_time;
+
+    /* Update the I/O performance statistics of the variables, the
+     * times are divided evenly between the variables written. */
+    for (int nv = 0; nv < nvars; nv++)
+    {
+        pio_perf_stats_t *perf = &file->varlist[varids[nv]].perf;
+
+        perf->nwrites++;
+        perf->wr_rearr_time += perf_rearr_time / nvars;
+        perf->wr_io_time += perf_io_time / nvars;
+        if (ios->ioproc)
+            perf->wr_bytes += iodesc->llen * iodesc->mpitype_size;
+    }
 
     /* Only PNETCDF does non-blocking buffered writes, and hence
      * needs an explicit flush/wait to make sure data is written
@@ -522,6 +739,113 @@ int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
     return PIO_NOERR;
 }
 
+/**
+ * Write one or more arrays with the same IO decomposition to the
+ * file.
+ *
+ * This funciton is similar to PIOc_write_darray(), but allows the
+ * caller to use their own data buffering (instead of using the
+ * buffering implemented in PIOc_write_darray()).
+ *
+ * When the user calls PIOc_write_darray() one or more times, then
+ * PIO_write_darray_multi() will be called when the buffer is flushed.
+ *
+ * Internally, this function will:
+ * <ul>
+ * <li>Find info about file, decomposition, and variable.
+ * <li>Do a special flush for pnetcdf if needed.
+ * <li>Allocates a buffer big enough to hold all the data in the
+ * multi-buffer, for all tasks.
+ * <li>Calls rearrange_comp2io() to move data from compute to IO
+ * tasks.
+ * <li>For parallel iotypes (pnetcdf and netCDF-4 parallel) call
+ * pio_write_darray_multi_nc().
+ * <li>For serial iotypes (netcdf classic and netCDF-4 serial) call
+ * write_darray_multi_serial().
+ * <li>For subset rearranger, create holegrid to write missing
+ * data. Then call pio_write_darray_multi_nc() or
+ * write_darray_multi_serial() to write the holegrid.
+ * <li>Special buffer flush for pnetcdf.
+ * </ul>
+ *
+ * @param ncid identifies the netCDF file.
+ * @param varids an array of length nvars containing the variable ids to
+ * be written.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param nvars the number of variables to be written with this
+ * call.
+ * @param arraylen the length of the array to be written. This is the
+ * length of the distrubited array. That is, the length of the portion
+ * of the data that is on the processor. The same arraylen is used for
+ * all variables in the call.
+ * @param array pointer to the data to be written. This is a pointer
+ * to an array of arrays with the distributed portion of the array
+ * that is on this processor. There are nvars arrays of data, and each
+ * array of data contains one record worth of data for that variable.
+ * @param frame an array of length nvars with the frame or record
+ * dimension for each of the nvars variables in IOBUF. NULL if this
+ * iodesc contains non-record vars.
+ * @param fillvalue pointer an array (of length nvars) of pointers to
+ * the fill value to be used for missing data.
+ * @param flushtodisk non-zero to cause buffers to be flushed to disk.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ * @author Jim Edwards, Ed Hartnett
+ */
+int PIOc_write_darray_multi(int ncid, const int *varids, int ioid, int nvars,
+                            PIO_Offset arraylen, void *array, const int *frame,
+                            void **fillvalue, bool flushtodisk)
+{
+    return write_darray_multi_int(ncid, varids, ioid, nvars, arraylen, array, NULL,
+                                  frame, fillvalue, flushtodisk);
+}
+
+/**
+ * Set whether PIOc_write_darray() copies the user data for a file.
+ *
+ * By default PIOc_write_darray() copies the user data into an
+ * internal multi-buffer, so the user array can be reused as soon as
+ * the call returns. When the copy is disabled only a pointer to the
+ * user array is cached, and the data is sent directly from the user
+ * arrays to the IO tasks when the multi-buffer is flushed. This
+ * avoids a copy (and the cache memory) on the compute tasks, but the
+ * caller must not modify or free the arrays passed to
+ * PIOc_write_darray() until the data has been flushed, i.e. until
+ * the next call to PIOc_sync() or PIOc_closefile() on this file.
+ * Data cached by PIOc_write_darray() can also be flushed by later
+ * calls to PIOc_write_darray() (when the cache limit set with
+ * PIOc_set_buffer_size_limit() is reached).
+ *
+ * The setting is ignored (user data is always copied) if the IO
+ * system uses asynchronous IO or for ADIOS files. This function
+ * must be called on all compute tasks.
+ *
+ * @param ncid the ncid of the open file.
+ * @param nocopy non-zero to cache pointers to the user arrays instead
+ * of copying the user data, zero to copy the user data (default).
+ * @returns 0 on success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_set_darray_nocopy(int ncid, int nocopy)
+{
+    file_desc_t *file;
+    int ierr;
+
+    LOG((1, "PIOc_set_darray_nocopy ncid = %d nocopy = %d", ncid, nocopy));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the no copy mode for writing distributed arrays failed. Invalid file id (ncid=%d) provided", ncid);
+    }
+
+    file->darray_nocopy = (nocopy && !file->iosystem->async) ? 1 : 0;
+
+    return PIO_NOERR;
+}
+
 /**
  * Find the fillvalue that should be used for a variable.
  *
@@ -579,34 +903,211 @@ int find_var_fillvalue(file_desc_t *file, int varid, var_desc_t *vdesc)
     return PIO_NOERR;
 }
 
-/* Check if the write multi buffer requires a flush
- * wmb : A write multi buffer that might already contain data
- * arraylen : The length of the new array that needs to be cached in this wmb
- *            (The array is not cached yet)
- * iodesc : io descriptor for the data cached in the write multi buffer
- * A disk flush implies that data needs to be rearranged and write needs to be
- * completed. Rearranging and writing data frees up cache is compute and I/O
- * processes
- * An I/O flush implies that data needs to be rearranged and write needs to be
- * started (for iotypes other than PnetCDF write also completes). This would
- * free up cache in compute processes (I/O processes still need to cache the
- * rearranged data until the write completes)
- * Returns 2 if a disk flush is required, 1 if an I/O flush is required, 0 otherwise
- */
-static int PIO_wmb_needs_flush(wmulti_buffer *wmb, int arraylen, io_desc_t *iodesc)
+/** A data array cached in a write multi buffer, sorted by
+ * pio_order_wmb_list(). */
+typedef struct wmb_entry_t
 {
-    bufsize curalloc, totfree, maxfree;
-    long nget, nrel;
-    const int NEEDS_DISK_FLUSH=2, NEEDS_IO_FLUSH=1, NO_FLUSH=0;
+    /** The variable ID. */
+    int vid;
 
-    assert(wmb && iodesc);
-    /* Find out how much free, contiguous space is available. */
-    bstats(&curalloc, &totfree, &maxfree, &nget, &nrel);
+    /** The frame (record number), -1 if none. */
+    int frame;
 
-    LOG((2, "maxfree = %ld wmb->num_arrays = %d (1 + wmb->num_arrays) *"
-         " arraylen * iodesc->mpitype_size = %ld totfree = %ld\n",
-          maxfree, wmb->num_arrays,
-         (1 + wmb->num_arrays) * arraylen * iodesc->mpitype_size, totfree));
+    /** Index of the array in the multi buffer. */
+    int idx;
+} wmb_entry_t;
+
+/* Compare two cached arrays by variable ID and frame, passed to
+ * qsort. */
+static int compare_wmb_entries(const void *a, const void *b)
+{
+    const wmb_entry_t *x = (const wmb_entry_t *)a;
+    const wmb_entry_t *y = (const wmb_entry_t *)b;
+
+    if (x->vid != y->vid)
+        return (x->vid < y->vid) ? -1 : 1;
+    if (x->frame != y->frame)
+        return (x->frame < y->frame) ? -1 : 1;
+    return (x->idx < y->idx) ? -1 : ((x->idx > y->idx) ? 1 : 0);
+}
+
+/* Compare two write multi buffers by decomposition and record var
+ * flag, passed to qsort. */
+static int compare_wmbs(const void *a, const void *b)
+{
+    const wmulti_buffer *x = *(wmulti_buffer * const *)a;
+    const wmulti_buffer *y = *(wmulti_buffer * const *)b;
+
+    if (x->ioid != y->ioid)
+        return (x->ioid < y->ioid) ? -1 : 1;
+    return (x->recordvar < y->recordvar) ? -1 : ((x->recordvar > y->recordvar) ? 1 : 0);
+}
+
+/**
+ * Sort the write multi buffers of a file by decomposition, and the
+ * arrays cached in each buffer by variable ID and frame. In the
+ * thread-safe mode (see PIOc_set_threadsafe()) the threads of a task
+ * cache the arrays in any order, and the arrays must be in the same
+ * order on all tasks before they are flushed. The fill values of the
+ * variables cached that are not known yet are also found, so this
+ * function is collective.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+int pio_order_wmb_list(file_desc_t *file)
+{
+    iosystem_desc_t *ios;
+    wmulti_buffer **wmbs;
+    int nwmb = 0;
+    int ierr;
+
+    assert(file && file->iosystem);
+    ios = file->iosystem;
+
+    for (wmulti_buffer *wmb = file->buffer.next; wmb; wmb = wmb->next)
+        nwmb++;
+    if (!nwmb)
+        return PIO_NOERR;
+
+    /* Sort the list of buffers, file->buffer is the head of the list. */
+    if (!(wmbs = malloc(nwmb * sizeof(wmulti_buffer *))))
+    {
+        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Sorting the data cached for file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for the list of write multi buffers", pio_get_fname_from_file(file), file->pio_ncid, (long long int)(nwmb * sizeof(wmulti_buffer *)));
+    }
+    nwmb = 0;
+    for (wmulti_buffer *wmb = file->buffer.next; wmb; wmb = wmb->next)
+        wmbs[nwmb++] = wmb;
+    qsort(wmbs, nwmb, sizeof(wmulti_buffer *), compare_wmbs);
+    file->buffer.next = wmbs[0];
+    for (int i = 0; i < nwmb; i++)
+        wmbs[i]->next = (i + 1 < nwmb) ? wmbs[i + 1] : NULL;
+    free(wmbs);
+
+    for (wmulti_buffer *wmb = file->buffer.next; wmb; wmb = wmb->next)
+    {
+        io_desc_t *iodesc;
+        wmb_entry_t *entries;
+        size_t dsize, tsize;
+        char *tmp;
+        bool sorted = true;
+
+        if (wmb->num_arrays <= 0)
+            continue;
+
+        /* Find the fill values not known yet. */
+        for (int i = 0; i < wmb->num_arrays; i++)
+            if (!file->varlist[wmb->vid[i]].fillvalue)
+                if ((ierr = find_var_fillvalue(file, wmb->vid[i], &file->varlist[wmb->vid[i]])))
+                {
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                    "Sorting the data cached for file (%s, ncid=%d) failed. Finding fillvalue associated with the variable (varid=%d) failed", pio_get_fname_from_file(file), file->pio_ncid, wmb->vid[i]);
+                }
+
+        if (!(iodesc = pio_get_iodesc_from_id(wmb->ioid)))
+        {
+            return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
+                            "Sorting the data cached for file (%s, ncid=%d) failed. Invalid I/O descriptor id (ioid=%d)", pio_get_fname_from_file(file), file->pio_ncid, wmb->ioid);
+        }
+
+        if (!(entries = malloc(wmb->num_arrays * sizeof(wmb_entry_t))))
+        {
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Sorting the data cached for file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for the list of cached arrays", pio_get_fname_from_file(file), file->pio_ncid, (long long int)(wmb->num_arrays * sizeof(wmb_entry_t)));
+        }
+        for (int i = 0; i < wmb->num_arrays; i++)
+        {
+            entries[i].vid = wmb->vid[i];
+            entries[i].frame = wmb->frame ? wmb->frame[i] : -1;
+            entries[i].idx = i;
+        }
+        qsort(entries, wmb->num_arrays, sizeof(wmb_entry_t), compare_wmb_entries);
+        for (int i = 0; sorted && i < wmb->num_arrays; i++)
+            sorted = (entries[i].idx == i);
+        if (sorted)
+        {
+            free(entries);
+            continue;
+        }
+
+        /* Permute the cached arrays, their fill values, variable ids
+         * and frames. */
+        dsize = (wmb->data) ? (size_t)wmb->arraylen * iodesc->mpitype_size : 0;
+        tsize = (dsize > sizeof(void *)) ? dsize : sizeof(void *);
+        if (tsize < (size_t)iodesc->mpitype_size)
+            tsize = iodesc->mpitype_size;
+        if (!(tmp = malloc(wmb->num_arrays * tsize)))
+        {
+            free(entries);
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Sorting the data cached for file (%s, ncid=%d) failed. Out of memory allocating a temporary buffer", pio_get_fname_from_file(file), file->pio_ncid);
+        }
+        if (wmb->data && dsize > 0)
+        {
+            for (int i = 0; i < wmb->num_arrays; i++)
+                memcpy(tmp + i * dsize, (char *)wmb->data + entries[i].idx * dsize, dsize);
+            memcpy(wmb->data, tmp, wmb->num_arrays * dsize);
+        }
+        if (wmb->udata)
+        {
+            for (int i = 0; i < wmb->num_arrays; i++)
+                ((void **)tmp)[i] = wmb->udata[entries[i].idx];
+            memcpy(wmb->udata, tmp, wmb->num_arrays * sizeof(void *));
+        }
+        if (wmb->fillvalue)
+        {
+            for (int i = 0; i < wmb->num_arrays; i++)
+                memcpy(tmp + i * iodesc->mpitype_size,
+                       (char *)wmb->fillvalue + entries[i].idx * iodesc->mpitype_size,
+                       iodesc->mpitype_size);
+            memcpy(wmb->fillvalue, tmp, wmb->num_arrays * iodesc->mpitype_size);
+        }
+        for (int i = 0; i < wmb->num_arrays; i++)
+        {
+            wmb->vid[i] = entries[i].vid;
+            if (wmb->frame)
+                wmb->frame[i] = entries[i].frame;
+        }
+        free(tmp);
+        free(entries);
+    }
+
+    return PIO_NOERR;
+}
+
+/* Check if the write multi buffer requires a flush
+ * wmb : A write multi buffer that might already contain data
+ * arraylen : The length of the new array that needs to be cached in this wmb
+ *            (The array is not cached yet)
+ * iodesc : io descriptor for the data cached in the write multi buffer
+ * nocopy : Non-zero if the wmb caches pointers to user arrays instead of
+ *          copies of the user data
+ * A disk flush implies that data needs to be rearranged and write needs to be
+ * completed. Rearranging and writing data frees up cache is compute and I/O
+ * processes
+ * An I/O flush implies that data needs to be rearranged and write needs to be
+ * started (for iotypes other than PnetCDF write also completes). This would
+ * free up cache in compute processes (I/O processes still need to cache the
+ * rearranged data until the write completes)
+ * Returns 2 if a disk flush is required, 1 if an I/O flush is required, 0 otherwise
+ */
+static int PIO_wmb_needs_flush(wmulti_buffer *wmb, int arraylen, io_desc_t *iodesc,
+                               int nocopy)
+{
+    bufsize curalloc, totfree, maxfree;
+    long nget, nrel;
+    const int NEEDS_DISK_FLUSH=2, NEEDS_IO_FLUSH=1, NO_FLUSH=0;
+
+    assert(wmb && iodesc);
+    /* Find out how much free, contiguous space is available. */
+    bstats(&curalloc, &totfree, &maxfree, &nget, &nrel);
+
+    LOG((2, "maxfree = %ld wmb->num_arrays = %d (1 + wmb->num_arrays) *"
+         " arraylen * iodesc->mpitype_size = %ld totfree = %ld\n",
+          maxfree, wmb->num_arrays,
+         (1 + wmb->num_arrays) * arraylen * iodesc->mpitype_size, totfree));
 
     /* We have exceeded the set buffer write cache limit, write data to
      * disk
@@ -623,6 +1124,16 @@ static int PIO_wmb_needs_flush(wmulti_buffer *wmb, int arraylen, io_desc_t *iode
      * contiguous block of memory.
      */
     PIO_Offset wmb_req_cache_sz = (1 + wmb->num_arrays) * array_sz_bytes;
+
+    /* The user arrays are not copied to the cache, but the user data
+     * is pinned until the wmb is flushed. Limit the pinned user data
+     * using the same limit as the cache
+     */
+    if(nocopy)
+    {
+        return (wmb_req_cache_sz >= pio_buffer_size_limit) ? NEEDS_IO_FLUSH : NO_FLUSH;
+    }
+
     /* maxfree is the maximum amount of contiguous memory available.
      * if maxfree <= 110% of the current size of wmb cache, it is close
      * to being exhausted/filled, flush so that we have enough space
@@ -896,6 +1407,24 @@ static void *PIOc_convert_buffer_adios(file_desc_t *file, io_desc_t *iodesc,
     void *buf = array;
     *ierr = 0;
 
+    /* Use the (vectorized) conversion kernels for conversions between
+     * doubles, floats and ints. */
+    if ((iodesc->piotype == PIO_DOUBLE || iodesc->piotype == PIO_FLOAT || iodesc->piotype == PIO_INT) &&
+        (av->nc_type == PIO_DOUBLE || av->nc_type == PIO_FLOAT || av->nc_type == PIO_INT) &&
+        iodesc->piotype != av->nc_type)
+    {
+        size_t to_size = (av->nc_type == PIO_DOUBLE) ? sizeof(double) :
+                            ((av->nc_type == PIO_FLOAT) ? sizeof(float) : sizeof(int));
+        if (!(buf = malloc((arraylen > 0) ? arraylen * to_size : 1)))
+        {
+            *ierr = PIO_ENOMEM;
+            return array;
+        }
+        *ierr = pio_convert_buffer(iodesc->piotype, array, av->nc_type, buf, arraylen,
+                                   NULL, NULL, NULL);
+        return buf;
+    }
+
     ADIOS_CONVERT_FROM(PIO_DOUBLE, double);
     ADIOS_CONVERT_FROM(PIO_FLOAT, float);
     ADIOS_CONVERT_FROM(PIO_INT, int);
@@ -1172,165 +1701,157 @@ static int PIOc_write_darray_adios(file_desc_t *file, int varid, int ioid,
 #endif
 
 /**
- * Write a distributed array to the output file.
- *
- * This routine aggregates output on the compute nodes and only sends
- * it to the IO nodes when the compute buffer is full or when a flush
- * is triggered.
- *
- * Internally, this function will:
- * <ul>
- * <li>Locate info about this file, decomposition, and variable.
- * <li>If we don't have a fillvalue for this variable, determine one
- * and remember it for future calls.
- * <li>Initialize or find the multi_buffer for this record/var.
- * <li>Find out how much free space is available in the multi buffer
- * and flush if needed.
- * <li>Store the new user data in the mutli buffer.
- * <li>If needed (only for subset rearranger), fill in gaps in data
- * with fillvalue.
- * <li>Remember the frame value (i.e. record number) of this data if
- * there is one.
- * </ul>
+ * Convert user data to the (narrower) type of the variable in the
+ * file and write it using a decomposition, with the same map, for the
+ * type of the variable. The decomposition is created the first time
+ * it is needed and is freed with the original decomposition (the
+ * decompositions for different types are chained through
+ * io_desc_t.conv_ioid). The decomposition uses the IO regions
+ * computed by PIO, so the data of decompositions with IO regions
+ * provided by the user is not converted (see
+ * io_desc_t.user_ioregions). The decomposition is not saved to disk
+ * (with PIO_SAVE_DECOMPS).
  *
- * NOTE: The write multi buffer wmulti_buffer is the cache on compute
- * nodes that will collect and store multiple variables before sending
- * them to the io nodes. Aggregating variables in this way leads to a
- * considerable savings in communication expense. Variables in the wmb
- * array must have the same decomposition and base data size and we
- * also need to keep track of whether each is a recordvar (has an
- * unlimited dimension) or not.
+ * User data equal to the fill value (the one provided by the user,
+ * or the default fill value for the type of the user data) and holes
+ * in the decomposition are written as the fill value of the
+ * variable. Values that cannot be represented in the type of the
+ * variable are also written as the fill value of the variable, and
+ * PIO_ERANGE is returned after the data is cached. The number of
+ * such values is summed over the compute tasks before the write, so
+ * the error is returned on all the tasks if any task has such values.
  *
- * @param ncid the ncid of the open netCDF file.
- * @param varid the ID of the variable that these data will be written
- * to.
- * @param ioid the I/O description ID as passed back by
- * PIOc_InitDecomp().
- * @param arraylen the length of the array to be written. This should
- * be at least the length of the local component of the distrubited
- * array. (Any values beyond length of the local component will be
- * ignored.)
- * @param array pointer to an array of length arraylen with the data
- * to be written. This is a pointer to the distributed portion of the
- * array that is on this task.
- * @param fillvalue pointer to the fill value to be used for missing
- * data.
- * @returns 0 for success, non-zero error code for failure.
+ * @param file pointer to the file_desc_t info.
+ * @param varid the variable ID.
+ * @param iodesc pointer to the decomposition of the user data.
+ * @param arraylen the length of the user array (at most iodesc->ndof).
+ * @param array pointer to the user data.
+ * @param fillvalue pointer to the fill value of the user data. May
+ * be NULL.
+ * @returns 0 for success, error code otherwise.
  * @ingroup PIO_write_darray
- * @author Jim Edwards, Ed Hartnett
  */
-int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
-                      void *fillvalue)
+static int write_darray_convert(file_desc_t *file, int varid, io_desc_t *iodesc,
+                                PIO_Offset arraylen, void *array, void *fillvalue)
 {
-    iosystem_desc_t *ios;  /* Pointer to io system information. */
-    file_desc_t *file;     /* Info about file we are writing to. */
-    io_desc_t *iodesc;     /* The IO description. */
-    var_desc_t *vdesc;     /* Info about the var being written. */
-    void *bufptr;          /* A data buffer. */
-    MPI_Datatype vtype;    /* The MPI type of the variable. */
-    wmulti_buffer *wmb;    /* The write multi buffer for one or more vars. */
-    int recordvar;         /* Non-zero if this is a record variable. */
-    int needsflush = 0;    /* True if we need to flush buffer. */
-#if PIO_LIMIT_CACHED_IO_REGIONS
-    PIO_Offset decomp_max_regions; /* Max non-contiguous regions in the IO decomposition */
-    PIO_Offset io_max_regions; /* Max non-contiguous regions cached in a single IO process */
-#endif
-    int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
-    int ierr = PIO_NOERR;  /* Return code. */
+    iosystem_desc_t *ios = file->iosystem;
+    var_desc_t *vdesc = &(file->varlist[varid]);
+    io_desc_t *conv_iodesc = iodesc;
+    void *buf;
+    void *from_fill = fillvalue;
+    double double_fill = PIO_FILL_DOUBLE;
+    PIO_Offset nerange = 0;
+    int mpierr = MPI_SUCCESS;
+    int ierr = PIO_NOERR;
+
+    LOG((2, "write_darray_convert varid = %d ioid = %d piotype = %d var pio_type = %d",
+         varid, iodesc->ioid, iodesc->piotype, vdesc->pio_type));
 
+    /* Find the decomposition for the type of the variable in the
+     * chain of decompositions created for converted data. Create it
+     * (at the end of the chain) if it does not exist. */
+    while (conv_iodesc->piotype != vdesc->pio_type)
+    {
+        if (conv_iodesc->conv_ioid < 0)
+        {
 #ifdef TIMING
-    GPTLstart("PIO:PIOc_write_darray");
+            GPTLstart("PIO:write_darray_convert_initdecomp");
 #endif
-    LOG((1, "PIOc_write_darray ncid = %d varid = %d ioid = %d arraylen = %d",
-         ncid, varid, ioid, arraylen));
+            if ((ierr = pio_init_decomp(ios->iosysid, vdesc->pio_type, iodesc->ndims,
+                                        iodesc->dimlen, iodesc->maplen, iodesc->map,
+                                        &conv_iodesc->conv_ioid, &iodesc->rearranger,
+                                        NULL, NULL, false)))
+            {
+                conv_iodesc->conv_ioid = -1;
+                return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Creating a decomposition to write the data converted to the type of the variable failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+            }
+#ifdef TIMING
+            GPTLstop("PIO:write_darray_convert_initdecomp");
+#endif
+        }
 
-    /* Get the file info. */
-    if ((ierr = pio_get_file(ncid, &file)))
+        if (!(conv_iodesc = pio_get_iodesc_from_id(conv_iodesc->conv_ioid)))
+        {
+            return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
+                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Invalid I/O descriptor id for converted data", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+        }
+    }
+
+    /* Only conversions from PIO_DOUBLE narrow the data. */
+    pioassert(iodesc->piotype == PIO_DOUBLE, "unexpected type", __FILE__, __LINE__);
+    if (!from_fill)
+        from_fill = &double_fill;
+
+    /* Convert the user data. */
+    if (!(buf = malloc((arraylen > 0) ? arraylen * conv_iodesc->mpitype_size : 1)))
     {
-        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
-                        "Writing variable (varid=%d) failed on file. Invalid file id (ncid=%d) provided", varid, ncid);
+        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Out of memory allocating %lld bytes to convert user data", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (long long int)(arraylen * conv_iodesc->mpitype_size));
     }
-    ios = file->iosystem;
 
 #ifdef TIMING
-#ifdef _ADIOS2 /* TAHSIN: timing */
-    if (file->iotype == PIO_IOTYPE_ADIOS)
-        GPTLstart("PIO:PIOc_write_darray_adios"); /* TAHSIN: start */
+    GPTLstart("PIO:write_darray_convert");
 #endif
+    ierr = pio_convert_buffer(iodesc->piotype, array, vdesc->pio_type, buf, arraylen,
+                              from_fill, vdesc->fillvalue, &nerange);
+#ifdef TIMING
+    GPTLstop("PIO:write_darray_convert");
 #endif
-
-    LOG((1, "PIOc_write_darray ncid=%d varid=%d wb_pend=%llu file_wb_pend=%llu",
-          ncid, varid,
-          (unsigned long long int) file->varlist[varid].wb_pend,
-          (unsigned long long int) file->wb_pend
-    ));
-
-    /* Can we write to this file? */
-    if (!(file->mode & PIO_WRITE))
+    if (ierr != PIO_NOERR)
     {
-        return pio_err(ios, file, PIO_EPERM, __FILE__, __LINE__,
-                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. The file was not opened for writing, try reopening the file in write mode (use the PIO_WRITE flag)", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+        free(buf);
+        return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Converting user data (type %d) to the type of the variable (type %d) failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, iodesc->piotype, vdesc->pio_type);
     }
 
-    /* Get decomposition information. */
-    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+    /* The write is collective, all the tasks return the range error
+     * if any task has values out of range. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &nerange, 1, MPI_OFFSET, MPI_SUM, ios->comp_comm)))
     {
-        return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
-                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Invalid I/O descriptor id (ioid=%d) provided", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, ioid);
+        free(buf);
+        return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
     }
 
-    /* Check that the local size of the variable passed in matches the
-     * size expected by the io descriptor. Fail if arraylen is too
-     * small, just put a warning in the log and truncate arraylen
-     * if it is too big (the excess values will be ignored.) */
-    if (arraylen < iodesc->ndof)
+    /* Write (cache) the converted data, holes are filled with the
+     * fill value of the variable. */
+    ierr = PIOc_write_darray(file->pio_ncid, varid, conv_iodesc->ioid, arraylen, buf,
+                             vdesc->fillvalue);
+    free(buf);
+    if (ierr != PIO_NOERR)
     {
-        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
-                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. The local array size (arraylen=%lld) is smaller than expected, the I/O decomposition (ioid=%d) requires a local array of size = %lld", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (long long int) arraylen, ioid, (long long int) iodesc->ndof);
+        return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Writing user data converted to the type of the variable failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
     }
-    LOG((2, "%s arraylen = %d iodesc->ndof = %d",
-         (arraylen > iodesc->ndof) ? "WARNING: arraylen > iodesc->ndof" : "",
-         arraylen, iodesc->ndof));
-    if (arraylen > iodesc->ndof)
-        arraylen = iodesc->ndof;
-
-#ifdef PIO_MICRO_TIMING
-    mtimer_start(file->varlist[varid].wr_mtimer);
-#endif
 
-#if PIO_SAVE_DECOMPS
-    if(!(iodesc->is_saved) &&
-        pio_save_decomps_regex_match(ioid, file->fname, file->varlist[varid].vname))
+    if (nerange > 0)
     {
-        char filename[PIO_MAX_NAME];
-        ierr = pio_create_uniq_str(ios, iodesc, filename, PIO_MAX_NAME, "piodecomp", ".dat");
-        if(ierr != PIO_NOERR)
-        {
-            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
-                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Saving I/O decomposition (ioid=%d) failed. Unable to create a unique file name for saving the I/O decomposition", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, ioid);
-        }
-        LOG((2, "Saving decomp map (write) to %s", filename));
-        PIOc_writemap(filename, ioid, iodesc->ndims, iodesc->dimlen, iodesc->maplen, iodesc->map, ios->my_comm);
-        iodesc->is_saved = true;
+        return pio_err(ios, file, PIO_ERANGE, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. %lld values of the user data (on all the compute tasks) cannot be represented in the type of the variable (type %d), these values are written as the variable fill value", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (long long int)nerange, vdesc->pio_type);
     }
-#endif
-    /* Get var description. */
-    vdesc = &(file->varlist[varid]);
-    LOG((2, "vdesc record %d nreqs %d", vdesc->record, vdesc->nreqs));
 
-    /* If we don't know the fill value for this var, get it. */
-    if (!vdesc->fillvalue)
-        if ((ierr = find_var_fillvalue(file, varid, vdesc)))
-        {
-            return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
-                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Finding fillvalue associated with the variable failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
-        }
+    return PIO_NOERR;
+}
 
-    /* Is this a record variable? The user must set the vdesc->record
-     * value by calling PIOc_setframe() before calling this
-     * function. */
-    recordvar = vdesc->record >= 0 ? 1 : 0;
-    LOG((3, "recordvar = %d looking for multibuffer", recordvar));
+/**
+ * Find the write multi buffer caching the data of the record (or of
+ * the non-record) variables with a decomposition in a file, and
+ * create it if there is none yet.
+ *
+ * @param file pointer to the file info.
+ * @param varid the ID of the variable written.
+ * @param ioid the ID of the decomposition.
+ * @param recordvar non-zero for record variables.
+ * @param arraylen the length of the array written.
+ * @param wmbp pointer that gets the write multi buffer.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+static int get_wmb(file_desc_t *file, int varid, int ioid, int recordvar, PIO_Offset arraylen,
+                   wmulti_buffer **wmbp)
+{
+    iosystem_desc_t *ios = file->iosystem;
+    wmulti_buffer *wmb;
 
     /* Move to end of list or the entry that matches this ioid. */
     for (wmb = &file->buffer; wmb->next; wmb = wmb->next)
@@ -1338,18 +1859,6 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
             break;
     LOG((3, "wmb->ioid = %d wmb->recordvar = %d", wmb->ioid, wmb->recordvar));
 
-#ifdef _ADIOS2
-    if (file->iotype == PIO_IOTYPE_ADIOS)
-    {
-        ierr = PIOc_write_darray_adios(file, varid, ioid, iodesc, arraylen, array, fillvalue);
-#ifdef TIMING
-        GPTLstop("PIO:PIOc_write_darray_adios"); /* TAHSIN: stop */
-        GPTLstop("PIO:PIOc_write_darray");
-#endif
-        return ierr;
-    }
-#endif
-
     /* If we did not find an existing wmb entry, create a new wmb. */
     if (wmb->ioid != ioid || wmb->recordvar != recordvar)
     {
@@ -1371,15 +1880,59 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
         wmb->arraylen = arraylen;
         wmb->vid = NULL;
         wmb->data = NULL;
+        wmb->udata = NULL;
         wmb->frame = NULL;
         wmb->fillvalue = NULL;
     }
+    *wmbp = wmb;
+    return PIO_NOERR;
+}
+
+/**
+ * Cache the data of a variable in a write multi buffer. If the buffer
+ * is full, or the cache size limit is reached, the data cached is
+ * flushed first. Collective on the compute tasks, except in the
+ * thread-safe mode (see PIOc_set_threadsafe()).
+ *
+ * @param file pointer to the file info.
+ * @param varid the ID of the variable written.
+ * @param iodesc pointer to the decomposition.
+ * @param wmb pointer to the write multi buffer (see get_wmb()).
+ * @param arraylen the length of the array written.
+ * @param array pointer to the data written.
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data, NULL to use the default fill value of the type.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+static int cache_darray(file_desc_t *file, int varid, io_desc_t *iodesc, wmulti_buffer *wmb,
+                        PIO_Offset arraylen, void *array, void *fillvalue)
+{
+    iosystem_desc_t *ios = file->iosystem;
+    var_desc_t *vdesc = &file->varlist[varid];
+    int ncid = file->pio_ncid;
+    void *bufptr;          /* A data buffer. */
+    MPI_Datatype vtype;    /* The MPI type of the variable. */
+    int needsflush = 0;    /* True if we need to flush buffer. */
+#if PIO_LIMIT_CACHED_IO_REGIONS
+    PIO_Offset decomp_max_regions; /* Max non-contiguous regions in the IO decomposition */
+    PIO_Offset io_max_regions; /* Max non-contiguous regions cached in a single IO process */
+#endif
+    int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
+    int ierr = PIO_NOERR;  /* Return code. */
+
     LOG((2, "wmb->num_arrays = %d arraylen = %d iodesc->mpitype_size = %d\n",
          wmb->num_arrays, arraylen, iodesc->mpitype_size));
 
-    needsflush = PIO_wmb_needs_flush(wmb, arraylen, iodesc);
+    needsflush = PIO_wmb_needs_flush(wmb, arraylen, iodesc, file->darray_nocopy);
     assert(needsflush >= 0);
 
+    /* The user switched between copying and not copying user data
+     * (PIOc_set_darray_nocopy()), flush the data cached in the other
+     * mode */
+    if (wmb->num_arrays > 0 && ((wmb->udata != NULL) != (file->darray_nocopy != 0)))
+        needsflush = (needsflush > 1) ? needsflush : 1;
+
 #if PIO_LIMIT_CACHED_IO_REGIONS
     /* When using PIO with PnetCDF + SUBSET rearranger the number
        of non-contiguous regions cached in a single IO process can
@@ -1403,13 +1956,16 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
 #endif
 
     /* Tell all tasks on the computation communicator whether we need
-     * to flush data. */
-    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &needsflush, 1,  MPI_INT,  MPI_MAX,
-                                ios->comp_comm)))
+     * to flush data. In the thread-safe mode the data is only flushed
+     * by PIOc_sync() and PIOc_closefile(). */
+    if (ios->threadsafe)
+        needsflush = 0;
+    else if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &needsflush, 1,  MPI_INT,  MPI_MAX,
+                                     ios->comp_comm)))
         return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
     LOG((2, "needsflush = %d", needsflush));
 
-    if(!ios->async || !ios->ioproc)
+    if(!ios->threadsafe && (!ios->async || !ios->ioproc))
     {
         if(file->varlist[varid].vrsize == 0)
         {
@@ -1458,8 +2014,17 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     mtimer_async_event_in_progress(file->varlist[varid].wr_mtimer, true);
 #endif
 
-    /* Get memory for data. */
-    if (arraylen > 0)
+    /* Get memory for data. If the user data is not copied only
+     * a pointer to the user array is cached. */
+    if (file->darray_nocopy)
+    {
+        if (!(wmb->udata = realloc(wmb->udata, sizeof(void *) * (1 + wmb->num_arrays))))
+        {
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Out of memory allocating space (realloc %lld bytes) for array of pointers to user data in write multi buffer", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long)(sizeof(void *) * (1 + wmb->num_arrays)));
+        }
+    }
+    else if (arraylen > 0)
     {
         if (!(wmb->data = bgetr(wmb->data, (1 + wmb->num_arrays) * arraylen * iodesc->mpitype_size)))
         {
@@ -1570,10 +2135,16 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
     LOG((3, "wmb->num_arrays = %d wmb->vid[wmb->num_arrays] = %d", wmb->num_arrays,
          wmb->vid[wmb->num_arrays]));
 
-    /* Copy the user-provided data to the buffer. */
-    bufptr = (void *)((char *)wmb->data + arraylen * iodesc->mpitype_size * wmb->num_arrays);
-    if (arraylen > 0)
+    /* Copy the user-provided data to the buffer, or just save a
+     * pointer to it. */
+    if (file->darray_nocopy)
+    {
+        wmb->udata[wmb->num_arrays] = array;
+        LOG((3, "cached pointer to %ld bytes of user data", arraylen * iodesc->mpitype_size));
+    }
+    else if (arraylen > 0)
     {
+        bufptr = (void *)((char *)wmb->data + arraylen * iodesc->mpitype_size * wmb->num_arrays);
         memcpy(bufptr, array, arraylen * iodesc->mpitype_size);
         LOG((3, "copied %ld bytes of user data", arraylen * iodesc->mpitype_size));
     }
@@ -1593,12 +2164,676 @@ int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *
               (unsigned long long int) file->varlist[varid].wb_pend,
               (unsigned long long int) file->wb_pend
         ));
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write a distributed array to the output file, see
+ * PIOc_write_darray(). In the thread-safe mode (see
+ * PIOc_set_threadsafe()) the caller holds the lock of the file, and
+ * the data is only cached: the collective calls (to find the fill
+ * value and the record size of the variable, and to decide whether
+ * to flush the cached data) are skipped.
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param varid the ID of the variable that these data will be written
+ * to.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param arraylen the length of the array to be written.
+ * @param array pointer to an array of length arraylen with the data
+ * to be written.
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+static int write_darray_int(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                            void *fillvalue)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    file_desc_t *file;     /* Info about file we are writing to. */
+    io_desc_t *iodesc;     /* The IO description. */
+    var_desc_t *vdesc;     /* Info about the var being written. */
+    wmulti_buffer *wmb;    /* The write multi buffer for one or more vars. */
+    int recordvar;         /* Non-zero if this is a record variable. */
+    int ierr = PIO_NOERR;  /* Return code. */
+
+#ifdef TIMING
+    GPTLstart("PIO:PIOc_write_darray");
+#endif
+    PIO_TRACE_BEGIN("PIOc_write_darray");
+    LOG((1, "PIOc_write_darray ncid = %d varid = %d ioid = %d arraylen = %d",
+         ncid, varid, ioid, arraylen));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+    {
+        ierr = pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Writing variable (varid=%d) failed on file. Invalid file id (ncid=%d) provided", varid, ncid);
+        goto exit;
+    }
+    ios = file->iosystem;
+
+#ifdef TIMING
+#ifdef _ADIOS2 /* TAHSIN: timing */
+    if (file->iotype == PIO_IOTYPE_ADIOS)
+        GPTLstart("PIO:PIOc_write_darray_adios"); /* TAHSIN: start */
+#endif
+#endif
+
+    LOG((1, "PIOc_write_darray ncid=%d varid=%d wb_pend=%llu file_wb_pend=%llu",
+          ncid, varid,
+          (unsigned long long int) file->varlist[varid].wb_pend,
+          (unsigned long long int) file->wb_pend
+    ));
+
+    /* Can we write to this file? */
+    if (!(file->mode & PIO_WRITE))
+    {
+        ierr = pio_err(ios, file, PIO_EPERM, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. The file was not opened for writing, try reopening the file in write mode (use the PIO_WRITE flag)", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+        goto exit;
+    }
+
+    /* Get decomposition information. */
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+    {
+        ierr = pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Invalid I/O descriptor id (ioid=%d) provided", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, ioid);
+        goto exit;
+    }
+
+    /* Check that the local size of the variable passed in matches the
+     * size expected by the io descriptor. Fail if arraylen is too
+     * small, just put a warning in the log and truncate arraylen
+     * if it is too big (the excess values will be ignored.) */
+    if (arraylen < iodesc->ndof)
+    {
+        ierr = pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. The local array size (arraylen=%lld) is smaller than expected, the I/O decomposition (ioid=%d) requires a local array of size = %lld", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, (long long int) arraylen, ioid, (long long int) iodesc->ndof);
+        goto exit;
+    }
+    LOG((2, "%s arraylen = %d iodesc->ndof = %d",
+         (arraylen > iodesc->ndof) ? "WARNING: arraylen > iodesc->ndof" : "",
+         arraylen, iodesc->ndof));
+    if (arraylen > iodesc->ndof)
+        arraylen = iodesc->ndof;
+
+    /* Get var description. */
+    vdesc = &(file->varlist[varid]);
+    LOG((2, "vdesc record %d nreqs %d", vdesc->record, vdesc->nreqs));
+
+    /* If we don't know the fill value for this var, get it. In the
+     * thread-safe mode it is found, if needed, before flushing the
+     * data (see pio_order_wmb_list()). */
+    if (!vdesc->fillvalue && !ios->threadsafe)
+        if ((ierr = find_var_fillvalue(file, varid, vdesc)))
+        {
+            ierr = pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
+                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Finding fillvalue associated with the variable failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
+            goto exit;
+        }
+
+    /* If the variable in the file has a narrower type than the user
+     * data, convert the data on the compute tasks (before it is
+     * rearranged) to reduce the data moved to the IO tasks. */
+    if (!ios->async && !ios->threadsafe && !file->darray_nocopy &&
+        file->iotype != PIO_IOTYPE_ADIOS && !iodesc->user_ioregions &&
+        pio_convert_narrows(iodesc->piotype, vdesc->pio_type))
+    {
+        ierr = write_darray_convert(file, varid, iodesc, arraylen, array, fillvalue);
+        goto exit;
+    }
+
+#ifdef PIO_MICRO_TIMING
+    mtimer_start(file->varlist[varid].wr_mtimer);
+#endif
+
+#if PIO_SAVE_DECOMPS
+    if(!(iodesc->is_saved) && !ios->threadsafe &&
+        pio_save_decomps_regex_match(ioid, file->fname, file->varlist[varid].vname))
+    {
+        char filename[PIO_MAX_NAME];
+        ierr = pio_create_uniq_str(ios, iodesc, filename, PIO_MAX_NAME, "piodecomp", ".dat");
+        if(ierr != PIO_NOERR)
+        {
+            ierr = pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Writing variable (%s, varid=%d) to file (%s, ncid=%d) failed. Saving I/O decomposition (ioid=%d) failed. Unable to create a unique file name for saving the I/O decomposition", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid, ioid);
+            goto exit;
+        }
+        LOG((2, "Saving decomp map (write) to %s", filename));
+        PIOc_writemap(filename, ioid, iodesc->ndims, iodesc->dimlen, iodesc->maplen, iodesc->map, ios->my_comm);
+        iodesc->is_saved = true;
+    }
+#endif
+
+    /* Is this a record variable? The user must set the vdesc->record
+     * value by calling PIOc_setframe() before calling this
+     * function. */
+    recordvar = vdesc->record >= 0 ? 1 : 0;
+    LOG((3, "recordvar = %d looking for multibuffer", recordvar));
+
+#ifdef _ADIOS2
+    if (file->iotype == PIO_IOTYPE_ADIOS)
+    {
+        ierr = PIOc_write_darray_adios(file, varid, ioid, iodesc, arraylen, array, fillvalue);
+#ifdef TIMING
+        GPTLstop("PIO:PIOc_write_darray_adios"); /* TAHSIN: stop */
+#endif
+        goto exit;
+    }
+#endif
+
+    /* Find the write multi buffer for the data. */
+    if ((ierr = get_wmb(file, varid, ioid, recordvar, arraylen, &wmb)))
+        goto exit;
+
+    /* Cache the data, flushing the cached data first if needed. */
+    if ((ierr = cache_darray(file, varid, iodesc, wmb, arraylen, array, fillvalue)))
+        goto exit;
+
 #ifdef PIO_MICRO_TIMING
     mtimer_stop(file->varlist[varid].wr_mtimer, get_var_desc_str(ncid, varid, NULL));
 #endif
+
+exit:
+#ifdef TIMING
+    GPTLstop("PIO:PIOc_write_darray");
+#endif
+    PIO_TRACE_END("PIOc_write_darray");
+    return ierr;
+}
+
+/**
+ * Write a distributed array to the output file.
+ *
+ * This routine aggregates output on the compute nodes and only sends
+ * it to the IO nodes when the compute buffer is full or when a flush
+ * is triggered.
+ *
+ * Internally, this function will:
+ * <ul>
+ * <li>Locate info about this file, decomposition, and variable.
+ * <li>If we don't have a fillvalue for this variable, determine one
+ * and remember it for future calls.
+ * <li>Initialize or find the multi_buffer for this record/var.
+ * <li>Find out how much free space is available in the multi buffer
+ * and flush if needed.
+ * <li>Store the new user data in the mutli buffer.
+ * <li>If needed (only for subset rearranger), fill in gaps in data
+ * with fillvalue.
+ * <li>Remember the frame value (i.e. record number) of this data if
+ * there is one.
+ * </ul>
+ *
+ * NOTE: The write multi buffer wmulti_buffer is the cache on compute
+ * nodes that will collect and store multiple variables before sending
+ * them to the io nodes. Aggregating variables in this way leads to a
+ * considerable savings in communication expense. Variables in the wmb
+ * array must have the same decomposition and base data size and we
+ * also need to keep track of whether each is a recordvar (has an
+ * unlimited dimension) or not.
+ *
+ * In the thread-safe mode (see PIOc_set_threadsafe()) this function
+ * is not collective, the threads of a task can write different
+ * variables of the same file concurrently. The data is only cached,
+ * it is flushed by the next call to PIOc_sync() or PIOc_closefile().
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param varid the ID of the variable that these data will be written
+ * to.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param arraylen the length of the array to be written. This should
+ * be at least the length of the local component of the distrubited
+ * array. (Any values beyond length of the local component will be
+ * ignored.)
+ * @param array pointer to an array of length arraylen with the data
+ * to be written. This is a pointer to the distributed portion of the
+ * array that is on this task.
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ * @author Jim Edwards, Ed Hartnett
+ */
+int PIOc_write_darray(int ncid, int varid, int ioid, PIO_Offset arraylen, void *array,
+                      void *fillvalue)
+{
+    file_desc_t *file;     /* Info about file we are writing to. */
+    int ierr = PIO_NOERR;  /* Return code. */
+
+    /* In the thread-safe mode the data is cached holding the lock of
+     * the file, the threads of a task can write variables of the
+     * same file concurrently. */
+    if (pio_get_file(ncid, &file) || !file->iosystem->threadsafe)
+        return write_darray_int(ncid, varid, ioid, arraylen, array, fillvalue);
+
+    pio_file_lock(file);
+    ierr = write_darray_int(ncid, varid, ioid, arraylen, array, fillvalue);
+    pio_file_unlock(file);
+
+    return ierr;
+}
+
+/* A write handle of a variable of a file and a decomposition, see
+ * PIOc_bind_darray(). */
+typedef struct pio_darray_handle_t
+{
+    /* The file, NULL once the file is closed or the decomposition is
+     * freed (see pio_release_darray_handles()). */
+    file_desc_t *file;
+
+    /* The variable written. */
+    int varid;
+
+    /* The decomposition of the variable. */
+    int ioid;
+    io_desc_t *iodesc;
+
+    /* The fill value for missing data, NULL for the default fill value
+     * of the type. */
+    void *fillvalue;
+
+    /* True if the data is converted to the narrower type of the
+     * variable before it is cached (see write_darray_convert()). */
+    bool narrows;
+
+    /* The write multi buffer the data is cached in, valid as long as
+     * wmb_gen matches the generation of the buffers of the file. */
+    wmulti_buffer *wmb;
+    int wmb_gen;
+
+    /* The number of writes using the handle, and true once the handle
+     * is unbound while in use: the last write frees it (see
+     * pio_put_darray_handle()). */
+    int nusers;
+    bool unbound;
+} pio_darray_handle_t;
+
+/* The write handles, indexed by the handle id. The entries of unbound
+ * handles are NULL. */
+static pio_darray_handle_t **pio_darray_handles = NULL;
+static int pio_num_darray_handles = 0;
+
+/**
+ * Get the write handle with a given id. The handle is not freed by a
+ * concurrent PIOc_unbind_darray() until it is released with
+ * pio_put_darray_handle().
+ *
+ * @param handle the id of the handle.
+ * @returns pointer to the handle, NULL if there is no such handle.
+ * @ingroup PIO_write_darray
+ */
+static pio_darray_handle_t *pio_get_darray_handle(int handle)
+{
+    pio_darray_handle_t *h = NULL;
+
+    PIO_LOCK();
+    if (handle >= 0 && handle < pio_num_darray_handles)
+        h = pio_darray_handles[handle];
+    if (h)
+        h->nusers++;
+    PIO_UNLOCK();
+
+    return h;
+}
+
+/**
+ * Release a write handle got with pio_get_darray_handle(), and free
+ * it if it was unbound while in use.
+ *
+ * @param h pointer to the handle.
+ * @ingroup PIO_write_darray
+ */
+static void pio_put_darray_handle(pio_darray_handle_t *h)
+{
+    bool unbound;
+
+    PIO_LOCK();
+    h->nusers--;
+    unbound = h->unbound && !h->nusers;
+    PIO_UNLOCK();
+
+    if (unbound)
+    {
+        free(h->fillvalue);
+        free(h);
+    }
+}
+
+/**
+ * Invalidate the write handles bound to a file, when the file is
+ * closed, or to a decomposition, when the decomposition is freed. The
+ * handles must still be released with PIOc_unbind_darray().
+ *
+ * @param file pointer to the file, or NULL.
+ * @param iodesc pointer to the decomposition, or NULL.
+ * @ingroup PIO_write_darray
+ */
+void pio_release_darray_handles(file_desc_t *file, io_desc_t *iodesc)
+{
+    PIO_LOCK();
+    for (int i = 0; i < pio_num_darray_handles; i++)
+    {
+        pio_darray_handle_t *h = pio_darray_handles[i];
+
+        if (h && h->file && ((file && h->file == file) || (iodesc && h->iodesc == iodesc)))
+        {
+            LOG((2, "releasing write handle %d of varid %d", i, h->varid));
+            h->file = NULL;
+            h->iodesc = NULL;
+            h->wmb = NULL;
+        }
+    }
+    PIO_UNLOCK();
+}
+
+/**
+ * Bind a variable of a file to a decomposition for writing records
+ * of the variable with PIOc_write_darray_handle().
+ *
+ * The per-variable work of PIOc_write_darray() (finding the fill
+ * value of the variable, the size of a record, and the write multi
+ * buffer the data is cached in) is done once when the handle is
+ * bound, the writes through the handle only cache the data of a
+ * record and flush the cached data when needed.
+ *
+ * This function is collective on the compute tasks, except in the
+ * thread-safe mode (see PIOc_set_threadsafe()). The handle is no
+ * longer usable once the file is closed or the decomposition is
+ * freed, it must be released with PIOc_unbind_darray().
+ *
+ * @param ncid the ncid of the open netCDF file.
+ * @param varid the ID of the variable written.
+ * @param ioid the I/O description ID as passed back by
+ * PIOc_InitDecomp().
+ * @param fillvalue pointer to the fill value to be used for missing
+ * data, NULL to use the default fill value of the type. The value is
+ * copied.
+ * @param handlep pointer that gets the id of the handle.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_bind_darray(int ncid, int varid, int ioid, void *fillvalue, int *handlep)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    file_desc_t *file;     /* Info about file we are writing to. */
+    io_desc_t *iodesc;     /* The IO description. */
+    var_desc_t *vdesc;     /* Info about the var being written. */
+    pio_darray_handle_t *h;
+    int handle;
+    int ierr = PIO_NOERR;  /* Return code. */
+
+    LOG((1, "PIOc_bind_darray ncid = %d varid = %d ioid = %d", ncid, varid, ioid));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Binding variable (varid=%d) for writing failed. Invalid file id (ncid=%d) provided", varid, ncid);
+    }
+    ios = file->iosystem;
+
+    /* Check inputs. */
+    if (!handlep || varid < 0 || varid >= PIO_MAX_VARS)
+    {
+        return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
+                        "Binding variable (varid=%d) of file (%s, ncid=%d) for writing failed. Invalid arguments provided, %s", varid, pio_get_fname_from_file(file), ncid, (!handlep) ? "handlep is NULL" : "invalid variable id");
+    }
+
+    /* Can we write to this file? */
+    if (!(file->mode & PIO_WRITE))
+    {
+        return pio_err(ios, file, PIO_EPERM, __FILE__, __LINE__,
+                        "Binding variable (%s, varid=%d) of file (%s, ncid=%d) for writing failed. The file was not opened for writing, try reopening the file in write mode (use the PIO_WRITE flag)", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid);
+    }
+
+    /* Get decomposition information. */
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+    {
+        return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
+                        "Binding variable (%s, varid=%d) of file (%s, ncid=%d) for writing failed. Invalid I/O descriptor id (ioid=%d) provided", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid, ioid);
+    }
+    vdesc = &(file->varlist[varid]);
+
+    /* Find the fill value and the record size of the variable now,
+     * so that the writes do not need to. In the thread-safe mode the
+     * fill value is found, if needed, before flushing the data. */
+    if (!ios->threadsafe)
+    {
+        if (!vdesc->fillvalue)
+            if ((ierr = find_var_fillvalue(file, varid, vdesc)))
+            {
+                return pio_err(ios, file, PIO_EBADID, __FILE__, __LINE__,
+                                "Binding variable (%s, varid=%d) of file (%s, ncid=%d) for writing failed. Finding fillvalue associated with the variable failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid);
+            }
+
+        if ((!ios->async || !ios->ioproc) && vdesc->vrsize == 0)
+            if ((ierr = calc_var_rec_sz(ncid, varid)))
+                LOG((1, "Unable to calculate the variable record size"));
+    }
+
+    /* Create the handle. */
+    if (!(h = calloc(1, sizeof(pio_darray_handle_t))))
+    {
+        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Binding variable (%s, varid=%d) of file (%s, ncid=%d) for writing failed. Out of memory allocating %lld bytes for the write handle", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid, (long long int)sizeof(pio_darray_handle_t));
+    }
+    h->file = file;
+    h->varid = varid;
+    h->ioid = ioid;
+    h->iodesc = iodesc;
+    h->narrows = !ios->async && !iodesc->user_ioregions &&
+        pio_convert_narrows(iodesc->piotype, vdesc->pio_type);
+    if (fillvalue)
+    {
+        if (!(h->fillvalue = malloc(iodesc->mpitype_size)))
+        {
+            free(h);
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Binding variable (%s, varid=%d) of file (%s, ncid=%d) for writing failed. Out of memory allocating %lld bytes for the fill value", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid, (long long int)iodesc->mpitype_size);
+        }
+        memcpy(h->fillvalue, fillvalue, iodesc->mpitype_size);
+    }
+
+    /* Add the handle to the first free entry of the list. */
+    PIO_LOCK();
+    for (handle = 0; handle < pio_num_darray_handles; handle++)
+        if (!pio_darray_handles[handle])
+            break;
+    if (handle == pio_num_darray_handles)
+    {
+        pio_darray_handle_t **handles = realloc(pio_darray_handles,
+                                                (handle + 1) * sizeof(pio_darray_handle_t *));
+        if (!handles)
+        {
+            PIO_UNLOCK();
+            free(h->fillvalue);
+            free(h);
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Binding variable (%s, varid=%d) of file (%s, ncid=%d) for writing failed. Out of memory allocating %lld bytes for the list of write handles", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid, (long long int)((handle + 1) * sizeof(pio_darray_handle_t *)));
+        }
+        pio_darray_handles = handles;
+        pio_num_darray_handles++;
+    }
+    pio_darray_handles[handle] = h;
+    PIO_UNLOCK();
+
+    LOG((2, "PIOc_bind_darray handle = %d", handle));
+    *handlep = handle;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Cache the data of one record of a variable bound with
+ * PIOc_bind_darray(). See write_darray_int().
+ *
+ * @param h pointer to the handle.
+ * @param array pointer to the data to be written.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+static int write_darray_handle_int(pio_darray_handle_t *h, void *array)
+{
+    file_desc_t *file = h->file;
+    iosystem_desc_t *ios = file->iosystem;
+    int recordvar;         /* Non-zero if this is a record variable. */
+    int ierr = PIO_NOERR;  /* Return code. */
+
+    /* The writes that need more than caching the data take the
+     * generic path. */
+    if (file->iotype == PIO_IOTYPE_ADIOS ||
+        (h->narrows && !ios->threadsafe && !file->darray_nocopy)
+#if PIO_SAVE_DECOMPS
+        || !h->iodesc->is_saved
+#endif
+        )
+        return write_darray_int(file->pio_ncid, h->varid, h->ioid, h->iodesc->ndof, array,
+                                h->fillvalue);
+
+#ifdef TIMING
+    GPTLstart("PIO:PIOc_write_darray");
+#endif
+    PIO_TRACE_BEGIN("PIOc_write_darray_handle");
+    LOG((1, "PIOc_write_darray_handle ncid = %d varid = %d ioid = %d record = %d",
+         file->pio_ncid, h->varid, h->ioid, file->varlist[h->varid].record));
+
+    /* Find the write multi buffer again only if the buffers were
+     * freed, or the variable is no longer written by record. */
+    recordvar = file->varlist[h->varid].record >= 0 ? 1 : 0;
+    if (!h->wmb || h->wmb_gen != file->wmb_gen || h->wmb->recordvar != recordvar)
+    {
+        if ((ierr = get_wmb(file, h->varid, h->ioid, recordvar, h->iodesc->ndof, &h->wmb)))
+            goto exit;
+        h->wmb_gen = file->wmb_gen;
+    }
+
+#ifdef PIO_MICRO_TIMING
+    mtimer_start(file->varlist[h->varid].wr_mtimer);
+#endif
+
+    if ((ierr = cache_darray(file, h->varid, h->iodesc, h->wmb, h->iodesc->ndof, array,
+                             h->fillvalue)))
+        goto exit;
+
+#ifdef PIO_MICRO_TIMING
+    mtimer_stop(file->varlist[h->varid].wr_mtimer, get_var_desc_str(file->pio_ncid, h->varid, NULL));
+#endif
+
+exit:
 #ifdef TIMING
     GPTLstop("PIO:PIOc_write_darray");
 #endif
+    PIO_TRACE_END("PIOc_write_darray_handle");
+    return ierr;
+}
+
+/**
+ * Write one record of a distributed array through a handle bound
+ * with PIOc_bind_darray(). This is equivalent to PIOc_setframe()
+ * followed by PIOc_write_darray(), with the local size of the
+ * decomposition as the array length, but only the per-record work is
+ * done.
+ *
+ * Like PIOc_write_darray() this function is collective on the compute
+ * tasks, since the cached data may need to be flushed, except in the
+ * thread-safe mode (see PIOc_set_threadsafe()).
+ *
+ * @param handle the id of the handle, as passed back by
+ * PIOc_bind_darray().
+ * @param frame the record written, ignored for variables without
+ * an unlimited dimension.
+ * @param array pointer to the data to be written, an array of the
+ * local size of the decomposition.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_write_darray_handle(int handle, int frame, void *array)
+{
+    pio_darray_handle_t *h;
+    file_desc_t *file;
+    int ierr = PIO_NOERR;  /* Return code. */
+
+    /* The handle is held until the write returns. */
+    if (!(h = pio_get_darray_handle(handle)) || !h->file)
+    {
+        if (h)
+            pio_put_darray_handle(h);
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Writing through write handle (%d) failed. Invalid handle, or the file or the decomposition of the handle is no longer valid", handle);
+    }
+    file = h->file;
+
+    /* Wait for the data handed off to the I/O thread, like
+     * pio_get_file() does for the other functions, since the
+     * pending byte counts of the file are reset when it is
+     * written. */
+    pio_io_thread_wait(file);
+
+    /* Only the change of record is sent to the IO tasks. */
+    if (file->varlist[h->varid].rec_var && frame != file->varlist[h->varid].record)
+        if ((ierr = PIOc_setframe(file->pio_ncid, h->varid, frame)))
+            goto exit;
+
+    if (!file->iosystem->threadsafe)
+        ierr = write_darray_handle_int(h, array);
+    else
+    {
+        pio_file_lock(file);
+        ierr = write_darray_handle_int(h, array);
+        pio_file_unlock(file);
+    }
+
+exit:
+    pio_put_darray_handle(h);
+    return ierr;
+}
+
+/**
+ * Release a write handle bound with PIOc_bind_darray(). The data
+ * written through the handle is still flushed by PIOc_sync() or
+ * PIOc_closefile(). In the thread-safe mode, a handle released while
+ * another thread writes through it is freed when the write returns.
+ *
+ * @param handle the id of the handle.
+ * @returns 0 for success, non-zero error code for failure.
+ * @ingroup PIO_write_darray
+ */
+int PIOc_unbind_darray(int handle)
+{
+    pio_darray_handle_t *h = NULL;
+    bool in_use;
+
+    LOG((1, "PIOc_unbind_darray handle = %d", handle));
+
+    PIO_LOCK();
+    if (handle >= 0 && handle < pio_num_darray_handles)
+    {
+        h = pio_darray_handles[handle];
+        pio_darray_handles[handle] = NULL;
+    }
+    if (h)
+        h->unbound = true;
+    in_use = h && h->nusers > 0;
+    PIO_UNLOCK();
+
+    if (!h)
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Releasing write handle (%d) failed. Invalid handle", handle);
+    }
+
+    /* A handle used by a concurrent write is freed by the write. */
+    if (!in_use)
+    {
+        free(h->fillvalue);
+        free(h);
+    }
+
     return PIO_NOERR;
 }
 
@@ -1629,6 +2864,7 @@ int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen,
     size_t rlen = 0;       /* the length of data in iobuf. */
     int ierr = PIO_NOERR, mpierr = MPI_SUCCESS;           /* Return code. */
     int fndims = 0;
+    double perf_time;      /* Time for the perf stats. */
 
 #ifdef TIMING
     GPTLstart("PIO:PIOc_read_darray");
@@ -1744,6 +2980,7 @@ int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen,
     }
 #endif
     /* Call the correct darray read function based on iotype. */
+    perf_time = MPI_Wtime();
     if(!ios->async || ios->ioproc)
     {
         switch (file->iotype)
@@ -1770,16 +3007,24 @@ int PIOc_read_darray(int ncid, int varid, int ioid, PIO_Offset arraylen,
         }
     }
 
+    file->varlist[varid].perf.rd_io_time += MPI_Wtime() - perf_time;
+    if (ios->ioproc)
+        file->varlist[varid].perf.rd_bytes += iodesc->llen * iodesc->mpitype_size;
+    file->varlist[varid].perf.nreads++;
+
 #ifdef PIO_MICRO_TIMING
     mtimer_start(file->varlist[varid].rd_rearr_mtimer);
 #endif
     /* Rearrange the data. */
+    perf_time = MPI_Wtime();
     if ((ierr = rearrange_io2comp(ios, iodesc, iobuf, array)))
     {
         return pio_err(ios, file, ierr, __FILE__, __LINE__,
                          "Reading variable (%s, varid=%d) from file (%s, ncid=%d) failed . Rearranging data read in the I/O processes to compute processes failed", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), file->pio_ncid);
     }
 
+    file->varlist[varid].perf.rd_rearr_time += MPI_Wtime() - perf_time;
+
 #ifdef PIO_MICRO_TIMING
     mtimer_stop(file->varlist[varid].rd_rearr_mtimer, get_var_desc_str(ncid, varid, NULL));
 #endif
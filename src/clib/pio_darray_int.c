@@ -1794,287 +1794,405 @@ int get_file_req_blocks(file_desc_t *file,
     return PIO_NOERR;
 }
 
+#ifdef _PNETCDF
+/** The pending requests of a file to wait for, possibly on the I/O
+ * thread (see PIOc_set_io_thread()). */
+typedef struct pio_wait_reqs_t
+{
+    file_desc_t *file;
+    int *reqs;
+    int nreqs;
+    int nvars_with_reqs;
+    int maxreq;
+    int *req_block_ranges;
+    int nreq_blocks;
+    void **staged_iobufs;
+    int num_staged_iobufs;
+    /* Number of waits, and time (secs) spent waiting. */
+    PIO_Offset nwaits;
+    double wait_time;
+} pio_wait_reqs_t;
+
 /**
- * Flush the output buffer. This is only relevant for files opened
- * with pnetcdf.
+ * Wait for the pending requests of a file, consolidated in blocks by
+ * get_file_req_blocks(), and release the IO buffers of the file. Only
+ * uses the communicator of the PnetCDF file, so it can run on the I/O
+ * thread. The waits are counted in the request info, not in the
+ * perf statistics of the file.
  *
- * @param file a pointer to the open file descriptor for the file
- * that will be written to
- * @param force true to force the flushing of the buffer
- * @param addsize additional size to add to buffer (in bytes)
+ * @param wr pointer to the pending requests.
  * @return 0 for success, error code otherwise.
  * @ingroup PIO_write_darray
- * @author Jim Edwards, Jayesh Krishna, Ed Hartnett
  */
-int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
+static int wait_file_reqs_int(pio_wait_reqs_t *wr)
 {
-    int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
-    int ierr = PIO_NOERR;
-
-#ifdef TIMING
-    GPTLstart("PIO:flush_output_buffer");
+    file_desc_t *file = wr->file;
+    int *reqs = wr->reqs;
+    int nreqs = wr->nreqs;
+    int nvars_with_reqs = wr->nvars_with_reqs;
+#if defined(PIO_MICRO_TIMING) || defined(MPIO_ONESIDED)
+    int maxreq = wr->maxreq;
 #endif
-#ifdef _PNETCDF
+    int *req_block_ranges = wr->req_block_ranges;
+    int nreq_blocks = wr->nreq_blocks;
+    void **staged_iobufs = wr->staged_iobufs;
+    int num_staged_iobufs = wr->num_staged_iobufs;
     var_desc_t *vdesc;
-    PIO_Offset usage = 0;
-
-    /* Check inputs. */
-    pioassert(file, "invalid input", __FILE__, __LINE__);
+    int rcnt = 0;
+    double wait_start;
+    int ierr = PIO_NOERR;
 
-    /* Find out the buffer usage. */
-    if ((ierr = ncmpi_inq_buffer_usage(file->fh, &usage)))
-	/* allow the buffer to be undefined */
-	if (ierr != NC_ENULLABUF)
-        {
-            return pio_err(NULL, file, PIO_EBADID, __FILE__, __LINE__,
-                              "Internal error flushing data written (ensuring/waiting_for all pending data is written to disk) to file (%s, ncid=%d). Unable to query the PnetCDF library buffer usage", file->fname, file->pio_ncid);
-        }
+#ifdef PIO_MICRO_TIMING
+    bool var_has_pend_reqs[maxreq + 1];
+    bool var_timer_was_running[maxreq + 1];
+    mtimer_t tmp_mt;
 
-    /* If we are not forcing a flush, spread the usage to all IO
-     * tasks. */
-    if (!force && file->iosystem->io_comm != MPI_COMM_NULL)
+    /* Temp timer to keep track of wait time */
+    tmp_mt = mtimer_create("Temp_wait_timer", file->iosystem->my_comm, "piowaitlog");
+    if(!mtimer_is_valid(tmp_mt))
     {
-        usage += addsize;
-        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &usage, 1,  MPI_OFFSET,  MPI_MAX,
-                                    file->iosystem->io_comm)))
-            return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+        LOG((1, "Unable to create a temp timer"));
+        return pio_err(file->iosystem, file, PIO_EINTERNAL, __FILE__, __LINE__,
+                          "Internal error flushing data written (ensuring/waiting_for all pending data is written to disk) to file (%s, ncid=%d). Unable to create a micro timer to measure wait/flush time", pio_get_fname_from_file(file), file->pio_ncid);
     }
 
-    /* Keep track of the maximum usage. */
-    if (usage > maxusage)
-        maxusage = usage;
-
-    /* If the user forces it, or the buffer has exceeded the size
-     * limit, then flush to disk. */
-    if (force || usage >= pio_buffer_size_limit)
+    ierr = mtimer_start(tmp_mt);
+    if(ierr != PIO_NOERR)
     {
-        int rcnt;
-        int  maxreq; /* Index of the last vdesc with pending requests */
-        int nvars_with_reqs = 0;
-        maxreq = -1;
-        rcnt = 0;
-
-        int *reqs = NULL;
-        int nreqs = 0;
-        int *req_block_ranges = NULL;
-        int nreq_blocks = 0;
-
-        ierr = get_file_req_blocks(file, 
-                &reqs, &nreqs, &nvars_with_reqs, &maxreq,
-                &req_block_ranges, &nreq_blocks);
-        if(ierr != PIO_NOERR)
-        {
-            return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
-                            "Unable to consolidate pending requests on file (%s, ncid=%d) to blocks (The function returned : Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of request blocks = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, nreq_blocks); 
-        }
-
-#ifdef PIO_MICRO_TIMING
-        bool var_has_pend_reqs[maxreq + 1];
-        bool var_timer_was_running[maxreq + 1];
-        mtimer_t tmp_mt;
-
-        /* Temp timer to keep track of wait time */
-        tmp_mt = mtimer_create("Temp_wait_timer", file->iosystem->my_comm, "piowaitlog");
-        if(!mtimer_is_valid(tmp_mt))
-        {
-            LOG((1, "Unable to create a temp timer"));
-            return pio_err(file->iosystem, file, PIO_EINTERNAL, __FILE__, __LINE__,
-                              "Internal error flushing data written (ensuring/waiting_for all pending data is written to disk) to file (%s, ncid=%d). Unable to create a micro timer to measure wait/flush time", pio_get_fname_from_file(file), file->pio_ncid);
-        }
-
-        ierr = mtimer_start(tmp_mt);
-        if(ierr != PIO_NOERR)
-        {
-            LOG((1, "Unable to start the temp wait timer"));
-            return ierr;
-        }
+        LOG((1, "Unable to start the temp wait timer"));
+        return ierr;
+    }
 
-        for (int i = 0; i <= maxreq; i++)
+    for (int i = 0; i <= maxreq; i++)
+    {
+        vdesc = file->varlist + i;
+        /* Pause all timers, the temp wait timer is used to keep
+         * track of wait time
+         */
+        var_timer_was_running[i] = false;
+        var_has_pend_reqs[i] = (vdesc->nreqs > 0) ? true : false;
+        if(mtimer_is_valid(vdesc->wr_mtimer))
         {
-            vdesc = file->varlist + i;
-            /* Pause all timers, the temp wait timer is used to keep
-             * track of wait time
-             */
-            var_timer_was_running[i] = false;
-            var_has_pend_reqs[i] = (vdesc->nreqs > 0) ? true : false;
-            if(mtimer_is_valid(vdesc->wr_mtimer))
+            ierr = mtimer_pause(vdesc->wr_mtimer, &(var_timer_was_running[i]));
+            if(ierr != PIO_NOERR)
             {
-                ierr = mtimer_pause(vdesc->wr_mtimer, &(var_timer_was_running[i]));
-                if(ierr != PIO_NOERR)
-                {
-                    LOG((1, "Unable to pause the timer"));
-                    return ierr;
-                }
+                LOG((1, "Unable to pause the timer"));
+                return ierr;
             }
         }
+    }
 #endif
 
+    wait_start = MPI_Wtime();
 #ifdef MPIO_ONESIDED
-        int *request = reqs;
-        int status[nreqs];
-        rcnt = 0;
-        for (int i = 0; i <= maxreq; i++)
-        {
-            vdesc = file->varlist + i;
-            /* Onesided optimization requires that all of the requests
-             * in a wait_all call represent a contiguous block of data
-             * in the file
-             */
-            if (rcnt > 0 && (prev_record != vdesc->record || vdesc->nreqs==0))
-            {
-                ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
-                if(ierr != PIO_NOERR)
-                {
-                    return pio_err(file->iosystem, file, ierr,
-                                    __FILE__, __LINE__,
-                                    "Waiting on pending requests on file (%s, ncid=%d) failed (Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of requests currently being waited on = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, rcnt); 
-                }
-
-                request += rcnt;
-                rcnt = 0;
-            }
-            rcnt += vdesc->nreqs;
-            prev_record = vdesc->record;
-        }
-        if (rcnt > 0)
+    int *request = reqs;
+    int status[nreqs];
+    rcnt = 0;
+    for (int i = 0; i <= maxreq; i++)
+    {
+        vdesc = file->varlist + i;
+        /* Onesided optimization requires that all of the requests
+         * in a wait_all call represent a contiguous block of data
+         * in the file
+         */
+        if (rcnt > 0 && (prev_record != vdesc->record || vdesc->nreqs==0))
         {
+            PIO_TRACE_BEGIN("ncmpi_wait_all");
             ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
+            PIO_TRACE_END("ncmpi_wait_all");
+            wr->nwaits++;
             if(ierr != PIO_NOERR)
             {
                 return pio_err(file->iosystem, file, ierr,
                                 __FILE__, __LINE__,
                                 "Waiting on pending requests on file (%s, ncid=%d) failed (Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of requests currently being waited on = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, rcnt); 
             }
-        }
-#else /* MPIO_ONESIDED */
-        int *request = reqs;
-        int status[nreqs];
-        rcnt = 0;
-        int *req_block_starts = req_block_ranges;
-        int *req_block_ends = req_block_ranges + nreq_blocks;
-        for(int k = 0; k < nreq_blocks; k++)
-        {
-            assert(req_block_ends[k] >= req_block_starts[k]);
-            rcnt = req_block_ends[k] - req_block_starts[k] + 1;
 
-            LOG((1, "ncmpi_wait_all(file=%s, ncid=%d, request range = [%d, %d], num pending requests = %d)", pio_get_fname_from_file(file), file->pio_ncid, req_block_starts[k], req_block_ends[k], nreqs));
-            ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
-            if(ierr != PIO_NOERR)
-            {
-                return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
-                                "Waiting on pending requests on file (%s, ncid=%d) failed (Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of request blocks = %d, Current block being waited on = %d, Number of requests in current block = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, nreq_blocks, k, rcnt); 
-            }
             request += rcnt;
+            rcnt = 0;
         }
-#endif /* MPIO_ONESIDED */
-        free(reqs);
-        free(req_block_ranges);
-
-#ifdef PIO_MICRO_TIMING
-        ierr = mtimer_pause(tmp_mt, NULL);
+        rcnt += vdesc->nreqs;
+        prev_record = vdesc->record;
+    }
+    if (rcnt > 0)
+    {
+        PIO_TRACE_BEGIN("ncmpi_wait_all");
+        ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
+        PIO_TRACE_END("ncmpi_wait_all");
+        wr->nwaits++;
         if(ierr != PIO_NOERR)
         {
-            LOG((1, "Unable to pause temp wait timer"));
-            return ierr;
+            return pio_err(file->iosystem, file, ierr,
+                            __FILE__, __LINE__,
+                            "Waiting on pending requests on file (%s, ncid=%d) failed (Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of requests currently being waited on = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, rcnt); 
         }
-
-        /* Get the total wait time */
-        double wait_time = 0;
-        ierr = mtimer_get_wtime(tmp_mt, &wait_time);
+    }
+#else /* MPIO_ONESIDED */
+    int *request = reqs;
+    int status[nreqs];
+    rcnt = 0;
+    int *req_block_starts = req_block_ranges;
+    int *req_block_ends = req_block_ranges + nreq_blocks;
+    for(int k = 0; k < nreq_blocks; k++)
+    {
+        assert(req_block_ends[k] >= req_block_starts[k]);
+        rcnt = req_block_ends[k] - req_block_starts[k] + 1;
+
+        LOG((1, "ncmpi_wait_all(file=%s, ncid=%d, request range = [%d, %d], num pending requests = %d)", pio_get_fname_from_file(file), file->pio_ncid, req_block_starts[k], req_block_ends[k], nreqs));
+        PIO_TRACE_BEGIN("ncmpi_wait_all");
+        ierr = ncmpi_wait_all(file->fh, rcnt, request, status);
+        PIO_TRACE_END("ncmpi_wait_all");
+        wr->nwaits++;
         if(ierr != PIO_NOERR)
         {
-            LOG((1, "Error trying to get wallclock time (temp wait timer)"));
-            return ierr;
+            return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
+                            "Waiting on pending requests on file (%s, ncid=%d) failed (Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of request blocks = %d, Current block being waited on = %d, Number of requests in current block = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, nreq_blocks, k, rcnt); 
         }
+        request += rcnt;
+    }
+#endif /* MPIO_ONESIDED */
+    wr->wait_time += MPI_Wtime() - wait_start;
 
-        ierr = mtimer_destroy(&tmp_mt);
-        if(ierr != PIO_NOERR)
-        {
-            LOG((1, "Destroying temp wait timer failed"));
-            /* Continue */
-        }
+#ifdef PIO_MICRO_TIMING
+    ierr = mtimer_pause(tmp_mt, NULL);
+    if(ierr != PIO_NOERR)
+    {
+        LOG((1, "Unable to pause temp wait timer"));
+        return ierr;
+    }
 
-        /* Find avg wait time per variable */
-        wait_time /= (nvars_with_reqs > 0) ? nvars_with_reqs : 1;
+    /* Get the total wait time */
+    double wait_time = 0;
+    ierr = mtimer_get_wtime(tmp_mt, &wait_time);
+    if(ierr != PIO_NOERR)
+    {
+        LOG((1, "Error trying to get wallclock time (temp wait timer)"));
+        return ierr;
+    }
 
-        /* Update timers for vars with pending ops (with the avg
-         * wait time)
-         */
-        for (int i = 0; i <= maxreq; i++)
+    ierr = mtimer_destroy(&tmp_mt);
+    if(ierr != PIO_NOERR)
+    {
+        LOG((1, "Destroying temp wait timer failed"));
+        /* Continue */
+    }
+
+    /* Find avg wait time per variable */
+    wait_time /= (nvars_with_reqs > 0) ? nvars_with_reqs : 1;
+
+    /* Update timers for vars with pending ops (with the avg
+     * wait time)
+     */
+    for (int i = 0; i <= maxreq; i++)
+    {
+        vdesc = file->varlist + i;
+        if(var_has_pend_reqs[i] && mtimer_is_valid(vdesc->wr_mtimer))
         {
-            vdesc = file->varlist + i;
-            if(var_has_pend_reqs[i] && mtimer_is_valid(vdesc->wr_mtimer))
+            ierr = mtimer_update(vdesc->wr_mtimer, wait_time);
+            if(ierr != PIO_NOERR)
             {
-                ierr = mtimer_update(vdesc->wr_mtimer, wait_time);
+                LOG((1, "Unable to update variable write timer"));
+                return ierr;
+            }
+
+            /* Wait complete - no more async events in progress */
+            ierr = mtimer_async_event_in_progress(vdesc->wr_mtimer, false);
+            if(ierr != PIO_NOERR)
+            {
+                LOG((1, "Unable to disable async events for var"));
+                return ierr;
+            }
+            /* If timer was already running, restart it or else flush it */
+            if(var_timer_was_running[i])
+            {
+                ierr = mtimer_resume(vdesc->wr_mtimer);
                 if(ierr != PIO_NOERR)
                 {
-                    LOG((1, "Unable to update variable write timer"));
+                    LOG((1, "Unable to resume variable write timer"));
                     return ierr;
                 }
-
-                /* Wait complete - no more async events in progress */
-                ierr = mtimer_async_event_in_progress(vdesc->wr_mtimer, false);
+            }
+            else
+            {
+                ierr = mtimer_flush(vdesc->wr_mtimer,
+                        get_var_desc_str(file->pio_ncid, vdesc->varid, NULL));
                 if(ierr != PIO_NOERR)
                 {
-                    LOG((1, "Unable to disable async events for var"));
+                    LOG((1, "Unable to flush timer"));
                     return ierr;
                 }
-                /* If timer was already running, restart it or else flush it */
-                if(var_timer_was_running[i])
-                {
-                    ierr = mtimer_resume(vdesc->wr_mtimer);
-                    if(ierr != PIO_NOERR)
-                    {
-                        LOG((1, "Unable to resume variable write timer"));
-                        return ierr;
-                    }
-                }
-                else
-                {
-                    ierr = mtimer_flush(vdesc->wr_mtimer,
-                            get_var_desc_str(file->pio_ncid, vdesc->varid, NULL));
-                    if(ierr != PIO_NOERR)
-                    {
-                        LOG((1, "Unable to flush timer"));
-                        return ierr;
-                    }
-                }
             }
         }
+    }
 #endif
 
-        /* Release resources. */
-        for (int i = 0; i < PIO_IODESC_MAX_IDS; i++)
+    /* Release resources. */
+    for (int i = 0; i < PIO_IODESC_MAX_IDS; i++)
+    {
+        if (file->iobuf[i])
         {
-            if (file->iobuf[i])
-            {
-                LOG((3,"freeing variable buffer in flush_output_buffer"));
-                brel(file->iobuf[i]);
-                file->iobuf[i] = NULL;
-            }
+            LOG((3,"freeing variable buffer in flush_output_buffer"));
+            brel(file->iobuf[i]);
+            file->iobuf[i] = NULL;
         }
-        for (int i = 0; i < PIO_MAX_VARS; i++)
+    }
+    for (int i = 0; i < num_staged_iobufs; i++)
+        brel(staged_iobufs[i]);
+    free(staged_iobufs);
+    for (int i = 0; i < PIO_MAX_VARS; i++)
+    {
+        vdesc = file->varlist + i;
+        vdesc->wb_pend = 0;
+        if (vdesc->nreqs > 0)
         {
-            vdesc = file->varlist + i;
-            vdesc->wb_pend = 0;
-            if (vdesc->nreqs > 0)
-            {
-                assert(vdesc->request && vdesc->request_sz);
-                free(vdesc->request);
-                free(vdesc->request_sz);
+            assert(vdesc->request && vdesc->request_sz);
+            free(vdesc->request);
+            free(vdesc->request_sz);
 
-                vdesc->request = NULL;
-                vdesc->request_sz = NULL;
-                vdesc->nreqs = 0;
-            }
+            vdesc->request = NULL;
+            vdesc->request_sz = NULL;
+            vdesc->nreqs = 0;
+        }
   
-            if (vdesc->fillbuf)
-            {
-                brel(vdesc->fillbuf);
-                vdesc->fillbuf = NULL;
-            }
+        if (vdesc->fillbuf)
+        {
+            brel(vdesc->fillbuf);
+            vdesc->fillbuf = NULL;
+        }
+    }
+    file->wb_pend = 0;
+
+    free(reqs);
+    free(req_block_ranges);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Wait for the pending requests of a file (see wait_file_reqs_int()),
+ * the job handed off to the I/O thread. The waits are kept in the
+ * file, and added to its perf statistics by pio_io_thread_finish() on
+ * the thread that flushed the file. Frees the request info.
+ *
+ * @param arg pointer to the pio_wait_reqs_t with the pending
+ * requests.
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ */
+static int wait_file_reqs(void *arg)
+{
+    pio_wait_reqs_t *wr = (pio_wait_reqs_t *)arg;
+    file_desc_t *file = wr->file;
+    int ierr;
+
+    ierr = wait_file_reqs_int(wr);
+    file->io_thread_nwaits += wr->nwaits;
+    file->io_thread_wait_time += wr->wait_time;
+    free(wr);
+
+    return ierr;
+}
+#endif /* _PNETCDF */
+
+/**
+ * Flush the output buffer. This is only relevant for files opened
+ * with pnetcdf. If the IO system has an I/O thread, the wait for the
+ * pending requests is handed off to it (see PIOc_set_io_thread()).
+ *
+ * @param file a pointer to the open file descriptor for the file
+ * that will be written to
+ * @param force true to force the flushing of the buffer
+ * @param addsize additional size to add to buffer (in bytes)
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_write_darray
+ * @author Jim Edwards, Jayesh Krishna, Ed Hartnett
+ */
+int flush_output_buffer(file_desc_t *file, bool force, PIO_Offset addsize)
+{
+    int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
+    int ierr = PIO_NOERR;
+
+#ifdef TIMING
+    GPTLstart("PIO:flush_output_buffer");
+#endif
+#ifdef _PNETCDF
+    PIO_Offset usage = 0;
+
+    /* Check inputs. */
+    pioassert(file, "invalid input", __FILE__, __LINE__);
+
+    /* Wait for the previous flush handed off to the I/O thread. */
+    if ((ierr = pio_io_thread_finish(file)))
+    {
+        return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
+                        "Flushing data written to file (%s, ncid=%d) failed. Waiting on the pending requests on the I/O thread failed", pio_get_fname_from_file(file), file->pio_ncid);
+    }
+
+    /* Find out the buffer usage. */
+    if ((ierr = ncmpi_inq_buffer_usage(file->fh, &usage)))
+	/* allow the buffer to be undefined */
+	if (ierr != NC_ENULLABUF)
+        {
+            return pio_err(NULL, file, PIO_EBADID, __FILE__, __LINE__,
+                              "Internal error flushing data written (ensuring/waiting_for all pending data is written to disk) to file (%s, ncid=%d). Unable to query the PnetCDF library buffer usage", file->fname, file->pio_ncid);
         }
-        file->wb_pend = 0;
+
+    /* If we are not forcing a flush, spread the usage to all IO
+     * tasks. */
+    if (!force && file->iosystem->io_comm != MPI_COMM_NULL)
+    {
+        usage += addsize;
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &usage, 1,  MPI_OFFSET,  MPI_MAX,
+                                    file->iosystem->io_comm)))
+            return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+    }
+
+    /* Keep track of the maximum usage. */
+    if (usage > maxusage)
+        maxusage = usage;
+
+    /* If the user forces it, or the buffer has exceeded the size
+     * limit, then flush to disk. */
+    if (force || usage >= pio_buffer_size_limit)
+    {
+        pio_wait_reqs_t *wr;
+
+        if (!(wr = calloc(1, sizeof(pio_wait_reqs_t))))
+        {
+            return pio_err(file->iosystem, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Internal error flushing data written to file (%s, ncid=%d). Out of memory allocating %lld bytes for the pending requests", pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long)sizeof(pio_wait_reqs_t));
+        }
+        wr->file = file;
+        wr->maxreq = -1;
+
+        ierr = get_file_req_blocks(file, 
+                &wr->reqs, &wr->nreqs, &wr->nvars_with_reqs, &wr->maxreq,
+                &wr->req_block_ranges, &wr->nreq_blocks);
+        if(ierr != PIO_NOERR)
+        {
+            int nreqs = wr->nreqs, nvars_with_reqs = wr->nvars_with_reqs, nreq_blocks = wr->nreq_blocks;
+
+            free(wr);
+            return pio_err(file->iosystem, file, ierr, __FILE__, __LINE__,
+                            "Unable to consolidate pending requests on file (%s, ncid=%d) to blocks (The function returned : Number of pending requests on file = %d, Number of variables with pending requests = %d, Number of request blocks = %d).", pio_get_fname_from_file(file), file->pio_ncid, nreqs, nvars_with_reqs, nreq_blocks); 
+        }
+
+        /* The staged buffers are released with the requests. */
+        wr->staged_iobufs = file->staged_iobufs;
+        wr->num_staged_iobufs = file->num_staged_iobufs;
+        file->staged_iobufs = NULL;
+        file->num_staged_iobufs = 0;
+        file->staged_iobufs_sz = 0;
+        PIO_LOCK();
+        file->iosystem->staged_bytes -= file->staged_bytes;
+        PIO_UNLOCK();
+        file->staged_bytes = 0;
+
+        /* The consolidation above is collective on the IO tasks, the
+         * wait only uses the PnetCDF file, and is handed off to the
+         * I/O thread if there is one. */
+        if ((ierr = pio_io_thread_submit(file, wait_file_reqs, wr)))
+            return ierr;
     }
 
 #endif /* _PNETCDF */
@@ -2149,14 +2267,16 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
 #ifdef TIMING
     GPTLstart("PIO:flush_buffer");
 #endif
+    PIO_TRACE_BEGIN("flush_buffer");
     /* Check input. */
     pioassert(wmb, "invalid input", __FILE__, __LINE__);
 
     /* Get the file info (to get error handler). */
     if ((ret = pio_get_file(ncid, &file)))
     {
-        return pio_err(NULL, NULL, ret, __FILE__, __LINE__,
+        ret = pio_err(NULL, NULL, ret, __FILE__, __LINE__,
                         "Internal error flushing data cached in a write multi buffer to %s. Invalid file id (ncid=%d) provided", (flushtodisk) ? "disk" : "I/O processes", ncid);
+        goto exit;
     }
 
     LOG((1, "flush_buffer ncid = %d flushtodisk = %d", ncid, flushtodisk));
@@ -2164,11 +2284,13 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
     /* If there are any variables in this buffer... */
     if (wmb->num_arrays > 0)
     {
+        file->perf.nflushes++;
+
         /* Write any data in the buffer. */
-        ret = PIOc_write_darray_multi(ncid, wmb->vid,  wmb->ioid, wmb->num_arrays,
-                                      wmb->arraylen, wmb->data, wmb->frame,
-                                      wmb->fillvalue, flushtodisk);
-        LOG((2, "return from PIOc_write_darray_multi ret = %d", ret));
+        ret = write_darray_multi_int(ncid, wmb->vid,  wmb->ioid, wmb->num_arrays,
+                                     wmb->arraylen, wmb->data, wmb->udata, wmb->frame,
+                                     wmb->fillvalue, flushtodisk);
+        LOG((2, "return from write_darray_multi_int ret = %d", ret));
 
         wmb->num_arrays = 0;
 
@@ -2180,6 +2302,10 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
         brel(wmb->data);
         wmb->data = NULL;
 
+        /* Release the pointers to user data. */
+        free(wmb->udata);
+        wmb->udata = NULL;
+
         /* If there is a fill value, release it. */
         if (wmb->fillvalue)
             brel(wmb->fillvalue);
@@ -2192,15 +2318,18 @@ int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk)
 
         if (ret)
         {
-            return pio_err(NULL, file, ret, __FILE__, __LINE__,
+            ret = pio_err(NULL, file, ret, __FILE__, __LINE__,
                         "Internal error flushing data cached in a write multi buffer to file (%s, ncid=%d). Error while flushing data to %s. Internal error flushing arrays (%d) in the write multi buffer", pio_get_fname_from_file(file), file->pio_ncid, (flushtodisk) ? "disk" : "I/O processes", wmb->num_arrays);
+            goto exit;
         }
     }
 
+exit:
 #ifdef TIMING
     GPTLstop("PIO:flush_buffer");
 #endif
-    return PIO_NOERR;
+    PIO_TRACE_END("flush_buffer");
+    return ret;
 }
 
 /**
@@ -59,6 +59,36 @@ int PIOc_openfile2(int iosysid, int *ncidp, int *iotype, const char *filename,
     return openfile_int(iosysid, ncidp, iotype, filename, mode, 0);
 }
 
+/**
+ * Open several existing files at once using PIO library.
+ *
+ * This is like calling PIOc_openfile() for each file, including the
+ * retry as netCDF serial, but the compute tasks send a single
+ * asynchronous message for all the files, and the open modes and
+ * unlimited dimensions of all the files are shared with a single
+ * broadcast. The files are still opened one after the other by the
+ * low level I/O library on the IO tasks: the open calls of netCDF and
+ * PnetCDF are blocking and collective on the IO communicator, so
+ * they can not be overlapped. Input parameters are read on comp task
+ * 0 and ignored elsewhere.
+ *
+ * @param iosysid : A defined pio system descriptor (input)
+ * @param nfiles : The number of files to open (input)
+ * @param ncids : Array of nfiles that gets the pio file descriptors
+ * (output)
+ * @param iotype : A pio output format, used for all the files (input)
+ * @param filenames : Array of nfiles with the filenames to open
+ * @param mode : The netcdf mode for the open operations
+ * @return 0 for success, error code otherwise. If any file could not
+ * be opened, none of the files is left open.
+ * @ingroup PIO_openfile
+ */
+int PIOc_openfiles(int iosysid, int nfiles, int *ncids, int *iotype, const char **filenames,
+                   int mode)
+{
+    return openfiles_int(iosysid, nfiles, ncids, iotype, filenames, mode, 1);
+}
+
 /**
  * Open an existing file using PIO library.
  *
@@ -140,28 +170,22 @@ int PIOc_createfile(int iosysid, int *ncidp, int *iotype, const char *filename,
         GPTLstart("PIO:PIOc_createfile_adios"); /* TAHSIN: start */
 #endif
 #endif
+    PIO_TRACE_BEGIN("PIOc_createfile");
 
     /* Get the IO system info from the id. */
     if (!(ios = pio_get_iosystem_from_id(iosysid)))
     {
-        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+        ret = pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
                         "Unable to create file (%s, mode = %d, iotype=%s). Invalid arguments provided, invalid iosystem id (iosysid = %d)", (filename) ? filename : "NULL", mode, (!iotype) ? "UNKNOWN" : pio_iotype_to_string(*iotype), iosysid);
+        goto exit;
     }
 
     /* Create the file. */
     if ((ret = PIOc_createfile_int(iosysid, ncidp, iotype, filename, mode)))
     {
-#ifdef TIMING
-        GPTLstop("PIO:PIOc_createfile");
-
-#ifdef _ADIOS2 /* TAHSIN: timing */
-        if (*iotype == PIO_IOTYPE_ADIOS)
-            GPTLstop("PIO:PIOc_createfile_adios"); /* TAHSIN: stop */
-#endif
-#endif
-
-        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+        ret = pio_err(ios, NULL, ret, __FILE__, __LINE__,
                         "Unable to create file (%s, mode = %d, iotype=%s) on iosystem (iosystem id = %d). Internal error creating the file", (filename) ? filename : "NULL", mode, (!iotype) ? "UNKNOWN" : pio_iotype_to_string(*iotype), iosysid);
+        goto exit;
     }
 
     /* Run this on all tasks if async is not in use, but only on
@@ -173,11 +197,13 @@ int PIOc_createfile(int iosysid, int *ncidp, int *iotype, const char *filename,
         /* Set the fill mode to NOFILL. */
         if ((ret = PIOc_set_fill(*ncidp, NC_NOFILL, NULL)))
         {
-            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+            ret = pio_err(ios, NULL, ret, __FILE__, __LINE__,
                             "Unable to create file (%s, mode = %d, iotype=%s) on iosystem (iosystem id = %d). Setting fill mode to NOFILL failed.", (filename) ? filename : "NULL", mode, (!iotype) ? "UNKNOWN" : pio_iotype_to_string(*iotype), iosysid);
+            goto exit;
         }
     }
 
+exit:
 #ifdef TIMING
     GPTLstop("PIO:PIOc_createfile");
 
@@ -186,10 +212,69 @@ int PIOc_createfile(int iosysid, int *ncidp, int *iotype, const char *filename,
         GPTLstop("PIO:PIOc_createfile_adios"); /* TAHSIN: stop */
 #endif
 #endif
+    PIO_TRACE_END("PIOc_createfile");
 
     return ret;
 }
 
+/**
+ * Create several new files using pio, as with PIOc_createfile() for
+ * each file. Input parameters are read on comp task 0 and ignored
+ * elsewhere.
+ *
+ * Unlike PIOc_openfiles(), the files are created one after the other
+ * with PIOc_createfile(), each with its own asynchronous message and
+ * broadcasts. Creating a file reads no header to share, only its
+ * error code and mode, and the cost of the create is the blocking
+ * collective create of the low level I/O library, which a batch can
+ * not overlap. The call only saves the per-file calls of the user
+ * and closes the files already created if a create fails.
+ *
+ * @param iosysid A defined pio system ID.
+ * @param nfiles The number of files to create.
+ * @param ncids Array of nfiles that gets the ncids of the newly
+ * created files.
+ * @param iotype A pointer to a pio output format, used for all the
+ * files.
+ * @param filenames Array of nfiles with the filenames to create.
+ * @param mode The netcdf mode for the create operations.
+ * @returns 0 for success, error code otherwise. If any file could not
+ * be created, the files created before it are closed.
+ * @ingroup PIO_createfile
+ */
+int PIOc_createfiles(int iosysid, int nfiles, int *ncids, int *iotype, const char **filenames,
+                     int mode)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    int ret;               /* Return code from function calls. */
+
+    /* Get the IO system info from the id. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Unable to create %d files. Invalid arguments provided, invalid iosystem id (iosysid = %d)", nfiles, iosysid);
+    }
+
+    if (nfiles <= 0 || !ncids || !filenames)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Unable to create %d files on iosystem (iosystem id = %d). Invalid arguments provided. nfiles is %d (expected > 0), ncids is %s (expected not NULL), filenames is %s (expected not NULL)", nfiles, iosysid, nfiles, PIO_IS_NULL(ncids), PIO_IS_NULL(filenames));
+    }
+
+    for (int f = 0; f < nfiles; f++)
+    {
+        if ((ret = PIOc_createfile(iosysid, &ncids[f], iotype, filenames[f], mode)))
+        {
+            for (int c = 0; c < f; c++)
+                PIOc_closefile(ncids[c]);
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Unable to create %d files on iosystem (iosystem id = %d). Creating file %d (%s) failed", nfiles, iosysid, f, (filenames[f]) ? filenames[f] : "NULL");
+        }
+    }
+
+    return PIO_NOERR;
+}
+
 /**
  * Open a new file using pio. The default fill mode will be used (FILL
  * for netCDF and netCDF-4 formats, NOFILL for pnetcdf.) Input
@@ -268,6 +353,15 @@ static int sync_file(int ncid)
         {
             wmulti_buffer *wmb, *twmb;
 
+            /* In the thread-safe mode the data was cached in any
+             * order, flush it in the same order on all tasks. */
+            if (ios->threadsafe)
+                if ((ierr = pio_order_wmb_list(file)))
+                {
+                    return pio_err(ios, file, ierr, __FILE__, __LINE__,
+                                    "Syncing file (%s, ncid=%d) failed. Sorting the data cached in the write multi buffers failed", pio_get_fname_from_file(file), ncid);
+                }
+
             LOG((3, "sync_file checking buffers"));
             wmb = &file->buffer;
             while (wmb)
@@ -288,6 +382,7 @@ static int sync_file(int ncid)
                     free(twmb);
                 }
             }
+            file->wmb_gen++;
         }
     }
 
@@ -336,6 +431,9 @@ static int sync_file(int ncid)
 #ifdef _PNETCDF
             case PIO_IOTYPE_PNETCDF:
                 ierr = flush_output_buffer(file, true, 0);
+                /* Return once the I/O thread has written the data. */
+                if (ierr == PIO_NOERR)
+                    ierr = pio_io_thread_finish(file);
                 break;
 #endif
             default:
@@ -376,13 +474,15 @@ int PIOc_closefile(int ncid)
 #ifdef TIMING
     GPTLstart("PIO:PIOc_closefile");
 #endif
+    PIO_TRACE_BEGIN("PIOc_closefile");
     LOG((1, "PIOc_closefile ncid = %d", ncid));
 
     /* Find the info about this file. */
     if ((ierr = pio_get_file(ncid, &file)))
     {
-        return pio_err(NULL, NULL, ierr, __FILE__, __LINE__,
+        ierr = pio_err(NULL, NULL, ierr, __FILE__, __LINE__,
                         "Closing file failed. Invalid file id (ncid=%d) provided", ncid);
+        goto exit;
     }
     ios = file->iosystem;
 
@@ -402,6 +502,17 @@ int PIOc_closefile(int ncid)
         if (file->mode & PIO_WRITE)
             sync_file(ncid);
 
+    /* The write handles bound to the file can no longer be used. */
+    pio_release_darray_handles(file, NULL);
+
+    /* Wait for the data handed off to the I/O thread to be written. */
+    if ((ierr = pio_io_thread_finish(file)))
+    {
+        ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
+                        "Closing file (%s, ncid=%d) failed. Writing the data handed off to the I/O thread failed", pio_get_fname_from_file(file), ncid);
+        goto exit;
+    }
+
     /* If async is in use and this is a comp tasks, then the compmaster
      * sends a msg to the pio_msg_handler running on the IO master and
      * waiting for a message. Then broadcast the ncid over the intercomm
@@ -413,8 +524,9 @@ int PIOc_closefile(int ncid)
         PIO_SEND_ASYNC_MSG(ios, msg, &ierr, ncid);
         if(ierr != PIO_NOERR)
         {
-            return pio_err(ios, file, ierr, __FILE__, __LINE__,
+            ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
                             "Closing file (%s, ncid=%d) failed. Error sending async msg PIO_MSG_CLOSE_FILE", pio_get_fname_from_file(file), ncid);
+            goto exit;
         }
     }
 
@@ -432,14 +544,16 @@ int PIOc_closefile(int ncid)
                 attributeH = adios2_define_attribute(file->ioH, "/__pio__/fillmode", adios2_type_int32_t, &file->fillmode);
                 if (attributeH == NULL)
                 {
-                    return pio_err(ios, file, PIO_EADIOS2ERR, __FILE__, __LINE__, "Defining (ADIOS) attribute (name=/__pio__/fillmode) failed for file (%s, ncid=%d)", pio_get_fname_from_file(file), file->pio_ncid);
+                    ierr = pio_err(ios, file, PIO_EADIOS2ERR, __FILE__, __LINE__, "Defining (ADIOS) attribute (name=/__pio__/fillmode) failed for file (%s, ncid=%d)", pio_get_fname_from_file(file), file->pio_ncid);
+                    goto exit;
                 }
             }
 
             adios2_error adiosErr = adios2_close(file->engineH);
             if (adiosErr != adios2_error_none)
             {
-                return pio_err(ios, file, PIO_EADIOS2ERR, __FILE__, __LINE__, "Closing (ADIOS) file (%s, ncid=%d) failed (adios2_error=%s)", pio_get_fname_from_file(file), file->pio_ncid, adios2_error_to_string(adiosErr));
+                ierr = pio_err(ios, file, PIO_EADIOS2ERR, __FILE__, __LINE__, "Closing (ADIOS) file (%s, ncid=%d) failed (adios2_error=%s)", pio_get_fname_from_file(file), file->pio_ncid, adios2_error_to_string(adiosErr));
+                goto exit;
             }
 
             file->engineH = NULL;
@@ -495,8 +609,9 @@ int PIOc_closefile(int ncid)
         LOG((1, "DONE CONVERTING: %s", file->filename));
         if (ierr != PIO_NOERR)
         {
-            return pio_err(ios, file, ierr, __FILE__, __LINE__,
+            ierr = pio_err(ios, file, ierr, __FILE__, __LINE__,
                             "C_API_ConvertBPToNC(infile = %s, outfile = %s, piotype = %s) failed", file->filename, outfilename, conv_iotype);
+            goto exit;
         }
 #endif
 
@@ -513,11 +628,8 @@ int PIOc_closefile(int ncid)
         /* Delete file from our list of open files. */
         pio_delete_file_from_list(ncid);
 
-#ifdef TIMING
-        GPTLstop("PIO:PIOc_closefile");
-#endif
-
-        return PIO_NOERR;
+        ierr = PIO_NOERR;
+        goto exit;
     }
 #endif
 
@@ -547,16 +659,30 @@ int PIOc_closefile(int ncid)
             break;
 #endif
         default:
-            return pio_err(ios, file, PIO_EBADIOTYPE, __FILE__, __LINE__,
+            ierr = pio_err(ios, file, PIO_EBADIOTYPE, __FILE__, __LINE__,
                             "Closing file (%s, ncid=%d) failed. Unsupported iotype (%d) specified", pio_get_fname_from_file(file), file->pio_ncid, file->iotype);
+            goto exit;
         }
     }
 
     ierr = check_netcdf(NULL, file, ierr, __FILE__, __LINE__);
     if(ierr != PIO_NOERR){
         LOG((1, "nc*_close failed, ierr = %d", ierr));
-        return pio_err(NULL, file, ierr, __FILE__, __LINE__,
+        ierr = pio_err(NULL, file, ierr, __FILE__, __LINE__,
                         "Closing file (%s, ncid=%d) failed. Underlying I/O library (iotype=%s) call failed", pio_get_fname_from_file(file), file->pio_ncid, pio_iotype_to_string(file->iotype));
+        goto exit;
+    }
+
+    /* Write the I/O performance report of the file. */
+    if (ios->perf_report != PIO_PERF_REPORT_NONE)
+    {
+        ierr = pio_write_perf_report(file);
+        if(ierr != PIO_NOERR)
+        {
+            ierr = pio_err(NULL, file, ierr, __FILE__, __LINE__,
+                            "Closing file (%s, ncid=%d) failed. Writing the I/O performance report of the file failed", pio_get_fname_from_file(file), file->pio_ncid);
+            goto exit;
+        }
     }
 
 #ifdef TIMING
@@ -567,9 +693,11 @@ int PIOc_closefile(int ncid)
     /* Delete file from our list of open files. */
     pio_delete_file_from_list(ncid);
 
+exit:
 #ifdef TIMING
     GPTLstop("PIO:PIOc_closefile");
 #endif
+    PIO_TRACE_END("PIOc_closefile");
     return ierr;
 }
 
@@ -654,6 +782,10 @@ int PIOc_deletefile(int iosysid, const char *filename)
  * HREF="http://www.unidata.ucar.edu/software/netcdf/docs/modules.html"
  * target="_blank"> netcdf </A> documentation.
  *
+ * If the IO system has an I/O thread, the call also waits for the
+ * I/O thread to write the data of the file, and returns the errors
+ * of the writes handed off to it (see PIOc_set_io_thread()).
+ *
  * @param ncid the ncid of the file to sync.
  * @returns PIO_NOERR for success, error code otherwise.
  * @author Jim Edwards, Ed Hartnett
@@ -55,6 +55,29 @@ void pio_log(int severity, const char *fmt, ...);
 #define LOG(e)
 #endif /* PIO_ENABLE_LOGGING */
 
+#ifdef PIO_TRACE
+extern int pio_trace_enabled;
+void pio_trace_event(const char *name, char ph);
+#define PIO_TRACE_BEGIN(name) do { if (pio_trace_enabled) pio_trace_event((name), 'B'); } while (0)
+#define PIO_TRACE_END(name) do { if (pio_trace_enabled) pio_trace_event((name), 'E'); } while (0)
+#else
+#define PIO_TRACE_BEGIN(name)
+#define PIO_TRACE_END(name)
+#endif /* PIO_TRACE */
+
+#if PIO_USE_THREADSAFE
+void pio_lock(void);
+void pio_unlock(void);
+int pio_thread_id(void);
+#define PIO_LOCK() pio_lock()
+#define PIO_UNLOCK() pio_unlock()
+#define PIO_THREAD_ID() pio_thread_id()
+#else
+#define PIO_LOCK()
+#define PIO_UNLOCK()
+#define PIO_THREAD_ID() 0
+#endif /* PIO_USE_THREADSAFE */
+
 #define max(a,b)                                \
     ({ __typeof__ (a) _a = (a);                 \
         __typeof__ (b) _b = (b);                \
@@ -73,6 +96,10 @@ void pio_log(int severity, const char *fmt, ...);
  * internally. */
 #define PIO_LONG_INTERNAL 13
 
+/** FNV-1a offset basis and prime (see pio_fnv_hash()). */
+#define PIO_FNV_BASIS 14695981039346656037ULL
+#define PIO_FNV_PRIME 1099511628211ULL
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -130,11 +157,13 @@ extern "C" {
     int  pio_add_to_iodesc_list(io_desc_t *iodesc, MPI_Comm comm);
     io_desc_t *pio_get_iodesc_from_id(int ioid);
     int pio_delete_iodesc_from_list(int ioid);
+    io_desc_t *pio_find_iodesc(int iosysid, int pio_type, int ndims, const int *dimlen);
+    io_desc_t *pio_find_shared_iodesc(io_desc_t *iodesc);
     int pio_num_iosystem(int *niosysid);
 
     int pio_get_file(int ncid, file_desc_t **filep);
     int pio_delete_file_from_list(int ncid);
-    int pio_add_to_file_list(file_desc_t *file, MPI_Comm comm);
+    int pio_add_to_file_list(file_desc_t *file, int *ncidp);
 
     /* Get a description of the variable represented by varid */
     const char *get_var_desc_str(int ncid, int varid, const char *desc_prefix);
@@ -150,6 +179,8 @@ extern "C" {
     /* Open a file and learn about metadata. */
     int openfile_int(int iosysid, int *ncidp, int *iotype, const char *filename,
                      int mode, int retry);
+    int openfiles_int(int iosysid, int nfiles, int *ncids, int *iotype,
+                      const char **filenames, int mode, int retry);
 
     /* Open a file with optional retry as netCDF-classic if first
      * iotype does not work. */
@@ -218,6 +249,8 @@ extern "C" {
 
     /* Convert an index into dimension values. */
     void idx_to_dim_list(int ndims, const int *gdims, PIO_Offset idx, PIO_Offset *dim_list);
+    void idx_to_dim_list_incr(int ndims, const int *gdims, PIO_Offset idx, PIO_Offset prev_idx,
+                              const PIO_Offset *prev_dim_list, PIO_Offset *dim_list);
 
     /* Convert a global coordinate value into a local array index. */
     PIO_Offset coord_to_lindex(int ndims, const PIO_Offset *lcoord, const PIO_Offset *count);
@@ -267,8 +300,22 @@ extern "C" {
     int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf, void *rbuf,
                           int nvars);
 
+    /* Move data from compute tasks to IO tasks, sending directly from
+     * nvars separate user arrays. */
+    int rearrange_comp2io_nocopy(iosystem_desc_t *ios, io_desc_t *iodesc, void **sbufs,
+                                 void *rbuf, int nvars);
+
     /* Allocate and initialize storage for decomposition information. */
     int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims, io_desc_t **iodesc);
+    unsigned long long pio_fnv_hash(unsigned long long hash, const void *buf, size_t len);
+    unsigned long long pio_decomp_hash(int ndims, const int *gdimlen, int maplen,
+                                       const PIO_Offset *compmap);
+    int pio_share_iodesc(iosystem_desc_t *ios, io_desc_t *iodesc, bool *shared);
+    int pio_init_decomp(int iosysid, int pio_type, int ndims, const int *gdimlen, int maplen,
+                        const PIO_Offset *compmap, int *ioidp, const int *rearranger,
+                        const PIO_Offset *iostart, const PIO_Offset *iocount, bool save_decomp);
+    int pio_load_rearr_plan(iosystem_desc_t *ios, io_desc_t *iodesc, bool *loaded);
+    int pio_save_rearr_plan(iosystem_desc_t *ios, io_desc_t *iodesc);
     void performance_tune_rearranger(iosystem_desc_t *ios, io_desc_t *iodesc);
 
     /* Flush contents of multi-buffer to disk. */
@@ -293,6 +340,7 @@ extern "C" {
     int gcd_array(int nain, int *ain);
 
     void free_region_list(io_region *top);
+    PIO_Offset pio_iodesc_mem_size(io_desc_t *iodesc);
 
     /* Convert a global coordinate value into a local array index. */
     PIO_Offset coord_to_lindex(int ndims, const PIO_Offset *lcoord, const PIO_Offset *count);
@@ -308,6 +356,8 @@ extern "C" {
     int create_mpi_datatypes(MPI_Datatype basetype, int msgcnt, const PIO_Offset *mindex,
                              const int *mcount, int *mfrom, MPI_Datatype *mtype);
     int compare_offsets(const void *a, const void *b) ;
+    int merge_sorted_maps(int nruns, const int *runlen, const int *rundispls,
+                          const PIO_Offset *iomap, const PIO_Offset *srcindex, mapsort *map);
 
     /* Print a trace statement, for debugging. */
     void print_trace (FILE *fp);
@@ -320,8 +370,29 @@ extern "C" {
     /* Flush PIO's data buffer. */
     int flush_buffer(int ncid, wmulti_buffer *wmb, bool flushtodisk);
 
+    /* Write multiple vars, data is either contiguous (array) or in
+     * separate user arrays (arrays). */
+    int write_darray_multi_int(int ncid, const int *varids, int ioid, int nvars,
+                               PIO_Offset arraylen, void *array, void **arrays,
+                               const int *frame, void **fillvalue, bool flushtodisk);
+
     int compute_maxaggregate_bytes(iosystem_desc_t *ios, io_desc_t *iodesc);
 
+    /* Type conversion of user data on compute tasks. */
+    bool pio_convert_narrows(int from_type, int to_type);
+    int pio_convert_buffer(int from_type, const void *from, int to_type, void *to,
+                           PIO_Offset len, const void *from_fill, const void *to_fill,
+                           PIO_Offset *nerangep);
+    int pio_quantize_buffer(int pio_type, int var_type, void *buf, PIO_Offset len,
+                            int quantize_mode, int nsd, const void *fill);
+
+    /* Choose chunk sizes of new netCDF-4 vars before leaving define mode. */
+    int pio_def_decomp_chunking(file_desc_t *file);
+
+    /* Write the I/O performance report of a file when closing it. */
+    int pio_write_perf_report(file_desc_t *file);
+    void pio_write_async_report(iosystem_desc_t *ios);
+
     /* Compute an element of start/count arrays. */
     void compute_one_dim(int gdim, int ioprocs, int rank, PIO_Offset *start,
                          PIO_Offset *count);
@@ -377,6 +448,29 @@ extern "C" {
     void pio_init_logging(void);
     void pio_finalize_logging(void );
 
+    /* Initialize and finalize the event tracer. */
+    void pio_init_trace(void);
+    void pio_finalize_trace(void);
+
+    /* Create, acquire, release and free the lock of a file. */
+    int pio_file_lock_init(file_desc_t *file);
+    void pio_file_lock(file_desc_t *file);
+    void pio_file_unlock(file_desc_t *file);
+    void pio_file_lock_free(file_desc_t *file);
+
+    /* Sort the data cached in the write multi buffers of a file. */
+    int pio_order_wmb_list(file_desc_t *file);
+
+    /* Invalidate the write handles bound to a file or a decomposition. */
+    void pio_release_darray_handles(file_desc_t *file, io_desc_t *iodesc);
+
+    /* Hand off jobs of a file to the I/O thread, wait for them, and
+     * stop the thread. */
+    int pio_io_thread_submit(file_desc_t *file, int (*fn)(void *arg), void *arg);
+    void pio_io_thread_wait(file_desc_t *file);
+    int pio_io_thread_finish(file_desc_t *file);
+    void pio_io_thread_stop(iosystem_desc_t *ios);
+
     /* Initialize and finalize GPTL timers. */
     void pio_init_gptl(void);
     void pio_finalize_gptl(void );
@@ -631,6 +725,10 @@ enum PIO_MSG
     PIO_MSG_COPY_ATT,
     PIO_MSG_INQ_TYPE,
     PIO_MSG_INQ_UNLIMDIMS,
+    PIO_MSG_DEF_VAR_QUANTIZE,
+    PIO_MSG_SET_PERF_REPORT,
+    PIO_MSG_SET_STAGE_LIMIT,
+    PIO_MSG_OPEN_FILES,
     PIO_MSG_EXIT,
     PIO_MAX_MSGS
 };
@@ -10,6 +10,7 @@
 #endif
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 
 static io_desc_t *pio_iodesc_list = NULL;
 static io_desc_t *current_iodesc = NULL;
@@ -17,19 +18,91 @@ static iosystem_desc_t *pio_iosystem_list = NULL;
 static file_desc_t *pio_file_list = NULL;
 static file_desc_t *current_file = NULL;
 
+/**
+ * Get a new id, for an entry of one of the global lists, that is
+ * unique across the comm provided. The id is the max, over comm, of
+ * the next ids of the tasks.
+ *
+ * In the thread-safe mode (see PIOc_set_threadsafe()) the global
+ * lock is not held during the reductions, since threads of a task
+ * may be getting ids on different comms, so another thread may take
+ * the id agreed on a task while the reduction is in progress. The
+ * agreement is then checked with a second reduction, and retried
+ * with a larger id if the id was taken on any task.
+ *
+ * @param next_id pointer to the next id of this task.
+ * @param comm MPI Communicator across which the id needs to be
+ * unique, or MPI_COMM_NULL.
+ * @returns the new id.
+ */
+static int pio_get_next_id(int *next_id, MPI_Comm comm)
+{
+    int id;
+
+    PIO_LOCK();
+    id = *next_id;
+    PIO_UNLOCK();
+
+    while (1)
+    {
+        int id_is_free;
+
+        if (comm != MPI_COMM_NULL)
+        {
+            int tmp_id = id;
+            int mpierr = MPI_Allreduce(&tmp_id, &id, 1, MPI_INT, MPI_MAX, comm);
+            assert(mpierr == MPI_SUCCESS);
+        }
+
+        /* Ids below the next id of this task may have been taken. */
+        PIO_LOCK();
+        id_is_free = (id >= *next_id);
+        if (id_is_free)
+            *next_id = id + 1;
+        PIO_UNLOCK();
+
+#if PIO_USE_THREADSAFE
+        if (comm != MPI_COMM_NULL)
+        {
+            int mpierr = MPI_Allreduce(MPI_IN_PLACE, &id_is_free, 1, MPI_INT, MPI_MIN, comm);
+            assert(mpierr == MPI_SUCCESS);
+        }
+        if (id_is_free)
+            break;
+
+        /* Ids reserved on this task that were not agreed on are not
+         * reused. */
+        PIO_LOCK();
+        id = *next_id;
+        PIO_UNLOCK();
+#else
+        assert(id_is_free);
+        break;
+#endif /* PIO_USE_THREADSAFE */
+    }
+
+    return id;
+}
+
 /** 
  * Add a new entry to the global list of open files.
  *
- * This function guarantees that files (id of the
- * files) are unique across the comm provided
+ * The id of the file is derived from the id of its iosystem and a
+ * slot, so no communication is needed to agree on it. All the tasks
+ * of an iosystem open and close its files in the same order, so they
+ * pick the same slot: the next one of the iosystem that is not in use
+ * by an open file.
  *
  * @param file pointer to the file_desc_t struct for the new file.
- * @param comm MPI Communicator across which the files
- * need to be unique
- * @returns The id for the file added to the list
+ * @param ncidp pointer that gets the id of the file.
+ * @returns 0 for success, PIO_ENFILE if all the file ids of the
+ * iosystem are in use, error code otherwise. The file is not added
+ * to the list on errors.
  */
 #define PIO_FILE_START_ID 16
-int pio_add_to_file_list(file_desc_t *file, MPI_Comm comm)
+#define PIO_IOSYSTEM_START_ID 2048
+#define PIO_FILE_IDS_PER_IOSYSTEM 4096
+int pio_add_to_file_list(file_desc_t *file, int *ncidp)
 {
     /* Using an arbitrary start id for file ids helps
      * in debugging, to distinguish between ids assigned
@@ -37,22 +110,53 @@ int pio_add_to_file_list(file_desc_t *file, MPI_Comm comm)
      * Also note that NetCDF ids start at 4, PnetCDF ids
      * start at 0 and NetCDF4 ids start at 65xxx
      */
-    static int pio_file_next_id = PIO_FILE_START_ID;
+    iosystem_desc_t *ios;
     file_desc_t *cfile;
+    int base;
+    int ret;
 
-    assert(file);
+    assert(file && file->iosystem && ncidp);
+    ios = file->iosystem;
 
-    if(comm != MPI_COMM_NULL)
+    /* Create the lock protecting the write multi buffers of the
+     * file. */
+    if ((ret = pio_file_lock_init(file)))
     {
-        int tmp_id = pio_file_next_id;
-        int mpierr = MPI_Allreduce(&tmp_id, &pio_file_next_id, 1, MPI_INT, MPI_MAX, comm);
-        assert(mpierr == MPI_SUCCESS);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Adding file (%s) to the list of open files failed. Creating the lock of the file failed", pio_get_fname_from_file(file));
     }
-    file->pio_ncid = pio_file_next_id;
-    pio_file_next_id++;
+
+    /* The first id of the files of the iosystem, wrapping around if
+     * the iosystem ids get very large. */
+    base = PIO_FILE_START_ID + ((ios->iosysid - PIO_IOSYSTEM_START_ID) %
+                                ((INT_MAX - PIO_FILE_START_ID) / PIO_FILE_IDS_PER_IOSYSTEM)) *
+        PIO_FILE_IDS_PER_IOSYSTEM;
+
     /* This file will be at the end of the list, and have no next. */
     file->next = NULL;
 
+    PIO_LOCK();
+
+    /* Take the next free slot of the iosystem. */
+    for (int i = 0; i < PIO_FILE_IDS_PER_IOSYSTEM; i++)
+    {
+        file->pio_ncid = base + ios->next_file_slot;
+        ios->next_file_slot = (ios->next_file_slot + 1) % PIO_FILE_IDS_PER_IOSYSTEM;
+
+        for (cfile = pio_file_list; cfile; cfile = cfile->next)
+            if (cfile->pio_ncid == file->pio_ncid)
+                break;
+        if (!cfile)
+            break;
+    }
+    if (cfile)
+    {
+        PIO_UNLOCK();
+        pio_file_lock_free(file);
+        return pio_err(ios, NULL, PIO_ENFILE, __FILE__, __LINE__,
+                        "Adding file (%s) to the list of open files failed. Too many open files on the iosystem (iosysid=%d), all the %d file ids of the iosystem are in use", pio_get_fname_from_file(file), ios->iosysid, PIO_FILE_IDS_PER_IOSYSTEM);
+    }
+
     /* Get a pointer to the global list of files. */
     cfile = pio_file_list;
 
@@ -70,12 +174,18 @@ int pio_add_to_file_list(file_desc_t *file, MPI_Comm comm)
         cfile->next = file;
     }
 
-    return file->pio_ncid;
+    PIO_UNLOCK();
+
+    *ncidp = file->pio_ncid;
+
+    return PIO_NOERR;
 }
 
 /** 
  * Given ncid, find the file_desc_t data for an open file. The ncid
- * used is the interally generated pio_ncid.
+ * used is the interally generated pio_ncid. If jobs of the file were
+ * handed off to the I/O thread, waits for them to complete, so the
+ * caller can use the file (see PIOc_set_io_thread()).
  *
  * @param ncid the PIO assigned ncid of the open file.
  * @param cfile1 pointer to a pointer to a file_desc_t. The pointer
@@ -95,6 +205,7 @@ int pio_get_file(int ncid, file_desc_t **cfile1)
         return PIO_EINVAL;
 
     /* Find the file pointer. */
+    PIO_LOCK();
     if (current_file && current_file->pio_ncid == ncid)
         cfile = current_file;
     else
@@ -104,6 +215,7 @@ int pio_get_file(int ncid, file_desc_t **cfile1)
                 current_file = cfile;
                 break;
             }
+    PIO_UNLOCK();
 
     /* If not found, return error. */
     if (!cfile)
@@ -116,6 +228,9 @@ int pio_get_file(int ncid, file_desc_t **cfile1)
     /* Let's just ensure we have a valid IO type. */
     pioassert(iotype_is_valid(cfile->iotype), "invalid IO type", __FILE__, __LINE__);
 
+    /* Wait for the I/O thread to be done with the file. */
+    pio_io_thread_wait(cfile);
+
     /* Copy pointer to file info. */
     *cfile1 = cfile;
 
@@ -134,6 +249,7 @@ int pio_delete_file_from_list(int ncid)
     file_desc_t *cfile, *pfile = NULL;
 
     /* Look through list of open files. */
+    PIO_LOCK();
     for (cfile = pio_file_list; cfile; cfile = cfile->next)
     {
         if (cfile->pio_ncid == ncid)
@@ -145,6 +261,7 @@ int pio_delete_file_from_list(int ncid)
 
             if (current_file == cfile)
                 current_file = pfile;
+            PIO_UNLOCK();
 
             /* Free any fill values that were allocated. */
             for (int v = 0; v < PIO_MAX_VARS; v++)
@@ -160,6 +277,10 @@ int pio_delete_file_from_list(int ncid)
             }
 
             free(cfile->unlim_dimids);
+            /* The staged buffers are normally released by the last
+             * flush of the file. */
+            free(cfile->staged_iobufs);
+            pio_file_lock_free(cfile);
             /* Free the memory used for this file. */
             free(cfile);
             
@@ -167,6 +288,7 @@ int pio_delete_file_from_list(int ncid)
         }
         pfile = cfile;
     }
+    PIO_UNLOCK();
 
     /* No file was found. */
     return PIO_EBADID;
@@ -185,6 +307,7 @@ int pio_delete_iosystem_from_list(int piosysid)
 
     LOG((1, "pio_delete_iosystem_from_list piosysid = %d", piosysid));
 
+    PIO_LOCK();
     for (ciosystem = pio_iosystem_list; ciosystem; ciosystem = ciosystem->next)
     {
         LOG((3, "ciosystem->iosysid = %d", ciosystem->iosysid));
@@ -194,11 +317,13 @@ int pio_delete_iosystem_from_list(int piosysid)
                 pio_iosystem_list = ciosystem->next;
             else
                 piosystem->next = ciosystem->next;
+            PIO_UNLOCK();
             free(ciosystem);
             return PIO_NOERR;
         }
         piosystem = ciosystem;
     }
+    PIO_UNLOCK();
     return PIO_EBADID;
 }
 
@@ -212,7 +337,6 @@ int pio_delete_iosystem_from_list(int piosysid)
  * need to be unique
  * @returns the id of the newly added iosystem.
  */
-#define PIO_IOSYSTEM_START_ID 2048
 int pio_add_to_iosystem_list(iosystem_desc_t *ios, MPI_Comm comm)
 {
     /* Using an arbitrary start id for iosystem ids helps
@@ -224,16 +348,10 @@ int pio_add_to_iosystem_list(iosystem_desc_t *ios, MPI_Comm comm)
 
     assert(ios);
 
-    if(comm != MPI_COMM_NULL)
-    {
-        int tmp_id = pio_iosystem_next_ioid;
-        int mpierr = MPI_Allreduce(&tmp_id, &pio_iosystem_next_ioid, 1, MPI_INT, MPI_MAX, comm);
-        assert(mpierr == MPI_SUCCESS);
-    }
-    ios->iosysid = pio_iosystem_next_ioid;
-    pio_iosystem_next_ioid += 1;
+    ios->iosysid = pio_get_next_id(&pio_iosystem_next_ioid, comm);
 
     ios->next = NULL;
+    PIO_LOCK();
     cios = pio_iosystem_list;
     if (!cios)
         pio_iosystem_list = ios;
@@ -245,6 +363,7 @@ int pio_add_to_iosystem_list(iosystem_desc_t *ios, MPI_Comm comm)
         }
         cios->next = ios;
     }
+    PIO_UNLOCK();
 
     return ios->iosysid;
 }
@@ -262,11 +381,13 @@ iosystem_desc_t *pio_get_iosystem_from_id(int iosysid)
 
     LOG((2, "pio_get_iosystem_from_id iosysid = %d", iosysid));
 
+    PIO_LOCK();
     for (ciosystem = pio_iosystem_list; ciosystem; ciosystem = ciosystem->next)
         if (ciosystem->iosysid == iosysid)
-            return ciosystem;
+            break;
+    PIO_UNLOCK();
 
-    return NULL;
+    return ciosystem;
 }
 
 /** 
@@ -281,8 +402,10 @@ int pio_num_iosystem(int *niosysid)
     int count = 0;
 
     /* Count the elements in the list. */
+    PIO_LOCK();
     for (iosystem_desc_t *c = pio_iosystem_list; c; c = c->next)
         count++;
+    PIO_UNLOCK();
 
     /* Return count to caller via pointer. */
     if (niosysid)
@@ -308,19 +431,14 @@ int pio_add_to_iodesc_list(io_desc_t *iodesc, MPI_Comm comm)
      * to different structures in the code
      */
     static int pio_iodesc_next_id = PIO_IODESC_START_ID;
-    io_desc_t *ciodesc = pio_iodesc_list;
+    io_desc_t *ciodesc;
 
-    if(comm != MPI_COMM_NULL)
-    {
-        int tmp_id = pio_iodesc_next_id;
-        int mpierr = MPI_Allreduce(&tmp_id, &pio_iodesc_next_id, 1, MPI_INT, MPI_MAX, comm);
-        assert(mpierr == MPI_SUCCESS);
-    }
-    iodesc->ioid = pio_iodesc_next_id;
-    pio_iodesc_next_id++;
+    iodesc->ioid = pio_get_next_id(&pio_iodesc_next_id, comm);
     iodesc->next = NULL;
 
     /* Add to the global list */
+    PIO_LOCK();
+    ciodesc = pio_iodesc_list;
     if (pio_iodesc_list == NULL)
         pio_iodesc_list = iodesc;
     else
@@ -333,6 +451,7 @@ int pio_add_to_iodesc_list(io_desc_t *iodesc, MPI_Comm comm)
         ciodesc->next = iodesc;
     }
     current_iodesc = iodesc;
+    PIO_UNLOCK();
 
     return iodesc->ioid;
 }
@@ -348,19 +467,97 @@ io_desc_t *pio_get_iodesc_from_id(int ioid)
 {
     io_desc_t *ciodesc = NULL;
 
+    PIO_LOCK();
+
     /* Do we already have a pointer to it? */
     if (current_iodesc && current_iodesc->ioid == ioid)
-        return current_iodesc;
+        ciodesc = current_iodesc;
+    else
+        /* Find the decomposition in the list. */
+        for (ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
+            if (ciodesc->ioid == ioid)
+            {
+                current_iodesc = ciodesc;
+                break;
+            }
 
-    /* Find the decomposition in the list. */
-    for (ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
-        if (ciodesc->ioid == ioid)
+    PIO_UNLOCK();
+
+    return ciodesc;
+}
+
+/**
+ * Find a decomposition of an IO system that can be used to write a
+ * variable with the given dimension lengths, and has the sizes of
+ * its IO regions (i.e. uses the box rearranger). Decompositions of
+ * the given type are preferred.
+ *
+ * @param iosysid the IO system ID.
+ * @param pio_type the PIO type of the variable.
+ * @param ndims the number of dimensions of the decomposition.
+ * @param dimlen array (length ndims) of the dimension lengths.
+ * @returns pointer to the iodesc, NULL if none is found.
+ */
+io_desc_t *pio_find_iodesc(int iosysid, int pio_type, int ndims, const int *dimlen)
+{
+    io_desc_t *found = NULL;
+
+    PIO_LOCK();
+    for (io_desc_t *ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
+    {
+        bool match = (ciodesc->iosysid == iosysid && ciodesc->ioregion_count &&
+                      ciodesc->ndims == ndims);
+
+        for (int d = 0; match && d < ndims; d++)
+            if (ciodesc->dimlen[d] != dimlen[d])
+                match = false;
+        if (!match)
+            continue;
+
+        if (ciodesc->piotype == pio_type)
         {
-            current_iodesc = ciodesc;
+            found = ciodesc;
             break;
         }
+        if (!found)
+            found = ciodesc;
+    }
+    PIO_UNLOCK();
 
-    return ciodesc;
+    return found;
+}
+
+/**
+ * Find a decomposition, created earlier on this task, with the same
+ * IO system, rearranger, dimensions and map as a new
+ * decomposition, whose rearranger setup can be shared with it (see
+ * pio_share_iodesc()). The one with the lowest ID is returned.
+ *
+ * @param iodesc pointer to the new decomposition, with its hash, map
+ * and dimensions set.
+ * @returns pointer to the iodesc, NULL if none is found.
+ */
+io_desc_t *pio_find_shared_iodesc(io_desc_t *iodesc)
+{
+    io_desc_t *found = NULL;
+
+    PIO_LOCK();
+    for (io_desc_t *ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
+    {
+        if (ciodesc == iodesc || ciodesc->hash != iodesc->hash ||
+            ciodesc->iosysid != iodesc->iosysid || ciodesc->rearranger != iodesc->rearranger ||
+            ciodesc->ndims != iodesc->ndims || ciodesc->maplen != iodesc->maplen)
+            continue;
+        if (found && found->ioid < ciodesc->ioid)
+            continue;
+        if (memcmp(ciodesc->dimlen, iodesc->dimlen, iodesc->ndims * sizeof(int)) ||
+            memcmp(ciodesc->map, iodesc->map, iodesc->maplen * sizeof(PIO_Offset)))
+            continue;
+        found = ciodesc;
+    }
+    PIO_UNLOCK();
+
+    return found;
 }
 
 /** 
@@ -374,6 +571,7 @@ int pio_delete_iodesc_from_list(int ioid)
 {
     io_desc_t *ciodesc, *piodesc = NULL;
 
+    PIO_LOCK();
     for (ciodesc = pio_iodesc_list; ciodesc; ciodesc = ciodesc->next)
     {
         if (ciodesc->ioid == ioid)
@@ -385,10 +583,12 @@ int pio_delete_iodesc_from_list(int ioid)
 
             if (current_iodesc == ciodesc)
                 current_iodesc = pio_iodesc_list;
+            PIO_UNLOCK();
             free(ciodesc);
             return PIO_NOERR;
         }
         piodesc = ciodesc;
     }
+    PIO_UNLOCK();
     return PIO_EBADID;
 }
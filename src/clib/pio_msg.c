@@ -90,6 +90,9 @@ int init_async_msgs_sign(void )
     strncpy(pio_async_msg_sign[PIO_MSG_OPEN_FILE], "scii", PIO_MAX_ASYNC_MSG_ARGS);
     /* PIO_MSG_CREATE_FILE message sends 1 int/len + 1 string + 1 int + 1 int */
     strncpy(pio_async_msg_sign[PIO_MSG_CREATE_FILE], "scii", PIO_MAX_ASYNC_MSG_ARGS);
+    /* PIO_MSG_OPEN_FILES message sends 1 int + 1 int/len + 1 char array
+     * (needs malloc) + 1 int + 1 int */
+    strncpy(pio_async_msg_sign[PIO_MSG_OPEN_FILES], "imBii", PIO_MAX_ASYNC_MSG_ARGS);
     /* PIO_MSG_INQ_ATT message sends 
      * 1 int + 1 int + 1 int/len + 1 string +1 bool + 1 bool
      */
@@ -554,6 +557,12 @@ int init_async_msgs_sign(void )
      strncpy(pio_async_msg_sign[ PIO_MSG_INQ_TYPE ], "iibb", PIO_MAX_ASYNC_MSG_ARGS);
     /*  PIO_MSG_INQ_UNLIMDIMS  sends 1 int and 2 chars/bytes */
      strncpy(pio_async_msg_sign[ PIO_MSG_INQ_UNLIMDIMS ], "ibb", PIO_MAX_ASYNC_MSG_ARGS);
+    /*  PIO_MSG_DEF_VAR_QUANTIZE sends 4 ints */
+     strncpy(pio_async_msg_sign[ PIO_MSG_DEF_VAR_QUANTIZE ], "iiii", PIO_MAX_ASYNC_MSG_ARGS);
+    /*  PIO_MSG_SET_PERF_REPORT sends 2 ints */
+     strncpy(pio_async_msg_sign[ PIO_MSG_SET_PERF_REPORT ], "ii", PIO_MAX_ASYNC_MSG_ARGS);
+    /*  PIO_MSG_SET_STAGE_LIMIT sends 1 int + 1 pio_offset */
+     strncpy(pio_async_msg_sign[ PIO_MSG_SET_STAGE_LIMIT ], "io", PIO_MAX_ASYNC_MSG_ARGS);
     /*  PIO_MSG_EXIT  is a local message, never sent between compute and I/O procs  */
      strncpy(pio_async_msg_sign[ PIO_MSG_EXIT ], "", PIO_MAX_ASYNC_MSG_ARGS);
     return PIO_NOERR;
@@ -2758,6 +2767,47 @@ int def_var_deflate_handler(iosystem_desc_t *ios)
     return PIO_NOERR;
 }
 
+/**
+ * This function is run on the IO tasks to define quantize settings
+ * for a netCDF variable.
+ *
+ * @param ios pointer to the iosystem_desc_t.
+ * @returns 0 for success, error code otherwise.
+ */
+int def_var_quantize_handler(iosystem_desc_t *ios)
+{
+    int ncid;
+    int varid;
+    int quantize_mode;
+    int nsd;
+    int ret;
+
+    assert(ios);
+    LOG((1, "def_var_quantize_handler comproot = %d", ios->comproot));
+
+    /* Get the parameters for this function that the comp master
+     * task is broadcasting. */
+    PIO_RECV_ASYNC_MSG(ios, PIO_MSG_DEF_VAR_QUANTIZE, &ret,
+        &ncid, &varid, &quantize_mode, &nsd);
+    if(ret != PIO_NOERR)
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error receiving asynchronous message, PIO_MSG_DEF_VAR_QUANTIZE on iosystem (iosysid=%d)", ios->iosysid);
+    }
+    LOG((1, "def_var_quantize_handler got parameters ncid = %d varid = %d "
+         "quantize_mode = %d nsd = %d", ncid, varid, quantize_mode, nsd));
+
+    /* Call the function. */
+    if ((ret = PIOc_def_var_quantize(ncid, varid, quantize_mode, nsd)))
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error processing asynchronous message, PIO_MSG_DEF_VAR_QUANTIZE on iosystem (iosysid=%d). Unable to define quantize settings for variable %s (varid=%d) in file %s (ncid=%d)", ios->iosysid, pio_get_vname_from_file_id(ncid, varid), varid, pio_get_fname_from_file_id(ncid), ncid);
+    }
+
+    LOG((1, "def_var_quantize_handler succeeded!"));
+    return PIO_NOERR;
+}
+
 /**
  * This function is run on the IO tasks to define chunk cache settings
  * for a netCDF variable.
@@ -3065,6 +3115,73 @@ int open_file_handler(iosystem_desc_t *ios)
     return PIO_NOERR;
 }
 
+/** 
+ * This function is run on the IO tasks to open several netCDF files
+ * at once.
+ *
+ * @param ios pointer to the iosystem_desc_t.
+ * @returns 0 for success, PIO_EIO for MPI Bcast errors, or error code
+ * from netCDF base function.
+ * @internal
+ */
+int open_files_handler(iosystem_desc_t *ios)
+{
+    int nfiles;
+    int len;
+    char *names = NULL;
+    int iotype;
+    int mode;
+    int *ncids;
+    const char **filenames;
+    int ret = PIO_NOERR;
+
+    LOG((1, "open_files_handler comproot = %d", ios->comproot));
+    assert(ios);
+
+    /* Get the parameters for this function that the comp master
+     * task is broadcasting. */
+    PIO_RECV_ASYNC_MSG(ios, PIO_MSG_OPEN_FILES, &ret, &nfiles, &len, &names, &iotype, &mode);
+    if(ret != PIO_NOERR)
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error receiving asynchronous message, PIO_MSG_OPEN_FILES on iosystem (iosysid=%d)", ios->iosysid);
+    }
+
+    LOG((2, "open_files_handler got parameters nfiles = %d len = %d iotype = %d mode = %d",
+         nfiles, len, iotype, mode));
+
+    if (!(ncids = malloc(nfiles * sizeof(int))) ||
+        !(filenames = malloc(nfiles * sizeof(const char *))))
+    {
+        free(ncids);
+        free(names);
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Error processing asynchronous message, PIO_MSG_OPEN_FILES on iosystem (iosysid=%d). Out of memory allocating the list of %d files", ios->iosysid, nfiles);
+    }
+
+    /* The filenames are sent one after the other. */
+    for (int f = 0, pos = 0; f < nfiles; f++)
+    {
+        filenames[f] = names + pos;
+        pos += strlen(filenames[f]) + 1;
+    }
+
+    /* Call the open files function */
+    ret = openfiles_int(ios->iosysid, nfiles, ncids, &iotype, filenames, mode, 0);
+
+    free(filenames);
+    free(ncids);
+    free(names);
+
+    if (ret != PIO_NOERR)
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error processing asynchronous message, PIO_MSG_OPEN_FILES on iosystem (iosysid=%d). Unable to open %d files", ios->iosysid, nfiles);
+    }
+
+    return PIO_NOERR;
+}
+
 /** 
  * This function is run on the IO tasks to delete a netCDF file.
  *
@@ -3378,6 +3495,80 @@ int seterrorhandling_handler(iosystem_desc_t *ios)
     return PIO_NOERR;
 }
 
+/**
+ * This function is run on the IO tasks to set the format of the I/O
+ * performance reports written when files are closed.
+ *
+ * @param ios pointer to the iosystem_desc_t.
+ * @returns 0 for success, error code otherwise.
+ */
+int set_perf_report_handler(iosystem_desc_t *ios)
+{
+    int iosysid;
+    int format;
+    int ret;
+
+    LOG((1, "set_perf_report_handler comproot = %d", ios->comproot));
+    assert(ios);
+
+    PIO_RECV_ASYNC_MSG(ios, PIO_MSG_SET_PERF_REPORT, &ret, &iosysid, &format);
+    if(ret != PIO_NOERR)
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error receiving asynchronous message, PIO_MSG_SET_PERF_REPORT on iosystem (iosysid=%d)", ios->iosysid);
+    }
+
+    LOG((1, "set_perf_report_handler got parameters iosysid = %d format = %d",
+         iosysid, format));
+
+    /* Call the function. */
+    if ((ret = PIOc_set_perf_report(iosysid, format)))
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error processing asynchronous message, PIO_MSG_SET_PERF_REPORT on iosystem (iosysid=%d). Unable to set the format of the I/O performance reports", ios->iosysid);
+    }
+
+    LOG((1, "set_perf_report_handler succeeded!"));
+    return PIO_NOERR;
+}
+
+/**
+ * This function is run on the IO tasks to set the budget of the data
+ * buffers staged for the PnetCDF writes.
+ *
+ * @param ios pointer to the iosystem_desc_t.
+ * @returns 0 for success, error code otherwise.
+ */
+int set_stage_limit_handler(iosystem_desc_t *ios)
+{
+    int iosysid;
+    PIO_Offset limit;
+    int ret;
+
+    LOG((1, "set_stage_limit_handler comproot = %d", ios->comproot));
+    assert(ios);
+
+    PIO_RECV_ASYNC_MSG(ios, PIO_MSG_SET_STAGE_LIMIT, &ret, &iosysid, &limit);
+    if(ret != PIO_NOERR)
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error receiving asynchronous message, PIO_MSG_SET_STAGE_LIMIT on iosystem (iosysid=%d)", ios->iosysid);
+    }
+
+    LOG((1, "set_stage_limit_handler got parameters iosysid = %d limit = %lld",
+         iosysid, (long long)limit));
+
+    /* Call the function. */
+    if ((ret = PIOc_set_stage_limit(iosysid, limit)))
+    {
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Error processing asynchronous message, PIO_MSG_SET_STAGE_LIMIT on iosystem (iosysid=%d). Unable to set the budget of the staged data buffers", ios->iosysid);
+    }
+
+    LOG((1, "set_stage_limit_handler succeeded!"));
+    return PIO_NOERR;
+}
+
 /**
  * This function is run on the IO tasks to set the chunk cache
  * parameters for netCDF-4.
@@ -3597,6 +3788,10 @@ int finalize_handler(iosystem_desc_t *ios, int index)
     }
     LOG((1, "finalize_handler got parameter iosysid = %d", iosysid));
 
+    /* The IO root reports the statistics of the async service. */
+    if (ios->perf_report != PIO_PERF_REPORT_NONE && ios->io_rank == 0)
+        pio_write_async_report(ios);
+
     /* Call the function. */
     LOG((2, "finalize_handler calling PIOc_finalize for iosysid = %d",
          iosysid));
@@ -3614,6 +3809,15 @@ int finalize_handler(iosystem_desc_t *ios, int index)
  * This function is called by the IO tasks.  This function will not
  * return, unless there is an error.
  *
+ * The messages of the components are handled one at a time by all
+ * the IO tasks in io_comm, the components with a message waiting are
+ * serviced in a round-robin order. If the IO tasks are split in
+ * groups (see PIOc_set_async_split()) each group runs this function
+ * for the components it serves, and the groups handle messages
+ * concurrently. The statistics of each component (number of
+ * messages, queue depth, wait and handling times) are kept in its
+ * iosystem (see pio_async_stats_t).
+ *
  * @param io_rank
  * @param component_count number of computation components
  * @param iosys pointer to pointer to iosystem info
@@ -3628,7 +3832,14 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
     int msgs[component_count];
     int msg = PIO_MSG_INVALID;
     MPI_Request req[component_count];
-    MPI_Status status;
+    MPI_Status status[component_count];
+    int done[component_count];       /* Indices of the requests completed. */
+    int ready[component_count];      /* Non-zero if a header was received. */
+    double ready_time[component_count]; /* Time the header was received. */
+    int nready = 0;                  /* Number of headers received. */
+    int last = component_count - 1;  /* Last component serviced. */
+    int queue_depth = 0;
+    double start_time;
     int index;
     int mpierr;
     int ret = PIO_NOERR;
@@ -3644,6 +3855,7 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
         for (int cmp = 0; cmp < component_count; cmp++)
         {
             my_iosys = iosys[cmp];
+            ready[cmp] = 0;
             LOG((1, "about to call MPI_Irecv union_comm = %d", my_iosys->union_comm));
             if ((mpierr = MPI_Irecv(&msgs[cmp], 1, MPI_INT, my_iosys->comproot,
                                     PIO_ASYNC_MSG_HDR_TAG, my_iosys->union_comm, &req[cmp])))
@@ -3657,18 +3869,50 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
     {
         LOG((3, "pio_msg_handler2 at top of loop"));
 
-        /* Wait until any one of the requests are complete. Once it
-         * returns, the Waitany function automatically sets the
-         * appropriate member of the req array to MPI_REQUEST_NULL. */
+        /* Collect the headers received from all the components,
+         * waiting only if none was received. The completed requests
+         * are set to MPI_REQUEST_NULL. The components with a header
+         * received are then serviced in a round-robin order, so a
+         * component sending many (or expensive) messages does not
+         * starve the others. */
         if (!io_rank)
         {
-            LOG((1, "about to call MPI_Waitany req[0] = %d MPI_REQUEST_NULL = %d",
+            int ndone = 0;
+
+            LOG((1, "about to call MPI_Testsome req[0] = %d MPI_REQUEST_NULL = %d",
                  req[0], MPI_REQUEST_NULL));
             for (int c = 0; c < component_count; c++)
                 LOG((2, "req[%d] = %d", c, req[c]));
-            if ((mpierr = MPI_Waitany(component_count, req, &index, &status)))
+            if ((mpierr = MPI_Testsome(component_count, req, &ndone, done, status)))
                 return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
-            LOG((3, "Waitany returned index = %d req[%d] = %d", index, index, req[index]));
+            if ((ndone == 0 || ndone == MPI_UNDEFINED) && nready == 0)
+                if ((mpierr = MPI_Waitsome(component_count, req, &ndone, done, status)))
+                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            if (ndone != MPI_UNDEFINED)
+            {
+                double now = MPI_Wtime();
+
+                for (int d = 0; d < ndone; d++)
+                {
+                    ready[done[d]] = 1;
+                    ready_time[done[d]] = now;
+                    nready++;
+                }
+            }
+
+            /* The number of messages waiting, including this one. */
+            queue_depth = nready;
+            for (int c = 1; c <= component_count; c++)
+            {
+                index = (last + c) % component_count;
+                if (ready[index])
+                    break;
+            }
+            assert(ready[index]);
+            ready[index] = 0;
+            nready--;
+            last = index;
+            LOG((3, "servicing index = %d queue_depth = %d", index, queue_depth));
         }
 
         /* Broadcast the index of the computational component that
@@ -3688,7 +3932,24 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
             return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
         LOG((1, "pio_msg_handler2 msg MPI_Bcast complete msg = %d", msg));
 
+        /* Update the statistics of the component, the queue depth
+         * and the wait time are only known on the IO root. */
+        start_time = MPI_Wtime();
+        my_iosys->async_stats.nmsgs++;
+        if (!io_rank)
+        {
+            double wait_time = start_time - ready_time[index];
+
+            my_iosys->async_stats.queue_depth_sum += queue_depth;
+            my_iosys->async_stats.max_queue_depth = max(my_iosys->async_stats.max_queue_depth,
+                                                        queue_depth);
+            my_iosys->async_stats.wait_time += wait_time;
+            my_iosys->async_stats.max_wait_time = max(my_iosys->async_stats.max_wait_time,
+                                                      wait_time);
+        }
+
         /* Handle the message. This code is run on all IO tasks. */
+        PIO_TRACE_BEGIN(pio_async_msg_to_string(msg));
         switch (msg)
         {
         case PIO_MSG_INQ_TYPE:
@@ -3749,6 +4010,9 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
         case PIO_MSG_DEF_VAR_DEFLATE:
             ret = def_var_deflate_handler(my_iosys);
             break;
+        case PIO_MSG_DEF_VAR_QUANTIZE:
+            ret = def_var_quantize_handler(my_iosys);
+            break;
         case PIO_MSG_INQ_VAR_ENDIAN:
             ret = inq_var_endian_handler(my_iosys);
             break;
@@ -3827,6 +4091,15 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
         case PIO_MSG_SETERRORHANDLING:
             ret = seterrorhandling_handler(my_iosys);
             break;
+        case PIO_MSG_SET_PERF_REPORT:
+            ret = set_perf_report_handler(my_iosys);
+            break;
+        case PIO_MSG_SET_STAGE_LIMIT:
+            ret = set_stage_limit_handler(my_iosys);
+            break;
+        case PIO_MSG_OPEN_FILES:
+            ret = open_files_handler(my_iosys);
+            break;
         case PIO_MSG_SET_CHUNK_CACHE:
             ret = set_chunk_cache_handler(my_iosys);
             break;
@@ -3846,10 +4119,21 @@ int pio_msg_handler2(int io_rank, int component_count, iosystem_desc_t **iosys,
             LOG((0, "unknown message received %d", msg));
             return PIO_EINVAL;
         }
+        PIO_TRACE_END(pio_async_msg_to_string(msg));
 
         /* If an error was returned by the handler, do nothing! */
         LOG((3, "pio_msg_handler2 checking error ret = %d", ret));
 
+        /* The iosystem is freed once the component is finalized. */
+        if (msg != PIO_MSG_FINALIZE)
+        {
+            double handle_time = MPI_Wtime() - start_time;
+
+            my_iosys->async_stats.handle_time += handle_time;
+            my_iosys->async_stats.max_handle_time = max(my_iosys->async_stats.max_handle_time,
+                                                        handle_time);
+        }
+
         /* Listen for another msg from the component whose message we
          * just handled. */
         if (!io_rank && (msg != PIO_MSG_FINALIZE))
@@ -2708,6 +2708,7 @@ int PIOc_def_var(int ncid, const char *name, nc_type xtype, int ndims,
             check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
 
     strncpy(file->varlist[*varidp].vname, name, PIO_MAX_NAME);
+    file->varlist[*varidp].new_var = 1;
     if(file->num_unlim_dimids > 0)
     {
         int is_rec_var = 0;
@@ -2921,6 +2922,151 @@ int PIOc_def_var_fill(int ncid, int varid, int fill_mode, const void *fill_value
     return PIO_NOERR;
 }
 
+/**
+ * Set the quantize mode for a PIO_FLOAT or PIO_DOUBLE variable.
+ *
+ * Data written with PIOc_write_darray() or PIOc_write_darray_multi()
+ * is quantized on the IO tasks, after it is rearranged and before it
+ * is written to the file. Quantization sets the trailing bits of the
+ * significand of each value (that are not needed to keep the
+ * requested precision) to zeros/ones, so that the data compresses
+ * much better, e.g. when deflate is turned on for a netCDF-4 variable
+ * (see PIOc_def_var_deflate()) or when the file is compressed later.
+ * The quantized data is stored as regular float/double values, so
+ * the files can be read by any netCDF reader. Fill values, NaNs and
+ * infinities are not quantized.
+ *
+ * With PIO_QUANTIZE_BITGROOM, nsd is the number of significant
+ * decimal digits to keep (1 - 7 for PIO_FLOAT, 1 - 15 for
+ * PIO_DOUBLE). With PIO_QUANTIZE_BITROUND, nsd is the number of
+ * significant bits of the significand to keep (1 - 23 for PIO_FLOAT,
+ * 1 - 52 for PIO_DOUBLE). The quantize mode of a variable can be
+ * changed at any time, it applies to the data written after the
+ * call.
+ *
+ * @param ncid the ncid of the open file.
+ * @param varid the ID of the variable.
+ * @param quantize_mode PIO_NOQUANTIZE, PIO_QUANTIZE_BITGROOM or
+ * PIO_QUANTIZE_BITROUND.
+ * @param nsd the number of significant digits/bits to keep. Ignored
+ * for PIO_NOQUANTIZE.
+ * @return PIO_NOERR for success, otherwise an error code.
+ * @ingroup PIO_def_var
+ */
+int PIOc_def_var_quantize(int ncid, int varid, int quantize_mode, int nsd)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    file_desc_t *file;     /* Pointer to file information. */
+    nc_type xtype = NC_NAT;    /* The type of the variable. */
+    int ierr = PIO_NOERR;      /* Return code from function calls. */
+
+    LOG((1, "PIOc_def_var_quantize ncid = %d varid = %d quantize_mode = %d nsd = %d",
+         ncid, varid, quantize_mode, nsd));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+    {
+        return pio_err(NULL, NULL, ierr, __FILE__, __LINE__,
+                        "Defining quantize settings for variable (varid=%d) failed on file (ncid=%d). Unable to inquire internal structure associated with the file id", varid, ncid);
+    }
+    ios = file->iosystem;
+
+    if (varid < 0 || varid >= PIO_MAX_VARS)
+    {
+        return pio_err(ios, file, PIO_ENOTVAR, __FILE__, __LINE__,
+                        "Defining quantize settings for variable (varid=%d) failed on file %s (ncid=%d). Invalid variable id", varid, pio_get_fname_from_file(file), ncid);
+    }
+
+    /* Run this on all tasks if async is not in use, but only on
+     * non-IO tasks if async is in use. Check the parameters against
+     * the type of the variable. */
+    if (!ios->async || !ios->ioproc)
+    {
+        int max_nsd;
+
+        ierr = PIOc_inq_vartype(ncid, varid, &xtype);
+        if(ierr != PIO_NOERR){
+            LOG((1, "PIOc_inq_vartype failed, ierr = %d", ierr));
+            return ierr;
+        }
+
+        if (quantize_mode == PIO_QUANTIZE_BITGROOM)
+            max_nsd = (xtype == PIO_FLOAT) ? 7 : 15;
+        else
+            max_nsd = (xtype == PIO_FLOAT) ? 23 : 52;
+
+        if ((quantize_mode != PIO_NOQUANTIZE && quantize_mode != PIO_QUANTIZE_BITGROOM &&
+             quantize_mode != PIO_QUANTIZE_BITROUND) ||
+            (quantize_mode != PIO_NOQUANTIZE &&
+             ((xtype != PIO_FLOAT && xtype != PIO_DOUBLE) || nsd < 1 || nsd > max_nsd)))
+        {
+            return pio_err(ios, file, PIO_EINVAL, __FILE__, __LINE__,
+                            "Defining quantize settings for variable %s (varid=%d) failed on file %s (ncid=%d). Invalid quantize mode (%d) or number of significant digits (%d) for a variable of type %d", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid, quantize_mode, nsd, xtype);
+        }
+    }
+
+    /* If async is in use, and this is not an IO task, bcast the parameters. */
+    if (ios->async)
+    {
+        int msg = PIO_MSG_DEF_VAR_QUANTIZE;
+
+        PIO_SEND_ASYNC_MSG(ios, msg, &ierr, ncid, varid, quantize_mode, nsd);
+        if(ierr != PIO_NOERR)
+        {
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Defining quantize settings for variable %s (varid=%d) failed on file %s (ncid=%d). Unable to send asynchronous message, PIO_MSG_DEF_VAR_QUANTIZE, on iosystem (iosysid=%d)", pio_get_vname_from_file(file, varid), varid, pio_get_fname_from_file(file), ncid, ios->iosysid);
+        }
+    }
+
+    /* The data is quantized by PIO, on the IO tasks, so there is
+     * nothing to pass on to the underlying library. */
+    file->varlist[varid].quantize_mode = quantize_mode;
+    file->varlist[varid].nsd = (quantize_mode == PIO_NOQUANTIZE) ? 0 : nsd;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Get the quantize mode for a variable (see PIOc_def_var_quantize()).
+ *
+ * @param ncid the ncid of the open file.
+ * @param varid the ID of the variable.
+ * @param quantize_modep pointer that gets the quantize mode. Ignored
+ * if NULL.
+ * @param nsdp pointer that gets the number of significant
+ * digits/bits kept. Ignored if NULL.
+ * @return PIO_NOERR for success, otherwise an error code.
+ * @ingroup PIO_inq_var
+ */
+int PIOc_inq_var_quantize(int ncid, int varid, int *quantize_modep, int *nsdp)
+{
+    file_desc_t *file;     /* Pointer to file information. */
+    int ierr;              /* Return code from function calls. */
+
+    LOG((1, "PIOc_inq_var_quantize ncid = %d varid = %d", ncid, varid));
+
+    /* Get the file info. */
+    if ((ierr = pio_get_file(ncid, &file)))
+    {
+        return pio_err(NULL, NULL, ierr, __FILE__, __LINE__,
+                        "Inquiring quantize settings for variable (varid=%d) failed on file (ncid=%d). Unable to inquire internal structure associated with the file id", varid, ncid);
+    }
+
+    if (varid < 0 || varid >= PIO_MAX_VARS)
+    {
+        return pio_err(file->iosystem, file, PIO_ENOTVAR, __FILE__, __LINE__,
+                        "Inquiring quantize settings for variable (varid=%d) failed on file %s (ncid=%d). Invalid variable id", varid, pio_get_fname_from_file(file), ncid);
+    }
+
+    /* The settings are kept on all tasks, no communication is needed. */
+    if (quantize_modep)
+        *quantize_modep = file->varlist[varid].quantize_mode;
+    if (nsdp)
+        *nsdp = file->varlist[varid].nsd;
+
+    return PIO_NOERR;
+}
+
 /**
  * The PIO-C interface for the NetCDF function nc_inq_var_fill.
  *
@@ -8,12 +8,320 @@
 #include <pio.h>
 #include <pio_internal.h>
 
+/** Target size, in bytes, of the chunks chosen by PIO for netCDF-4
+ * variables. 0 if PIO does not choose the chunk sizes (the default),
+ * see PIOc_set_chunk_size_target(). */
+static PIO_Offset pio_chunk_size_target = 0;
+
+#ifdef _NETCDF4
+/** Max size, in bytes, of a chunk in a HDF5 dataset. */
+#define PIO_MAX_CHUNK_BYTES 4294967295LL
+
+/** Max number of target sized chunks in the chunk cache set by PIO
+ * for a variable. */
+#define PIO_MAX_CACHE_CHUNKS 4
+
+/** Number of hash table slots, per chunk that fits in the chunk
+ * cache, of the chunk cache set by PIO for a variable. HDF5
+ * recommends a number of slots much larger (about 10 times) than the
+ * number of chunks in the cache, so that chunks of the cache are
+ * rarely evicted because their slots collide. */
+#define PIO_CHUNK_CACHE_SLOTS_PER_CHUNK 10
+
+/** Preemption of the chunk cache set by PIO for a variable. This is
+ * the default of HDF5 (and netCDF): chunks that were fully written
+ * (or read) are evicted before the other chunks, PIO writes whole
+ * chunks. */
+#define PIO_CHUNK_CACHE_PREEMPTION 0.75
+#endif /* _NETCDF4 */
+
+/**
+ * Set the target size, in bytes, of the chunks that PIO chooses for
+ * the variables of netCDF-4 files. By default PIO does not choose
+ * chunk sizes, the chunk sizes are set by netCDF (or by the user with
+ * PIOc_def_var_chunking()). With a target size, when leaving define
+ * mode (see PIOc_enddef()) PIO sets the chunk sizes, and the chunk
+ * cache, of the new chunked variables of the file without user chunk
+ * sizes, including record variables, so that the chunks are aligned
+ * with the IO regions of a box rearranger decomposition (see
+ * def_var_decomp_chunking()). The chunk sizes are chosen on the IO
+ * tasks, when using async this function must be called on the IO
+ * tasks.
+ *
+ * Compressed variables of PIO_IOTYPE_NETCDF4P files always get chunk
+ * sizes aligned with the IO regions (see PIOc_def_var_deflate()), the
+ * chunks are then only limited by the max chunk size of HDF5 unless a
+ * target size is set.
+ *
+ * @param target the new target size in bytes. 0 turns off the chunk
+ * sizes chosen by PIO, negative values are ignored. Larger values are
+ * limited to the max chunk size of HDF5 (4 GiB).
+ * @returns the previous target size.
+ * @ingroup PIO_def_var
+ */
+PIO_Offset PIOc_set_chunk_size_target(PIO_Offset target)
+{
+    PIO_Offset oldtarget = pio_chunk_size_target;
+
+    if (target >= 0)
+    {
+#ifdef _NETCDF4
+        pio_chunk_size_target = (target > PIO_MAX_CHUNK_BYTES) ? PIO_MAX_CHUNK_BYTES : target;
+#else
+        pio_chunk_size_target = target;
+#endif
+    }
+    LOG((2, "PIOc_set_chunk_size_target oldtarget = %lld target = %lld",
+         oldtarget, pio_chunk_size_target));
+
+    return oldtarget;
+}
+
+#ifdef _NETCDF4
+/**
+ * Set the chunk sizes, and the chunk cache, of a chunked variable in
+ * a netCDF-4 file. The chunks are aligned with the IO regions of a box
+ * rearranger decomposition, i.e. each IO task writes whole chunks when
+ * the variable is written with that decomposition, and are close to
+ * (not larger than) the chunk size target (see
+ * PIOc_set_chunk_size_target()).
+ *
+ * The variable is not tied to a decomposition when it is defined, so
+ * the IO regions are taken from the first box rearranger
+ * decomposition of the IO system with the lengths of the fixed size
+ * dimensions of the variable, preferably of the type of the variable
+ * (see pio_find_iodesc()). The box rearranger gives each IO task a
+ * single IO region, of the same size on all IO tasks except for the
+ * remainder on the last ones, the smallest one is used (see
+ * PIOc_InitDecomp()). If there is no such decomposition, the IO
+ * regions of the box rearranger are computed (see
+ * CalcStartandCount()), variables written with a subset rearranger
+ * decomposition are not aligned. The chunk sizes start with the size
+ * of the IO regions. The slowest varying dimensions are then divided
+ * by the smallest divisors of their sizes that make the chunks small
+ * enough, so that the IO regions are still a multiple of the
+ * chunks. Unlimited dimensions get a chunk size of 1.
+ *
+ * With a chunk size target the chunk cache holds the chunks of one IO
+ * region (up to PIO_MAX_CACHE_CHUNKS target sized chunks), with
+ * PIO_CHUNK_CACHE_SLOTS_PER_CHUNK hash slots per chunk (plus one) and
+ * the default preemption. Without a target (compressed variables of
+ * PIO_IOTYPE_NETCDF4P files) the chunk cache is not changed.
+ *
+ * Contiguous variables, scalars and variables of non-atomic types
+ * are not changed.
+ *
+ * This function is called, with the same results, by all IO tasks
+ * that do IO on the file, and does not communicate.
+ *
+ * @param file pointer to the file_desc_t info.
+ * @param varid the ID of the variable.
+ * @returns 0 for success, error code otherwise.
+ */
+static int def_var_decomp_chunking(file_desc_t *file, int varid)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    nc_type xtype;         /* The type of the variable. */
+    size_t type_size;      /* The size of the type of the variable. */
+    int storage;           /* NC_CHUNKED or NC_CONTIGUOUS. */
+    int ndims;             /* The number of dimensions of the variable. */
+    int nunlimdims;        /* The number of unlimited dimensions in the file. */
+    PIO_Offset target;     /* Target size of the chunks. */
+    int ierr;              /* Return code from function calls. */
+
+    assert(file && file->iosystem && (file->iotype == PIO_IOTYPE_NETCDF4P ||
+                                      file->iotype == PIO_IOTYPE_NETCDF4C));
+    ios = file->iosystem;
+    target = (pio_chunk_size_target > 0) ? pio_chunk_size_target : PIO_MAX_CHUNK_BYTES;
+
+    if ((ierr = nc_inq_var(file->fh, varid, NULL, &xtype, &ndims, NULL, NULL)))
+        return ierr;
+
+    /* Leave the chunking of scalars and non-atomic types to netCDF. */
+    if (ndims == 0 || xtype >= NC_STRING)
+        return PIO_NOERR;
+
+    if ((ierr = nc_inq_var_chunking(file->fh, varid, &storage, NULL)))
+        return ierr;
+    if (storage != NC_CHUNKED)
+        return PIO_NOERR;
+
+    if ((ierr = nc_inq_type(file->fh, xtype, NULL, &type_size)))
+        return ierr;
+
+    if ((ierr = nc_inq_unlimdims(file->fh, &nunlimdims, NULL)))
+        return ierr;
+
+    {
+        int dimids[ndims];
+        int unlimdimids[nunlimdims + 1];
+        size_t chunksizes[ndims];
+        int fixed_dim[ndims];  /* Index of the var dimension of each fixed dimension. */
+        int gdims[ndims];      /* Lengths of the fixed dimensions. */
+        PIO_Offset count[ndims];   /* Size of the IO regions. */
+        PIO_Offset chunk_bytes;
+        PIO_Offset region_chunks = 1;  /* Number of chunks in an IO region. */
+        PIO_Offset cache_size;
+        io_desc_t *iodesc;
+        int nfixed = 0;
+
+        if ((ierr = nc_inq_vardimid(file->fh, varid, dimids)))
+            return ierr;
+        if ((ierr = nc_inq_unlimdims(file->fh, NULL, unlimdimids)))
+            return ierr;
+
+        for (int d = 0; d < ndims; d++)
+        {
+            bool unlim = false;
+            size_t dimlen;
+
+            chunksizes[d] = 1;
+            for (int u = 0; u < nunlimdims; u++)
+                if (dimids[d] == unlimdimids[u])
+                    unlim = true;
+            if (unlim)
+                continue;
+
+            if ((ierr = nc_inq_dimlen(file->fh, dimids[d], &dimlen)))
+                return ierr;
+            if (dimlen == 0)
+                return PIO_NOERR;
+            fixed_dim[nfixed] = d;
+            gdims[nfixed++] = (int)dimlen;
+        }
+
+        if (nfixed == 0)
+            return PIO_NOERR;
+
+        /* Find the size of the IO regions. */
+        if ((iodesc = pio_find_iodesc(ios->iosysid, xtype, nfixed, gdims)))
+        {
+            for (int f = 0; f < nfixed; f++)
+                count[f] = iodesc->ioregion_count[f];
+        }
+        else
+        {
+            PIO_Offset start[nfixed];
+            int num_aiotasks;
+
+            /* The regions of the first IO task are the smallest. */
+            if ((ierr = CalcStartandCount(xtype, nfixed, gdims, ios->num_iotasks, 0,
+                                          start, count, &num_aiotasks)))
+                return ierr;
+        }
+
+        chunk_bytes = type_size;
+        for (int f = 0; f < nfixed; f++)
+        {
+            chunksizes[fixed_dim[f]] = (count[f] > 0) ? count[f] : 1;
+            chunk_bytes *= chunksizes[fixed_dim[f]];
+        }
+
+        /* Divide the slowest varying dimensions until the chunks are
+         * not larger than the target size. */
+        for (int f = 0; f < nfixed && chunk_bytes > target; f++)
+        {
+            size_t *cs = &chunksizes[fixed_dim[f]];
+            PIO_Offset other_bytes = chunk_bytes / *cs;
+            size_t factor = (chunk_bytes + target - 1) / target;
+            size_t div = factor;
+
+            while (div < *cs && *cs % div)
+                div++;
+            if (div > *cs)
+                div = *cs;
+            *cs /= div;
+            region_chunks *= div;
+            chunk_bytes = other_bytes * *cs;
+        }
+
+        /* Cache the chunks of an IO region, but at least one chunk. */
+        cache_size = region_chunks * chunk_bytes;
+        if (cache_size > PIO_MAX_CACHE_CHUNKS * target)
+            cache_size = PIO_MAX_CACHE_CHUNKS * target;
+        if (cache_size < chunk_bytes)
+            cache_size = chunk_bytes;
+
+        LOG((2, "def_var_decomp_chunking varid = %d ndims = %d nfixed = %d chunk_bytes = %lld "
+             "cache_size = %lld", varid, ndims, nfixed, chunk_bytes, cache_size));
+
+        if ((ierr = nc_def_var_chunking(file->fh, varid, NC_CHUNKED, chunksizes)))
+            return ierr;
+
+        if (pio_chunk_size_target > 0 && !file->varlist[varid].user_chunk_cache)
+            if ((ierr = nc_set_var_chunk_cache(file->fh, varid, cache_size,
+                                               PIO_CHUNK_CACHE_SLOTS_PER_CHUNK *
+                                               (cache_size / chunk_bytes) + 1,
+                                               PIO_CHUNK_CACHE_PREEMPTION)))
+                return ierr;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Choose the chunk sizes of the variables of a netCDF-4 file that
+ * were defined since the file was last in define mode, except for
+ * the variables with chunk sizes set by the user (see
+ * def_var_decomp_chunking()). This is only done if a chunk size
+ * target is set (see PIOc_set_chunk_size_target()), otherwise only
+ * for the compressed variables of PIO_IOTYPE_NETCDF4P files. This
+ * function is called by all IO tasks that do IO on the file, before
+ * leaving define mode.
+ *
+ * @param file pointer to the file_desc_t info.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_def_decomp_chunking(file_desc_t *file)
+{
+    int nvars;
+    int ierr;
+
+    assert(file);
+
+    if (!pio_chunk_size_target && file->iotype != PIO_IOTYPE_NETCDF4P)
+        return PIO_NOERR;
+
+    if ((ierr = nc_inq_nvars(file->fh, &nvars)))
+        return ierr;
+
+    for (int v = 0; v < nvars && v < PIO_MAX_VARS; v++)
+    {
+        if (!file->varlist[v].new_var || file->varlist[v].user_chunking)
+            continue;
+
+        if (!pio_chunk_size_target)
+        {
+            int deflate;
+
+            if ((ierr = nc_inq_var_deflate(file->fh, v, NULL, &deflate, NULL)))
+                return ierr;
+            if (!deflate)
+                continue;
+        }
+
+        if ((ierr = def_var_decomp_chunking(file, v)))
+            return ierr;
+    }
+
+    return PIO_NOERR;
+}
+#endif /* _NETCDF4 */
+
 /**
  * Set deflate (zlib) settings for a variable.
  *
  * This function only applies to netCDF-4 files. When used with netCDF
  * classic files, the error PIO_ENOTNC4 will be returned.
  *
+ * With PIO_IOTYPE_NETCDF4P the data is compressed in parallel, each IO
+ * task compresses the chunks it writes. This requires a netCDF
+ * library with support for filters with parallel I/O (4.7.4 or
+ * later), otherwise PIO_EINVAL is returned. Unless the chunk sizes of
+ * the variable are set with PIOc_def_var_chunking(), PIO chooses chunk
+ * sizes that are aligned with the IO decomposition of the variable
+ * when leaving define mode (see PIOc_enddef()).
+ *
  * See the <a
  * href="http://www.unidata.ucar.edu/software/netcdf/docs/group__variables.html">netCDF
  * variable documentation</a> for details about the operation of this
@@ -69,18 +377,18 @@ int PIOc_def_var_deflate(int ncid, int varid, int shuffle, int deflate,
     if (ios->ioproc)
     {
 #ifdef _NETCDF4
-        if (file->iotype == PIO_IOTYPE_NETCDF4P)
+        /* Filters with parallel I/O require netCDF 4.7.4 or later. */
+        if (file->iotype == PIO_IOTYPE_NETCDF4P && !PIO_HAS_PAR_FILTERS)
             ierr = NC_EINVAL;
-        else
+        /* With PIO_IOTYPE_NETCDF4P all IO tasks define the filter
+         * collectively. */
+        else if (file->iotype == PIO_IOTYPE_NETCDF4P || file->do_io)
         {
-            if (file->do_io)
-            {
-                /* In NetCDF 4.7.4 and later releases, to set a new deflate level, deflation
-                   needs to be turned off first to unset existing deflate level */
-                ierr = nc_def_var_deflate(file->fh, varid, 0, 0, 1);
-                if (ierr == PIO_NOERR)
-                    ierr = nc_def_var_deflate(file->fh, varid, shuffle, deflate, deflate_level);
-            }
+            /* In NetCDF 4.7.4 and later releases, to set a new deflate level, deflation
+               needs to be turned off first to unset existing deflate level */
+            ierr = nc_def_var_deflate(file->fh, varid, 0, 0, 1);
+            if (ierr == PIO_NOERR)
+                ierr = nc_def_var_deflate(file->fh, varid, shuffle, deflate, deflate_level);
         }
 #endif
     }
@@ -314,6 +622,9 @@ int PIOc_def_var_chunking(int ncid, int varid, int storage, const PIO_Offset *ch
         return ierr;
     }
 
+    /* Do not change the chunk sizes set by the user. */
+    file->varlist[varid].user_chunking = 1;
+
     return PIO_NOERR;
 }
 
@@ -865,6 +1176,9 @@ int PIOc_set_var_chunk_cache(int ncid, int varid, PIO_Offset size, PIO_Offset ne
         return ierr;
     }
 
+    /* Do not change the chunk cache set by the user. */
+    file->varlist[varid].user_chunk_cache = 1;
+
     return PIO_NOERR;
 }
 
@@ -0,0 +1,527 @@
+/**
+ * @file
+ * I/O performance reports. The I/O performance statistics of the
+ * files and variables (see pio_perf_stats_t) are always collected,
+ * when the user turns on the reports (see PIOc_set_perf_report()) the
+ * statistics of a file are reduced over the tasks when the file is
+ * closed, and the IO root appends a report of the file to a JSON or
+ * CSV report file. With async I/O, the statistics of the service for
+ * each component are also reported when the component is finalized.
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+
+/** Prefix of the names of the report files, the names of the files
+ * are pio_perf_report_<iosysid>.json and pio_perf_report_<iosysid>.csv */
+#define PIO_PERF_REPORT_PREFIX "pio_perf_report"
+
+/** Statistics reduced over the IO tasks (io_comm). */
+enum PIO_PERF_IO_STATS
+{
+    PIO_PERF_WR_BYTES = 0,
+    PIO_PERF_RD_BYTES,
+    PIO_PERF_WR_IO_TIME,
+    PIO_PERF_RD_IO_TIME,
+    PIO_PERF_NWAITS,
+    PIO_PERF_WAIT_TIME,
+    PIO_PERF_NUM_IO_STATS
+};
+
+/** Statistics reduced over all tasks (my_comm). */
+enum PIO_PERF_COMP_STATS
+{
+    PIO_PERF_NWRITES = 0,
+    PIO_PERF_NREADS,
+    PIO_PERF_NFLUSHES,
+    PIO_PERF_WR_REARR_TIME,
+    PIO_PERF_RD_REARR_TIME,
+    PIO_PERF_NUM_COMP_STATS
+};
+
+/** Reduced statistics of a file or a variable. */
+typedef struct pio_perf_summary_t
+{
+    /** Min, max and sum over the IO tasks. */
+    double io_min[PIO_PERF_NUM_IO_STATS];
+    double io_max[PIO_PERF_NUM_IO_STATS];
+    double io_sum[PIO_PERF_NUM_IO_STATS];
+
+    /** Min, max and sum over all tasks. */
+    double comp_min[PIO_PERF_NUM_COMP_STATS];
+    double comp_max[PIO_PERF_NUM_COMP_STATS];
+    double comp_sum[PIO_PERF_NUM_COMP_STATS];
+} pio_perf_summary_t;
+
+/**
+ * Set the format of the I/O performance reports written when files
+ * are closed. For each file closed, the statistics of the file and of
+ * its variables (bytes written/read, time spent rearranging data and
+ * in the underlying I/O library, number of flushes of the write multi
+ * buffers and of waits on pending PnetCDF requests) are reduced
+ * (min/max/mean) over the tasks, and the IO root appends the report
+ * of the file to pio_perf_report_<iosysid>.json (one JSON object per
+ * line) or to pio_perf_report_<iosysid>.csv (one row per variable and
+ * a row, with an empty variable name, with the totals of the file).
+ *
+ * The statistics are always collected, the reports only add a few
+ * reductions when closing files. Reports are not written for files
+ * with the PIO_IOTYPE_ADIOS iotype.
+ *
+ * With async I/O, the IO root of each component also appends the
+ * statistics of the async service for the component (number of
+ * messages, queue depth, wait and handling times of the messages,
+ * see pio_async_stats_t) to pio_perf_report_async_<iosysid>.json or
+ * .csv when the component is finalized.
+ *
+ * This function is collective on the IO system.
+ *
+ * @param iosysid the IO system ID.
+ * @param format PIO_PERF_REPORT_JSON, PIO_PERF_REPORT_CSV or
+ * PIO_PERF_REPORT_NONE (the default) to turn off the reports.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_perf_report
+ */
+int PIOc_set_perf_report(int iosysid, int format)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+    int ierr = PIO_NOERR;  /* Return code. */
+
+    LOG((1, "PIOc_set_perf_report iosysid = %d format = %d", iosysid, format));
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the format of the I/O performance reports failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    if (format != PIO_PERF_REPORT_NONE && format != PIO_PERF_REPORT_JSON &&
+        format != PIO_PERF_REPORT_CSV)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Setting the format of the I/O performance reports failed. Invalid format (%d) provided for iosystem (iosysid=%d)", format, iosysid);
+    }
+
+    /* If using async, and not an IO task, then send parameters. */
+    if (ios->async)
+    {
+        int msg = PIO_MSG_SET_PERF_REPORT;
+
+        PIO_SEND_ASYNC_MSG(ios, msg, &ierr, iosysid, format);
+        if(ierr != PIO_NOERR)
+        {
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Setting the format of the I/O performance reports failed. Error sending async msg PIO_MSG_SET_PERF_REPORT (iosysid=%d)", iosysid);
+        }
+    }
+
+    ios->perf_report = format;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Get the local statistics of a variable (or of a file) that are
+ * reduced over the IO tasks and over all tasks.
+ *
+ * @param perf pointer to the statistics.
+ * @param io_stats array (of length PIO_PERF_NUM_IO_STATS) that gets
+ * the statistics reduced over the IO tasks.
+ * @param comp_stats array (of length PIO_PERF_NUM_COMP_STATS) that
+ * gets the statistics reduced over all tasks.
+ */
+static void pio_perf_get_stats(const pio_perf_stats_t *perf, double *io_stats,
+                               double *comp_stats)
+{
+    io_stats[PIO_PERF_WR_BYTES] = (double)perf->wr_bytes;
+    io_stats[PIO_PERF_RD_BYTES] = (double)perf->rd_bytes;
+    io_stats[PIO_PERF_WR_IO_TIME] = perf->wr_io_time;
+    io_stats[PIO_PERF_RD_IO_TIME] = perf->rd_io_time;
+    io_stats[PIO_PERF_NWAITS] = (double)perf->nwaits;
+    io_stats[PIO_PERF_WAIT_TIME] = perf->wait_time;
+
+    comp_stats[PIO_PERF_NWRITES] = (double)perf->nwrites;
+    comp_stats[PIO_PERF_NREADS] = (double)perf->nreads;
+    comp_stats[PIO_PERF_NFLUSHES] = (double)perf->nflushes;
+    comp_stats[PIO_PERF_WR_REARR_TIME] = perf->wr_rearr_time;
+    comp_stats[PIO_PERF_RD_REARR_TIME] = perf->rd_rearr_time;
+}
+
+/**
+ * Get the bandwidth (bytes/sec) of the writes or reads of a variable
+ * (or a file), the total bytes divided by the time of the slowest IO
+ * task.
+ */
+static double pio_perf_bw(const pio_perf_summary_t *s, int bytes, int io_time)
+{
+    return (s->io_max[io_time] > 0) ? s->io_sum[bytes] / s->io_max[io_time] : 0;
+}
+
+/**
+ * Get the load imbalance (max/mean) of a statistic over the IO tasks.
+ */
+static double pio_perf_imbalance(const pio_perf_summary_t *s, int stat, int num_iotasks)
+{
+    double mean = s->io_sum[stat] / num_iotasks;
+
+    return (mean > 0) ? s->io_max[stat] / mean : 1;
+}
+
+/**
+ * Write a string, with JSON escapes, to a report.
+ */
+static void pio_perf_json_str(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (const char *c = str; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)*c >= ' ')
+            fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+/**
+ * Write a quoted string to a CSV report.
+ */
+static void pio_perf_csv_str(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (const char *c = str; *c; c++)
+    {
+        if (*c == '"')
+            fputc('"', fp);
+        fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+/**
+ * Write the reduced statistics of a variable (or a file), a JSON
+ * object without the enclosing braces, to a JSON report.
+ */
+static void pio_perf_json_summary(FILE *fp, const pio_perf_summary_t *s,
+                                  int num_iotasks, int num_comptasks)
+{
+    fprintf(fp, "\"nwrites\":%.0f,\"nreads\":%.0f,\"wr_bytes\":%.0f,\"rd_bytes\":%.0f",
+            s->comp_max[PIO_PERF_NWRITES], s->comp_max[PIO_PERF_NREADS],
+            s->io_sum[PIO_PERF_WR_BYTES], s->io_sum[PIO_PERF_RD_BYTES]);
+    fprintf(fp, ",\"wr_rearr_time\":{\"min\":%g,\"max\":%g,\"mean\":%g}",
+            s->comp_min[PIO_PERF_WR_REARR_TIME], s->comp_max[PIO_PERF_WR_REARR_TIME],
+            s->comp_sum[PIO_PERF_WR_REARR_TIME] / num_comptasks);
+    fprintf(fp, ",\"wr_io_time\":{\"min\":%g,\"max\":%g,\"mean\":%g}",
+            s->io_min[PIO_PERF_WR_IO_TIME], s->io_max[PIO_PERF_WR_IO_TIME],
+            s->io_sum[PIO_PERF_WR_IO_TIME] / num_iotasks);
+    fprintf(fp, ",\"rd_rearr_time\":{\"min\":%g,\"max\":%g,\"mean\":%g}",
+            s->comp_min[PIO_PERF_RD_REARR_TIME], s->comp_max[PIO_PERF_RD_REARR_TIME],
+            s->comp_sum[PIO_PERF_RD_REARR_TIME] / num_comptasks);
+    fprintf(fp, ",\"rd_io_time\":{\"min\":%g,\"max\":%g,\"mean\":%g}",
+            s->io_min[PIO_PERF_RD_IO_TIME], s->io_max[PIO_PERF_RD_IO_TIME],
+            s->io_sum[PIO_PERF_RD_IO_TIME] / num_iotasks);
+    fprintf(fp, ",\"wr_bw\":%g,\"rd_bw\":%g,\"wr_bytes_imbalance\":%g,\"wr_io_imbalance\":%g"
+            ",\"rd_bytes_imbalance\":%g,\"rd_io_imbalance\":%g",
+            pio_perf_bw(s, PIO_PERF_WR_BYTES, PIO_PERF_WR_IO_TIME),
+            pio_perf_bw(s, PIO_PERF_RD_BYTES, PIO_PERF_RD_IO_TIME),
+            pio_perf_imbalance(s, PIO_PERF_WR_BYTES, num_iotasks),
+            pio_perf_imbalance(s, PIO_PERF_WR_IO_TIME, num_iotasks),
+            pio_perf_imbalance(s, PIO_PERF_RD_BYTES, num_iotasks),
+            pio_perf_imbalance(s, PIO_PERF_RD_IO_TIME, num_iotasks));
+}
+
+/**
+ * Write a row of reduced statistics of a variable (or a file) to a
+ * CSV report.
+ */
+static void pio_perf_csv_row(FILE *fp, const char *fname, const char *vname,
+                             const pio_perf_summary_t *s, int num_iotasks,
+                             int num_comptasks)
+{
+    pio_perf_csv_str(fp, fname);
+    fputc(',', fp);
+    pio_perf_csv_str(fp, vname);
+    fprintf(fp, ",%.0f,%.0f,%.0f,%.0f,%.0f,%.0f",
+            s->comp_max[PIO_PERF_NWRITES], s->comp_max[PIO_PERF_NREADS],
+            s->comp_max[PIO_PERF_NFLUSHES], s->io_max[PIO_PERF_NWAITS],
+            s->io_sum[PIO_PERF_WR_BYTES], s->io_sum[PIO_PERF_RD_BYTES]);
+    fprintf(fp, ",%g,%g,%g,%g,%g,%g",
+            s->comp_min[PIO_PERF_WR_REARR_TIME], s->comp_max[PIO_PERF_WR_REARR_TIME],
+            s->comp_sum[PIO_PERF_WR_REARR_TIME] / num_comptasks,
+            s->io_min[PIO_PERF_WR_IO_TIME], s->io_max[PIO_PERF_WR_IO_TIME],
+            s->io_sum[PIO_PERF_WR_IO_TIME] / num_iotasks);
+    fprintf(fp, ",%g,%g,%g,%g,%g,%g",
+            s->comp_min[PIO_PERF_RD_REARR_TIME], s->comp_max[PIO_PERF_RD_REARR_TIME],
+            s->comp_sum[PIO_PERF_RD_REARR_TIME] / num_comptasks,
+            s->io_min[PIO_PERF_RD_IO_TIME], s->io_max[PIO_PERF_RD_IO_TIME],
+            s->io_sum[PIO_PERF_RD_IO_TIME] / num_iotasks);
+    fprintf(fp, ",%g,%g,%g,%g,%g,%g,%g,%g,%g\n",
+            s->io_min[PIO_PERF_WAIT_TIME], s->io_max[PIO_PERF_WAIT_TIME],
+            s->io_sum[PIO_PERF_WAIT_TIME] / num_iotasks,
+            pio_perf_bw(s, PIO_PERF_WR_BYTES, PIO_PERF_WR_IO_TIME),
+            pio_perf_bw(s, PIO_PERF_RD_BYTES, PIO_PERF_RD_IO_TIME),
+            pio_perf_imbalance(s, PIO_PERF_WR_BYTES, num_iotasks),
+            pio_perf_imbalance(s, PIO_PERF_WR_IO_TIME, num_iotasks),
+            pio_perf_imbalance(s, PIO_PERF_RD_BYTES, num_iotasks),
+            pio_perf_imbalance(s, PIO_PERF_RD_IO_TIME, num_iotasks));
+}
+
+/**
+ * Write the I/O performance report of a file (see
+ * PIOc_set_perf_report()). The statistics of the file and of its
+ * variables are reduced over the IO tasks and over all tasks, and
+ * the IO root appends the report to the report file of the IO
+ * system. Errors writing the report file are logged but not
+ * returned, a report never fails the close of a file.
+ *
+ * This function is collective on the union of the compute and IO
+ * tasks (ios->my_comm), and is called when closing a file.
+ *
+ * @param file pointer to the file_desc_t of the file.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_write_perf_report(file_desc_t *file)
+{
+    iosystem_desc_t *ios;
+    int nvars = 0;         /* Number of vars reported (max varid + 1). */
+    int nstats;            /* Number of files and vars reported. */
+    int num_comptasks;     /* Number of tasks in my_comm. */
+    double *io_stats = NULL, *io_min = NULL, *io_max = NULL, *io_sum = NULL;
+    double *comp_stats = NULL, *comp_min = NULL, *comp_max = NULL, *comp_sum = NULL;
+    pio_perf_stats_t ftotal;
+    int mpierr = MPI_SUCCESS;  /* Return code from MPI functions. */
+    int ierr = PIO_NOERR;
+
+    pioassert(file && file->iosystem, "invalid input", __FILE__, __LINE__);
+    ios = file->iosystem;
+
+#ifdef TIMING
+    GPTLstart("PIO:pio_write_perf_report");
+#endif
+    LOG((2, "pio_write_perf_report file = %s format = %d", pio_get_fname_from_file(file),
+         ios->perf_report));
+
+    /* Report the variables up to the last one with any activity on
+     * any task. */
+    for (int v = PIO_MAX_VARS - 1; v >= 0; v--)
+        if (file->varlist[v].perf.nwrites || file->varlist[v].perf.nreads)
+        {
+            nvars = v + 1;
+            break;
+        }
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &nvars, 1, MPI_INT, MPI_MAX, ios->my_comm)))
+        return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+    if ((mpierr = MPI_Comm_size(ios->my_comm, &num_comptasks)))
+        return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+
+    /* The first entry is the total of the file. */
+    nstats = nvars + 1;
+    io_stats = malloc(4 * nstats * PIO_PERF_NUM_IO_STATS * sizeof(double));
+    comp_stats = malloc(4 * nstats * PIO_PERF_NUM_COMP_STATS * sizeof(double));
+    if (!io_stats || !comp_stats)
+    {
+        free(io_stats);
+        free(comp_stats);
+        return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Writing the I/O performance report of file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for the statistics", pio_get_fname_from_file(file), file->pio_ncid, (long long int) (4 * nstats * (PIO_PERF_NUM_IO_STATS + PIO_PERF_NUM_COMP_STATS) * sizeof(double)));
+    }
+    io_min = io_stats + nstats * PIO_PERF_NUM_IO_STATS;
+    io_max = io_min + nstats * PIO_PERF_NUM_IO_STATS;
+    io_sum = io_max + nstats * PIO_PERF_NUM_IO_STATS;
+    comp_min = comp_stats + nstats * PIO_PERF_NUM_COMP_STATS;
+    comp_max = comp_min + nstats * PIO_PERF_NUM_COMP_STATS;
+    comp_sum = comp_max + nstats * PIO_PERF_NUM_COMP_STATS;
+
+    /* Get the local statistics, the file totals are the sums of the
+     * statistics of the vars. */
+    ftotal = file->perf;
+    for (int v = 0; v < nvars; v++)
+    {
+        pio_perf_stats_t *perf = &file->varlist[v].perf;
+
+        ftotal.nwrites += perf->nwrites;
+        ftotal.nreads += perf->nreads;
+        ftotal.wr_bytes += perf->wr_bytes;
+        ftotal.rd_bytes += perf->rd_bytes;
+        ftotal.wr_rearr_time += perf->wr_rearr_time;
+        ftotal.rd_rearr_time += perf->rd_rearr_time;
+        ftotal.wr_io_time += perf->wr_io_time;
+        ftotal.rd_io_time += perf->rd_io_time;
+        pio_perf_get_stats(perf, io_stats + (v + 1) * PIO_PERF_NUM_IO_STATS,
+                           comp_stats + (v + 1) * PIO_PERF_NUM_COMP_STATS);
+    }
+    pio_perf_get_stats(&ftotal, io_stats, comp_stats);
+
+    /* Reduce the statistics to the IO root. The IO root is the root
+     * of io_comm, and is ios->ioroot in my_comm. */
+    if (ios->ioproc)
+    {
+        int count = nstats * PIO_PERF_NUM_IO_STATS;
+
+        if ((mpierr = MPI_Reduce(io_stats, io_min, count, MPI_DOUBLE, MPI_MIN, 0, ios->io_comm)))
+            ierr = check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+        if (!ierr && (mpierr = MPI_Reduce(io_stats, io_max, count, MPI_DOUBLE, MPI_MAX, 0, ios->io_comm)))
+            ierr = check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+        if (!ierr && (mpierr = MPI_Reduce(io_stats, io_sum, count, MPI_DOUBLE, MPI_SUM, 0, ios->io_comm)))
+            ierr = check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+    }
+    if (!ierr)
+    {
+        int count = nstats * PIO_PERF_NUM_COMP_STATS;
+
+        if ((mpierr = MPI_Reduce(comp_stats, comp_min, count, MPI_DOUBLE, MPI_MIN, ios->ioroot, ios->my_comm)))
+            ierr = check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+        if (!ierr && (mpierr = MPI_Reduce(comp_stats, comp_max, count, MPI_DOUBLE, MPI_MAX, ios->ioroot, ios->my_comm)))
+            ierr = check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+        if (!ierr && (mpierr = MPI_Reduce(comp_stats, comp_sum, count, MPI_DOUBLE, MPI_SUM, ios->ioroot, ios->my_comm)))
+            ierr = check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+    }
+
+    /* The IO root appends the report to the report file. */
+    if (!ierr && ios->ioproc && ios->io_rank == 0)
+    {
+        char rname[PIO_MAX_NAME + 1];
+        const char *fname = pio_get_fname_from_file(file);
+        pio_perf_summary_t *s;
+        FILE *fp;
+
+        snprintf(rname, PIO_MAX_NAME + 1, "%s_%d.%s", PIO_PERF_REPORT_PREFIX, ios->iosysid,
+                 (ios->perf_report == PIO_PERF_REPORT_CSV) ? "csv" : "json");
+
+        if (!(s = malloc(nstats * sizeof(pio_perf_summary_t))))
+        {
+            free(io_stats);
+            free(comp_stats);
+            return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Writing the I/O performance report of file (%s, ncid=%d) failed. Out of memory allocating %lld bytes for the statistics", fname, file->pio_ncid, (long long int) (nstats * sizeof(pio_perf_summary_t)));
+        }
+        for (int i = 0; i < nstats; i++)
+        {
+            memcpy(s[i].io_min, io_min + i * PIO_PERF_NUM_IO_STATS, sizeof(s[i].io_min));
+            memcpy(s[i].io_max, io_max + i * PIO_PERF_NUM_IO_STATS, sizeof(s[i].io_max));
+            memcpy(s[i].io_sum, io_sum + i * PIO_PERF_NUM_IO_STATS, sizeof(s[i].io_sum));
+            memcpy(s[i].comp_min, comp_min + i * PIO_PERF_NUM_COMP_STATS, sizeof(s[i].comp_min));
+            memcpy(s[i].comp_max, comp_max + i * PIO_PERF_NUM_COMP_STATS, sizeof(s[i].comp_max));
+            memcpy(s[i].comp_sum, comp_sum + i * PIO_PERF_NUM_COMP_STATS, sizeof(s[i].comp_sum));
+        }
+
+        if (!(fp = fopen(rname, "a")))
+        {
+            LOG((1, "Unable to open the I/O performance report file %s", rname));
+        }
+        else if (ios->perf_report == PIO_PERF_REPORT_CSV)
+        {
+            /* Write the header to new report files. */
+            if (ftell(fp) == 0)
+                fprintf(fp, "file,var,nwrites,nreads,nflushes,nwaits,wr_bytes,rd_bytes,"
+                        "wr_rearr_time_min,wr_rearr_time_max,wr_rearr_time_mean,"
+                        "wr_io_time_min,wr_io_time_max,wr_io_time_mean,"
+                        "rd_rearr_time_min,rd_rearr_time_max,rd_rearr_time_mean,"
+                        "rd_io_time_min,rd_io_time_max,rd_io_time_mean,"
+                        "wait_time_min,wait_time_max,wait_time_mean,wr_bw,rd_bw,"
+                        "wr_bytes_imbalance,wr_io_imbalance,rd_bytes_imbalance,rd_io_imbalance\n");
+            for (int v = 0; v < nvars; v++)
+                if (s[v + 1].comp_max[PIO_PERF_NWRITES] > 0 || s[v + 1].comp_max[PIO_PERF_NREADS] > 0)
+                    pio_perf_csv_row(fp, fname, pio_get_vname_from_file(file, v), &s[v + 1],
+                                     ios->num_iotasks, num_comptasks);
+            pio_perf_csv_row(fp, fname, "", &s[0], ios->num_iotasks, num_comptasks);
+            fclose(fp);
+        }
+        else
+        {
+            bool first = true;
+
+            fputs("{\"file\":", fp);
+            pio_perf_json_str(fp, fname);
+            fprintf(fp, ",\"iotype\":\"%s\",\"ntasks\":%d,\"niotasks\":%d,",
+                    pio_iotype_to_string(file->iotype), num_comptasks, ios->num_iotasks);
+            pio_perf_json_summary(fp, &s[0], ios->num_iotasks, num_comptasks);
+            fprintf(fp, ",\"nflushes\":%.0f,\"nwaits\":%.0f"
+                    ",\"wait_time\":{\"min\":%g,\"max\":%g,\"mean\":%g},\"vars\":[",
+                    s[0].comp_max[PIO_PERF_NFLUSHES], s[0].io_max[PIO_PERF_NWAITS],
+                    s[0].io_min[PIO_PERF_WAIT_TIME], s[0].io_max[PIO_PERF_WAIT_TIME],
+                    s[0].io_sum[PIO_PERF_WAIT_TIME] / ios->num_iotasks);
+            for (int v = 0; v < nvars; v++)
+            {
+                if (s[v + 1].comp_max[PIO_PERF_NWRITES] == 0 && s[v + 1].comp_max[PIO_PERF_NREADS] == 0)
+                    continue;
+                fputs(first ? "{\"name\":" : ",{\"name\":", fp);
+                pio_perf_json_str(fp, pio_get_vname_from_file(file, v));
+                fputc(',', fp);
+                pio_perf_json_summary(fp, &s[v + 1], ios->num_iotasks, num_comptasks);
+                fputc('}', fp);
+                first = false;
+            }
+            fputs("]}\n", fp);
+            fclose(fp);
+        }
+        free(s);
+    }
+
+    free(io_stats);
+    free(comp_stats);
+
+#ifdef TIMING
+    GPTLstop("PIO:pio_write_perf_report");
+#endif
+    return ierr;
+}
+
+/**
+ * Write the statistics of the asynchronous I/O service for a
+ * computation component (see pio_async_stats_t), when the component
+ * is finalized and I/O performance reports are turned on (see
+ * PIOc_set_perf_report()). The IO root of the component appends the
+ * statistics to pio_perf_report_async_<iosysid>.json or .csv. Errors
+ * are logged but not returned.
+ *
+ * This function is local, and is called on the IO root.
+ *
+ * @param ios pointer to the iosystem_desc_t of the component.
+ */
+void pio_write_async_report(iosystem_desc_t *ios)
+{
+    const pio_async_stats_t *st;
+    char rname[PIO_MAX_NAME + 1];
+    double nmsgs;
+    FILE *fp;
+
+    pioassert(ios, "invalid input", __FILE__, __LINE__);
+    st = &ios->async_stats;
+    nmsgs = (st->nmsgs > 0) ? (double)st->nmsgs : 1;
+
+    snprintf(rname, PIO_MAX_NAME + 1, "%s_async_%d.%s", PIO_PERF_REPORT_PREFIX, ios->iosysid,
+             (ios->perf_report == PIO_PERF_REPORT_CSV) ? "csv" : "json");
+    if (!(fp = fopen(rname, "a")))
+    {
+        LOG((1, "Unable to open the async I/O service report file %s", rname));
+        return;
+    }
+
+    if (ios->perf_report == PIO_PERF_REPORT_CSV)
+    {
+        /* Write the header to new report files. */
+        if (ftell(fp) == 0)
+            fprintf(fp, "iosysid,component,niotasks,nmsgs,queue_depth_max,queue_depth_mean,"
+                    "wait_time_total,wait_time_max,wait_time_mean,"
+                    "handle_time_total,handle_time_max,handle_time_mean\n");
+        fprintf(fp, "%d,%d,%d,%lld,%d,%g,%g,%g,%g,%g,%g,%g\n", ios->iosysid, ios->comp_idx,
+                ios->num_iotasks, (long long int)st->nmsgs, st->max_queue_depth,
+                st->queue_depth_sum / nmsgs, st->wait_time, st->max_wait_time,
+                st->wait_time / nmsgs, st->handle_time, st->max_handle_time,
+                st->handle_time / nmsgs);
+    }
+    else
+    {
+        fprintf(fp, "{\"iosysid\":%d,\"component\":%d,\"niotasks\":%d,\"nmsgs\":%lld"
+                ",\"queue_depth\":{\"max\":%d,\"mean\":%g}"
+                ",\"wait_time\":{\"total\":%g,\"max\":%g,\"mean\":%g}"
+                ",\"handle_time\":{\"total\":%g,\"max\":%g,\"mean\":%g}}\n",
+                ios->iosysid, ios->comp_idx, ios->num_iotasks, (long long int)st->nmsgs,
+                st->max_queue_depth, st->queue_depth_sum / nmsgs, st->wait_time,
+                st->max_wait_time, st->wait_time / nmsgs, st->handle_time,
+                st->max_handle_time, st->handle_time / nmsgs);
+    }
+    fclose(fp);
+}
@@ -0,0 +1,722 @@
+/**
+ * @file
+ * Rearranger plan cache. When the user sets a cache directory (see
+ * PIOc_set_rearr_plan_cache()) the rearranger setup computed for a
+ * decomposition (the plan: the send/receive counts and indices, the
+ * IO regions and the fill regions) is saved to a file in the cache
+ * directory. Decompositions created later, usually by later runs of
+ * the model, with the same map on the same tasks and IO tasks load
+ * the plan from the file instead of computing it.
+ *
+ * The plan of a decomposition is saved to one file, written and read
+ * in parallel with MPI-IO. The file starts with a header, followed by
+ * the offset and size of the plan of each task, followed by the plans
+ * of the tasks. The plans are saved in the native binary format, so
+ * the files can only be read on systems with the same format.
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+
+/** Magic string at the beginning of the plan files. */
+#define PIO_PLAN_MAGIC "PIOPLAN"
+
+/** Version of the format of the plan files. */
+#define PIO_PLAN_VERSION 2
+
+/** Prefix of the names of the plan files, the names of the files are
+ * pio_plan_<key>.dat */
+#define PIO_PLAN_PREFIX "pio_plan"
+
+/** The target blocksize of the box rearranger (see
+ * PIOc_set_blocksize()). */
+extern int blocksize;
+
+/** Header of a plan file. */
+typedef struct pio_plan_header_t
+{
+    /** PIO_PLAN_MAGIC. */
+    char magic[8];
+
+    /** PIO_PLAN_VERSION. */
+    int version;
+
+    /** Size of a PIO_Offset, the plans are in the native format. */
+    int offset_size;
+
+    /** Number of tasks and of IO tasks of the IO system. */
+    int ntasks;
+    int num_iotasks;
+
+    /** The rearranger and the number of dimensions of the
+     * decomposition. */
+    int rearranger;
+    int ndims;
+
+    /** Key of the plan, also in the name of the file. */
+    unsigned long long key[2];
+} pio_plan_header_t;
+
+/**
+ * Set the directory of the rearranger plan cache. The rearranger
+ * setup of the decompositions created afterwards on the IO system is
+ * loaded from the cache if a decomposition with the same map was
+ * saved by an earlier run on the same tasks and IO tasks, and is
+ * saved to the cache otherwise. This saves the cost of computing the
+ * setup of large decompositions at every model startup.
+ *
+ * The directory must exist. The plans are saved in the native binary
+ * format. The cache is not used for asynchronous IO systems, nor for
+ * decompositions created with user provided IO regions (iostart and
+ * iocount).
+ *
+ * This function is collective on the IO system, and must be called
+ * with the same directory on all tasks.
+ *
+ * @param iosysid the IO system ID.
+ * @param dirname the name of the cache directory, NULL (the default)
+ * to turn off the cache.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_rearr_plan_cache
+ */
+int PIOc_set_rearr_plan_cache(int iosysid, const char *dirname)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+
+    LOG((1, "PIOc_set_rearr_plan_cache iosysid = %d dirname = %s", iosysid,
+         dirname ? dirname : "NULL"));
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the rearranger plan cache directory failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    free(ios->plan_cache_dir);
+    ios->plan_cache_dir = NULL;
+
+    if (dirname)
+    {
+        if (!(ios->plan_cache_dir = malloc(strlen(dirname) + 1)))
+        {
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Setting the rearranger plan cache directory failed. Out of memory allocating %lld bytes for the name of the directory on iosystem (iosysid=%d)", (unsigned long long) (strlen(dirname) + 1), iosysid);
+        }
+        strcpy(ios->plan_cache_dir, dirname);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Compute the key of the plan of a decomposition. The key depends on
+ * the maps of all the tasks, on the IO tasks and on the parameters of
+ * the rearranger. This is collective on the IO system.
+ *
+ * @param ios pointer to the IO system info.
+ * @param iodesc pointer to the decomposition info.
+ * @param key array of length 2 that gets the key.
+ * @returns 0 for success, error code otherwise.
+ */
+static int pio_plan_key(iosystem_desc_t *ios, io_desc_t *iodesc, unsigned long long *key)
+{
+    unsigned long long task[5]; /* Fingerprint of the part of this task. */
+    int mpierr;
+
+    /* The map and the role of this task. The fingerprints of the tasks
+     * are combined with two different hashes. */
+    task[0] = ios->union_rank;
+    task[1] = iodesc->hash;
+    task[2] = iodesc->maplen;
+    task[3] = ios->ioproc;
+    task[4] = ios->io_rank;
+    key[0] = pio_fnv_hash(PIO_FNV_BASIS, task, sizeof(task));
+    key[1] = pio_fnv_hash(~PIO_FNV_BASIS, task, sizeof(task));
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, key, 2, MPI_UNSIGNED_LONG_LONG, MPI_BXOR,
+                                ios->union_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+
+    /* The IO tasks and the parameters of the rearranger. The box
+     * rearranger partitions the data in blocks of the target
+     * blocksize. */
+    for (int k = 0; k < 2; k++)
+    {
+        int param[4] = {PIO_PLAN_VERSION, ios->num_uniontasks, iodesc->rearranger, 0};
+
+        if (iodesc->rearranger == PIO_REARR_BOX)
+            param[3] = blocksize / iodesc->mpitype_size;
+        key[k] = pio_fnv_hash(key[k], param, sizeof(param));
+        key[k] = pio_fnv_hash(key[k], ios->ioranks, ios->num_iotasks * sizeof(int));
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Get the name of the file of a plan.
+ *
+ * @param ios pointer to the IO system info.
+ * @param key the key of the plan.
+ * @param suffix suffix appended to the name.
+ * @param fname pointer that gets the name, freed by the caller.
+ * @returns 0 for success, error code otherwise.
+ */
+static int pio_plan_filename(iosystem_desc_t *ios, const unsigned long long *key,
+                             const char *suffix, char **fname)
+{
+    size_t len = strlen(ios->plan_cache_dir) + strlen(PIO_PLAN_PREFIX) + strlen(suffix) + 64;
+
+    if (!(*fname = malloc(len)))
+    {
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Getting the name of the rearranger plan file failed. Out of memory allocating %lld bytes for the name", (unsigned long long) len);
+    }
+    snprintf(*fname, len, "%s/%s_%016llx%016llx.dat%s", ios->plan_cache_dir, PIO_PLAN_PREFIX,
+             key[0], key[1], suffix);
+
+    return PIO_NOERR;
+}
+
+/**
+ * Put a value in a plan buffer.
+ *
+ * @param buf pointer to the buffer, NULL to only compute the size.
+ * @param pos pointer to the position in the buffer, advanced.
+ * @param val pointer to the value.
+ * @param len length of the value (bytes).
+ */
+static void plan_put(char *buf, PIO_Offset *pos, const void *val, PIO_Offset len)
+{
+    if (buf && len > 0)
+        memcpy(buf + *pos, val, len);
+    *pos += len;
+}
+
+/**
+ * Put an array in a plan buffer, preceded by its length (-1 for a
+ * NULL array).
+ *
+ * @param buf pointer to the buffer, NULL to only compute the size.
+ * @param pos pointer to the position in the buffer, advanced.
+ * @param arr pointer to the array, may be NULL.
+ * @param n the number of elements of the array.
+ * @param elsize the size of the elements (bytes).
+ */
+static void plan_put_array(char *buf, PIO_Offset *pos, const void *arr, PIO_Offset n,
+                           size_t elsize)
+{
+    PIO_Offset len = arr ? n : -1;
+
+    plan_put(buf, pos, &len, sizeof(PIO_Offset));
+    if (arr)
+        plan_put(buf, pos, arr, n * elsize);
+}
+
+/**
+ * Put a list of regions in a plan buffer, preceded by the number of
+ * regions.
+ *
+ * @param buf pointer to the buffer, NULL to only compute the size.
+ * @param pos pointer to the position in the buffer, advanced.
+ * @param ndims the number of dimensions of the regions.
+ * @param region pointer to the first region, may be NULL.
+ */
+static void plan_put_regions(char *buf, PIO_Offset *pos, int ndims, const io_region *region)
+{
+    int nregions = 0;
+
+    for (const io_region *r = region; r; r = r->next)
+        nregions++;
+    plan_put(buf, pos, &nregions, sizeof(int));
+    for (; region; region = region->next)
+    {
+        plan_put(buf, pos, &region->loffset, sizeof(int));
+        plan_put(buf, pos, region->start, ndims * sizeof(PIO_Offset));
+        plan_put(buf, pos, region->count, ndims * sizeof(PIO_Offset));
+    }
+}
+
+/**
+ * Get a value from a plan buffer.
+ *
+ * @param buf pointer to the buffer.
+ * @param size the size of the buffer (bytes).
+ * @param pos pointer to the position in the buffer, advanced.
+ * @param val pointer that gets the value.
+ * @param len length of the value (bytes).
+ * @returns true for success, false if the buffer is too short.
+ */
+static bool plan_get(const char *buf, PIO_Offset size, PIO_Offset *pos, void *val,
+                     PIO_Offset len)
+{
+    if (len < 0 || *pos + len > size)
+        return false;
+    if (len > 0)
+        memcpy(val, buf + *pos, len);
+    *pos += len;
+
+    return true;
+}
+
+/**
+ * Get an array from a plan buffer.
+ *
+ * @param buf pointer to the buffer.
+ * @param size the size of the buffer (bytes).
+ * @param pos pointer to the position in the buffer, advanced.
+ * @param elsize the size of the elements (bytes).
+ * @param arrp pointer that gets the allocated array, NULL for a NULL
+ * array.
+ * @returns true for success, false if the buffer is invalid or out
+ * of memory.
+ */
+static bool plan_get_array(const char *buf, PIO_Offset size, PIO_Offset *pos, size_t elsize,
+                           void **arrp)
+{
+    PIO_Offset n;
+
+    *arrp = NULL;
+    if (!plan_get(buf, size, pos, &n, sizeof(PIO_Offset)) || n < -1 || n > size)
+        return false;
+    if (n < 0)
+        return true;
+    if (!(*arrp = malloc(max(n, 1) * elsize)))
+        return false;
+
+    return plan_get(buf, size, pos, *arrp, n * elsize);
+}
+
+/**
+ * Get a list of regions from a plan buffer.
+ *
+ * @param ios pointer to the IO system info.
+ * @param buf pointer to the buffer.
+ * @param size the size of the buffer (bytes).
+ * @param pos pointer to the position in the buffer, advanced.
+ * @param ndims the number of dimensions of the regions.
+ * @param regionp pointer that gets the first region, NULL for an
+ * empty list.
+ * @returns true for success, false if the buffer is invalid or out
+ * of memory.
+ */
+static bool plan_get_regions(iosystem_desc_t *ios, const char *buf, PIO_Offset size,
+                             PIO_Offset *pos, int ndims, io_region **regionp)
+{
+    io_region **next = regionp;
+    int nregions;
+
+    *regionp = NULL;
+    if (!plan_get(buf, size, pos, &nregions, sizeof(int)) || nregions < 0)
+        return false;
+    for (int r = 0; r < nregions; r++)
+    {
+        if (alloc_region2(ios, ndims, next))
+            return false;
+        if (!plan_get(buf, size, pos, &(*next)->loffset, sizeof(int)) ||
+            !plan_get(buf, size, pos, (*next)->start, ndims * sizeof(PIO_Offset)) ||
+            !plan_get(buf, size, pos, (*next)->count, ndims * sizeof(PIO_Offset)))
+            return false;
+        next = &(*next)->next;
+    }
+
+    return true;
+}
+
+/**
+ * Pack the plan of this task in a buffer.
+ *
+ * @param ios pointer to the IO system info.
+ * @param iodesc pointer to the decomposition info.
+ * @param buf pointer to the buffer, NULL to only compute the size.
+ * @returns the size of the plan (bytes).
+ */
+static PIO_Offset pio_pack_plan(iosystem_desc_t *ios, io_desc_t *iodesc, char *buf)
+{
+    PIO_Offset nrfrom, nrcount, nscount, nsindex, nrindex; /* Lengths of the arrays. */
+    int ival[4];
+    PIO_Offset pos = 0;
+
+    /* The lengths of the arrays allocated by the rearrangers. */
+    if (iodesc->rearranger == PIO_REARR_SUBSET)
+    {
+        nrfrom = iodesc->llen - iodesc->mergedholes;
+        nrcount = iodesc->nrecvs;
+        nscount = 1;
+        nsindex = iodesc->scount ? iodesc->scount[0] : 0;
+        nrindex = iodesc->llen - iodesc->mergedholes;
+    }
+    else
+    {
+        nrfrom = nrcount = max(1, iodesc->nrecvs);
+        nscount = ios->num_iotasks;
+        nsindex = iodesc->ndof;
+        nrindex = 0;
+        if (iodesc->rcount)
+            for (int i = 0; i < iodesc->nrecvs; i++)
+                nrindex += iodesc->rcount[i];
+    }
+
+    /* What this plan was computed for, checked when loading it. */
+    ival[0] = iodesc->maplen;
+    ival[1] = ios->ioproc;
+    ival[2] = ios->io_rank;
+    ival[3] = iodesc->needsfill;
+    plan_put(buf, &pos, &iodesc->hash, sizeof(iodesc->hash));
+    plan_put(buf, &pos, ival, sizeof(ival));
+
+    plan_put(buf, &pos, &iodesc->nrecvs, sizeof(int));
+    plan_put(buf, &pos, &iodesc->ndof, sizeof(int));
+    plan_put(buf, &pos, &iodesc->num_aiotasks, sizeof(int));
+    plan_put(buf, &pos, &iodesc->maxregions, sizeof(int));
+    plan_put(buf, &pos, &iodesc->holegridsize, sizeof(int));
+    plan_put(buf, &pos, &iodesc->maxholegridsize, sizeof(int));
+    plan_put(buf, &pos, &iodesc->maxfillregions, sizeof(int));
+    plan_put(buf, &pos, &iodesc->mergedholes, sizeof(int));
+    plan_put(buf, &pos, &iodesc->llen, sizeof(PIO_Offset));
+    plan_put(buf, &pos, &iodesc->maxiobuflen, sizeof(PIO_Offset));
+
+    plan_put_array(buf, &pos, iodesc->rfrom, nrfrom, sizeof(int));
+    plan_put_array(buf, &pos, iodesc->rcount, nrcount, sizeof(int));
+    plan_put_array(buf, &pos, iodesc->scount, nscount, sizeof(int));
+    plan_put_array(buf, &pos, iodesc->sindex, nsindex, sizeof(PIO_Offset));
+    plan_put_array(buf, &pos, iodesc->rindex, nrindex, sizeof(PIO_Offset));
+    plan_put_array(buf, &pos, iodesc->ioregion_count, iodesc->ndims, sizeof(PIO_Offset));
+    plan_put_array(buf, &pos, iodesc->holeindex, iodesc->mergedholes, sizeof(PIO_Offset));
+
+    plan_put_regions(buf, &pos, iodesc->ndims, iodesc->firstregion);
+    plan_put_regions(buf, &pos, iodesc->ndims, iodesc->fillregion);
+
+    return pos;
+}
+
+/**
+ * Free the arrays and regions of an unpacked plan.
+ *
+ * @param plan pointer to the plan.
+ */
+static void pio_free_plan(io_desc_t *plan)
+{
+    free(plan->rfrom);
+    free(plan->rcount);
+    free(plan->scount);
+    free(plan->sindex);
+    free(plan->rindex);
+    free(plan->ioregion_count);
+    free(plan->holeindex);
+    free_region_list(plan->firstregion);
+    free_region_list(plan->fillregion);
+}
+
+/**
+ * Unpack the plan of this task from a buffer, and check that it was
+ * computed for this task.
+ *
+ * @param ios pointer to the IO system info.
+ * @param iodesc pointer to the decomposition info.
+ * @param buf pointer to the buffer.
+ * @param size the size of the buffer (bytes).
+ * @param plan pointer to a zeroed io_desc_t that gets the plan, its
+ * arrays and regions must be freed with pio_free_plan() if not used.
+ * @returns true for success, false if the plan is invalid or out of
+ * memory.
+ */
+static bool pio_unpack_plan(iosystem_desc_t *ios, io_desc_t *iodesc, const char *buf,
+                            PIO_Offset size, io_desc_t *plan)
+{
+    unsigned long long hash;
+    int ival[4];
+    PIO_Offset pos = 0;
+
+    if (!plan_get(buf, size, &pos, &hash, sizeof(hash)) ||
+        !plan_get(buf, size, &pos, ival, sizeof(ival)))
+        return false;
+    if (hash != iodesc->hash || ival[0] != iodesc->maplen || ival[1] != ios->ioproc ||
+        ival[2] != ios->io_rank)
+        return false;
+    plan->needsfill = ival[3];
+
+    if (!plan_get(buf, size, &pos, &plan->nrecvs, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->ndof, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->num_aiotasks, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->maxregions, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->holegridsize, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->maxholegridsize, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->maxfillregions, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->mergedholes, sizeof(int)) ||
+        !plan_get(buf, size, &pos, &plan->llen, sizeof(PIO_Offset)) ||
+        !plan_get(buf, size, &pos, &plan->maxiobuflen, sizeof(PIO_Offset)))
+        return false;
+
+    if (!plan_get_array(buf, size, &pos, sizeof(int), (void **)&plan->rfrom) ||
+        !plan_get_array(buf, size, &pos, sizeof(int), (void **)&plan->rcount) ||
+        !plan_get_array(buf, size, &pos, sizeof(int), (void **)&plan->scount) ||
+        !plan_get_array(buf, size, &pos, sizeof(PIO_Offset), (void **)&plan->sindex) ||
+        !plan_get_array(buf, size, &pos, sizeof(PIO_Offset), (void **)&plan->rindex) ||
+        !plan_get_array(buf, size, &pos, sizeof(PIO_Offset), (void **)&plan->ioregion_count) ||
+        !plan_get_array(buf, size, &pos, sizeof(PIO_Offset), (void **)&plan->holeindex))
+        return false;
+
+    if (!plan_get_regions(ios, buf, size, &pos, iodesc->ndims, &plan->firstregion) ||
+        !plan_get_regions(ios, buf, size, &pos, iodesc->ndims, &plan->fillregion))
+        return false;
+
+    /* Every task has at least one region. */
+    return pos == size && plan->ndof == iodesc->maplen && plan->firstregion &&
+        (!plan->mergedholes || plan->holeindex);
+}
+
+/**
+ * Load the rearranger setup of a decomposition from the plan cache
+ * (see PIOc_set_rearr_plan_cache()). A plan is only loaded if the
+ * plans of all tasks are found and valid, otherwise the setup must be
+ * computed. This is collective on the IO system.
+ *
+ * @param ios pointer to the IO system info.
+ * @param iodesc pointer to the decomposition info, with the map set.
+ * @param loaded pointer that gets true if the setup was loaded.
+ * @returns 0 for success, error code otherwise. A missing or invalid
+ * plan is not an error.
+ */
+int pio_load_rearr_plan(iosystem_desc_t *ios, io_desc_t *iodesc, bool *loaded)
+{
+    unsigned long long key[2];  /* Key of the plan. */
+    char *fname;                /* Name of the plan file. */
+    MPI_File fh;
+    pio_plan_header_t hdr;
+    PIO_Offset base;            /* Offset of the table of plans. */
+    PIO_Offset index[2] = {0, 0}; /* Offset and size of the plan of this task. */
+    MPI_Offset fsize = 0;
+    char *buf = NULL;
+    io_desc_t plan;
+    double load_start = MPI_Wtime();
+    int opened, valid;
+    int ret;
+    int mpierr;
+
+    pioassert(ios && iodesc && loaded && ios->plan_cache_dir, "invalid input",
+              __FILE__, __LINE__);
+    *loaded = false;
+
+    if ((ret = pio_plan_key(ios, iodesc, key)))
+        return ret;
+    if ((ret = pio_plan_filename(ios, key, "", &fname)))
+        return ret;
+    LOG((2, "pio_load_rearr_plan fname = %s", fname));
+
+    /* A missing plan file is not an error. */
+    opened = (MPI_File_open(ios->union_comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL,
+                            &fh) == MPI_SUCCESS);
+    free(fname);
+    valid = opened;
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &valid, 1, MPI_INT, MPI_MIN, ios->union_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (!valid)
+    {
+        if (opened)
+            MPI_File_close(&fh);
+        LOG((2, "no rearranger plan for this decomposition"));
+        return PIO_NOERR;
+    }
+
+    /* Read the header, and the offset and size of the plan of this
+     * task. All tasks take part in the collective reads. */
+    memset(&hdr, 0, sizeof(hdr));
+    base = sizeof(hdr) + 2 * ios->num_uniontasks * sizeof(PIO_Offset);
+    if (MPI_File_read_at_all(fh, 0, &hdr, sizeof(hdr), MPI_BYTE, MPI_STATUS_IGNORE))
+        valid = 0;
+    if (MPI_File_read_at_all(fh, sizeof(hdr) + 2 * ios->union_rank * sizeof(PIO_Offset),
+                             index, 2, MPI_OFFSET, MPI_STATUS_IGNORE))
+        valid = 0;
+    if (MPI_File_get_size(fh, &fsize))
+        valid = 0;
+    if (memcmp(hdr.magic, PIO_PLAN_MAGIC, sizeof(PIO_PLAN_MAGIC)) ||
+        hdr.version != PIO_PLAN_VERSION || hdr.offset_size != sizeof(PIO_Offset) ||
+        hdr.ntasks != ios->num_uniontasks || hdr.num_iotasks != ios->num_iotasks ||
+        hdr.rearranger != iodesc->rearranger || hdr.ndims != iodesc->ndims ||
+        hdr.key[0] != key[0] || hdr.key[1] != key[1])
+        valid = 0;
+    if (index[0] < base || index[1] <= 0 || index[1] > INT_MAX || index[0] + index[1] > fsize)
+        valid = 0;
+
+    /* Read and unpack the plan of this task. */
+    if (valid && !(buf = malloc(index[1])))
+        valid = 0;
+    if (MPI_File_read_at_all(fh, valid ? index[0] : 0, buf, valid ? (int)index[1] : 0,
+                             MPI_BYTE, MPI_STATUS_IGNORE))
+        valid = 0;
+    MPI_File_close(&fh);
+
+    memset(&plan, 0, sizeof(plan));
+    if (valid && !pio_unpack_plan(ios, iodesc, buf, index[1], &plan))
+        valid = 0;
+    free(buf);
+
+    /* The plan is only used if it is valid on all tasks. */
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &valid, 1, MPI_INT, MPI_MIN, ios->union_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (!valid)
+    {
+        pio_free_plan(&plan);
+        LOG((2, "the rearranger plan of this decomposition is invalid"));
+        return PIO_NOERR;
+    }
+
+    /* Replace the first region allocated with the iodesc. */
+    free_region_list(iodesc->firstregion);
+
+    iodesc->nrecvs = plan.nrecvs;
+    iodesc->ndof = plan.ndof;
+    iodesc->num_aiotasks = plan.num_aiotasks;
+    iodesc->maxregions = plan.maxregions;
+    iodesc->needsfill = plan.needsfill;
+    iodesc->llen = plan.llen;
+    iodesc->maxiobuflen = plan.maxiobuflen;
+    iodesc->rfrom = plan.rfrom;
+    iodesc->rcount = plan.rcount;
+    iodesc->scount = plan.scount;
+    iodesc->sindex = plan.sindex;
+    iodesc->rindex = plan.rindex;
+    iodesc->holegridsize = plan.holegridsize;
+    iodesc->maxholegridsize = plan.maxholegridsize;
+    iodesc->maxfillregions = plan.maxfillregions;
+    iodesc->firstregion = plan.firstregion;
+    iodesc->fillregion = plan.fillregion;
+    iodesc->mergedholes = plan.mergedholes;
+    iodesc->holeindex = plan.holeindex;
+    iodesc->ioregion_count = plan.ioregion_count;
+
+    /* The subset communicator and maxbytes, that depends on the
+     * buffer size limits, are not saved in the plan. */
+    if (iodesc->rearranger == PIO_REARR_SUBSET)
+        if ((ret = default_subset_partition(ios, iodesc)))
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Loading the rearranger plan of the I/O decomposition failed. Creating the subset communicator failed on iosystem (iosysid=%d)", ios->iosysid);
+    if ((ret = compute_maxaggregate_bytes(ios, iodesc)))
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                        "Loading the rearranger plan of the I/O decomposition failed. Computing the max aggregate bytes failed on iosystem (iosysid=%d)", ios->iosysid);
+
+    iodesc->setup.load_time += MPI_Wtime() - load_start;
+    *loaded = true;
+    LOG((2, "loaded the rearranger plan of this decomposition"));
+
+    return PIO_NOERR;
+}
+
+/**
+ * Save the rearranger setup of a decomposition to the plan cache
+ * (see PIOc_set_rearr_plan_cache()). The plan is written to a
+ * temporary file renamed when complete, so that partially written
+ * plans are never loaded. Failures to save the plan are not errors.
+ * This is collective on the IO system.
+ *
+ * @param ios pointer to the IO system info.
+ * @param iodesc pointer to the decomposition info.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_save_rearr_plan(iosystem_desc_t *ios, io_desc_t *iodesc)
+{
+    unsigned long long key[2];  /* Key of the plan. */
+    char *fname = NULL, *tmpname = NULL; /* Names of the plan file. */
+    char suffix[32];
+    MPI_File fh;
+    pio_plan_header_t hdr;
+    PIO_Offset index[2] = {0, 0}; /* Offset and size of the plan of this task. */
+    PIO_Offset size;
+    char *buf = NULL;
+    int pid;
+    int ok;
+    int ret;
+    int mpierr;
+
+    pioassert(ios && iodesc && ios->plan_cache_dir, "invalid input", __FILE__, __LINE__);
+
+    if ((ret = pio_plan_key(ios, iodesc, key)))
+        return ret;
+
+    /* Pack the plan of this task. */
+    size = pio_pack_plan(ios, iodesc, NULL);
+    ok = size <= INT_MAX && (buf = malloc(size)) != NULL;
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, ios->union_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (!ok)
+    {
+        free(buf);
+        LOG((2, "unable to pack the rearranger plan of this decomposition"));
+        return PIO_NOERR;
+    }
+    pio_pack_plan(ios, iodesc, buf);
+
+    /* Offset of the plan of this task. */
+    if ((mpierr = MPI_Exscan(&size, &index[0], 1, MPI_OFFSET, MPI_SUM, ios->union_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (ios->union_rank == 0)
+        index[0] = 0;
+    index[0] += sizeof(hdr) + 2 * ios->num_uniontasks * sizeof(PIO_Offset);
+    index[1] = size;
+
+    /* Runs saving the same plan at the same time write different
+     * temporary files. */
+    pid = getpid();
+    if ((mpierr = MPI_Bcast(&pid, 1, MPI_INT, 0, ios->union_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", pid);
+    if ((ret = pio_plan_filename(ios, key, "", &fname)) ||
+        (ret = pio_plan_filename(ios, key, suffix, &tmpname)))
+    {
+        free(fname);
+        free(buf);
+        return ret;
+    }
+    LOG((2, "pio_save_rearr_plan fname = %s", fname));
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, PIO_PLAN_MAGIC, sizeof(PIO_PLAN_MAGIC));
+    hdr.version = PIO_PLAN_VERSION;
+    hdr.offset_size = sizeof(PIO_Offset);
+    hdr.ntasks = ios->num_uniontasks;
+    hdr.num_iotasks = ios->num_iotasks;
+    hdr.rearranger = iodesc->rearranger;
+    hdr.ndims = iodesc->ndims;
+    hdr.key[0] = key[0];
+    hdr.key[1] = key[1];
+
+    /* Write the header (on the first task), the offset and size of
+     * the plan of each task, and the plans. */
+    ok = (MPI_File_open(ios->union_comm, tmpname, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                        MPI_INFO_NULL, &fh) == MPI_SUCCESS);
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, ios->union_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (ok)
+    {
+        if (MPI_File_write_at_all(fh, 0, &hdr, ios->union_rank ? 0 : sizeof(hdr), MPI_BYTE,
+                                  MPI_STATUS_IGNORE))
+            ok = 0;
+        if (MPI_File_write_at_all(fh, sizeof(hdr) + 2 * ios->union_rank * sizeof(PIO_Offset),
+                                  index, 2, MPI_OFFSET, MPI_STATUS_IGNORE))
+            ok = 0;
+        if (MPI_File_write_at_all(fh, index[0], buf, (int)size, MPI_BYTE, MPI_STATUS_IGNORE))
+            ok = 0;
+        if (MPI_File_close(&fh))
+            ok = 0;
+        if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, ios->union_comm)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+
+        if (ios->union_rank == 0)
+        {
+            if (!ok || rename(tmpname, fname))
+            {
+                LOG((1, "unable to save the rearranger plan to %s", fname));
+                remove(tmpname);
+            }
+        }
+    }
+    else
+        LOG((1, "unable to create the rearranger plan file %s", tmpname));
+
+    free(fname);
+    free(tmpname);
+    free(buf);
+
+    return PIO_NOERR;
+}
@@ -549,6 +549,14 @@ const char *pio_async_msg_to_string(int msg)
             return "PIO_MSG_INQ_TYPE";
     case  PIO_MSG_INQ_UNLIMDIMS:
             return "PIO_MSG_INQ_UNLIMDIMS";
+    case  PIO_MSG_DEF_VAR_QUANTIZE:
+            return "PIO_MSG_DEF_VAR_QUANTIZE";
+    case  PIO_MSG_SET_PERF_REPORT:
+            return "PIO_MSG_SET_PERF_REPORT";
+    case  PIO_MSG_SET_STAGE_LIMIT:
+            return "PIO_MSG_SET_STAGE_LIMIT";
+    case  PIO_MSG_OPEN_FILES:
+            return "PIO_MSG_OPEN_FILES";
     case  PIO_MSG_EXIT:
             return "PIO_MSG_EXIT";
     default:
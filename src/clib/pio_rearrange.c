@@ -69,14 +69,136 @@ inline void idx_to_dim_list(int ndims, const int *gdimlen, PIO_Offset idx,
     }
 }
 
+/**
+ * Convert a 1-D index into a coordinate value, given the coordinate
+ * value of a previous index. When the index is ahead of the previous
+ * index by less than the size of the fastest varying dimension, the
+ * coordinate value is updated with at most one carry per dimension,
+ * instead of a division per dimension. Otherwise idx_to_dim_list() is
+ * used. The result is the same as the result of idx_to_dim_list().
+ *
+ * @param ndims number of dimensions.
+ * @param gdimlen array of length ndims with the dimension sizes.
+ * @param idx the index to convert.
+ * @param prev_idx the previous index.
+ * @param prev_dim_list array of length ndims with the coordinate
+ * value of the previous index.
+ * @param dim_list array of length ndims that will get the dimensions
+ * corresponding to this index. May be the same as prev_dim_list.
+ */
+void idx_to_dim_list_incr(int ndims, const int *gdimlen, PIO_Offset idx, PIO_Offset prev_idx,
+                          const PIO_Offset *prev_dim_list, PIO_Offset *dim_list)
+{
+    PIO_Offset delta = idx - prev_idx;
+
+    if (ndims <= 0 || prev_idx < -1 || delta < 0 || delta >= gdimlen[ndims - 1])
+    {
+        idx_to_dim_list(ndims, gdimlen, idx, dim_list);
+        return;
+    }
+
+    if (dim_list != prev_dim_list)
+        memcpy(dim_list, prev_dim_list, ndims * sizeof(PIO_Offset));
+    dim_list[ndims - 1] += delta;
+
+    /* Like idx_to_dim_list(), the outermost dimension wraps around. */
+    for (int i = ndims - 1; i >= 0 && dim_list[i] >= gdimlen[i]; i--)
+    {
+        dim_list[i] -= gdimlen[i];
+        if (i > 0)
+            dim_list[i - 1]++;
+    }
+}
+
+/** Number of map elements compared at once when looking for the
+ * end of a run. The comparisons of a block are done without
+ * branches, so that they can be vectorized by the compiler. */
+#define PIO_RUN_BLOCK 8
+
+/**
+ * Find the length of a run of map elements with a constant stride.
+ *
+ * @param map array of length n.
+ * @param first the expected value of map[0].
+ * @param stride the expected difference of consecutive elements.
+ * @param n the length of map.
+ * @returns the number of leading elements of map equal to first +
+ * j * stride.
+ */
+static inline PIO_Offset stride_run_len(const PIO_Offset *map, PIO_Offset first,
+                                        PIO_Offset stride, PIO_Offset n)
+{
+    PIO_Offset j = 0;
+
+    /* Short runs are common, check the first elements one by one. */
+    for (; j < n && j < PIO_RUN_BLOCK; j++)
+        if (map[j] != first + j * stride)
+            return j;
+
+    for (; j + PIO_RUN_BLOCK <= n; j += PIO_RUN_BLOCK)
+    {
+        int mismatch = 0;
+
+        for (int k = 0; k < PIO_RUN_BLOCK; k++)
+            mismatch |= (map[j + k] != first + (j + k) * stride);
+        if (mismatch)
+            break;
+    }
+    while (j < n && map[j] == first + j * stride)
+        j++;
+
+    return j;
+}
+
+/**
+ * Check whether a block of map elements is a shifted copy of another
+ * block.
+ *
+ * @param block array of length n.
+ * @param ref array of length n.
+ * @param shift the expected difference of the elements.
+ * @param n the length of the blocks.
+ * @returns true if block[j] == ref[j] + shift for all j.
+ */
+static inline bool block_matches(const PIO_Offset *block, const PIO_Offset *ref,
+                                 PIO_Offset shift, PIO_Offset n)
+{
+    PIO_Offset j = 0;
+
+    /* Most blocks that do not match differ in the first element. */
+    if (n > 0 && block[0] != ref[0] + shift)
+        return false;
+
+    for (; j + PIO_RUN_BLOCK <= n; j += PIO_RUN_BLOCK)
+    {
+        int mismatch = 0;
+
+        for (int k = 0; k < PIO_RUN_BLOCK; k++)
+            mismatch |= (block[j + k] != ref[j + k] + shift);
+        if (mismatch)
+            return false;
+    }
+    for (; j < n; j++)
+        if (block[j] != ref[j] + shift)
+            return false;
+
+    return true;
+}
+
 /**
  * Expand a region along dimension dim, by incrementing count[i] as
  * much as possible, consistent with the map.
  *
- * Once max_size is reached, the map is exhausted, or the next entries fail
- * to match, expand_region updates the count and calls itself with the next
- * outermost dimension, until the region has been expanded as much as
- * possible along all dimensions.
+ * Once max_size is reached, the map is exhausted, or the next entries
+ * fail to match, expand_region updates the count and moves on to the
+ * next outermost dimension, until the region has been expanded as
+ * much as possible along all dimensions.
+ *
+ * Along the dimension where the region is a single element (the
+ * innermost one, when called from find_region()) the count is the
+ * length of the run of the map with the stride of the dimension,
+ * along the other dimensions it is the number of following blocks of
+ * region_size elements that are shifted copies of the region.
  *
  * Precondition: maplen >= region_size (thus loop runs at least
  * once).
@@ -85,7 +207,8 @@ inline void idx_to_dim_list(int ndims, const int *gdimlen, PIO_Offset idx,
  * @param gdimlen array of global dimension lengths.
  * @param maplen the length of the map.
  * @param map array (length maplen) with the the 1-based compmap.
- * @param region_size ???
+ * @param region_size the number of elements of the region found
+ * along the dimensions after dim.
  * @param region_stride amount incremented along dimension.
  * @param max_size array of size dim + 1 that contains the maximum
  * sizes along that dimension.
@@ -96,49 +219,84 @@ void expand_region(int dim, const int *gdimlen, int maplen, const PIO_Offset *ma
                    int region_size, int region_stride, const int *max_size,
                    PIO_Offset *count)
 {
-    /* Flag used to signal that we can no longer expand the region
-       along dimension dim. */
-    int expansion_done = 0;
+    PIO_Offset size = region_size;     /* Elements in the region so far. */
+    PIO_Offset stride = region_stride; /* Stride along dimension dim. */
 
     /* Check inputs. */
     pioassert(dim >= 0 && gdimlen && maplen >= 0 && map && region_size >= 0 &&
               maplen >= region_size && region_stride >= 0 && max_size && count,
               "invalid input", __FILE__, __LINE__);
 
-    /* Expand no greater than max_size along this dimension. */
-    for (int i = 1; i <= max_size[dim]; ++i)
+    for (; dim >= 0; dim--)
     {
-        /* Count so far is at least i. */
-        count[dim] = i;
+        PIO_Offset nblocks; /* Max number of blocks after the region. */
 
-        /* Now see if we can expand to i+1 by checking that the next
-           region_size elements are ahead by exactly region_stride.
-           Assuming monotonicity in the map, we could skip this for the
-           innermost dimension, but it's necessary past that because the
-           region does not necessarily comprise contiguous values. */
-        for (int j = 0; j < region_size; j++)
+        /* Expand no greater than max_size along this dimension. */
+        if (max_size[dim] >= 1)
         {
-            int test_idx; /* Index we are testing. */
-
-            test_idx = j + i * region_size;
-
-            /* If we have exhausted the map, or the map no longer matches,
-               we are done, break out of both loops. */
-            if (test_idx >= maplen || map[test_idx] != map[j] + i * region_stride)
+            /* Only complete blocks of size elements expand the region. */
+            nblocks = size ? min((PIO_Offset)max_size[dim] - 1, maplen / size - 1) :
+                (PIO_Offset)max_size[dim] - 1;
+            if (size == 1)
+                count[dim] = 1 + stride_run_len(&map[1], map[0] + stride, stride, nblocks);
+            else
             {
-                expansion_done = 1;
-                break;
+                PIO_Offset i;
+
+                for (i = 1; i <= nblocks; i++)
+                    if (!block_matches(&map[i * size], map, i * stride, size))
+                        break;
+                count[dim] = i;
             }
         }
-        if (expansion_done)
-            break;
+
+        size *= count[dim];
+        stride *= gdimlen[dim];
     }
+}
+/**
+ * Set count so that start and count describe the first region in
+ * map, given start, the coordinate value of the first element of
+ * map. Called by find_region() and get_regions().
+ *
+ * @param ndims the number of dimensions.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the length of the map.
+ * @param map array (length maplen) with the 1-based map.
+ * @param start array (length ndims) with the start indicies of the
+ * region.
+ * @param count array (length ndims) that will get counts of found
+ * region.
+ * @returns length of the region found.
+ */
+static PIO_Offset find_region_at(int ndims, const int *gdimlen, int maplen,
+                                 const PIO_Offset *map, const PIO_Offset *start,
+                                 PIO_Offset *count)
+{
+    PIO_Offset regionlen = 1;
+    int max_size[ndims];
 
-    /* Move on to next outermost dimension if there are more left,
-     * else return. */
-    if (dim > 0)
-        expand_region(dim - 1, gdimlen, maplen, map, region_size * count[dim],
-                      region_stride * gdimlen[dim], max_size, count);
+    /* Can't expand beyond the array edge. Set up max_size array for
+     * expand_region call below. */
+    for (int dim = 0; dim < ndims; ++dim)
+    {
+        max_size[dim] = gdimlen[dim] - start[dim];
+        LOG((3, "max_size[%d] = %d", max_size[dim]));
+    }
+
+    /* For each dimension, figure out how far we can expand in that dimension
+       while staying contiguous in the input array.
+
+       Start with the innermost dimension (ndims-1), and it will move
+       on to the outermost dimensions. */
+    expand_region(ndims - 1, gdimlen, maplen, map, 1, 1, max_size, count);
+
+    /* Calculate the number of data elements in this region. */
+    for (int dim = 0; dim < ndims; dim++)
+        regionlen *= count[dim];
+
+    return regionlen;
 }
 
 /**
@@ -172,39 +330,16 @@ void expand_region(int dim, const int *gdimlen, int maplen, const PIO_Offset *ma
 PIO_Offset find_region(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map,
                        PIO_Offset *start, PIO_Offset *count)
 {
-    PIO_Offset regionlen = 1;
-
     /* Check inputs. */
     pioassert(ndims > 0 && gdimlen && maplen > 0 && map && start && count,
               "invalid input", __FILE__, __LINE__);
     LOG((2, "find_region ndims = %d maplen = %d", ndims, maplen));
 
-    int max_size[ndims];
-
     /* Convert the index which is the first element of map into global
      * data space. */
     idx_to_dim_list(ndims, gdimlen, map[0] - 1, start);
 
-    /* Can't expand beyond the array edge. Set up max_size array for
-     * expand_region call below. */
-    for (int dim = 0; dim < ndims; ++dim)
-    {
-        max_size[dim] = gdimlen[dim] - start[dim];
-        LOG((3, "max_size[%d] = %d", max_size[dim]));
-    }
-
-    /* For each dimension, figure out how far we can expand in that dimension
-       while staying contiguous in the input array.
-
-       Start with the innermost dimension (ndims-1), and it will recurse
-       through to the outermost dimensions. */
-    expand_region(ndims - 1, gdimlen, maplen, map, 1, 1, max_size, count);
-
-    /* Calculate the number of data elements in this region. */
-    for (int dim = 0; dim < ndims; dim++)
-        regionlen *= count[dim];
-
-    return regionlen;
+    return find_region_at(ndims, gdimlen, maplen, map, start, count);
 }
 
 /**
@@ -464,6 +599,7 @@ int create_mpi_datatypes(MPI_Datatype mpitype, int msgcnt,
  */
 int define_iodesc_datatypes(iosystem_desc_t *ios, io_desc_t *iodesc)
 {
+    double phase_start = MPI_Wtime(); /* Start of this setup phase. */
     int ret; /* Return value. */
 
     pioassert(ios && iodesc, "invalid input", __FILE__, __LINE__);
@@ -545,6 +681,8 @@ int define_iodesc_datatypes(iosystem_desc_t *ios, io_desc_t *iodesc)
         }
     }
 
+    iodesc->setup.datatypes_time += MPI_Wtime() - phase_start;
+
     LOG((3, "done with define_iodesc_datatypes()"));
     return PIO_NOERR;
 }
@@ -855,19 +993,22 @@ int compute_counts(iosystem_desc_t *ios, io_desc_t *iodesc,
 }
 
 /**
- * Moves data from compute tasks to IO tasks. This is called from
- * PIOc_write_darray_multi().
+ * Moves data from compute tasks to IO tasks. The data to send is
+ * either in a single contiguous buffer (sbuf), holding nvars arrays
+ * of iodesc->ndof elements each, or in nvars separate arrays
+ * (sbufs). Only one of sbuf and sbufs is used.
  *
  * @param ios pointer to the iosystem_desc_t struct.
  * @param iodesc a pointer to the io_desc_t struct.
  * @param sbuf send buffer. May be NULL.
+ * @param sbufs array of nvars send buffers. May be NULL.
  * @param rbuf receive buffer. May be NULL.
  * @param nvars number of variables.
  * @returns 0 on success, error code otherwise.
  * @author Jim Edwards
  */
-int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
-                      void *rbuf, int nvars)
+static int comp2io_int(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                       void **sbufs, void *rbuf, int nvars)
 {
     int ntasks;       /* Number of tasks in communicator. */
     int niotasks;     /* Number of IO tasks. */
@@ -993,6 +1134,26 @@ int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
         }
     }
 
+    /* When sending from separate user arrays, the send types are
+     * built from the absolute addresses of the arrays (the send
+     * buffer passed to pio_swapm is MPI_BOTTOM). */
+    int sblocklens[nvars];
+    MPI_Aint sbufaddrs[nvars];
+    if (sbufs && (!ios->async || ios->compproc))
+    {
+        for (int v = 0; v < nvars; v++)
+        {
+            sblocklens[v] = 1;
+#if PIO_USE_MPISERIAL
+            if ((mpierr = MPI_Address(sbufs[v], &sbufaddrs[v])))
+                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+#else
+            if ((mpierr = MPI_Get_address(sbufs[v], &sbufaddrs[v])))
+                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+#endif /* PIO_USE_MPISERIAL */
+        }
+    }
+
     /* On compute tasks loop over iotasks and create a data type for
      * each exchange.  */
     if(!ios->async || ios->compproc)
@@ -1005,7 +1166,25 @@ int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
                 io_comprank = 0;
 
             LOG((3, "i = %d iodesc->scount[i] = %d", i, iodesc->scount[i]));
-            if (iodesc->scount[i] > 0 && sbuf)
+            if (iodesc->scount[i] > 0 && sbufs)
+            {
+                LOG((3, "io task %d creating sendtypes[%d] from %d user arrays", i, io_comprank, nvars));
+                sendcounts[io_comprank] = 1;
+    #if PIO_USE_MPISERIAL
+                if ((mpierr = MPI_Type_hindexed(nvars, sblocklens, sbufaddrs,
+                                                iodesc->stype[i], &sendtypes[io_comprank])))
+                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    #else
+                if ((mpierr = MPI_Type_create_hindexed(nvars, sblocklens, sbufaddrs,
+                                                       iodesc->stype[i], &sendtypes[io_comprank])))
+                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    #endif /* PIO_USE_MPISERIAL */
+                pioassert(sendtypes[io_comprank] != PIO_DATATYPE_NULL,  "bad mpi type", __FILE__, __LINE__);
+
+                if ((mpierr = MPI_Type_commit(&sendtypes[io_comprank])))
+                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            }
+            else if (iodesc->scount[i] > 0 && sbuf)
             {
                 LOG((3, "io task %d creating sendtypes[%d]", i, io_comprank));
                 sendcounts[io_comprank] = 1;
@@ -1032,7 +1211,7 @@ int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
     
     /* Data in sbuf on the compute nodes is sent to rbuf on the ionodes */
     LOG((2, "about to call pio_swapm for sbuf"));
-    if ((ret = pio_swapm(sbuf, sendcounts, sdispls, sendtypes,
+    if ((ret = pio_swapm(sbufs ? MPI_BOTTOM : sbuf, sendcounts, sdispls, sendtypes,
                          rbuf, recvcounts, rdispls, recvtypes, mycomm,
                          &iodesc->rearr_opts.comp2io)))
     {
@@ -1060,6 +1239,57 @@ int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
     return PIO_NOERR;
 }
 
+/**
+ * Moves data from compute tasks to IO tasks. This is called from
+ * PIOc_write_darray_multi().
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbuf send buffer. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ * @author Jim Edwards
+ */
+int rearrange_comp2io(iosystem_desc_t *ios, io_desc_t *iodesc, void *sbuf,
+                      void *rbuf, int nvars)
+{
+    int ret;
+
+    PIO_TRACE_BEGIN("rearrange_comp2io");
+    ret = comp2io_int(ios, iodesc, sbuf, NULL, rbuf, nvars);
+    PIO_TRACE_END("rearrange_comp2io");
+
+    return ret;
+}
+
+/**
+ * Moves data from compute tasks to IO tasks, sending the data
+ * directly from nvars separate user arrays (no intermediate copy on
+ * the compute tasks). This is called when flushing a multi-buffer
+ * for a file that does not copy user data (see
+ * PIOc_set_darray_nocopy()).
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct.
+ * @param sbufs array of nvars send buffers, each with (at least)
+ * iodesc->ndof elements. May be NULL.
+ * @param rbuf receive buffer. May be NULL.
+ * @param nvars number of variables.
+ * @returns 0 on success, error code otherwise.
+ */
+int rearrange_comp2io_nocopy(iosystem_desc_t *ios, io_desc_t *iodesc, void **sbufs,
+                             void *rbuf, int nvars)
+{
+    int ret;
+
+    PIO_TRACE_BEGIN("rearrange_comp2io_nocopy");
+    ret = comp2io_int(ios, iodesc, NULL, sbufs, rbuf, nvars);
+    PIO_TRACE_END("rearrange_comp2io_nocopy");
+
+    return ret;
+}
+
 /**
  * Moves data from IO tasks to compute tasks. This function is used in
  * PIOc_read_darray().
@@ -1290,6 +1520,7 @@ int determine_fill(iosystem_desc_t *ios, io_desc_t *iodesc, const int *gdimlen,
 int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *compmap,
                          const int *gdimlen, int ndims, io_desc_t *iodesc)
 {
+    double phase_start; /* Start of a phase of the setup. */
     int ret;
 
 #ifdef TIMING
@@ -1410,11 +1641,13 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
     }
 
     /* Determine whether fill values will be needed. */
+    phase_start = MPI_Wtime();
     if ((ret = determine_fill(ios, iodesc, gdimlen, compmap)))
     {
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
                         "Creating BOX rearranger failed for I/O decomposition (iodi=%d) on iosystem (iosysid=%d). Unable to determine fillvalue to use", iodesc->ioid, ios->iosysid);
     }
+    iodesc->setup.fill_time += MPI_Wtime() - phase_start;
     LOG((2, "iodesc->needsfill = %d ios->num_iotasks = %d", iodesc->needsfill,
          ios->num_iotasks));
 
@@ -1467,6 +1700,7 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
     /* Send sc_info msg from iotasks (all iotasks) to all procs(compute and I/O procs)*/
     LOG((3, "about to call pio_swapm with start/count from iotask ndims = %d",
          ndims));
+    phase_start = MPI_Wtime();
     if ((ret = pio_swapm(sc_info_msg_send, sendcounts, sdispls, dtypes, sc_info_msg_recv,
                          recvcounts, rdispls, dtypes, ios->union_comm,
                          &iodesc->rearr_opts.io2comp)))
@@ -1474,6 +1708,7 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
                         "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). pio_swapm() call failed to exchange start/counts for setting up the rearranger", iodesc->ioid, ios->iosysid);
     }
+    iodesc->setup.exchange_time += MPI_Wtime() - phase_start;
 
 #if PIO_ENABLE_LOGGING
     /* First entry in the sc_info msg for each iorank is the iomaplen */
@@ -1482,11 +1717,16 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
 #endif /* PIO_ENABLE_LOGGING */
 
     /* Convert a 1-D index into a global coordinate value for each data element */
+    phase_start = MPI_Wtime();
     for (int k = 0; k < maplen; k++)
     {
         /* The compmap array is 1 based but calculations are 0 based */
         LOG((3, "about to call idx_to_dim_list ndims = %d ", ndims));
-        idx_to_dim_list(ndims, gdimlen, compmap[k] - 1, gcoord_map[k]);
+        if (k > 0)
+            idx_to_dim_list_incr(ndims, gdimlen, compmap[k] - 1, compmap[k - 1] - 1,
+                                 gcoord_map[k - 1], gcoord_map[k]);
+        else
+            idx_to_dim_list(ndims, gdimlen, compmap[k] - 1, gcoord_map[k]);
 #if PIO_ENABLE_LOGGING
         for (int d = 0; d < ndims; d++)
             LOG((3, "gcoord_map[%d][%d] = %lld", k, d, gcoord_map[k][d]));
@@ -1570,8 +1810,11 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
                             "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to find a destination I/O process for data (compmap[%d]=%lld)", iodesc->ioid, ios->iosysid, k, (unsigned long long)(compmap[k]));
         }
 
+    iodesc->setup.map_time += MPI_Wtime() - phase_start;
+
     /* Completes the mapping for the box rearranger. */
     LOG((2, "calling compute_counts maplen = %d", maplen));
+    phase_start = MPI_Wtime();
     if ((ret = compute_counts(ios, iodesc, dest_ioproc, dest_ioindex)))
     {
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
@@ -1602,6 +1845,7 @@ int box_rearrange_create(iosystem_desc_t *ios, int maplen, const PIO_Offset *com
                         "Creating BOX rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to calculate the max aggregate bytes across all processes", iodesc->ioid, ios->iosysid);
     }
     LOG((3, "iodesc->maxbytes = %d", iodesc->maxbytes));
+    iodesc->setup.counts_time += MPI_Wtime() - phase_start;
 
 #ifdef TIMING
     GPTLstop("PIO:box_rearrange_create");
@@ -1759,7 +2003,11 @@ int box_rearrange_create_with_holes(iosystem_desc_t *ios, int maplen, const PIO_
     {
         /* The compmap array is 1 based but calculations are 0 based */
         LOG((3, "about to call idx_to_dim_list ndims = %d ", ndims));
-        idx_to_dim_list(ndims, gdimlen, compmap[k] - 1, gcoord_map[k]);
+        if (k > 0)
+            idx_to_dim_list_incr(ndims, gdimlen, compmap[k] - 1, compmap[k - 1] - 1,
+                                 gcoord_map[k - 1], gcoord_map[k]);
+        else
+            idx_to_dim_list(ndims, gdimlen, compmap[k] - 1, gcoord_map[k]);
 #if PIO_ENABLE_LOGGING
         for (int d = 0; d < ndims; d++)
             LOG((3, "gcoord_map[%d][%d] = %lld", k, d, gcoord_map[k][d]));
@@ -1934,7 +2182,104 @@ int compare_offsets(const void *a, const void *b)
     mapsort *y = (mapsort *)b;
     if (!x || !y)
         return 0;
-    return (int)(x->iomap - y->iomap);
+    return (x->iomap > y->iomap) - (x->iomap < y->iomap);
+}
+
+/**
+ * Is the next offset of run r1 less than the next offset of run r2?
+ * Runs with equal offsets are ordered by their index, so that the
+ * merge is stable. Used in merge_sorted_maps().
+ *
+ * @param iomap the offsets of all the runs.
+ * @param next the index, in iomap, of the next offset of each run.
+ * @param r1 a run.
+ * @param r2 another run.
+ * @returns true if the offset of r1 goes before the offset of r2.
+ */
+static inline bool run_less(const PIO_Offset *iomap, const int *next, int r1, int r2)
+{
+    return iomap[next[r1]] < iomap[next[r2]] ||
+        (iomap[next[r1]] == iomap[next[r2]] && r1 < r2);
+}
+
+/**
+ * Merge the sorted maps gathered from the compute tasks of a subset
+ * by the subset rearranger. Each compute task sorts its own map, so
+ * the IO task only merges nruns sorted runs (with a heap of the runs)
+ * instead of sorting the whole gathered map.
+ *
+ * @param nruns the number of runs (the tasks in the subset).
+ * @param runlen array (length nruns) with the length of each run.
+ * @param rundispls array (length nruns) with the index in iomap and
+ * srcindex of the first element of each run.
+ * @param iomap the sorted offsets of each run.
+ * @param srcindex the index, on the compute task, of each offset.
+ * @param map array that gets the merged map, with the task (rfrom) and
+ * index (soffset) each offset came from.
+ * @returns the number of elements merged.
+ */
+int merge_sorted_maps(int nruns, const int *runlen, const int *rundispls,
+                      const PIO_Offset *iomap, const PIO_Offset *srcindex, mapsort *map)
+{
+    int heap[nruns]; /* Min-heap of the runs not exhausted. */
+    int next[nruns]; /* Index of the next offset of each run. */
+    int nheap = 0;
+    int k = 0;
+
+    pioassert(nruns > 0 && runlen && rundispls && map, "invalid input", __FILE__, __LINE__);
+
+    /* Add the non-empty runs to the heap. */
+    for (int r = 0; r < nruns; r++)
+    {
+        int c = nheap;
+
+        next[r] = rundispls[r];
+        if (runlen[r] <= 0)
+            continue;
+        while (c > 0 && run_less(iomap, next, r, heap[(c - 1) / 2]))
+        {
+            heap[c] = heap[(c - 1) / 2];
+            c = (c - 1) / 2;
+        }
+        heap[c] = r;
+        nheap++;
+    }
+
+    while (nheap > 0)
+    {
+        int r = heap[0];
+        int p = 0;
+
+        /* Take the smallest offset. */
+        map[k].rfrom = r;
+        map[k].soffset = srcindex[next[r]];
+        map[k].iomap = iomap[next[r]];
+        k++;
+
+        /* Replace an exhausted run by the last run in the heap. */
+        if (++next[r] == rundispls[r] + runlen[r])
+        {
+            if (--nheap == 0)
+                break;
+            r = heap[nheap];
+        }
+
+        /* Sift the run down the heap. */
+        while (2 * p + 1 < nheap)
+        {
+            int c = 2 * p + 1;
+
+            if (c + 1 < nheap && run_less(iomap, next, heap[c + 1], heap[c]))
+                c++;
+            if (!run_less(iomap, next, heap[c], r))
+                break;
+            heap[p] = heap[c];
+            p = c;
+        }
+        heap[p] = r;
+    }
+
+    return k;
 }
 
 /**
@@ -1962,6 +2307,9 @@ int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map
     int nmaplen = 0;
     int regionlen;
     io_region *region;
+    PIO_Offset last[max(ndims, 1)]; /* Coordinates of the last element of a region. */
+    PIO_Offset last_idx = -1;       /* Index of the last element of a region. */
+    bool have_last = false;         /* Whether last is known. */
     int ret;
 
     /* Check inputs. */
@@ -1993,12 +2341,27 @@ int get_regions(int ndims, const int *gdimlen, int maplen, const PIO_Offset *map
         for (int i = 0; i < ndims; i++)
             region->count[i] = 1;
 
-        /* Set start/count to describe first region in map. */
-        regionlen = find_region(ndims, gdimlen, maplen-nmaplen,
-                                &map[nmaplen], region->start, region->count);
+        /* Set start/count to describe first region in map. The start
+         * is found from the coordinates of the last element of the
+         * previous region, that is usually close. */
+        LOG((2, "find_region ndims = %d maplen = %d", ndims, maplen - nmaplen));
+        if (have_last)
+            idx_to_dim_list_incr(ndims, gdimlen, map[nmaplen] - 1, last_idx, last,
+                                 region->start);
+        else
+            idx_to_dim_list(ndims, gdimlen, map[nmaplen] - 1, region->start);
+        regionlen = find_region_at(ndims, gdimlen, maplen - nmaplen, &map[nmaplen],
+                                   region->start, region->count);
         pioassert(region->start[0] >= 0, "failed to find region", __FILE__, __LINE__);
 
+        /* The coordinates of the last element of the region, known
+         * unless the region starts with a hole. */
+        for (int i = 0; i < ndims; i++)
+            last[i] = region->start[i] + region->count[i] - 1;
+        have_last = map[nmaplen] > 0;
+
         nmaplen = nmaplen + regionlen;
+        last_idx = map[nmaplen - 1] - 1;
         LOG((2, "regionlen = %d nmaplen = %d", regionlen, nmaplen));
 
         /* If we need to, allocate the next region. */
@@ -2118,6 +2481,114 @@ int default_subset_partition(iosystem_desc_t *ios, io_desc_t *iodesc)
     return PIO_NOERR;
 }
 
+/**
+ * Merge the holes of an IO task into its data regions (subset
+ * rearranger), if that takes fewer regions than writing the data and
+ * the fill values separately.
+ *
+ * Holes in between the data points of an IO task split both the
+ * data and the fill writes into many small regions, often a single
+ * element each, and each region is a separate request to the
+ * underlying library. Merged holes are given a place in the IO
+ * buffer (listed in iodesc->holeindex), which gets the fill value
+ * before the data is rearranged into it, so one write of the merged
+ * regions writes both the data and the fill values.
+ *
+ * @param ios pointer to the iosystem_desc_t struct.
+ * @param iodesc a pointer to the io_desc_t struct, with llen, rindex
+ * and the fill regions of this task set.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param iomap pointer to the sorted map (length llen) of the data on
+ * this IO task. It is replaced by the merged map if the holes are
+ * merged.
+ * @param fillgrid the sorted map (length holegridsize) of the holes
+ * of this IO task.
+ * @returns 0 on success, error code otherwise.
+ */
+static int merge_fill_holes(iosystem_desc_t *ios, io_desc_t *iodesc, const int *gdimlen,
+                            PIO_Offset **iomap, const PIO_Offset *fillgrid)
+{
+    PIO_Offset *mergedmap;
+    PIO_Offset mergedlen = iodesc->llen + iodesc->holegridsize;
+    io_region *regions = NULL;
+    int ndataregions = 0, nmergedregions = 0;
+    PIO_Offset i = 0, j = 0, k = 0;
+    int ret;
+
+    pioassert(ios && iodesc && gdimlen && iomap && fillgrid && iodesc->llen > 0 &&
+              iodesc->holegridsize > 0, "invalid input", __FILE__, __LINE__);
+
+    /* Merge the holes into the map of the data. */
+    if (!(mergedmap = malloc(mergedlen * sizeof(PIO_Offset))))
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                       "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for merging the holes into the data map", iodesc->ioid, ios->iosysid, (unsigned long long) (mergedlen * sizeof(PIO_Offset)));
+    while (i < iodesc->llen || j < iodesc->holegridsize)
+    {
+        if (j == iodesc->holegridsize || (i < iodesc->llen && (*iomap)[i] < fillgrid[j]))
+            mergedmap[k++] = (*iomap)[i++];
+        else
+            mergedmap[k++] = fillgrid[j++];
+    }
+
+    /* Count the regions with and without merging. */
+    if ((ret = alloc_region2(ios, iodesc->ndims, &regions)))
+    {
+        free(mergedmap);
+        return ret;
+    }
+    if (!(ret = get_regions(iodesc->ndims, gdimlen, iodesc->llen, *iomap, &ndataregions,
+                            regions)))
+    {
+        free_region_list(regions->next);
+        regions->next = NULL;
+        ret = get_regions(iodesc->ndims, gdimlen, mergedlen, mergedmap, &nmergedregions,
+                          regions);
+    }
+    free_region_list(regions);
+    if (ret)
+    {
+        free(mergedmap);
+        return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                       "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Getting the data regions with merged holes failed", iodesc->ioid, ios->iosysid);
+    }
+    LOG((2, "merge_fill_holes ndataregions = %d maxfillregions = %d nmergedregions = %d",
+         ndataregions, iodesc->maxfillregions, nmergedregions));
+
+    if (nmergedregions >= ndataregions + iodesc->maxfillregions)
+    {
+        free(mergedmap);
+        return PIO_NOERR;
+    }
+
+    /* Find where the data and the holes go in the IO buffer. */
+    if (!(iodesc->holeindex = malloc(iodesc->holegridsize * sizeof(PIO_Offset))))
+    {
+        free(mergedmap);
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                       "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for storing the positions of the holes in the IO buffer", iodesc->ioid, ios->iosysid, (unsigned long long) (iodesc->holegridsize * sizeof(PIO_Offset)));
+    }
+    for (i = 0, j = 0, k = 0; k < mergedlen; k++)
+    {
+        if (i < iodesc->llen && mergedmap[k] == (*iomap)[i])
+            iodesc->rindex[i++] = k;
+        else
+            iodesc->holeindex[j++] = k;
+    }
+
+    /* The holes are now written with the data. */
+    free(*iomap);
+    *iomap = mergedmap;
+    iodesc->llen = mergedlen;
+    iodesc->mergedholes = iodesc->holegridsize;
+    iodesc->holegridsize = 0;
+    free_region_list(iodesc->fillregion);
+    iodesc->fillregion = NULL;
+    iodesc->maxfillregions = 0;
+
+    return PIO_NOERR;
+}
+
 /**
  * Create the subset rearranger.
  *
@@ -2177,10 +2648,12 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
     PIO_Offset totalgridsize;
     PIO_Offset *srcindex = NULL;
     PIO_Offset *myfillgrid = NULL;
+    PIO_Offset *sortedmap; /* The sorted map (without holes) of this task, if not already sorted. */
     int maxregions;
     int rank, ntasks;
     int rcnt = 0;
     int mpierr; /* Return call from MPI function calls. */
+    double phase_start; /* Start of a phase of the setup. */
     int ret;
 
 #ifdef TIMING
@@ -2195,11 +2668,13 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
     /* subset partitions each have exactly 1 io task which is task 0
      * of that subset_comm */
     /* TODO: introduce a mechanism for users to define partitions */
+    phase_start = MPI_Wtime();
     if ((ret = default_subset_partition(ios, iodesc)))
     {
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
                         "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to create the default subset partition for the I/O decomposition", iodesc->ioid, ios->iosysid);
     }
+    iodesc->setup.partition_time += MPI_Wtime() - phase_start;
     iodesc->rearranger = PIO_REARR_SUBSET;
 
     /* Get size of this subset communicator and rank of this task in it. */
@@ -2271,11 +2746,48 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         if (compmap[i] > 0)
             iodesc->sindex[j++] = i;
 
+    /* Sort the map (without holes) of this task, so that the IO task
+     * only has to merge the sorted maps of its compute tasks. The
+     * sindex is sorted with the map. */
+    phase_start = MPI_Wtime();
+    sortedmap = NULL;
+    for (i = 1; i < iodesc->scount[0]; i++)
+        if (compmap[iodesc->sindex[i]] < compmap[iodesc->sindex[i - 1]])
+            break;
+    if (i < iodesc->scount[0])
+    {
+        mapsort *lmap;
+
+        if (!(lmap = malloc(iodesc->scount[0] * sizeof(mapsort))) ||
+            !(sortedmap = malloc(iodesc->scount[0] * sizeof(PIO_Offset))))
+        {
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Out of memory allocating %lld bytes for sorting the comp map while setting up the rearranger", iodesc->ioid, ios->iosysid, (unsigned long long) (iodesc->scount[0] * (sizeof(mapsort) + sizeof(PIO_Offset))));
+        }
+
+        for (i = 0; i < iodesc->scount[0]; i++)
+        {
+            lmap[i].rfrom = 0;
+            lmap[i].soffset = iodesc->sindex[i];
+            lmap[i].iomap = compmap[iodesc->sindex[i]];
+        }
+        qsort(lmap, iodesc->scount[0], sizeof(mapsort), compare_offsets);
+        for (i = 0; i < iodesc->scount[0]; i++)
+        {
+            iodesc->sindex[i] = lmap[i].soffset;
+            sortedmap[i] = lmap[i].iomap;
+        }
+        free(lmap);
+    }
+    iodesc->setup.map_time += MPI_Wtime() - phase_start;
+
     /* Pass the reduced maplen (without holes) from each compute task
      * to its associated IO task. */
+    phase_start = MPI_Wtime();
     if ((mpierr = MPI_Gather(iodesc->scount, 1, MPI_INT, iodesc->rcount, rcnt,
                              MPI_INT, 0, iodesc->subset_comm)))
         return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    iodesc->setup.exchange_time += MPI_Wtime() - phase_start;
 
     iodesc->llen = 0;
 
@@ -2316,13 +2828,16 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
     }
 
     /* Determine whether fill values will be needed. */
+    phase_start = MPI_Wtime();
     if ((ret = determine_fill(ios, iodesc, gdimlen, compmap)))
     {
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
                         "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Unable to determine the fillvalue to be used", iodesc->ioid, ios->iosysid);
     }
+    iodesc->setup.fill_time += MPI_Wtime() - phase_start;
 
     /* Pass the sindex from each compute task to its associated IO task. */
+    phase_start = MPI_Wtime();
     if ((mpierr = MPI_Gatherv(iodesc->sindex, iodesc->scount[0], PIO_OFFSET,
                               srcindex, recvcounts, rdispls, PIO_OFFSET, 0,
                               iodesc->subset_comm)))
@@ -2347,7 +2862,11 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     /* Now pass the compmap, skipping the holes. */
     PIO_Offset *shrtmap;
-    if (maplen > iodesc->scount[0] && iodesc->scount[0] > 0)
+    if (sortedmap)
+    {
+        shrtmap = sortedmap;
+    }
+    else if (maplen > iodesc->scount[0] && iodesc->scount[0] > 0)
     {
         if (!(shrtmap = calloc(iodesc->scount[0], sizeof(PIO_Offset))))
         {
@@ -2373,28 +2892,15 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     if (shrtmap != compmap)
         free(shrtmap);
+    iodesc->setup.exchange_time += MPI_Wtime() - phase_start;
 
     /* On IO tasks that have data in the local array ??? */
+    phase_start = MPI_Wtime();
     if (ios->ioproc && iodesc->llen > 0)
     {
-        int pos = 0;
-        int k = 0;
-        mapsort *mptr;
-        for (i = 0; i < ntasks; i++)
-        {
-            for (j = 0; j < iodesc->rcount[i]; j++)
-            {
-                mptr = &map[k];
-                mptr->rfrom = i;
-                mptr->soffset = srcindex[pos + j];
-                mptr->iomap = iomap[pos + j];
-                k++;
-            }
-            pos += iodesc->rcount[i];
-        }
-
-        /* sort the mapping, this will transpose the data into IO order */
-        qsort(map, iodesc->llen, sizeof(mapsort), compare_offsets);
+        /* Merge the sorted maps of the compute tasks, this will
+         * transpose the data into IO order. */
+        merge_sorted_maps(ntasks, iodesc->rcount, rdispls, iomap, srcindex, map);
 
         if (!(iodesc->rindex = calloc(1, iodesc->llen * sizeof(PIO_Offset))))
         {
@@ -2426,7 +2932,10 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
         srcindex[(cnt[iodesc->rfrom[i]])++] = mptr->soffset;
     }
 
+    iodesc->setup.map_time += MPI_Wtime() - phase_start;
+
     /* Handle fill values if needed. */
+    phase_start = MPI_Wtime();
     if (ios->ioproc && iodesc->needsfill)
     {
         /* we need the list of offsets which are not in the union of iomap */
@@ -2567,6 +3076,12 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
                 return pio_err(ios, NULL, ret, __FILE__, __LINE__,
                                 "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Getting data regions with fillvalues failed", iodesc->ioid, ios->iosysid);
             }
+
+            /* Write the holes with the data where that takes fewer
+             * regions. */
+            if (iodesc->llen > 0)
+                if ((ret = merge_fill_holes(ios, iodesc, gdimlen, &iomap, myfillgrid)))
+                    return ret;
             free(myfillgrid);
             maxregions = iodesc->maxfillregions;
         }
@@ -2586,14 +3101,19 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
             return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
     }
 
+    iodesc->setup.fill_time += MPI_Wtime() - phase_start;
+
     /* Scatter values of srcindex to subset communicator. ??? */
+    phase_start = MPI_Wtime();
     if ((mpierr = MPI_Scatterv((void *)srcindex, recvcounts, rdispls, PIO_OFFSET,
                                (void *)iodesc->sindex, iodesc->scount[0],  PIO_OFFSET,
                                0, iodesc->subset_comm)))
         return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    iodesc->setup.exchange_time += MPI_Wtime() - phase_start;
 
     if (ios->ioproc)
     {
+        phase_start = MPI_Wtime();
         iodesc->maxregions = 0;
         if ((ret = get_regions(iodesc->ndims, gdimlen, iodesc->llen, iomap,
                                &iodesc->maxregions, iodesc->firstregion)))
@@ -2618,6 +3138,7 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
         if (srcindex)
             free(srcindex);
+        iodesc->setup.map_time += MPI_Wtime() - phase_start;
 
         /* Compute the max io buffer size needed for an iodesc. */
         if ((ret = compute_maxIObuffersize(ios->io_comm, iodesc)))
@@ -2631,11 +3152,13 @@ int subset_rearrange_create(iosystem_desc_t *ios, int maplen, PIO_Offset *compma
 
     /* Using maxiobuflen compute the maximum number of vars of this type that the io
        task buffer can handle. */
+    phase_start = MPI_Wtime();
     if ((ret = compute_maxaggregate_bytes(ios, iodesc)))
     {
         return pio_err(ios, NULL, ret, __FILE__, __LINE__,
                             "Creating SUBSET rearranger failed for I/O decomposition (ioid=%d) on iosystem (iosysid=%d). Calculating maximum aggregate bytes for the I/O decomposition failed", iodesc->ioid, ios->iosysid);
     }
+    iodesc->setup.counts_time += MPI_Wtime() - phase_start;
 
 #ifdef TIMING
     GPTLstop("PIO:subset_rearrange_create");
@@ -95,6 +95,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 #ifdef TIMING
     GPTLstart("PIO:pio_swapm");
 #endif
+    PIO_TRACE_BEGIN("pio_swapm");
     LOG((2, "pio_swapm fc->hs = %d fc->isend = %d fc->max_pend_req = %d", fc->hs,
          fc->isend, fc->max_pend_req));
 
@@ -134,6 +135,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 #ifdef TIMING
         GPTLstop("PIO:pio_swapm");
 #endif
+        PIO_TRACE_END("pio_swapm");
         return PIO_NOERR;
     }
 
@@ -184,6 +186,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 #ifdef TIMING
         GPTLstop("PIO:pio_swapm");
 #endif
+        PIO_TRACE_END("pio_swapm");
         return PIO_NOERR;
     }
 
@@ -216,6 +219,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 #ifdef TIMING
         GPTLstop("PIO:pio_swapm");
 #endif
+        PIO_TRACE_END("pio_swapm");
         return PIO_NOERR;
     }
 
@@ -387,6 +391,7 @@ int pio_swapm(void *sendbuf, int *sendcounts, int *sdispls, MPI_Datatype *sendty
 #ifdef TIMING
     GPTLstop("PIO:pio_swapm");
 #endif
+    PIO_TRACE_END("pio_swapm");
     return PIO_NOERR;
 }
 
@@ -0,0 +1,602 @@
+/**
+ * @file
+ * Thread-safe mode of the C API. When the library is configured with
+ * PIO_ENABLE_THREADSAFE, a global lock protects the lists of IO
+ * systems, files and decompositions, the ids assigned to them and
+ * the bget memory pool, and a lock per file protects the write multi
+ * buffers of the file. The calls that can be made concurrently are
+ * described in PIOc_set_threadsafe().
+ *
+ * The same configuration provides the I/O thread, a helper thread on
+ * each IO task that waits for the pending writes of the files, see
+ * PIOc_set_io_thread().
+ */
+/* Recursive mutexes are not part of the C99 POSIX defaults. */
+#define _XOPEN_SOURCE 700
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+#if PIO_USE_THREADSAFE
+#include <pthread.h>
+#include <stdint.h>
+
+/** The global lock, recursive. */
+static pthread_mutex_t pio_global_lock;
+
+/** Used to initialize the global lock once. */
+static pthread_once_t pio_global_lock_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Initialize a recursive mutex.
+ *
+ * @param mutex pointer to the mutex.
+ * @returns 0 for success, error code otherwise.
+ */
+static int pio_init_recursive_mutex(pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attr;
+    int ret;
+
+    if ((ret = pthread_mutexattr_init(&attr)))
+        return ret;
+    if (!(ret = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE)))
+        ret = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return ret;
+}
+
+/** A job handed off to the I/O thread. */
+typedef struct pio_io_job_t
+{
+    /** The file the job works on. */
+    file_desc_t *file;
+
+    /** The function run by the job, and its argument. */
+    int (*fn)(void *arg);
+    void *arg;
+
+    /** Next job in the queue. */
+    struct pio_io_job_t *next;
+} pio_io_job_t;
+
+/** The I/O thread of an IO system on an IO task. */
+typedef struct pio_io_thread_t
+{
+    /** The thread. */
+    pthread_t thread;
+
+    /** Protects the queue, the stop flag and the job counts and
+     * errors of the files. */
+    pthread_mutex_t mutex;
+
+    /** Signaled when a job is queued or completed, or the thread
+     * must stop. */
+    pthread_cond_t cond;
+
+    /** The queue of jobs, run in order. */
+    pio_io_job_t *head;
+    pio_io_job_t *tail;
+
+    /** Non-zero once the thread must stop (after the queued jobs). */
+    int stop;
+} pio_io_thread_t;
+
+/**
+ * Initialize the global lock, called once.
+ */
+static void pio_init_global_lock(void)
+{
+    int ret = pio_init_recursive_mutex(&pio_global_lock);
+    assert(!ret);
+}
+
+/**
+ * Acquire the global lock. The lock is recursive, a thread holding
+ * the lock can acquire it again.
+ */
+void pio_lock(void)
+{
+    pthread_once(&pio_global_lock_once, pio_init_global_lock);
+    pthread_mutex_lock(&pio_global_lock);
+}
+
+/**
+ * Release the global lock.
+ */
+void pio_unlock(void)
+{
+    pthread_mutex_unlock(&pio_global_lock);
+}
+
+/** Key of the ids of the threads, see pio_thread_id(). */
+static pthread_key_t pio_thread_id_key;
+
+/** Used to create the key of the ids of the threads once. */
+static pthread_once_t pio_thread_id_once = PTHREAD_ONCE_INIT;
+
+/** Number of threads that got an id. */
+static int pio_num_thread_ids = 0;
+
+/**
+ * Create the key of the ids of the threads.
+ */
+static void pio_init_thread_id_key(void)
+{
+    int ret = pthread_key_create(&pio_thread_id_key, NULL);
+    assert(!ret);
+}
+
+/**
+ * Get a small id of the calling thread, used to tell the events
+ * recorded by the threads of a task apart (see PIOc_set_trace()). The
+ * threads get ids 0, 1, ... in the order they first ask for one.
+ *
+ * @returns the id of the calling thread.
+ */
+int pio_thread_id(void)
+{
+    intptr_t id;
+
+    pthread_once(&pio_thread_id_once, pio_init_thread_id_key);
+
+    /* The key stores the id plus one, NULL is not set. */
+    if (!(id = (intptr_t)pthread_getspecific(pio_thread_id_key)))
+    {
+        PIO_LOCK();
+        id = ++pio_num_thread_ids;
+        PIO_UNLOCK();
+        pthread_setspecific(pio_thread_id_key, (void *)id);
+    }
+
+    return (int)(id - 1);
+}
+#endif /* PIO_USE_THREADSAFE */
+
+/**
+ * Create the lock of a file. If the library is not configured with
+ * PIO_ENABLE_THREADSAFE the file has no lock.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_file_lock_init(file_desc_t *file)
+{
+    assert(file);
+
+    file->lock = NULL;
+#if PIO_USE_THREADSAFE
+    {
+        pthread_mutex_t *mutex;
+
+        if (!(mutex = malloc(sizeof(pthread_mutex_t))))
+            return PIO_ENOMEM;
+        if (pio_init_recursive_mutex(mutex))
+        {
+            free(mutex);
+            return PIO_EINVAL;
+        }
+        file->lock = mutex;
+    }
+#endif /* PIO_USE_THREADSAFE */
+
+    return PIO_NOERR;
+}
+
+/**
+ * Acquire the lock of a file, if it has one.
+ *
+ * @param file pointer to the file info.
+ */
+void pio_file_lock(file_desc_t *file)
+{
+#if PIO_USE_THREADSAFE
+    if (file->lock)
+        pthread_mutex_lock((pthread_mutex_t *)file->lock);
+#endif /* PIO_USE_THREADSAFE */
+}
+
+/**
+ * Release the lock of a file, if it has one.
+ *
+ * @param file pointer to the file info.
+ */
+void pio_file_unlock(file_desc_t *file)
+{
+#if PIO_USE_THREADSAFE
+    if (file->lock)
+        pthread_mutex_unlock((pthread_mutex_t *)file->lock);
+#endif /* PIO_USE_THREADSAFE */
+}
+
+/**
+ * Free the lock of a file, if it has one.
+ *
+ * @param file pointer to the file info.
+ */
+void pio_file_lock_free(file_desc_t *file)
+{
+#if PIO_USE_THREADSAFE
+    if (file->lock)
+    {
+        pthread_mutex_destroy((pthread_mutex_t *)file->lock);
+        free(file->lock);
+    }
+#endif /* PIO_USE_THREADSAFE */
+    file->lock = NULL;
+}
+
+/**
+ * Turn the thread-safe mode of an IO system on or off. The mode is
+ * only available if the library is configured with
+ * PIO_ENABLE_THREADSAFE and MPI is initialized with
+ * MPI_THREAD_MULTIPLE, and it is not supported with async IO.
+ *
+ * Independent of the mode, when the library is configured with
+ * PIO_ENABLE_THREADSAFE the lists of IO systems, files and
+ * decompositions and the memory pool are protected by a lock, so
+ * different threads can initialize IO systems, create and open
+ * files, define them, and create decompositions concurrently, as
+ * long as concurrent collective calls are made on different IO
+ * systems (initialized with different, e.g. duplicated,
+ * communicators). As with MPI, collective calls on the same IO
+ * system must be made in the same order on all tasks. The underlying
+ * I/O library must be thread-safe for the files accessed
+ * concurrently: PnetCDF is (for different files), the netCDF and
+ * HDF5 libraries usually are not.
+ *
+ * In the thread-safe mode, PIOc_write_darray() is no longer
+ * collective: it only caches the user data in the write multi
+ * buffers of the file, under a lock of the file, so different
+ * threads can write different variables of the same file
+ * concurrently (and in a different order on different tasks). The
+ * frame of a record variable must be set, with PIOc_setframe(), by
+ * the thread writing it. The cached data is flushed, in the order of
+ * the decompositions and variable ids, by the next call to
+ * PIOc_sync() or PIOc_closefile(), made from a single thread on each
+ * task once all the writes have returned. All the data written is
+ * kept in the buffers until then (no flush is triggered by the size
+ * of the cached data), and the data of variables of a narrower type
+ * than the user data is not converted on the compute tasks.
+ *
+ * The mode must be changed when no data is cached in the files of
+ * the IO system (e.g. after PIOc_sync()). This function is
+ * collective on the computation tasks of the IO system.
+ *
+ * @param iosysid the IO system ID.
+ * @param threadsafe non-zero to turn on the thread-safe mode, 0 to
+ * turn it off.
+ * @returns 0 for success, error code otherwise.
+ * @ingroup PIO_threadsafe
+ */
+int PIOc_set_threadsafe(int iosysid, int threadsafe)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+
+    LOG((1, "PIOc_set_threadsafe iosysid = %d threadsafe = %d", iosysid, threadsafe));
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the thread-safe mode failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    if (!threadsafe)
+    {
+        ios->threadsafe = 0;
+        return PIO_NOERR;
+    }
+
+#if PIO_USE_THREADSAFE
+    {
+        int provided = MPI_THREAD_SINGLE;
+        int mpierr;
+
+        if (ios->async)
+        {
+            return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                            "Setting the thread-safe mode failed on iosystem (iosysid=%d). The thread-safe mode is not supported with asynchronous I/O", iosysid);
+        }
+
+        if ((mpierr = MPI_Query_thread(&provided)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if (provided < MPI_THREAD_MULTIPLE)
+        {
+            return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                            "Setting the thread-safe mode failed on iosystem (iosysid=%d). MPI was not initialized with MPI_THREAD_MULTIPLE (provided thread level = %d)", iosysid, provided);
+        }
+        ios->threadsafe = 1;
+    }
+
+    return PIO_NOERR;
+#else
+    return pio_err(ios, NULL, PIO_ENOTBUILT, __FILE__, __LINE__,
+                    "Setting the thread-safe mode failed on iosystem (iosysid=%d). The library was not configured with PIO_ENABLE_THREADSAFE", iosysid);
+#endif /* PIO_USE_THREADSAFE */
+}
+
+#if PIO_USE_THREADSAFE
+/**
+ * The main function of the I/O thread: run the queued jobs in order
+ * until the thread is stopped.
+ *
+ * @param arg pointer to the pio_io_thread_t of the thread.
+ * @returns NULL.
+ */
+static void *pio_io_thread_main(void *arg)
+{
+    pio_io_thread_t *iot = (pio_io_thread_t *)arg;
+
+    pthread_mutex_lock(&iot->mutex);
+    while (1)
+    {
+        pio_io_job_t *job;
+        int ret;
+
+        while (!iot->head && !iot->stop)
+            pthread_cond_wait(&iot->cond, &iot->mutex);
+        if (!iot->head)
+            break;
+
+        job = iot->head;
+        iot->head = job->next;
+        if (!iot->head)
+            iot->tail = NULL;
+
+        /* Run the job without holding the lock. */
+        pthread_mutex_unlock(&iot->mutex);
+        ret = job->fn(job->arg);
+        pthread_mutex_lock(&iot->mutex);
+
+        if (ret != PIO_NOERR && job->file->io_thread_ierr == PIO_NOERR)
+            job->file->io_thread_ierr = ret;
+        job->file->io_thread_njobs--;
+        free(job);
+        pthread_cond_broadcast(&iot->cond);
+    }
+    pthread_mutex_unlock(&iot->mutex);
+
+    return NULL;
+}
+#endif /* PIO_USE_THREADSAFE */
+
+/**
+ * Hand off a job of a file to the I/O thread of its IO system. The
+ * job is run after the jobs queued before it, and must only use the
+ * file, the memory it owns and MPI communicators not used by the
+ * calling thread (e.g. the communicator of the PnetCDF file). If the
+ * IO system has no I/O thread the job is run by the calling thread.
+ *
+ * @param file pointer to the file info.
+ * @param fn the function run by the job, returning a PIO error code.
+ * @param arg the argument of fn.
+ * @returns 0 for success, error code otherwise. The errors of a job
+ * run by the I/O thread are returned by pio_io_thread_finish().
+ */
+int pio_io_thread_submit(file_desc_t *file, int (*fn)(void *arg), void *arg)
+{
+    assert(file && file->iosystem && fn);
+
+#if PIO_USE_THREADSAFE
+    if (file->iosystem->io_thread)
+    {
+        pio_io_thread_t *iot = (pio_io_thread_t *)file->iosystem->io_thread;
+        pio_io_job_t *job;
+
+        if (!(job = malloc(sizeof(pio_io_job_t))))
+        {
+            return pio_err(file->iosystem, file, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Handing off a job of file (%s, ncid=%d) to the I/O thread failed. Out of memory allocating %lld bytes for the job", pio_get_fname_from_file(file), file->pio_ncid, (unsigned long long)sizeof(pio_io_job_t));
+        }
+        job->file = file;
+        job->fn = fn;
+        job->arg = arg;
+        job->next = NULL;
+
+        pthread_mutex_lock(&iot->mutex);
+        if (iot->tail)
+            iot->tail->next = job;
+        else
+            iot->head = job;
+        iot->tail = job;
+        file->io_thread_njobs++;
+        pthread_cond_broadcast(&iot->cond);
+        pthread_mutex_unlock(&iot->mutex);
+
+        return PIO_NOERR;
+    }
+#endif /* PIO_USE_THREADSAFE */
+
+    return fn(arg);
+}
+
+/**
+ * Wait for the jobs of a file handed off to the I/O thread to
+ * complete. Returns immediately if called from the I/O thread.
+ *
+ * @param file pointer to the file info.
+ */
+void pio_io_thread_wait(file_desc_t *file)
+{
+#if PIO_USE_THREADSAFE
+    pio_io_thread_t *iot;
+
+    assert(file && file->iosystem);
+    if (!(iot = (pio_io_thread_t *)file->iosystem->io_thread))
+        return;
+    if (pthread_equal(pthread_self(), iot->thread))
+        return;
+
+    pthread_mutex_lock(&iot->mutex);
+    while (file->io_thread_njobs > 0)
+        pthread_cond_wait(&iot->cond, &iot->mutex);
+    pthread_mutex_unlock(&iot->mutex);
+#endif /* PIO_USE_THREADSAFE */
+}
+
+/**
+ * Wait for the jobs of a file handed off to the I/O thread to
+ * complete, and report their errors. The waits of the jobs are added
+ * to the perf statistics of the file by the calling thread.
+ *
+ * @param file pointer to the file info.
+ * @returns 0 for success, the error code of the first job that
+ * failed otherwise.
+ */
+int pio_io_thread_finish(file_desc_t *file)
+{
+    int ierr;
+
+    pio_io_thread_wait(file);
+
+    /* No job of the file is running, the error and the waits can be
+     * read. */
+    ierr = file->io_thread_ierr;
+    file->io_thread_ierr = PIO_NOERR;
+    file->perf.nwaits += file->io_thread_nwaits;
+    file->perf.wait_time += file->io_thread_wait_time;
+    file->io_thread_nwaits = 0;
+    file->io_thread_wait_time = 0;
+
+    return ierr;
+}
+
+/**
+ * Stop the I/O thread of an IO system, if it has one, once the jobs
+ * queued are completed.
+ *
+ * @param ios pointer to the IO system info.
+ */
+void pio_io_thread_stop(iosystem_desc_t *ios)
+{
+#if PIO_USE_THREADSAFE
+    pio_io_thread_t *iot;
+
+    assert(ios);
+    if (!(iot = (pio_io_thread_t *)ios->io_thread))
+        return;
+
+    pthread_mutex_lock(&iot->mutex);
+    iot->stop = 1;
+    pthread_cond_broadcast(&iot->cond);
+    pthread_mutex_unlock(&iot->mutex);
+    pthread_join(iot->thread, NULL);
+
+    pthread_cond_destroy(&iot->cond);
+    pthread_mutex_destroy(&iot->mutex);
+    free(iot);
+    ios->io_thread = NULL;
+#endif /* PIO_USE_THREADSAFE */
+}
+
+/**
+ * Start or stop the I/O thread of an IO system. The I/O thread is
+ * only available if the library is configured with
+ * PIO_ENABLE_THREADSAFE and MPI is initialized with
+ * MPI_THREAD_MULTIPLE, and it is not supported with async IO.
+ *
+ * The I/O thread is a lighter alternative to async IO tasks: instead
+ * of sending the data to dedicated IO tasks, each IO task starts a
+ * helper thread that waits for the pending writes of the files
+ * opened with PIO_IOTYPE_PNETCDF. When the data cached by
+ * PIOc_write_darray() is flushed (by PIOc_sync(), or because the
+ * buffer is full), the data is rearranged and the non-blocking
+ * PnetCDF writes are posted as usual, then the wait for the writes
+ * to complete and the release of the IO buffers are handed off to
+ * the I/O thread, and the call returns while the data is written.
+ *
+ * The next call on the same file waits for the I/O thread to be
+ * done with the file, so at most one flush of a file is in flight
+ * and the memory used is bounded by the PnetCDF buffer size limit
+ * (see PIOc_set_buffer_size_limit()). PIOc_closefile() waits for all
+ * the data to be written, and so does PIOc_sync(): only the waits of
+ * the flushes triggered by the size of the cached data are left to
+ * the I/O thread when the call returns. Errors of these writes are
+ * returned by the next flush, sync or close of the file. The other IO
+ * types, and the reads, are not affected. The I/O thread is not
+ * supported if the library is built with PIO_MICRO_TIMING.
+ *
+ * This function is collective on all the tasks of the IO system.
+ * The I/O thread is stopped by PIOc_finalize().
+ *
+ * @param iosysid the IO system ID.
+ * @param enable non-zero to start the I/O thread, 0 to stop it once
+ * the data handed off to it is written.
+ * @returns 0 for success, error code otherwise. PIO_ENOTBUILT if
+ * the library is built without PIO_ENABLE_THREADSAFE, or with
+ * PIO_MICRO_TIMING.
+ * @ingroup PIO_threadsafe
+ */
+int PIOc_set_io_thread(int iosysid, int enable)
+{
+    iosystem_desc_t *ios;  /* Pointer to io system information. */
+
+    LOG((1, "PIOc_set_io_thread iosysid = %d enable = %d", iosysid, enable));
+
+    /* Get the IO system info. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Setting the I/O thread failed. Invalid iosystem id (%d) provided", iosysid);
+    }
+
+    if (!enable)
+    {
+        pio_io_thread_stop(ios);
+        return PIO_NOERR;
+    }
+
+#if PIO_USE_THREADSAFE && !defined(PIO_MICRO_TIMING)
+    {
+        pio_io_thread_t *iot;
+        int provided = MPI_THREAD_SINGLE;
+        int mpierr;
+        int ret;
+
+        if (ios->async)
+        {
+            return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                            "Starting the I/O thread failed on iosystem (iosysid=%d). The I/O thread is not supported with asynchronous I/O", iosysid);
+        }
+
+        if ((mpierr = MPI_Query_thread(&provided)))
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if (provided < MPI_THREAD_MULTIPLE)
+        {
+            return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                            "Starting the I/O thread failed on iosystem (iosysid=%d). MPI was not initialized with MPI_THREAD_MULTIPLE (provided thread level = %d)", iosysid, provided);
+        }
+
+        /* Only the IO tasks write, and the thread is started once. */
+        if (!ios->ioproc || ios->io_thread)
+            return PIO_NOERR;
+
+        if (!(iot = calloc(1, sizeof(pio_io_thread_t))))
+        {
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Starting the I/O thread failed on iosystem (iosysid=%d). Out of memory allocating %lld bytes for the thread info", iosysid, (unsigned long long)sizeof(pio_io_thread_t));
+        }
+        pthread_mutex_init(&iot->mutex, NULL);
+        pthread_cond_init(&iot->cond, NULL);
+        if ((ret = pthread_create(&iot->thread, NULL, pio_io_thread_main, iot)))
+        {
+            pthread_cond_destroy(&iot->cond);
+            pthread_mutex_destroy(&iot->mutex);
+            free(iot);
+            return pio_err(ios, NULL, PIO_EINTERNAL, __FILE__, __LINE__,
+                            "Starting the I/O thread failed on iosystem (iosysid=%d). Creating the thread failed (error = %d)", iosysid, ret);
+        }
+        ios->io_thread = iot;
+    }
+
+    return PIO_NOERR;
+#elif PIO_USE_THREADSAFE
+    /* The micro timers of the variables are updated by the waits. */
+    return pio_err(ios, NULL, PIO_ENOTBUILT, __FILE__, __LINE__,
+                    "Starting the I/O thread failed on iosystem (iosysid=%d). The I/O thread is not supported with PIO_MICRO_TIMING", iosysid);
+#else
+    return pio_err(ios, NULL, PIO_ENOTBUILT, __FILE__, __LINE__,
+                    "Starting the I/O thread failed on iosystem (iosysid=%d). The library was not configured with PIO_ENABLE_THREADSAFE", iosysid);
+#endif /* PIO_USE_THREADSAFE */
+}
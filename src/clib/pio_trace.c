@@ -0,0 +1,191 @@
+/**
+ * @file
+ * Event tracer. When the library is configured with PIO_ENABLE_TRACE
+ * and the tracer is turned on (see PIOc_set_trace()), the begin and
+ * end of the traced events (writes of distributed arrays, flushes of
+ * the write multi buffers, data rearrangement, waits on pending
+ * PnetCDF requests, asynchronous messages handled on the IO tasks,
+ * and file opens and closes) are recorded in a ring buffer on each
+ * task. The buffer is written, in the Chrome trace format (that can
+ * be viewed with Perfetto or chrome://tracing), to
+ * pio_trace_<rank>.json when the library is finalized. In the
+ * thread-safe configuration the events are recorded under the global
+ * lock, with the id of the thread that recorded them, so the events
+ * of the I/O thread and of the user threads are shown on their own
+ * tracks.
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+
+/** Non-zero if the tracer is turned on. */
+int pio_trace_enabled = 0;
+
+#ifdef PIO_TRACE
+/** Number of events in the ring buffer of each task. When the buffer
+ * is full the oldest events are overwritten. */
+#define PIO_TRACE_NUM_EVENTS 65536
+
+/** A traced event. */
+typedef struct pio_trace_event_t
+{
+    /** Name of the event, a static string. */
+    const char *name;
+
+    /** Time of the event (secs). */
+    double ts;
+
+    /** Phase of the event, 'B' (begin) or 'E' (end). */
+    char ph;
+
+    /** Id of the thread that recorded the event (see
+     * pio_thread_id()). */
+    int tid;
+} pio_trace_event_t;
+
+/** The ring buffer of events, allocated when the first event is
+ * recorded. */
+static pio_trace_event_t *pio_trace_buf = NULL;
+
+/** Total number of events recorded. */
+static unsigned long long pio_trace_nevents = 0;
+
+/** Number of initializations of the library not finalized. */
+static int pio_trace_ref_cnt = 0;
+#endif /* PIO_TRACE */
+
+/**
+ * Turn the event tracer on or off. The tracer is only available if
+ * the library is configured with PIO_ENABLE_TRACE, otherwise this
+ * function has no effect. The events recorded are written to
+ * pio_trace_<rank>.json when the library is finalized.
+ *
+ * This function is not collective, the tracer can be turned on or
+ * off on any task at any time.
+ *
+ * @param enable non-zero to turn on the tracer, 0 to turn it off.
+ * @returns the previous setting.
+ * @ingroup PIO_trace
+ */
+int PIOc_set_trace(int enable)
+{
+    int old_enable = pio_trace_enabled;
+
+    LOG((1, "PIOc_set_trace enable = %d", enable));
+    pio_trace_enabled = enable ? 1 : 0;
+
+    return old_enable;
+}
+
+#ifdef PIO_TRACE
+/**
+ * Record an event in the ring buffer. Use the PIO_TRACE_BEGIN() and
+ * PIO_TRACE_END() macros, that only call this function if the tracer
+ * is turned on.
+ *
+ * @param name the name of the event, must be a static string.
+ * @param ph the phase of the event, 'B' (begin) or 'E' (end).
+ */
+void pio_trace_event(const char *name, char ph)
+{
+    pio_trace_event_t *ev;
+    int tid = PIO_THREAD_ID();
+
+    PIO_LOCK();
+
+    /* Events are not recorded outside of init/finalize. */
+    if (!pio_trace_buf)
+    {
+        if (pio_trace_ref_cnt <= 0)
+        {
+            PIO_UNLOCK();
+            return;
+        }
+        if (!(pio_trace_buf = malloc(PIO_TRACE_NUM_EVENTS * sizeof(pio_trace_event_t))))
+        {
+            LOG((1, "Unable to allocate the event trace buffer, turning off the tracer"));
+            pio_trace_enabled = 0;
+            PIO_UNLOCK();
+            return;
+        }
+    }
+
+    ev = &pio_trace_buf[pio_trace_nevents++ % PIO_TRACE_NUM_EVENTS];
+    ev->name = name;
+    ev->ts = MPI_Wtime();
+    ev->ph = ph;
+    ev->tid = tid;
+
+    PIO_UNLOCK();
+}
+
+/**
+ * Write the events in the ring buffer to pio_trace_<rank>.json, in
+ * the Chrome trace format. The MPI rank (in MPI_COMM_WORLD) is the
+ * process id of the events.
+ */
+static void pio_trace_dump(void)
+{
+    char fname[PIO_MAX_NAME];
+    unsigned long long first = 0;
+    int my_rank;
+    FILE *fp;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    sprintf(fname, "pio_trace_%d.json", my_rank);
+    if (!(fp = fopen(fname, "w")))
+    {
+        LOG((1, "Unable to open the event trace file %s", fname));
+        return;
+    }
+
+    /* Only the last PIO_TRACE_NUM_EVENTS events are in the buffer. */
+    if (pio_trace_nevents > PIO_TRACE_NUM_EVENTS)
+        first = pio_trace_nevents - PIO_TRACE_NUM_EVENTS;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (unsigned long long i = first; i < pio_trace_nevents; i++)
+    {
+        pio_trace_event_t *ev = &pio_trace_buf[i % PIO_TRACE_NUM_EVENTS];
+
+        fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"pio\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d}\n", (i == first) ? "" : ",", ev->name, ev->ph,
+                ev->ts * 1e6, my_rank, ev->tid);
+    }
+    fprintf(fp, "]}\n");
+    fclose(fp);
+}
+#endif /* PIO_TRACE */
+
+/**
+ * Initialize the event tracer, called when the library is
+ * initialized.
+ */
+void pio_init_trace(void)
+{
+#ifdef PIO_TRACE
+    PIO_LOCK();
+    pio_trace_ref_cnt++;
+    PIO_UNLOCK();
+#endif
+}
+
+/**
+ * Finalize the event tracer, called when the library is finalized.
+ * When the last initialization is finalized the events recorded are
+ * written to pio_trace_<rank>.json, and the ring buffer is freed.
+ */
+void pio_finalize_trace(void)
+{
+#ifdef PIO_TRACE
+    PIO_LOCK();
+    if (--pio_trace_ref_cnt == 0 && pio_trace_buf)
+    {
+        pio_trace_dump();
+        free(pio_trace_buf);
+        pio_trace_buf = NULL;
+        pio_trace_nevents = 0;
+    }
+    PIO_UNLOCK();
+#endif
+}
@@ -24,6 +24,10 @@ int default_error_handler = PIO_INTERNAL_ERROR;
  * used (see pio_sc.c). */
 extern int blocksize;
 
+/** Non-zero if PIOc_init_intercomm() splits the IO tasks in one group
+ * per computation component (see PIOc_set_async_split()). */
+static int async_split = 0;
+
 /**
  * Check to see if PIO has been initialized.
  *
@@ -479,22 +483,7 @@ int pio_create_uniq_str(iosystem_desc_t *ios, io_desc_t *iodesc, char *str, int
 }
 
 /**
- * Initialize the decomposition used with distributed arrays. The
- * decomposition describes how the data will be distributed between
- * tasks.
- *
- * Internally, this function will:
- * <ul>
- * <li>Allocate and initialize an iodesc struct for this
- * decomposition. (This also allocates an io_region struct for the
- * first region.)
- * <li>(Box rearranger only) If iostart or iocount are NULL, call
- * CalcStartandCount() to determine starts/counts. Then call
- * compute_maxIObuffersize() to compute the max IO buffer size needed.
- * <li>Create the rearranger.
- * <li>Assign an ioid and add this decomposition to the list of open
- * decompositions.
- * </ul>
+ * Initialize a decomposition (see PIOc_InitDecomp()).
  *
  * @param iosysid the IO system ID.
  * @param pio_type the basic PIO data type used.
@@ -504,31 +493,31 @@ int pio_create_uniq_str(iosystem_desc_t *ios, io_desc_t *iodesc, char *str, int
  * dimensions.
  * @param maplen the local length of the compmap array.
  * @param compmap a 1 based array of offsets into the array record on
- * file. A 0 in this array indicates a value which should not be
- * transfered.
+ * file.
  * @param ioidp pointer that will get the io description ID.
  * @param rearranger pointer to the rearranger to be used for this
  * decomp or NULL to use the default.
- * @param iostart An array of start values for block cyclic
- * decompositions for the SUBSET rearranger. Ignored if block
- * rearranger is used. If NULL and SUBSET rearranger is used, the
- * iostarts are generated.
- * @param iocount An array of count values for block cyclic
- * decompositions for the SUBSET rearranger. Ignored if block
- * rearranger is used. If NULL and SUBSET rearranger is used, the
- * iostarts are generated.
+ * @param iostart An array of start values of the IO region of this
+ * task, or NULL.
+ * @param iocount An array of count values of the IO region of this
+ * task, or NULL.
+ * @param save_decomp true if the decomposition may be saved to disk
+ * (with PIO_SAVE_DECOMPS), false for decompositions created by PIO
+ * for internal use.
  * @returns 0 on success, error code otherwise
- * @ingroup PIO_initdecomp
- * @author Jim Edwards, Ed Hartnett
  */
-int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, int maplen,
+int pio_init_decomp(int iosysid, int pio_type, int ndims, const int *gdimlen, int maplen,
                     const PIO_Offset *compmap, int *ioidp, const int *rearranger,
-                    const PIO_Offset *iostart, const PIO_Offset *iocount)
+                    const PIO_Offset *iostart, const PIO_Offset *iocount, bool save_decomp)
 {
     iosystem_desc_t *ios;  /* Pointer to io system information. */
     io_desc_t *iodesc;     /* The IO description. */
     int mpierr = MPI_SUCCESS;  /* Return code from MPI function calls. */
     int ierr;              /* Return code. */
+    double setup_start = MPI_Wtime(); /* Start of the setup of the decomposition. */
+    double phase_start;    /* Start of a phase of the setup. */
+    bool shared = false;  /* Setup shared with an identical decomposition. */
+    bool loaded = false;  /* Setup loaded from the plan cache. */
 
 #ifdef TIMING
     GPTLstart("PIO:PIOc_initdecomp");
@@ -635,9 +624,39 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
     else
         iodesc->rearranger = *rearranger;
     LOG((2, "iodesc->rearranger = %d", iodesc->rearranger));
+    iodesc->user_ioregions = (iodesc->rearranger == PIO_REARR_BOX && iostart && iocount);
+
+    /* Share the rearranger setup of an identical decomposition, if
+     * any. The setup computed from user provided IO regions (iostart
+     * and iocount) is not shared, and the IO tasks of async IO
+     * systems do not share the setup. */
+    if (!ios->async && !(iostart && iocount))
+    {
+        iodesc->hash = pio_decomp_hash(ndims, gdimlen, maplen, compmap);
+        if ((ierr = pio_share_iodesc(ios, iodesc, &shared)))
+        {
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Initializing the PIO decomposition failed. Error sharing the setup of an identical decomposition");
+        }
+    }
 
-    /* Is this the subset rearranger? */
-    if (iodesc->rearranger == PIO_REARR_SUBSET)
+    /* Load the rearranger setup from the plan cache, if it is used. */
+    if (!shared && iodesc->hash && ios->plan_cache_dir)
+    {
+        if ((ierr = pio_load_rearr_plan(ios, iodesc, &loaded)))
+        {
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Initializing the PIO decomposition failed. Error loading the rearranger plan from the cache");
+        }
+    }
+
+    /* Set up the subset or box rearranger, unless the setup is
+     * shared or loaded. */
+    if (shared || loaded)
+    {
+        LOG((2, "%s the rearranger setup", shared ? "sharing" : "loaded"));
+    }
+    else if (iodesc->rearranger == PIO_REARR_SUBSET)
     {
         iodesc->num_aiotasks = ios->num_iotasks;
         LOG((2, "creating subset rearranger iodesc->num_aiotasks = %d",
@@ -651,6 +670,7 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
     }
     else /* box rearranger */
     {
+        phase_start = MPI_Wtime();
         if (ios->ioproc)
         {
             /*  Unless the user specifies the start and count for each
@@ -686,6 +706,30 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
             }
             LOG((3, "compute_maxIObuffersize called iodesc->maxiobuflen = %d",
                  iodesc->maxiobuflen));
+
+            /* Find the smallest non-empty IO region along each
+             * dimension, PIO chooses the chunk sizes of netCDF-4
+             * variables so that the chunks are aligned with the IO
+             * regions. Empty regions do not limit the size. */
+            if (!(iodesc->ioregion_count = malloc(ndims * sizeof(PIO_Offset))))
+            {
+                return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                                "Initializing the PIO decomposition failed. Out of memory allocating %lld bytes for the sizes of the IO regions", (unsigned long long) (ndims * sizeof(PIO_Offset)));
+            }
+            {
+                PIO_Offset my_count[ndims];
+                bool empty = false;
+
+                for (int d = 0; d < ndims; d++)
+                    if (iodesc->firstregion->count[d] == 0)
+                        empty = true;
+                for (int d = 0; d < ndims; d++)
+                    my_count[d] = empty ? gdimlen[d] : iodesc->firstregion->count[d];
+
+                if ((mpierr = MPI_Allreduce(my_count, iodesc->ioregion_count, ndims, MPI_OFFSET,
+                                            MPI_MIN, ios->io_comm)))
+                    return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+            }
         }
 
         /* Depending on array size and io-blocksize the actual number
@@ -694,6 +738,7 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
                                 ios->my_comm)))
             return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
         LOG((3, "iodesc->num_aiotasks = %d", iodesc->num_aiotasks));
+        iodesc->setup.partition_time += MPI_Wtime() - phase_start;
 
         /* Compute the communications pattern for this decomposition. */
         if (iodesc->rearranger == PIO_REARR_BOX)
@@ -704,6 +749,16 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
             }
     }
 
+    /* Save the rearranger setup computed to the plan cache. */
+    if (!shared && !loaded && iodesc->hash && ios->plan_cache_dir)
+    {
+        if ((ierr = pio_save_rearr_plan(ios, iodesc)))
+        {
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Initializing the PIO decomposition failed. Error saving the rearranger plan to the cache");
+        }
+    }
+
     /* Add this IO description to the list. */
     MPI_Comm comm = MPI_COMM_NULL;
 #ifdef _ADIOS2
@@ -730,7 +785,7 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
     }
 
 #if PIO_SAVE_DECOMPS
-    if(pio_save_decomps_regex_match(*ioidp, NULL, NULL))
+    if(save_decomp && pio_save_decomps_regex_match(*ioidp, NULL, NULL))
     {
         char filename[PIO_MAX_NAME];
         ierr = pio_create_uniq_str(ios, iodesc, filename, PIO_MAX_NAME, "piodecomp", ".dat");
@@ -775,12 +830,65 @@ int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, in
      * PERFTUNE is set. */
     performance_tune_rearranger(ios, iodesc);
 
+    iodesc->setup.total_time = MPI_Wtime() - setup_start;
+
 #ifdef TIMING
     GPTLstop("PIO:PIOc_initdecomp");
 #endif
     return PIO_NOERR;
 }
 
+/**
+ * Initialize the decomposition used with distributed arrays. The
+ * decomposition describes how the data will be distributed between
+ * tasks.
+ *
+ * Internally, this function will:
+ * <ul>
+ * <li>Allocate and initialize an iodesc struct for this
+ * decomposition. (This also allocates an io_region struct for the
+ * first region.)
+ * <li>(Box rearranger only) If iostart or iocount are NULL, call
+ * CalcStartandCount() to determine starts/counts. Then call
+ * compute_maxIObuffersize() to compute the max IO buffer size needed.
+ * <li>Create the rearranger.
+ * <li>Assign an ioid and add this decomposition to the list of open
+ * decompositions.
+ * </ul>
+ *
+ * @param iosysid the IO system ID.
+ * @param pio_type the basic PIO data type used.
+ * @param ndims the number of dimensions in the variable, not
+ * including the unlimited dimension.
+ * @param gdimlen an array length ndims with the sizes of the global
+ * dimensions.
+ * @param maplen the local length of the compmap array.
+ * @param compmap a 1 based array of offsets into the array record on
+ * file. A 0 in this array indicates a value which should not be
+ * transfered.
+ * @param ioidp pointer that will get the io description ID.
+ * @param rearranger pointer to the rearranger to be used for this
+ * decomp or NULL to use the default.
+ * @param iostart An array of start values for block cyclic
+ * decompositions for the SUBSET rearranger. Ignored if block
+ * rearranger is used. If NULL and SUBSET rearranger is used, the
+ * iostarts are generated.
+ * @param iocount An array of count values for block cyclic
+ * decompositions for the SUBSET rearranger. Ignored if block
+ * rearranger is used. If NULL and SUBSET rearranger is used, the
+ * iostarts are generated.
+ * @returns 0 on success, error code otherwise
+ * @ingroup PIO_initdecomp
+ * @author Jim Edwards, Ed Hartnett
+ */
+int PIOc_InitDecomp(int iosysid, int pio_type, int ndims, const int *gdimlen, int maplen,
+                    const PIO_Offset *compmap, int *ioidp, const int *rearranger,
+                    const PIO_Offset *iostart, const PIO_Offset *iocount)
+{
+    return pio_init_decomp(iosysid, pio_type, ndims, gdimlen, maplen, compmap, ioidp,
+                           rearranger, iostart, iocount, true);
+}
+
 /**
  * Initialize the decomposition used with distributed arrays. The
  * decomposition describes how the data will be distributed between
@@ -993,6 +1101,7 @@ int PIOc_Init_Intracomm(MPI_Comm comp_comm, int num_iotasks, int stride, int bas
 #endif
     /* Turn on the logging system. */
     pio_init_logging();
+    pio_init_trace();
 
 #ifdef PIO_MICRO_TIMING
     /* Initialize the timer framework - MPI_Wtime() + output from root proc */
@@ -1307,6 +1416,9 @@ int PIOc_finalize(int iosysid)
         }
     }
 
+    /* Stop the I/O thread, once the data handed off to it is written. */
+    pio_io_thread_stop(ios);
+
     /* Free this memory that was allocated in init_intracomm. */
     if (ios->ioranks)
         free(ios->ioranks);
@@ -1314,6 +1426,7 @@ int PIOc_finalize(int iosysid)
     if (ios->compranks)
         free(ios->compranks);
     LOG((3, "Freed compranks."));
+    free(ios->plan_cache_dir);
 
     /* Learn the number of open IO systems. */
     if ((ierr = pio_num_iosystem(&niosysid)))
@@ -1370,6 +1483,7 @@ int PIOc_finalize(int iosysid)
 
     LOG((1, "about to finalize logging"));
     pio_finalize_logging();
+    pio_finalize_trace();
 
     LOG((2, "PIOc_finalize completed successfully"));
 #ifdef TIMING
@@ -1601,6 +1715,7 @@ int PIOc_init_async(MPI_Comm world, int num_io_procs, int *io_proc_list,
 
     /* Turn on the logging system for PIO. */
     pio_init_logging();
+    pio_init_trace();
     LOG((1, "PIOc_Init_Async num_io_procs = %d component_count = %d", num_io_procs,
          component_count));
 
@@ -2013,6 +2128,138 @@ int PIOc_init_async(MPI_Comm world, int num_io_procs, int *io_proc_list,
     return PIO_NOERR;
 }
 
+/**
+ * Find the number of IO tasks serving each computation component
+ * when the IO tasks are split (see PIOc_set_async_split()). Each
+ * component gets at least one IO task, the other IO tasks are
+ * distributed in proportion to the number of compute tasks of the
+ * components.
+ *
+ * @param component_count number of computation components.
+ * @param comp_sizes the number of compute tasks of each component.
+ * @param num_iotasks number of IO tasks, at least component_count.
+ * @param group_sizes array (of length component_count) that gets the
+ * number of IO tasks serving each component.
+ */
+static void async_group_sizes(int component_count, const int *comp_sizes, int num_iotasks,
+                              int *group_sizes)
+{
+    long long total = 0;
+    int left = num_iotasks - component_count;
+
+    for (int i = 0; i < component_count; i++)
+    {
+        group_sizes[i] = 1;
+        total += comp_sizes[i];
+    }
+    if (total <= 0)
+        total = 1;
+
+    /* Share the other IO tasks in proportion to the component sizes. */
+    for (int i = 0; i < component_count; i++)
+    {
+        int extra = (int)((long long)(num_iotasks - component_count) * comp_sizes[i] / total);
+
+        group_sizes[i] += extra;
+        left -= extra;
+    }
+
+    /* The IO tasks left by the rounding go to the components with the
+     * most compute tasks per IO task. */
+    for (; left > 0; left--)
+    {
+        int imax = 0;
+
+        for (int i = 1; i < component_count; i++)
+            if ((long long)comp_sizes[i] * group_sizes[imax] >
+                (long long)comp_sizes[imax] * group_sizes[i])
+                imax = i;
+        group_sizes[imax]++;
+    }
+}
+
+/**
+ * Split the IO tasks of the async I/O service in one group per
+ * computation component, if requested (see PIOc_set_async_split())
+ * and if there are enough IO tasks. This function is collective on
+ * peer_comm.
+ *
+ * @param component_count number of computation components.
+ * @param peer_comm the parent communicator of all the tasks.
+ * @param comp_comms the communicators of the components,
+ * MPI_COMM_NULL on the tasks not in the component.
+ * @param io_comm the communicator of the IO tasks, MPI_COMM_NULL on
+ * the compute tasks.
+ * @param group_comm pointer that gets the communicator of the group of
+ * this IO task, MPI_COMM_NULL if the IO tasks are not split.
+ * @param group pointer that gets the index of the component served by
+ * this IO task, -1 if the IO tasks are not split (and serve all the
+ * components).
+ * @returns 0 for success, error code otherwise.
+ */
+static int async_split_io_tasks(int component_count, MPI_Comm peer_comm,
+                                const MPI_Comm *comp_comms, MPI_Comm io_comm,
+                                MPI_Comm *group_comm, int *group)
+{
+    int comp_sizes[component_count];
+    int mpierr;
+
+    *group_comm = MPI_COMM_NULL;
+    *group = -1;
+    if (!async_split || component_count < 2)
+        return PIO_NOERR;
+
+    /* The root of each component contributes the size of the
+     * component. */
+    for (int i = 0; i < component_count; i++)
+    {
+        comp_sizes[i] = 0;
+        if (comp_comms[i] != MPI_COMM_NULL)
+        {
+            int comp_rank;
+
+            if ((mpierr = MPI_Comm_rank(comp_comms[i], &comp_rank)))
+                return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+            if (!comp_rank)
+                if ((mpierr = MPI_Comm_size(comp_comms[i], &comp_sizes[i])))
+                    return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        }
+    }
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, comp_sizes, component_count, MPI_INT, MPI_SUM,
+                                peer_comm)))
+        return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+
+    if (io_comm != MPI_COMM_NULL)
+    {
+        int group_sizes[component_count];
+        int num_iotasks, io_rank;
+        int first = 0;
+
+        if ((mpierr = MPI_Comm_size(io_comm, &num_iotasks)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        if ((mpierr = MPI_Comm_rank(io_comm, &io_rank)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+        if (num_iotasks < component_count)
+        {
+            LOG((1, "Not splitting the %d IO tasks over %d components, all the IO tasks serve all the components",
+                 num_iotasks, component_count));
+            return PIO_NOERR;
+        }
+
+        async_group_sizes(component_count, comp_sizes, num_iotasks, group_sizes);
+        for (int i = 0; i < component_count; first += group_sizes[i++])
+            if (io_rank >= first && io_rank < first + group_sizes[i])
+                *group = i;
+        LOG((2, "IO task %d serves component %d (%d IO tasks, %d compute tasks)", io_rank,
+             *group, group_sizes[*group], comp_sizes[*group]));
+
+        if ((mpierr = MPI_Comm_split(io_comm, *group, io_rank, group_comm)))
+            return check_mpi(NULL, NULL, mpierr, __FILE__, __LINE__);
+    }
+
+    return PIO_NOERR;
+}
+
 /**
  * This variation of PIO_init supports I/O as an asynchronous service.
  *
@@ -2038,6 +2285,14 @@ int PIOc_init_async(MPI_Comm world, int num_io_procs, int *io_proc_list,
  * peer_comm => Parent communicator to all compute and I/O comms. The
  * compute and I/O communicators are derived from this comm.
  *
+ * By default all the I/O processes serve all the components, and
+ * handle the messages of the components one at a time (in a
+ * round-robin order over the components with messages waiting). If
+ * PIOc_set_async_split() was called, the I/O processes are split in
+ * one group per component, sized in proportion to the number of
+ * compute processes of the components, and the groups handle the
+ * messages of their components concurrently.
+ *
  * @param component_count Number of components (determines the number
  * of comp_comms and iosysidps)
  * @param peer_comm The parent communicator used to create comp_comms
@@ -2080,6 +2335,7 @@ int PIOc_init_intercomm(int component_count, const MPI_Comm peer_comm,
 
     /* Turn on the logging system for PIO. */
     pio_init_logging();
+    pio_init_trace();
     LOG((1, "PIOc_init_intercomm component_count = %d", component_count));
 
 #ifdef PIO_MICRO_TIMING
@@ -2116,6 +2372,18 @@ int PIOc_init_intercomm(int component_count, const MPI_Comm peer_comm,
                         "PIO Init (async) failed. Out of memory allocating %lld bytes for storing MPI communicators for the different asynchronous components", (unsigned long long) (component_count * sizeof(MPI_Comm)));
     }
 
+    /* Split the IO tasks in groups serving different components, if
+     * requested. */
+    MPI_Comm group_comm = MPI_COMM_NULL;
+    int io_group = -1;
+    ret = async_split_io_tasks(component_count, peer_comm, comp_comms, uio_comm,
+                               &group_comm, &io_group);
+    if(ret != PIO_NOERR)
+    {
+        return pio_err(NULL, NULL, ret, __FILE__, __LINE__,
+                        "PIO Init (async) failed. Splitting the I/O processes in groups serving the different components failed");
+    }
+
     /* Allocate iosystems for all comp comms
      * Each iosystem here includes comp_comms[i] and io_comm
      */
@@ -2181,11 +2449,14 @@ int PIOc_init_intercomm(int component_count, const MPI_Comm peer_comm,
 
         iosys[i]->async = true;
 
-        /* Dup the io comm since its cached in the iosystem */
-        MPI_Comm io_comm = uio_comm;
-        if(uio_comm != MPI_COMM_NULL)
+        /* Dup the io comm since its cached in the iosystem. If the IO
+         * tasks are split, only the group serving this component is
+         * part of the iosystem, the other IO tasks are neither IO nor
+         * compute tasks of the iosystem. */
+        MPI_Comm io_comm = MPI_COMM_NULL;
+        if(uio_comm != MPI_COMM_NULL && (io_group < 0 || io_group == i))
         {
-            ret = MPI_Comm_dup(uio_comm, &io_comm);
+            ret = MPI_Comm_dup((io_group < 0) ? uio_comm : group_comm, &io_comm);
             if(ret != MPI_SUCCESS)
             {
                 LOG((1, "PIO Init (async) failed. Duping user I/O comm failed"));
@@ -2550,12 +2821,36 @@ int PIOc_init_intercomm(int component_count, const MPI_Comm peer_comm,
         MPI_Comm msg_comm = MPI_COMM_NULL;
 
         LOG((2, "Creating global comm for async i/o service messages"));
-        ret = create_async_service_msg_comm(uio_comm, &msg_comm);
+        ret = create_async_service_msg_comm((io_group < 0) ? uio_comm : group_comm, &msg_comm);
         if(ret != PIO_NOERR)
         {
             return pio_err(NULL, NULL, ret, __FILE__, __LINE__,
                             "PIO Init (async) failed. Creating an MPI comm for asynchronous messages failed");
         }
+        if(group_comm != MPI_COMM_NULL)
+            MPI_Comm_free(&group_comm);
+
+        /* The components served by this I/O process. If the I/O
+         * processes are split, the iosystems of the other components
+         * were only created to agree on the iosystem ids. This I/O
+         * process never receives their PIO_MSG_FINALIZE, so free them
+         * here (they hold no communicators). */
+        iosystem_desc_t *srv_iosys[component_count];
+        int srv_count = 0;
+        for(int i=0; i<component_count; i++)
+        {
+            if(iosys[i]->ioproc)
+            {
+                srv_iosys[srv_count++] = iosys[i];
+            }
+            else
+            {
+                LOG((2, "Freeing iosystem %d of component %d, not served by this I/O process",
+                     iosysidps[i], i));
+                pio_delete_iosystem_from_list(iosysidps[i]);
+                iosys[i] = NULL;
+            }
+        }
 
         ret = MPI_Comm_rank(msg_comm, &rank);
         if(ret != MPI_SUCCESS)
@@ -2564,8 +2859,8 @@ int PIOc_init_intercomm(int component_count, const MPI_Comm peer_comm,
         }
 
         LOG((2, "Starting message handler io_rank = %d component_count = %d",
-             rank, component_count));
-        ret = pio_msg_handler2(rank, component_count, iosys, msg_comm);
+             rank, srv_count));
+        ret = pio_msg_handler2(rank, srv_count, srv_iosys, msg_comm);
         if(ret != PIO_NOERR)
         {
             return pio_err(NULL, NULL, ret, __FILE__, __LINE__,
@@ -2647,3 +2942,31 @@ int PIOc_set_blocksize(int newblocksize)
     blocksize = newblocksize;
     return PIO_NOERR;
 }
+
+/**
+ * Split the IO tasks of the asynchronous I/O service in one group per
+ * computation component. By default all the IO tasks initialized by
+ * PIOc_init_intercomm() serve all the components, and handle the
+ * messages of one component at a time, so a component writing a
+ * large amount of data delays the messages of the other
+ * components. With the split, each component is served by its own
+ * group of IO tasks, and the groups handle messages concurrently.
+ * Each component gets at least one IO task, the other IO tasks are
+ * distributed in proportion to the number of compute tasks of the
+ * components. The IO tasks are not split if there are fewer IO tasks
+ * than components.
+ *
+ * This function must be called with the same value on all the tasks
+ * before PIOc_init_intercomm(), it does not affect the IO systems
+ * already initialized.
+ *
+ * @param split non-zero to split the IO tasks, 0 (the default) for
+ * all the IO tasks to serve all the components.
+ * @returns 0 for success.
+ * @ingroup PIO_init
+ */
+int PIOc_set_async_split(int split)
+{
+    async_split = split;
+    return PIO_NOERR;
+}
@@ -836,6 +836,126 @@ int find_mpi_type(int pio_type, MPI_Datatype *mpi_type, int *type_size)
     return PIO_NOERR;
 }
 
+/**
+ * Update a FNV-1a hash with a buffer. Start with PIO_FNV_BASIS.
+ *
+ * @param hash the hash.
+ * @param buf pointer to the buffer.
+ * @param len the length of the buffer (bytes).
+ * @returns the updated hash.
+ */
+unsigned long long pio_fnv_hash(unsigned long long hash, const void *buf, size_t len)
+{
+    const unsigned char *bytes = buf;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ bytes[i]) * PIO_FNV_PRIME;
+
+    return hash;
+}
+
+/**
+ * Compute the fingerprint of a decomposition, a FNV-1a hash of its
+ * dimensions and of the map of this task.
+ *
+ * @param ndims the number of dimensions.
+ * @param gdimlen array (length ndims) of the global dimension lengths.
+ * @param maplen the length of the map.
+ * @param compmap the map of this task.
+ * @returns the fingerprint, never 0.
+ */
+unsigned long long pio_decomp_hash(int ndims, const int *gdimlen, int maplen,
+                                   const PIO_Offset *compmap)
+{
+    unsigned long long hash;
+
+    hash = pio_fnv_hash(PIO_FNV_BASIS, gdimlen, ndims * sizeof(int));
+    hash = pio_fnv_hash(hash, compmap, maplen * sizeof(PIO_Offset));
+
+    return hash ? hash : 1;
+}
+
+/**
+ * Share the rearranger setup of an identical decomposition created
+ * earlier, instead of computing it. The decompositions are identical
+ * if, on all tasks, they have the same rearranger, dimensions and map
+ * (the type of the data can be different). The regions, the counts
+ * and indices used to rearrange data, and the subset communicator
+ * are shared (and reference counted), the MPI datatypes, that depend
+ * on the type of the data, are created for each decomposition.
+ *
+ * This function is collective on the IO system, the cost is a local
+ * comparison of the map and an allreduce of two integers.
+ *
+ * @param ios pointer to the IO system info.
+ * @param iodesc pointer to the new decomposition, with its hash,
+ * rearranger, map and dimensions set.
+ * @param shared pointer that gets true if the setup is shared.
+ * @returns 0 for success, error code otherwise.
+ */
+int pio_share_iodesc(iosystem_desc_t *ios, io_desc_t *iodesc, bool *shared)
+{
+    io_desc_t *src;
+    int ioids[2]; /* Min and -max of the ID of the identical decomposition. */
+    int mpierr = MPI_SUCCESS;
+
+    pioassert(ios && iodesc && shared, "invalid input", __FILE__, __LINE__);
+    *shared = false;
+
+    /* All tasks must find the same decomposition. */
+    src = pio_find_shared_iodesc(iodesc);
+    ioids[0] = src ? src->ioid : -1;
+    ioids[1] = -ioids[0];
+    if ((mpierr = MPI_Allreduce(MPI_IN_PLACE, ioids, 2, MPI_INT, MPI_MIN, ios->my_comm)))
+        return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    if (ioids[0] < 0 || ioids[0] != -ioids[1])
+        return PIO_NOERR;
+
+    LOG((2, "pio_share_iodesc sharing the setup of ioid = %d", src->ioid));
+
+    /* Count the decompositions sharing the setup. */
+    if (!src->nshared)
+    {
+        if (!(src->nshared = malloc(sizeof(int))))
+        {
+            return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Sharing the setup of the I/O decomposition (ioid=%d) failed. Out of memory allocating %lld bytes for the reference count", src->ioid, (unsigned long long) sizeof(int));
+        }
+        *src->nshared = 1;
+    }
+    (*src->nshared)++;
+    iodesc->nshared = src->nshared;
+
+    /* Replace the first region allocated with the iodesc. */
+    free_region_list(iodesc->firstregion);
+
+    iodesc->nrecvs = src->nrecvs;
+    iodesc->ndof = src->ndof;
+    iodesc->num_aiotasks = src->num_aiotasks;
+    iodesc->maxregions = src->maxregions;
+    iodesc->needsfill = src->needsfill;
+    iodesc->maxbytes = src->maxbytes;
+    iodesc->llen = src->llen;
+    iodesc->maxiobuflen = src->maxiobuflen;
+    iodesc->rfrom = src->rfrom;
+    iodesc->rcount = src->rcount;
+    iodesc->scount = src->scount;
+    iodesc->sindex = src->sindex;
+    iodesc->rindex = src->rindex;
+    iodesc->holegridsize = src->holegridsize;
+    iodesc->maxholegridsize = src->maxholegridsize;
+    iodesc->maxfillregions = src->maxfillregions;
+    iodesc->firstregion = src->firstregion;
+    iodesc->fillregion = src->fillregion;
+    iodesc->mergedholes = src->mergedholes;
+    iodesc->holeindex = src->holeindex;
+    iodesc->subset_comm = src->subset_comm;
+    iodesc->ioregion_count = src->ioregion_count;
+    *shared = true;
+
+    return PIO_NOERR;
+}
+
 /**
  * Allocate space for an IO description struct, and initialize it.
  *
@@ -896,6 +1016,7 @@ int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims,
     (*iodesc)->maxregions = 1;
     (*iodesc)->ioid = -1;
     (*iodesc)->ndims = ndims;
+    (*iodesc)->iosysid = ios->iosysid;
 
     /* Allocate space for, and initialize, the first region. */
     if ((ret = alloc_region2(ios, ndims, &((*iodesc)->firstregion))))
@@ -907,6 +1028,9 @@ int malloc_iodesc(iosystem_desc_t *ios, int piotype, int ndims,
     /* Set the swap memory settings to defaults for this IO system. */
     (*iodesc)->rearr_opts = ios->rearr_opts;
 
+    /* No decomposition for converted user data yet. */
+    (*iodesc)->conv_ioid = -1;
+
 #if PIO_SAVE_DECOMPS
     /* The descriptor is not yet saved to disk */
     (*iodesc)->is_saved = false;
@@ -937,6 +1061,72 @@ void free_region_list(io_region *top)
     }
 }
 
+/**
+ * Get the memory (in bytes) used on this task by an IO description:
+ * the struct, the map, the regions, and the arrays and MPI datatypes
+ * used to rearrange data. The memory used by MPI for the datatypes
+ * and the subset communicator is not included.
+ *
+ * @param iodesc pointer to the IO description.
+ * @returns the memory used by the IO description.
+ */
+PIO_Offset pio_iodesc_mem_size(io_desc_t *iodesc)
+{
+    iosystem_desc_t *ios;
+    PIO_Offset size = sizeof(io_desc_t);
+    PIO_Offset nrindex = 0;
+    io_region *region;
+
+    pioassert(iodesc, "invalid input", __FILE__, __LINE__);
+
+    size += iodesc->maplen * sizeof(PIO_Offset) + iodesc->ndims * sizeof(int);
+    if (iodesc->ioregion_count)
+        size += iodesc->ndims * sizeof(PIO_Offset);
+
+    /* The send and receive counts/indices. */
+    if (iodesc->rearranger == PIO_REARR_SUBSET)
+    {
+        if (iodesc->scount)
+            size += sizeof(int) + iodesc->scount[0] * sizeof(PIO_Offset);
+        if (iodesc->rcount)
+            size += iodesc->nrecvs * sizeof(int);
+        if (iodesc->rfrom)
+            size += (iodesc->llen - iodesc->mergedholes) * sizeof(int);
+        if (iodesc->rindex)
+            nrindex = iodesc->llen - iodesc->mergedholes;
+        if (iodesc->holeindex)
+            size += iodesc->mergedholes * sizeof(PIO_Offset);
+    }
+    else
+    {
+        if (iodesc->scount && (ios = pio_get_iosystem_from_id(iodesc->iosysid)))
+            size += ios->num_iotasks * sizeof(int);
+        if (iodesc->sindex)
+            size += iodesc->ndof * sizeof(PIO_Offset);
+        if (iodesc->rcount)
+        {
+            size += 2 * max(1, iodesc->nrecvs) * sizeof(int);
+            for (int i = 0; i < iodesc->nrecvs; i++)
+                nrindex += iodesc->rcount[i];
+        }
+    }
+    size += nrindex * sizeof(PIO_Offset);
+
+    /* The MPI datatypes. */
+    if (iodesc->rtype)
+        size += iodesc->nrecvs * sizeof(MPI_Datatype);
+    if (iodesc->stype)
+        size += iodesc->num_stypes * sizeof(MPI_Datatype);
+
+    /* The regions. */
+    for (region = iodesc->firstregion; region; region = region->next)
+        size += sizeof(io_region) + 2 * iodesc->ndims * sizeof(PIO_Offset);
+    for (region = iodesc->fillregion; region; region = region->next)
+        size += sizeof(io_region) + 2 * iodesc->ndims * sizeof(PIO_Offset);
+
+    return size;
+}
+
 /**
  * Free a decomposition map.
  *
@@ -979,15 +1169,28 @@ int PIOc_freedecomp(int iosysid, int ioid)
         }
     }
 
+    /* The write handles bound to the decomposition can no longer be
+     * used. */
+    pio_release_darray_handles(NULL, iodesc);
+
+    /* Free the decomposition used to write converted user data. */
+    if (iodesc->conv_ioid >= 0)
+    {
+        if ((ret = PIOc_freedecomp(iosysid, iodesc->conv_ioid)))
+        {
+            return pio_err(ios, NULL, ret, __FILE__, __LINE__,
+                            "Freeing PIO decomposition failed (iosysid = %d, ioid=%d). Error freeing the decomposition (ioid=%d) used to write converted data", iosysid, ioid, iodesc->conv_ioid);
+        }
+        iodesc->conv_ioid = -1;
+    }
+
     /* Free the map. */
     free(iodesc->map);
 
     /* Free the dimlens. */
     free(iodesc->dimlen);
 
-    if (iodesc->rfrom)
-        free(iodesc->rfrom);
-
+    /* Free the MPI datatypes, that depend on the type of the data. */
     if (iodesc->rtype)
     {
         for (int i = 0; i < iodesc->nrecvs; i++)
@@ -1009,27 +1212,44 @@ int PIOc_freedecomp(int iosysid, int ioid)
         free(iodesc->stype);
     }
 
-    if (iodesc->scount)
-        free(iodesc->scount);
+    /* The rearranger setup may be shared with identical
+     * decompositions, it is freed with the last of them. */
+    if (!iodesc->nshared || --(*iodesc->nshared) == 0)
+    {
+        free(iodesc->nshared);
 
-    if (iodesc->rcount)
-        free(iodesc->rcount);
+        /* Free the sizes of the IO regions. */
+        if (iodesc->ioregion_count)
+            free(iodesc->ioregion_count);
 
-    if (iodesc->sindex)
-        free(iodesc->sindex);
+        if (iodesc->rfrom)
+            free(iodesc->rfrom);
 
-    if (iodesc->rindex)
-        free(iodesc->rindex);
+        if (iodesc->scount)
+            free(iodesc->scount);
 
-    if (iodesc->firstregion)
-        free_region_list(iodesc->firstregion);
+        if (iodesc->rcount)
+            free(iodesc->rcount);
 
-    if (iodesc->fillregion)
-        free_region_list(iodesc->fillregion);
+        if (iodesc->sindex)
+            free(iodesc->sindex);
 
-    if (iodesc->rearranger == PIO_REARR_SUBSET)
-        if ((mpierr = MPI_Comm_free(&iodesc->subset_comm)))
-            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+        if (iodesc->rindex)
+            free(iodesc->rindex);
+
+        if (iodesc->holeindex)
+            free(iodesc->holeindex);
+
+        if (iodesc->firstregion)
+            free_region_list(iodesc->firstregion);
+
+        if (iodesc->fillregion)
+            free_region_list(iodesc->fillregion);
+
+        if (iodesc->rearranger == PIO_REARR_SUBSET)
+            if ((mpierr = MPI_Comm_free(&iodesc->subset_comm)))
+                return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
+    }
 
     ret = pio_delete_iodesc_from_list(ioid);
     if (ret != PIO_NOERR)
@@ -2164,6 +2384,43 @@ int PIO_get_avail_iotypes(char *buf, size_t sz)
     return ret;
 }
 
+/**
+ * Close a file if it was opened (or created) with the low level I/O
+ * library on this IO task (the file handle is set, even if later
+ * steps of the open failed), when opening or creating the file or
+ * other files of the same batch failed. The open status is local to the task, the error
+ * codes shared by the IO root do not tell which tasks opened the
+ * file.
+ *
+ * @param ios pointer to the IO system info.
+ * @param file pointer to the file info.
+ */
+static void openfile_io_close(iosystem_desc_t *ios, file_desc_t *file)
+{
+    if (!ios->ioproc || file->fh == -1)
+        return;
+
+    switch (file->iotype)
+    {
+#ifdef _NETCDF
+#ifdef _NETCDF4
+    case PIO_IOTYPE_NETCDF4P:
+    case PIO_IOTYPE_NETCDF4C:
+#endif /* _NETCDF4 */
+    case PIO_IOTYPE_NETCDF:
+        nc_close(file->fh);
+        break;
+#endif /* _NETCDF */
+#ifdef _PNETCDF
+    case PIO_IOTYPE_PNETCDF:
+        ncmpi_close(file->fh);
+        break;
+#endif /* _PNETCDF */
+    default:
+        break;
+    }
+}
+
 /**
  * Create a new file using pio. This is an internal function that is
  * called by both PIOc_create() and PIOc_createfile(). Input
@@ -2598,16 +2855,25 @@ int PIOc_createfile_int(int iosysid, int *ncidp, int *iotype, const char *filena
     file->mode = file->mode | PIO_WRITE;
 
     /* Add the struct with this files info to the global list of
-     * open files. */
-    MPI_Comm comm = MPI_COMM_NULL;
-    if(ios->async)
+     * open files. The file id is the same on all the tasks of the
+     * iosystem, as needed by the asynchronous I/O service. */
+    if ((ierr = pio_add_to_file_list(file, ncidp)))
     {
-        /* For asynchronous I/O service, since file ids are passed across
-         * disjoint comms we need it to be unique across the union comm
-         */
-        comm = ios->union_comm;
+        openfile_io_close(ios, file);
+#ifdef _ADIOS2
+#ifdef TIMING /* TAHSIN: timing */
+        if (file->iotype == PIO_IOTYPE_ADIOS)
+            GPTLstop("PIO:PIOc_createfile_int_adios"); /* TAHSIN: stop */
+#endif
+        free(file->filename);
+#endif
+        free(file);
+#ifdef TIMING
+        GPTLstop("PIO:PIOc_createfile_int");
+#endif
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Creating file (%s) failed. Adding the file to the list of open files failed", filename);
     }
-    *ncidp = pio_add_to_file_list(file, comm);
 
     LOG((2, "Created file %s file->fh = %d file->pio_ncid = %d", filename,
          file->fh, file->pio_ncid));
@@ -2695,66 +2961,88 @@ int check_unlim_use(int ncid)
     return PIO_NOERR;
 }
 
+/* Layout of the info on a file just opened that the IO root
+ * broadcasts to all tasks: the error code, the open mode, the number
+ * of unlimited dimensions and the ids of the first ones. */
+#define PIO_OPEN_INFO_IERR 0
+#define PIO_OPEN_INFO_MODE 1
+#define PIO_OPEN_INFO_NUNLIM 2
+#define PIO_OPEN_INFO_UNLIM 3
+#define PIO_OPEN_INFO_MAX_UNLIM 8
+#define PIO_OPEN_INFO_LEN (PIO_OPEN_INFO_UNLIM + PIO_OPEN_INFO_MAX_UNLIM)
+
 /**
- * Open an existing file using PIO library. This is an internal
- * function. Depending on the value of the retry parameter, a failed
- * open operation will be handled differently. If retry is non-zero,
- * then a failed attempt to open a file with netCDF-4 (serial or
- * parallel), or parallel-netcdf will be followed by an attempt to
- * open the file as a serial classic netCDF file. This is an important
- * feature to some NCAR users. The functionality is exposed to the
- * user as PIOc_openfile() (which does the retry), and PIOc_open()
- * (which does not do the retry).
- *
- * Input parameters are read on comp task 0 and ignored elsewhere.
- *
- * @param iosysid: A defined pio system descriptor (input)
- * @param ncidp: A pio file descriptor (output)
- * @param iotype: A pio output format (input)
- * @param filename: The filename to open
- * @param mode: The netcdf mode for the open operation
- * @param retry: non-zero to automatically retry with netCDF serial
- * classic.
+ * Get the unlimited dimensions of a file that was just opened, and
+ * cache them in the file info. Only called on the IO root, which has
+ * the file open with all the iotypes.
  *
- * @return 0 for success, error code otherwise.
- * @ingroup PIO_openfile
- * @author Jim Edwards, Ed Hartnett
+ * @param file pointer to the file info.
+ * @returns 0 for success, error code otherwise.
  */
-int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filename,
-                        int mode, int retry)
+static int inq_open_unlimdims(file_desc_t *file)
 {
-    iosystem_desc_t *ios;      /* Pointer to io system information. */
-    file_desc_t *file;         /* Pointer to file information. */
-    int imode;                 /* Internal mode val for netcdf4 file open. */
-    int mpierr = MPI_SUCCESS;  /** Return code from MPI function codes. */
-    int ierr = PIO_NOERR;      /* Return code from function calls. */
-    int ierr2 = PIO_NOERR;      /* Return code from function calls. */
+    int nunlimdims = 0;
+    int unlimdimid = -1;
+    int ierr = PIO_NOERR;
 
-    /* Get the IO system info from the iosysid. */
-    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    switch (file->iotype)
     {
-        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
-                        "Opening file (%s) failed. Invalid iosystem id (%d) provided", (filename) ? filename : "UNKNOWN", iosysid);
+#ifdef _NETCDF4
+    case PIO_IOTYPE_NETCDF4P:
+    case PIO_IOTYPE_NETCDF4C:
+        ierr = nc_inq_unlimdims(file->fh, &nunlimdims, NULL);
+        break;
+#endif /* _NETCDF4 */
+#ifdef _NETCDF
+    case PIO_IOTYPE_NETCDF:
+        ierr = nc_inq_unlimdim(file->fh, &unlimdimid);
+        break;
+#endif /* _NETCDF */
+#ifdef _PNETCDF
+    case PIO_IOTYPE_PNETCDF:
+        ierr = ncmpi_inq_unlimdim(file->fh, &unlimdimid);
+        break;
+#endif /* _PNETCDF */
+    default:
+        break;
     }
+    if (ierr != PIO_NOERR)
+        return ierr;
 
-    /* User must provide valid input for these parameters. */
-    if (!ncidp || !iotype || !filename)
-    {
-        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
-                        "Opening file (%s) failed. Invalid arguments provided. ncidp is %s (expected not NULL), iotype is %s (expected not NULL), filename is %s (expected not NULL)", (filename) ? filename : "UNKNOWN", PIO_IS_NULL(ncidp), PIO_IS_NULL(iotype), PIO_IS_NULL(filename));
-    }
+    if (unlimdimid >= 0)
+        nunlimdims = 1;
 
-    /* A valid iotype must be specified. */
-    if (!iotype_is_valid(*iotype))
+    if (nunlimdims > 0)
     {
-        char avail_iotypes[PIO_MAX_NAME + 1];
-        PIO_get_avail_iotypes(avail_iotypes, PIO_MAX_NAME);
-        return pio_err(ios, NULL, PIO_EBADIOTYPE, __FILE__, __LINE__,
-                        "Opening file (%s) failed. Invalid iotype (%s:%d) specified. Available iotypes are : %s", filename, pio_iotype_to_string(*iotype), *iotype, avail_iotypes);
+        if (!(file->unlim_dimids = (int *)malloc(nunlimdims * sizeof(int))))
+            return PIO_ENOMEM;
+
+        if (unlimdimid >= 0)
+            file->unlim_dimids[0] = unlimdimid;
+#ifdef _NETCDF4
+        else if ((ierr = nc_inq_unlimdims(file->fh, &nunlimdims, file->unlim_dimids)))
+            return ierr;
+#endif /* _NETCDF4 */
     }
+    file->num_unlim_dimids = nunlimdims;
 
-    LOG((2, "PIOc_openfile_retry iosysid = %d iotype = %d filename = %s mode = %d retry = %d",
-         iosysid, *iotype, filename, mode, retry));
+    return PIO_NOERR;
+}
+
+/**
+ * Allocate and initialize the info of a file to open.
+ *
+ * @param ios pointer to the IO system info.
+ * @param iotype pointer to the iotype of the file.
+ * @param filename the name of the file.
+ * @param mode the netcdf mode for the open operation.
+ * @param filep pointer that gets the file info.
+ * @return 0 for success, error code otherwise.
+ */
+static int openfile_alloc(iosystem_desc_t *ios, int *iotype, const char *filename,
+                          int mode, file_desc_t **filep)
+{
+    file_desc_t *file;
 
     /* Allocate space for the file info. */
     if (!(file = calloc(sizeof(*file), 1)))
@@ -2805,17 +3093,30 @@ int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filena
     for (int i = 0; i < PIO_IODESC_MAX_IDS; i++)
         file->iobuf[i] = NULL;
 
-    /* If async is in use, bcast the parameters from compute to I/O procs. */
-    if(ios->async)
-    {
-        int len = strlen(filename) + 1;
-        PIO_SEND_ASYNC_MSG(ios, PIO_MSG_OPEN_FILE, &ierr, len, filename, file->iotype, file->mode);
-        if(ierr != PIO_NOERR)
-        {
-            return pio_err(ios, file, ierr, __FILE__, __LINE__,
-                            "Opening file (%s) failed. Sending asynchronous message, PIO_MSG_OPEN_FILE, failed on iosystem (iosysid=%d)", filename, ios->iosysid);
-        }
-    }
+    *filep = file;
+    return PIO_NOERR;
+}
+
+/**
+ * Open a file with the low level I/O library on the IO tasks, and get
+ * its unlimited dimensions on the IO root. Does nothing on the
+ * computation tasks.
+ *
+ * @param ios pointer to the IO system info.
+ * @param file pointer to the file info.
+ * @param iotype pointer to the iotype requested by the user.
+ * @param filename the name of the file.
+ * @param retry non-zero to retry with netCDF serial classic.
+ * @return 0 for success, error code from the low level I/O library
+ * otherwise. The error code is local to the task.
+ */
+static int openfile_io(iosystem_desc_t *ios, file_desc_t *file, int *iotype,
+                       const char *filename, int retry)
+{
+    int imode;                 /* Internal mode val for netcdf4 file open. */
+    int mpierr = MPI_SUCCESS;  /** Return code from MPI function codes. */
+    int ierr = PIO_NOERR;      /* Return code from function calls. */
+    int ierr2 = PIO_NOERR;      /* Return code from function calls. */
 
     /* If this is an IO task, then call the netCDF function. */
     if (ios->ioproc)
@@ -2878,7 +3179,6 @@ int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filena
 #endif
 
         default:
-            free(file);
             {
                 char avail_iotypes[PIO_MAX_NAME + 1];
                 PIO_get_avail_iotypes(avail_iotypes, PIO_MAX_NAME);
@@ -2943,60 +3243,257 @@ int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filena
         }
     }
 
-    ierr = check_netcdf(ios, NULL, ierr, __FILE__, __LINE__);
-    /* If there was an error, free allocated memory and deal with the error. */
-    if(ierr != PIO_NOERR){
-        free(file);
-        LOG((1, "PIOc_openfile_retry failed, ierr = %d", ierr));
-        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
-                        "Opening file (%s) with iotype %d (%s) failed. The low level I/O library call failed", filename, *iotype, pio_iotype_to_string(*iotype));;
-    }
+    /* Get the unlimited dimensions of the file on the IO root, they
+     * are shared with the other tasks along with the open mode. */
+    if (ierr == PIO_NOERR && ios->ioproc && ios->io_rank == 0)
+        ierr = inq_open_unlimdims(file);
 
-    /* Broadcast open mode to all tasks. */
-    if ((mpierr = MPI_Bcast(&file->mode, 1, MPI_INT, ios->ioroot, ios->my_comm)))
-        return check_mpi(NULL, file, mpierr, __FILE__, __LINE__);
+    return ierr;
+}
 
-    /* Add this file to the list of currently open files. */
-    MPI_Comm comm = MPI_COMM_NULL;
-    if(ios->async)
+/**
+ * Share the result of the opens of files on the IO tasks with all
+ * tasks and add the files to the list of open files. The error codes,
+ * open modes and unlimited dimensions of all the files are broadcast
+ * from the IO root at once. If any file failed to open, the other
+ * files are closed and none is added to the list.
+ *
+ * @param ios pointer to the IO system info.
+ * @param nfiles the number of files.
+ * @param files the info of the files, freed on errors.
+ * @param ierrs the error codes of the opens on this task.
+ * @param iotype pointer to the iotype requested by the user.
+ * @param ncids array that gets the ids of the files.
+ * @return 0 for success, error code otherwise.
+ */
+static int openfiles_finish(iosystem_desc_t *ios, int nfiles, file_desc_t **files,
+                            int *ierrs, int *iotype, int *ncids)
+{
+    int *open_info;            /* Info on the files shared by the IO root. */
+    int mpierr = MPI_SUCCESS;  /** Return code from MPI function codes. */
+    int ierr = PIO_NOERR;      /* Return code from function calls. */
+    int failed = -1;           /* Index of the first file that failed to open. */
+
+    if (!(open_info = malloc(nfiles * PIO_OPEN_INFO_LEN * sizeof(int))))
     {
-        /* For asynchronous I/O service, since file ids are passed across
-         * disjoint comms we need it to be unique across the union comm
-         */
-        comm = ios->union_comm;
+        return pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Opening files failed. Out of memory allocating %lld bytes for the info of %d files", (unsigned long long) (nfiles * PIO_OPEN_INFO_LEN * sizeof(int)), nfiles);
     }
-    *ncidp = pio_add_to_file_list(file, comm);
 
-    LOG((2, "Opened file %s file->pio_ncid = %d file->fh = %d ierr = %d",
-         filename, file->pio_ncid, file->fh, ierr));
+    /* With PIO_BCAST_ERROR the error codes of the IO root are shared
+     * with the open info below. */
+    for (int f = 0; f < nfiles; f++)
+    {
+        int *info = open_info + f * PIO_OPEN_INFO_LEN;
+        file_desc_t *file = files[f];
+
+        if (ios->error_handler != PIO_BCAST_ERROR)
+            ierrs[f] = check_netcdf(ios, NULL, ierrs[f], __FILE__, __LINE__);
+        if (ierrs[f] != PIO_NOERR && failed < 0)
+            failed = f;
 
-    /* Check if the file has unlimited dimensions */
-    if(!ios->async || !ios->ioproc)
+        info[PIO_OPEN_INFO_IERR] = ierrs[f];
+        info[PIO_OPEN_INFO_MODE] = file->mode;
+        info[PIO_OPEN_INFO_NUNLIM] = file->num_unlim_dimids;
+        for (int d = 0; d < min(file->num_unlim_dimids, PIO_OPEN_INFO_MAX_UNLIM); d++)
+            info[PIO_OPEN_INFO_UNLIM + d] = file->unlim_dimids[d];
+    }
+
+    /* Broadcast the error codes, the open modes and the unlimited
+     * dimensions to all tasks at once. */
+    if (failed < 0 || ios->error_handler == PIO_BCAST_ERROR)
     {
-        ierr = PIOc_inq_unlimdims(*ncidp, &(file->num_unlim_dimids), NULL);
-        if(ierr != PIO_NOERR)
+        if ((mpierr = MPI_Bcast(open_info, nfiles * PIO_OPEN_INFO_LEN, MPI_INT, ios->ioroot,
+                                ios->my_comm)))
         {
-            return pio_err(ios, file, ierr, __FILE__, __LINE__,
-                              "Opening file (%s) failed. Although the file was opened successfully, querying the number of unlimited dimensions in the file failed", filename);
+            free(open_info);
+            return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
         }
-        if(file->num_unlim_dimids > 0)
+
+        failed = -1;
+        for (int f = 0; f < nfiles; f++)
         {
-            file->unlim_dimids = (int *)malloc(file->num_unlim_dimids * sizeof(int));
-            if(!file->unlim_dimids)
+            ierrs[f] = open_info[f * PIO_OPEN_INFO_LEN + PIO_OPEN_INFO_IERR];
+            if (ierrs[f] != PIO_NOERR && failed < 0)
+                failed = f;
+        }
+    }
+
+    for (int f = 0; f < nfiles && failed < 0; f++)
+    {
+        int *info = open_info + f * PIO_OPEN_INFO_LEN;
+        file_desc_t *file = files[f];
+
+        file->mode = info[PIO_OPEN_INFO_MODE];
+        if (!file->unlim_dimids && info[PIO_OPEN_INFO_NUNLIM] > 0)
+        {
+            file->num_unlim_dimids = info[PIO_OPEN_INFO_NUNLIM];
+            if (!(file->unlim_dimids = (int *)malloc(file->num_unlim_dimids * sizeof(int))))
             {
-                return pio_err(ios, file, PIO_ENOMEM, __FILE__, __LINE__,
-                                "Opening file (%s) failed. Out of memory allocating %lld bytes for caching the unlimited dimension ids", filename, (unsigned long long) (file->num_unlim_dimids * sizeof(int)));
+                ierrs[f] = PIO_ENOMEM;
+                failed = f;
+                break;
             }
-            ierr = PIOc_inq_unlimdims(*ncidp, NULL, file->unlim_dimids);
-            if(ierr != PIO_NOERR)
+            for (int d = 0; d < min(file->num_unlim_dimids, PIO_OPEN_INFO_MAX_UNLIM); d++)
+                file->unlim_dimids[d] = info[PIO_OPEN_INFO_UNLIM + d];
+        }
+
+        /* Files with many unlimited dimensions need a second
+         * broadcast. */
+        if (file->num_unlim_dimids > PIO_OPEN_INFO_MAX_UNLIM)
+        {
+            if ((mpierr = MPI_Bcast(file->unlim_dimids, file->num_unlim_dimids, MPI_INT,
+                                    ios->ioroot, ios->my_comm)))
             {
-                return pio_err(ios, file, ierr, __FILE__, __LINE__,
-                                "Opening file (%s) failed. Although the file was opened successfully, querying the unlimited dimensions in the file failed", filename);
+                free(open_info);
+                return check_mpi(ios, NULL, mpierr, __FILE__, __LINE__);
             }
         }
-        LOG((3, "File has %d unlimited dimensions", file->num_unlim_dimids));
+        LOG((3, "File %s has %d unlimited dimensions", file->fname, file->num_unlim_dimids));
     }
+    free(open_info);
 
+    /* If there was an error, close the files that were opened, free
+     * allocated memory and deal with the error. */
+    if (failed >= 0)
+    {
+        char filename[PIO_MAX_NAME + 1];
+
+        strncpy(filename, files[failed]->fname, PIO_MAX_NAME);
+        filename[PIO_MAX_NAME] = '\0';
+        ierr = ierrs[failed];
+        for (int f = 0; f < nfiles; f++)
+        {
+            openfile_io_close(ios, files[f]);
+            free(files[f]->unlim_dimids);
+            free(files[f]);
+            files[f] = NULL;
+        }
+        LOG((1, "PIOc_openfile_retry failed, ierr = %d", ierr));
+        return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                        "Opening file (%s) with iotype %d (%s) failed. The low level I/O library call failed", filename, *iotype, pio_iotype_to_string(*iotype));
+    }
+
+    /* Add the files to the list of currently open files. The file ids
+     * are the same on all the tasks of the iosystem, as needed by the
+     * asynchronous I/O service. */
+    for (int f = 0; f < nfiles; f++)
+    {
+        if ((ierr = pio_add_to_file_list(files[f], &ncids[f])))
+        {
+            char filename[PIO_MAX_NAME + 1];
+
+            /* None of the files is left open. */
+            strncpy(filename, files[f]->fname, PIO_MAX_NAME);
+            filename[PIO_MAX_NAME] = '\0';
+            for (int g = 0; g < nfiles; g++)
+            {
+                openfile_io_close(ios, files[g]);
+                if (g < f)
+                    pio_delete_file_from_list(ncids[g]);
+                else
+                {
+                    free(files[g]->unlim_dimids);
+                    free(files[g]);
+                }
+                files[g] = NULL;
+            }
+            return pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Opening file (%s) failed. Adding the file to the list of open files failed", filename);
+        }
+
+        LOG((2, "Opened file %s file->pio_ncid = %d file->fh = %d",
+             files[f]->fname, files[f]->pio_ncid, files[f]->fh));
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Open an existing file using PIO library. This is an internal
+ * function. Depending on the value of the retry parameter, a failed
+ * open operation will be handled differently. If retry is non-zero,
+ * then a failed attempt to open a file with netCDF-4 (serial or
+ * parallel), or parallel-netcdf will be followed by an attempt to
+ * open the file as a serial classic netCDF file. This is an important
+ * feature to some NCAR users. The functionality is exposed to the
+ * user as PIOc_openfile() (which does the retry), and PIOc_open()
+ * (which does not do the retry).
+ *
+ * Input parameters are read on comp task 0 and ignored elsewhere.
+ *
+ * @param iosysid: A defined pio system descriptor (input)
+ * @param ncidp: A pio file descriptor (output)
+ * @param iotype: A pio output format (input)
+ * @param filename: The filename to open
+ * @param mode: The netcdf mode for the open operation
+ * @param retry: non-zero to automatically retry with netCDF serial
+ * classic.
+ *
+ * @return 0 for success, error code otherwise.
+ * @ingroup PIO_openfile
+ * @author Jim Edwards, Ed Hartnett
+ */
+int PIOc_openfile_retry(int iosysid, int *ncidp, int *iotype, const char *filename,
+                        int mode, int retry)
+{
+    iosystem_desc_t *ios;      /* Pointer to io system information. */
+    file_desc_t *file;         /* Pointer to file information. */
+    int open_ierr;             /* Return code from the open on this task. */
+    int ierr = PIO_NOERR;      /* Return code from function calls. */
+
+    /* Get the IO system info from the iosysid. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Opening file (%s) failed. Invalid iosystem id (%d) provided", (filename) ? filename : "UNKNOWN", iosysid);
+    }
+
+    /* User must provide valid input for these parameters. */
+    if (!ncidp || !iotype || !filename)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Opening file (%s) failed. Invalid arguments provided. ncidp is %s (expected not NULL), iotype is %s (expected not NULL), filename is %s (expected not NULL)", (filename) ? filename : "UNKNOWN", PIO_IS_NULL(ncidp), PIO_IS_NULL(iotype), PIO_IS_NULL(filename));
+    }
+
+    /* A valid iotype must be specified. */
+    if (!iotype_is_valid(*iotype))
+    {
+        char avail_iotypes[PIO_MAX_NAME + 1];
+        PIO_get_avail_iotypes(avail_iotypes, PIO_MAX_NAME);
+        return pio_err(ios, NULL, PIO_EBADIOTYPE, __FILE__, __LINE__,
+                        "Opening file (%s) failed. Invalid iotype (%s:%d) specified. Available iotypes are : %s", filename, pio_iotype_to_string(*iotype), *iotype, avail_iotypes);
+    }
+
+    LOG((2, "PIOc_openfile_retry iosysid = %d iotype = %d filename = %s mode = %d retry = %d",
+         iosysid, *iotype, filename, mode, retry));
+    PIO_TRACE_BEGIN("PIOc_openfile");
+
+    /* Allocate space for the file info. */
+    if ((ierr = openfile_alloc(ios, iotype, filename, mode, &file)))
+        goto exit;
+
+    /* If async is in use, bcast the parameters from compute to I/O procs. */
+    if(ios->async)
+    {
+        int len = strlen(filename) + 1;
+        PIO_SEND_ASYNC_MSG(ios, PIO_MSG_OPEN_FILE, &ierr, len, filename, file->iotype, file->mode);
+        if(ierr != PIO_NOERR)
+        {
+            free(file);
+            ierr = pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                            "Opening file (%s) failed. Sending asynchronous message, PIO_MSG_OPEN_FILE, failed on iosystem (iosysid=%d)", filename, ios->iosysid);
+            goto exit;
+        }
+    }
+
+    /* Open the file on the IO tasks, and share the result with all
+     * tasks. */
+    open_ierr = openfile_io(ios, file, iotype, filename, retry);
+    ierr = openfiles_finish(ios, 1, &file, &open_ierr, iotype, ncidp);
+
+exit:
+    PIO_TRACE_END("PIOc_openfile");
     return ierr;
 }
 
@@ -3042,6 +3539,136 @@ int openfile_int(int iosysid, int *ncidp, int *iotype, const char *filename,
     return PIO_NOERR;
 }
 
+/**
+ * Internal function used to open several existing files at once. This
+ * function is called by PIOc_openfiles(). The
+ * files are opened one after the other by the low level I/O library,
+ * but with a single asynchronous message to the IO tasks, and a single
+ * broadcast of the open modes and unlimited dimensions of all the
+ * files.
+ *
+ * Input parameters are read on comp task 0 and ignored elsewhere.
+ *
+ * @param iosysid: A defined pio system descriptor (input)
+ * @param nfiles: The number of files to open
+ * @param ncids: Array of nfiles that gets the pio file descriptors
+ * (output)
+ * @param iotype: A pio output format, used for all the files (input)
+ * @param filenames: Array of nfiles with the filenames to open
+ * @param mode: The netcdf mode for the open operations
+ * @param retry: non-zero to automatically retry with netCDF serial
+ * classic.
+ *
+ * @return 0 for success, error code otherwise. If any file could not
+ * be opened, none of the files is left open.
+ * @ingroup PIO_openfile
+ */
+int openfiles_int(int iosysid, int nfiles, int *ncids, int *iotype,
+                  const char **filenames, int mode, int retry)
+{
+    iosystem_desc_t *ios;      /* Pointer to io system information. */
+    file_desc_t **files = NULL; /* Pointers to file information. */
+    int *open_ierrs = NULL;    /* Return codes from the opens on this task. */
+    int ierr = PIO_NOERR;      /* Return code from function calls. */
+
+    /* Get the IO system info from the iosysid. */
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+    {
+        return pio_err(NULL, NULL, PIO_EBADID, __FILE__, __LINE__,
+                        "Opening %d files failed. Invalid iosystem id (%d) provided", nfiles, iosysid);
+    }
+
+    /* User must provide valid input for these parameters. */
+    if (nfiles <= 0 || !ncids || !iotype || !filenames)
+    {
+        return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                        "Opening %d files failed. Invalid arguments provided. nfiles is %d (expected > 0), ncids is %s (expected not NULL), iotype is %s (expected not NULL), filenames is %s (expected not NULL)", nfiles, nfiles, PIO_IS_NULL(ncids), PIO_IS_NULL(iotype), PIO_IS_NULL(filenames));
+    }
+    for (int f = 0; f < nfiles; f++)
+    {
+        if (!filenames[f])
+        {
+            return pio_err(ios, NULL, PIO_EINVAL, __FILE__, __LINE__,
+                            "Opening %d files failed. Invalid arguments provided. filenames[%d] is NULL (expected not NULL)", nfiles, f);
+        }
+    }
+
+    /* A valid iotype must be specified. */
+    if (!iotype_is_valid(*iotype))
+    {
+        char avail_iotypes[PIO_MAX_NAME + 1];
+        PIO_get_avail_iotypes(avail_iotypes, PIO_MAX_NAME);
+        return pio_err(ios, NULL, PIO_EBADIOTYPE, __FILE__, __LINE__,
+                        "Opening %d files failed. Invalid iotype (%s:%d) specified. Available iotypes are : %s", nfiles, pio_iotype_to_string(*iotype), *iotype, avail_iotypes);
+    }
+
+    LOG((2, "openfiles_int iosysid = %d nfiles = %d iotype = %d mode = %d retry = %d",
+         iosysid, nfiles, *iotype, mode, retry));
+    PIO_TRACE_BEGIN("PIOc_openfiles");
+
+    if (!(files = calloc(nfiles, sizeof(file_desc_t *))) ||
+        !(open_ierrs = calloc(nfiles, sizeof(int))))
+    {
+        ierr = pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                        "Opening %d files failed. Out of memory allocating the file structures", nfiles);
+        goto exit;
+    }
+
+    /* Allocate space for the file info. */
+    for (int f = 0; f < nfiles && ierr == PIO_NOERR; f++)
+        ierr = openfile_alloc(ios, iotype, filenames[f], mode, &files[f]);
+
+    /* If async is in use, bcast the parameters of all the files from
+     * compute to I/O procs. */
+    if (ierr == PIO_NOERR && ios->async)
+    {
+        char *names;
+        int len = 0;
+
+        for (int f = 0; f < nfiles; f++)
+            len += strlen(filenames[f]) + 1;
+        if (!(names = malloc(len)))
+            ierr = pio_err(ios, NULL, PIO_ENOMEM, __FILE__, __LINE__,
+                            "Opening %d files failed. Out of memory allocating %d bytes for the filenames", nfiles, len);
+        else
+        {
+            len = 0;
+            for (int f = 0; f < nfiles; f++)
+            {
+                strcpy(names + len, filenames[f]);
+                len += strlen(filenames[f]) + 1;
+            }
+
+            PIO_SEND_ASYNC_MSG(ios, PIO_MSG_OPEN_FILES, &ierr, nfiles, len, names,
+                               files[0]->iotype, files[0]->mode);
+            free(names);
+            if (ierr != PIO_NOERR)
+                ierr = pio_err(ios, NULL, ierr, __FILE__, __LINE__,
+                                "Opening %d files failed. Sending asynchronous message, PIO_MSG_OPEN_FILES, failed on iosystem (iosysid=%d)", nfiles, ios->iosysid);
+        }
+    }
+
+    if (ierr != PIO_NOERR)
+    {
+        for (int f = 0; f < nfiles; f++)
+            free(files[f]);
+        goto exit;
+    }
+
+    /* Open the files on the IO tasks, and share the results with all
+     * tasks at once. */
+    for (int f = 0; f < nfiles; f++)
+        open_ierrs[f] = openfile_io(ios, files[f], iotype, filenames[f], retry);
+    ierr = openfiles_finish(ios, nfiles, files, open_ierrs, iotype, ncids);
+
+exit:
+    free(files);
+    free(open_ierrs);
+
+    PIO_TRACE_END("PIOc_openfiles");
+    return ierr;
+}
+
 /**
  * Internal function to provide inq_type function for pnetcdf.
  *
@@ -3149,8 +3776,14 @@ int pioc_change_def(int ncid, int is_enddef)
         {
             if (is_enddef)
             {
+#ifdef _NETCDF4
+                /* Choose the chunk sizes of the new variables. */
+                if (file->iotype == PIO_IOTYPE_NETCDF4C || file->iotype == PIO_IOTYPE_NETCDF4P)
+                    ierr = pio_def_decomp_chunking(file);
+#endif /* _NETCDF4 */
                 LOG((3, "pioc_change_def calling nc_enddef file->fh = %d", file->fh));
-                ierr = nc_enddef(file->fh);
+                if (ierr == PIO_NOERR)
+                    ierr = nc_enddef(file->fh);
             }
             else
                 ierr = nc_redef(file->fh);
@@ -3163,6 +3796,11 @@ int pioc_change_def(int ncid, int is_enddef)
       return pio_err(ios, file, ierr, __FILE__, __LINE__,
                       "Changing the define mode for file (%s) failed. Low-level I/O library API failed", pio_get_fname_from_file(file));
     }
+
+    /* The chunk sizes of the variables defined so far are final. */
+    if (is_enddef)
+        for (int v = 0; v < PIO_MAX_VARS; v++)
+            file->varlist[v].new_var = 0;
     LOG((3, "pioc_change_def succeeded"));
 
     return ierr;
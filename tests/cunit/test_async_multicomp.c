@@ -0,0 +1,216 @@
+/*
+ * Tests for the async I/O service with multiple computation
+ * components (PIOc_init_intercomm()). Two IO tasks serve two
+ * components of one task each, first all the IO tasks serving both
+ * components, then with the IO tasks split in one group per
+ * component (PIOc_set_async_split()). Each component creates and
+ * checks sample files, then checks the statistics of the async
+ * service reported for the component.
+ */
+#include <limits.h>
+#include <pio.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_async_multicomp"
+
+/* Number of processors that will do IO. */
+#define NUM_IO_PROCS 2
+
+/* Number of computational components to create. */
+#define COMPONENT_COUNT 2
+
+/* Max length of a line of the async service reports. */
+#define MAX_REPORT_LINE 1024
+
+/**
+ * Check the statistics of the async service for the component of
+ * this task, in the last line of the JSON report written by the IO
+ * root when the component was finalized. The report must be for the
+ * component, with the expected number of IO tasks, and the
+ * components (that do the same I/O) must have handled the same
+ * number of messages.
+ *
+ * @param test_comm the communicator of the test.
+ * @param iosysid the iosystem ID of the component of this task.
+ * @param my_comp the component of this task, -1 on the IO tasks.
+ * @param niotasks the number of IO tasks expected to serve the
+ * component.
+ * @returns 0 for success, error code otherwise.
+ */
+int check_async_report(MPI_Comm test_comm, int iosysid, int my_comp, int niotasks)
+{
+    long long nmsgs_range[2] = {LLONG_MIN, LLONG_MIN}; /* -min and max. */
+    int ret;
+
+    if (my_comp >= 0)
+    {
+        char rname[PIO_MAX_NAME + 1];
+        char line[MAX_REPORT_LINE];
+        int rsysid = -1, rcomp = -1, rniotasks = -1;
+        long long nmsgs = -1;
+        FILE *fp;
+
+        sprintf(rname, "pio_perf_report_async_%d.json", iosysid);
+        if (!(fp = fopen(rname, "r")))
+            return ERR_WRONG;
+        while (fgets(line, MAX_REPORT_LINE, fp))
+            if (sscanf(line, "{\"iosysid\":%d,\"component\":%d,\"niotasks\":%d,\"nmsgs\":%lld",
+                       &rsysid, &rcomp, &rniotasks, &nmsgs) != 4)
+            {
+                fclose(fp);
+                return ERR_WRONG;
+            }
+        fclose(fp);
+
+        if (rsysid != iosysid || rcomp != my_comp || rniotasks != niotasks || nmsgs <= 0)
+            return ERR_WRONG;
+        nmsgs_range[0] = -nmsgs;
+        nmsgs_range[1] = nmsgs;
+    }
+
+    /* Check the message counts of the components. */
+    if ((ret = MPI_Allreduce(MPI_IN_PLACE, nmsgs_range, 2, MPI_LONG_LONG, MPI_MAX, test_comm)))
+        MPIERR(ret);
+    if (-nmsgs_range[0] != nmsgs_range[1])
+        return ERR_WRONG;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Initialize the async I/O service for the components, create and
+ * check sample files on the compute tasks, finalize, and check the
+ * reported statistics of the async service.
+ *
+ * @param test_comm the communicator of the test.
+ * @param io_comm the communicator of the IO tasks, MPI_COMM_NULL on
+ * the compute tasks.
+ * @param comp_comms the communicators of the components.
+ * @param my_comp the component of this task, -1 on the IO tasks.
+ * @param split the argument of PIOc_set_async_split().
+ * @param num_flavors the number of iotypes.
+ * @param flavor the iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int run_components(MPI_Comm test_comm, MPI_Comm io_comm, MPI_Comm *comp_comms, int my_comp,
+                   int split, int num_flavors, int *flavor, int my_rank)
+{
+    int iosysid[COMPONENT_COUNT];
+    int ret;
+    int mpierr;
+
+    if ((ret = PIOc_set_async_split(split)))
+        return ret;
+
+    /* The IO tasks only return once the components are finalized. */
+    if ((ret = PIOc_init_intercomm(COMPONENT_COUNT, test_comm, comp_comms, io_comm,
+                                   PIO_REARR_BOX, iosysid)))
+        return ret;
+
+    if (my_comp >= 0)
+    {
+        /* The reports include the statistics of the async service. */
+        if ((ret = PIOc_set_perf_report(iosysid[my_comp], PIO_PERF_REPORT_JSON)))
+            return ret;
+
+        for (int flv = 0; flv < num_flavors; flv++)
+        {
+            for (int sample = 0; sample < NUM_SAMPLES; sample++)
+            {
+                char filename[PIO_MAX_NAME + 1];
+                char iotype_name[PIO_MAX_NAME + 1];
+
+                if ((ret = get_iotype_name(flavor[flv], iotype_name)))
+                    return ret;
+                sprintf(filename, "%s_%s_%d_%d_%d.nc", TEST_NAME, iotype_name, sample, my_comp,
+                        split);
+
+                if ((ret = create_nc_sample(sample, iosysid[my_comp], flavor[flv], filename,
+                                            my_rank, NULL)))
+                    return ret;
+                if ((ret = check_nc_sample(sample, iosysid[my_comp], flavor[flv], filename,
+                                           my_rank, NULL)))
+                    return ret;
+            }
+        }
+
+        if ((ret = PIOc_finalize(iosysid[my_comp])))
+            return ret;
+    }
+
+    /* The IO roots write the reports when the components are
+     * finalized, the IO tasks return once all are. */
+    if ((mpierr = MPI_Barrier(test_comm)))
+        MPIERR(mpierr);
+    if ((ret = check_async_report(test_comm, (my_comp >= 0) ? iosysid[my_comp] : -1, my_comp,
+                                  split ? NUM_IO_PROCS / COMPONENT_COUNT : NUM_IO_PROCS)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
+/* Run the async tests with multiple components. */
+int main(int argc, char **argv)
+{
+    int my_rank; /* Zero-based rank of processor. */
+    int ntasks; /* Number of processors involved in current execution. */
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm;
+    int ret; /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init(argc, argv, &my_rank, &ntasks, TARGET_NTASKS,
+                             &test_comm)))
+        ERR(ERR_INIT);
+
+    /* Only do something on TARGET_NTASKS tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        MPI_Comm split_comm;
+        MPI_Comm io_comm = MPI_COMM_NULL;
+        MPI_Comm comp_comms[COMPONENT_COUNT] = {MPI_COMM_NULL, MPI_COMM_NULL};
+        int my_comp = (my_rank < NUM_IO_PROCS) ? -1 : my_rank - NUM_IO_PROCS;
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        /* The IO tasks and the components have their communicators. */
+        if ((ret = MPI_Comm_split(test_comm, my_comp + 1, my_rank, &split_comm)))
+            MPIERR(ret);
+        if (my_comp < 0)
+            io_comm = split_comm;
+        else
+            comp_comms[my_comp] = split_comm;
+
+        /* All the IO tasks serve both components. */
+        if ((ret = run_components(test_comm, io_comm, comp_comms, my_comp, 0, num_flavors,
+                                  flavor, my_rank)))
+            ERR(ret);
+
+        /* Each component is served by its own IO task. */
+        if ((ret = run_components(test_comm, io_comm, comp_comms, my_comp, 1, num_flavors,
+                                  flavor, my_rank)))
+            ERR(ret);
+
+        if ((ret = PIOc_set_async_split(0)))
+            ERR(ret);
+        if ((ret = MPI_Comm_free(&split_comm)))
+            MPIERR(ret);
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize test. */
+    printf("%d %s finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ERR_AWFUL;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+
+    return 0;
+}
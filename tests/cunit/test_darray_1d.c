@@ -683,6 +683,80 @@ int test_darray_fill_unlim(int iosysid, int ioid, int pio_type, int num_flavors,
     return PIO_NOERR;
 }
 
+/**
+ * Test writing records of an int variable with holes in the
+ * decomposition without flushing them to disk in between, so the
+ * data and fill value buffers of a record are still in use by the
+ * pending requests when the next record is written (see
+ * PIOc_set_stage_limit()).
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the PIO_INT decomposition.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+*/
+int test_darray_fill_pending(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank)
+{
+#define NUM_PENDING_RECS 3
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int dimid[NDIM2];     /* The dimension IDs. */
+    int ncid;      /* The ncid of the netCDF file. */
+    int varid;     /* The ID of the netCDF varable. */
+    int test_data[NUM_PENDING_RECS][2];
+    int int_fill = NC_FILL_INT;
+    void *fillvalue = &int_fill;
+    int data_in[NUM_PENDING_RECS * DIM_LEN];
+    int ret;       /* Return code. */
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        /* Create the filename. */
+        sprintf(filename, "data_%s_iotype_%d_pending.nc", TEST_NAME, flavor[fmt]);
+
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME, NC_UNLIMITED, &dimid[0])))
+            ERR(ret);
+        if ((ret = PIOc_def_dim(ncid, DIM_NAME_2, DIM_LEN, &dimid[1])))
+            ERR(ret);
+        if ((ret = PIOc_def_var(ncid, VAR_NAME, PIO_INT, NDIM2, dimid, &varid)))
+            ERR(ret);
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* Write the records, the fill values of a record are written
+         * after its data. */
+        for (int r = 0; r < NUM_PENDING_RECS; r++)
+        {
+            test_data[r][0] = test_data[r][1] = r * 10 + my_rank;
+            if ((ret = PIOc_write_darray_multi(ncid, &varid, ioid, 1, 2, test_data[r], &r,
+                                               fillvalue, false)))
+                ERR(ret);
+        }
+
+        /* Close the file, this flushes the data. */
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* Check the data, each task wrote the first element of its
+         * slice. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+        if ((ret = PIOc_get_var_int(ncid, varid, data_in)))
+            ERR(ret);
+        for (int r = 0; r < NUM_PENDING_RECS; r++)
+            for (int e = 0; e < DIM_LEN; e++)
+                if (data_in[r * DIM_LEN + e] != (e < TARGET_NTASKS ? r * 10 + e : NC_FILL_INT))
+                    return ERR_WRONG;
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    } /* next iotype */
+
+    return PIO_NOERR;
+}
+
 /**
  * Test the decomp read/write functionality.
  *
@@ -877,6 +951,12 @@ int main(int argc, char **argv)
                                                   flavor, my_rank, test_comm)))
                     return ret;
 
+                /* Run tests. */
+                if (test_type[t] == PIO_INT)
+                    if ((ret = test_darray_fill_pending(iosysid, ioid, num_flavors, flavor,
+                                                        my_rank)))
+                        return ret;
+
                 /* Free the PIO decomposition. */
                 if ((ret = PIOc_freedecomp(iosysid, ioid)))
                     ERR(ret);
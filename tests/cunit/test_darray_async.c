@@ -463,6 +463,13 @@ int main(int argc, char **argv)
             /* This code runs only on computation components. */
             if (my_rank)
             {
+                /* Alternate between staging the data buffers on the
+                 * IO task and a budget too small to stage any. */
+                if (PIOc_set_stage_limit(iosysid, -1) != PIO_EINVAL)
+                    ERR(ERR_WRONG);
+                if ((ret = PIOc_set_stage_limit(iosysid, (t % 2) ? 1 : 0)))
+                    ERR(ret);
+
                 /* Run the simple darray async test. */
                 if ((ret = run_darray_async_test(iosysid, my_rank, test_comm, num_flavors, flavor,
                                                  test_type[t])))
@@ -0,0 +1,247 @@
+/*
+ * Tests for the chunk sizes that PIO chooses for the variables of
+ * netCDF-4 files (PIOc_set_chunk_size_target()).
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_darray_chunking"
+
+/* The number of dimensions in the example data. In this test, we
+ * are using three-dimensional data. */
+#define NDIM 3
+
+/* But sometimes we need arrays of the non-record dimensions. */
+#define NDIM2 2
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The chunk size target, in bytes, for the second file. */
+#define LARGE_CHUNK_SIZE_TARGET 4194304
+
+/* The chunk size target, in bytes, for the third file (one row of
+ * ints). */
+#define SMALL_CHUNK_SIZE_TARGET (Y_DIM_LEN * 4)
+
+/* The name of the variable in the netCDF output files. */
+#define VAR_NAME "foo"
+
+/* The dimension names. */
+char dim_name[NDIM][PIO_MAX_NAME + 1] = {"timestep", "x", "y"};
+
+/* Length of the dimensions in the sample data. */
+int dim_len[NDIM] = {NC_UNLIMITED, X_DIM_LEN, Y_DIM_LEN};
+
+/**
+ * Create a netCDF-4 file with a record variable, using the given
+ * chunk size target, and check the chunk sizes and the chunk cache
+ * chosen by PIO when leaving define mode. Then write a record, and
+ * reopen the file to check the data.
+ *
+ * The sample data is small, so one IO task writes all data (the IO
+ * region is one record). With the large target a chunk is one
+ * record, with the small target a chunk is one row of a record.
+ * Without a target PIO leaves the chunking, and the chunk cache, to
+ * netCDF.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param iotype the netCDF-4 iotype to test.
+ * @param target the chunk size target, 0 for no target.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_chunking(int iosysid, int ioid, int iotype, PIO_Offset target, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int dimids[NDIM];      /* The dimension IDs. */
+    int ncid;              /* The ncid of the netCDF file. */
+    int varid;             /* The ID of the netCDF varable. */
+    PIO_Offset chunksize[NDIM] = {1, X_DIM_LEN, Y_DIM_LEN};
+    PIO_Offset chunksize_in[NDIM];
+    PIO_Offset cache_size, cache_nelems;
+    PIO_Offset old_target;
+    float cache_preemption;
+    int storage;
+    int test_data[ARRAYLEN];
+    int test_data_in[ARRAYLEN];
+    int ret;               /* Return code. */
+
+    /* Initialize some data. */
+    for (int f = 0; f < ARRAYLEN; f++)
+        test_data[f] = my_rank * 10 + f;
+
+    /* Set the chunk size target. */
+    old_target = PIOc_set_chunk_size_target(target);
+    if (target == SMALL_CHUNK_SIZE_TARGET)
+        chunksize[1] = 1;
+
+    /* Create the filename. */
+    sprintf(filename, "data_%s_iotype_%d_target_%lld.nc", TEST_NAME, iotype, target);
+
+    /* Create the netCDF output file. */
+    if ((ret = PIOc_createfile(iosysid, &ncid, &iotype, filename, PIO_CLOBBER)))
+        ERR(ret);
+
+    /* Define netCDF dimensions and variables. */
+    for (int d = 0; d < NDIM; d++)
+        if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len[d], &dimids[d])))
+            ERR(ret);
+    if ((ret = PIOc_def_var(ncid, VAR_NAME, PIO_INT, NDIM, dimids, &varid)))
+        ERR(ret);
+
+    if ((ret = PIOc_enddef(ncid)))
+        ERR(ret);
+
+    /* Check the chunk sizes and the chunk cache. */
+    if ((ret = PIOc_inq_var_chunking(ncid, varid, &storage, chunksize_in)))
+        ERR(ret);
+    if (storage != NC_CHUNKED)
+        ERR(ERR_WRONG);
+    if (target)
+        for (int d = 0; d < NDIM; d++)
+            if (chunksize_in[d] != chunksize[d])
+                ERR(ERR_WRONG);
+
+    /* With a target the cache holds the chunks of a record, otherwise
+     * it is the (larger) default cache of netCDF. */
+    if ((ret = PIOc_get_var_chunk_cache(ncid, varid, &cache_size, &cache_nelems,
+                                        &cache_preemption)))
+        ERR(ret);
+    if ((cache_size == X_DIM_LEN * Y_DIM_LEN * sizeof(int)) != (target != 0))
+        ERR(ERR_WRONG);
+
+    /* Without a target, keep the chunk sizes chosen by netCDF. */
+    if (!target)
+        for (int d = 0; d < NDIM; d++)
+            chunksize[d] = chunksize_in[d];
+
+    /* Write the data. */
+    if ((ret = PIOc_setframe(ncid, varid, 0)))
+        ERR(ret);
+    if ((ret = PIOc_write_darray(ncid, varid, ioid, ARRAYLEN, test_data, NULL)))
+        ERR(ret);
+
+    /* Close the netCDF file, this flushes the data. */
+    if ((ret = PIOc_closefile(ncid)))
+        ERR(ret);
+
+    /* Reopen the file and check the chunk sizes and the data. */
+    if ((ret = PIOc_openfile(iosysid, &ncid, &iotype, filename, PIO_NOWRITE)))
+        ERR(ret);
+
+    if ((ret = PIOc_inq_var_chunking(ncid, varid, &storage, chunksize_in)))
+        ERR(ret);
+    for (int d = 0; d < NDIM; d++)
+        if (chunksize_in[d] != chunksize[d])
+            ERR(ERR_WRONG);
+
+    if ((ret = PIOc_setframe(ncid, varid, 0)))
+        ERR(ret);
+    if ((ret = PIOc_read_darray(ncid, varid, ioid, ARRAYLEN, test_data_in)))
+        ERR(ret);
+    for (int f = 0; f < ARRAYLEN; f++)
+        if (test_data_in[f] != test_data[f])
+            return ERR_WRONG;
+
+    if ((ret = PIOc_closefile(ncid)))
+        ERR(ret);
+
+    /* Restore the chunk size target. */
+    if (PIOc_set_chunk_size_target(old_target) != target)
+        ERR(ERR_WRONG);
+
+    return PIO_NOERR;
+}
+
+/* Run tests for the chunk sizes chosen by PIO. */
+int main(int argc, char **argv)
+{
+#define NUM_REARRANGERS_TO_TEST 2
+    int rearranger[NUM_REARRANGERS_TO_TEST] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    int my_rank;
+    int ntasks;
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              MIN_NTASKS, 3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+        int ioid;     /* The ID of the decomposition. */
+        int ioproc_stride = 1;    /* Stride in the mpi rank between io tasks. */
+        int ioproc_start = 0;     /* Zero based rank of first processor to be used for I/O. */
+        int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        for (int r = 0; r < NUM_REARRANGERS_TO_TEST; r++)
+        {
+            /* Initialize the PIO IO system. */
+            if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, ioproc_stride,
+                                           ioproc_start, rearranger[r], &iosysid)))
+                return ret;
+
+            /* Decompose the data over the tasks. */
+            if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                               &ioid, PIO_INT)))
+                return ret;
+
+            /* Run tests for the netCDF-4 iotypes. */
+            for (int fmt = 0; fmt < num_flavors; fmt++)
+            {
+                if (flavor[fmt] != PIO_IOTYPE_NETCDF4C && flavor[fmt] != PIO_IOTYPE_NETCDF4P)
+                    continue;
+                if ((ret = test_chunking(iosysid, ioid, flavor[fmt], 0, my_rank)))
+                    return ret;
+                if ((ret = test_chunking(iosysid, ioid, flavor[fmt], LARGE_CHUNK_SIZE_TARGET,
+                                         my_rank)))
+                    return ret;
+                if ((ret = test_chunking(iosysid, ioid, flavor[fmt], SMALL_CHUNK_SIZE_TARGET,
+                                         my_rank)))
+                    return ret;
+            }
+
+            /* Free the PIO decomposition. */
+            if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                ERR(ret);
+
+            /* Finalize PIO system. */
+            if ((ret = PIOc_finalize(iosysid)))
+                return ret;
+        } /* next rearranger */
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
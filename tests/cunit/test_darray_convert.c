@@ -0,0 +1,259 @@
+/*
+ * Tests for writing PIO distributed arrays of doubles to variables
+ * of narrower types (the data is converted on the compute tasks).
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_darray_convert"
+
+/* The number of dimensions in the example data. */
+#define NDIM2 2
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The names of the variables in the netCDF output files. */
+#define FLOAT_VAR_NAME "foo_float"
+#define INT_VAR_NAME "foo_int"
+#define RANGE_VAR_NAME "foo_range"
+#define USER_VAR_NAME "foo_float_user"
+
+/* The dimension names. */
+char dim_name[NDIM2][PIO_MAX_NAME + 1] = {"x", "y"};
+
+/**
+ * Write double data to a PIO_FLOAT and a PIO_INT variable, then read
+ * the variables back (using decompositions of the variable types) and
+ * check the data. Values equal to the fill value of the user data are
+ * written as the fill value of the variable. Writing a value that is
+ * out of range for the PIO_INT variable (on one task) returns
+ * PIO_ERANGE on all the tasks. The data
+ * of a decomposition with IO regions provided by the user (one row
+ * per IO task) is not converted on the compute tasks with the box
+ * rearranger.
+ *
+ * @param iosysid the IO system ID.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_convert(int iosysid, int num_flavors, int *flavor, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];    /* The dimension IDs. */
+    int ncid;             /* The ncid of the netCDF file. */
+    int varid_float;      /* The ID of the PIO_FLOAT variable. */
+    int varid_int;        /* The ID of the PIO_INT variable. */
+    int varid_range;      /* The ID of the PIO_INT variable for range checks. */
+    int varid_user;       /* The ID of the PIO_FLOAT variable for user IO regions. */
+    int ioid_double;      /* Decomposition for doubles. */
+    int ioid_float;       /* Decomposition for floats. */
+    int ioid_int;         /* Decomposition for ints. */
+    int ioid_user;        /* Decomposition for doubles with user IO regions. */
+    PIO_Offset compdof[ARRAYLEN];
+    PIO_Offset iostart[NDIM2] = {my_rank, 0};
+    PIO_Offset iocount[NDIM2] = {1, Y_DIM_LEN};
+    io_desc_t *iodesc;
+    double fillvalue_double = -1.0;
+    double test_data[ARRAYLEN];
+    double test_data_range[ARRAYLEN];
+    float test_data_float_in[ARRAYLEN];
+    float test_data_user_in[ARRAYLEN];
+    int test_data_int_in[ARRAYLEN];
+    int ret;              /* Return code. */
+
+    /* Initialize some data, the last element on each task is the
+     * fill value. */
+    for (int f = 0; f < ARRAYLEN; f++)
+    {
+        test_data[f] = my_rank * 10 + f + 0.25;
+        test_data_range[f] = test_data[f];
+    }
+    test_data[ARRAYLEN - 1] = fillvalue_double;
+    if (my_rank == 0)
+        test_data_range[0] = 1e20;
+
+    /* Decompose the data over the tasks. */
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                       &ioid_double, PIO_DOUBLE)))
+        return ret;
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                       &ioid_float, PIO_FLOAT)))
+        return ret;
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                       &ioid_int, PIO_INT)))
+        return ret;
+    for (int f = 0; f < ARRAYLEN; f++)
+        compdof[f] = my_rank * ARRAYLEN + f + 1;
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_DOUBLE, NDIM2, dim_len_2d, ARRAYLEN, compdof,
+                               &ioid_user, NULL, iostart, iocount)))
+        ERR(ret);
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        /* Create the filename. */
+        sprintf(filename, "data_%s_iotype_%d.nc", TEST_NAME, flavor[fmt]);
+
+        /* Create the netCDF output file. */
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+
+        /* Define netCDF dimensions and variables. */
+        for (int d = 0; d < NDIM2; d++)
+            if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len_2d[d], &dimids[d])))
+                ERR(ret);
+        if ((ret = PIOc_def_var(ncid, FLOAT_VAR_NAME, PIO_FLOAT, NDIM2, dimids, &varid_float)))
+            ERR(ret);
+        if ((ret = PIOc_def_var(ncid, INT_VAR_NAME, PIO_INT, NDIM2, dimids, &varid_int)))
+            ERR(ret);
+        if ((ret = PIOc_def_var(ncid, RANGE_VAR_NAME, PIO_INT, NDIM2, dimids, &varid_range)))
+            ERR(ret);
+        if ((ret = PIOc_def_var(ncid, USER_VAR_NAME, PIO_FLOAT, NDIM2, dimids, &varid_user)))
+            ERR(ret);
+
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* Write the double data to both variables. */
+        if ((ret = PIOc_write_darray(ncid, varid_float, ioid_double, ARRAYLEN, test_data,
+                                     &fillvalue_double)))
+            ERR(ret);
+
+        if ((ret = PIOc_write_darray(ncid, varid_int, ioid_double, ARRAYLEN, test_data,
+                                     &fillvalue_double)))
+            ERR(ret);
+
+        /* Out of range values can not be written to an int var. */
+        ret = PIOc_write_darray(ncid, varid_range, ioid_double, ARRAYLEN, test_data_range,
+                                &fillvalue_double);
+        if (ret != PIO_ERANGE)
+            ERR(ERR_WRONG);
+
+        /* The data of the decomposition with user IO regions is
+         * converted on the compute tasks only with the subset
+         * rearranger (the IO regions are ignored). */
+        if ((ret = PIOc_write_darray(ncid, varid_user, ioid_user, ARRAYLEN, test_data,
+                                     &fillvalue_double)))
+            ERR(ret);
+        if (!(iodesc = pio_get_iodesc_from_id(ioid_user)))
+            ERR(ERR_WRONG);
+        if ((iodesc->conv_ioid >= 0) != (iodesc->rearranger == PIO_REARR_SUBSET))
+            ERR(ERR_WRONG);
+
+        /* Close the netCDF file, this flushes the data. */
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* Reopen the file and check the data. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+
+        if ((ret = PIOc_read_darray(ncid, varid_float, ioid_float, ARRAYLEN, test_data_float_in)))
+            ERR(ret);
+        if ((ret = PIOc_read_darray(ncid, varid_int, ioid_int, ARRAYLEN, test_data_int_in)))
+            ERR(ret);
+        if ((ret = PIOc_read_darray(ncid, varid_user, ioid_float, ARRAYLEN, test_data_user_in)))
+            ERR(ret);
+
+        for (int f = 0; f < ARRAYLEN - 1; f++)
+        {
+            if (test_data_float_in[f] != (float)test_data[f])
+                return ERR_WRONG;
+            if (test_data_int_in[f] != (int)test_data[f])
+                return ERR_WRONG;
+            if (test_data_user_in[f] != (float)test_data[f])
+                return ERR_WRONG;
+        }
+        if (test_data_float_in[ARRAYLEN - 1] != PIO_FILL_FLOAT)
+            return ERR_WRONG;
+        if (test_data_int_in[ARRAYLEN - 1] != PIO_FILL_INT)
+            return ERR_WRONG;
+
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    } /* next iotype */
+
+    /* Free the PIO decompositions. */
+    if ((ret = PIOc_freedecomp(iosysid, ioid_double)))
+        ERR(ret);
+    if ((ret = PIOc_freedecomp(iosysid, ioid_float)))
+        ERR(ret);
+    if ((ret = PIOc_freedecomp(iosysid, ioid_int)))
+        ERR(ret);
+    if ((ret = PIOc_freedecomp(iosysid, ioid_user)))
+        ERR(ret);
+
+    return PIO_NOERR;
+}
+
+/* Run tests for writing converted darrays. */
+int main(int argc, char **argv)
+{
+#define NUM_REARRANGERS_TO_TEST 2
+    int rearranger[NUM_REARRANGERS_TO_TEST] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    int my_rank;
+    int ntasks;
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              MIN_NTASKS, 3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+        int ioproc_stride = 1;    /* Stride in the mpi rank between io tasks. */
+        int ioproc_start = 0;     /* Zero based rank of first processor to be used for I/O. */
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        for (int r = 0; r < NUM_REARRANGERS_TO_TEST; r++)
+        {
+            /* Initialize the PIO IO system. */
+            if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, ioproc_stride,
+                                           ioproc_start, rearranger[r], &iosysid)))
+                return ret;
+
+            /* Run tests. */
+            if ((ret = test_darray_convert(iosysid, num_flavors, flavor, my_rank)))
+                return ret;
+
+            /* Finalize PIO system. */
+            if ((ret = PIOc_finalize(iosysid)))
+                return ret;
+        } /* next rearranger */
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
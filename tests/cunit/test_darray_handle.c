@@ -0,0 +1,233 @@
+/*
+ * Tests for writing records of PIO distributed arrays through write
+ * handles (PIOc_bind_darray()).
+ */
+#include <pio.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_darray_handle"
+
+/* The number of dimensions in the example data. In this test, we
+ * are using three-dimensional data. */
+#define NDIM 3
+
+/* But sometimes we need arrays of the non-record dimensions. */
+#define NDIM2 2
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* The number of timesteps of data to write. */
+#define NUM_TIMESTEPS 4
+
+/* The number of variables in the netCDF output files. */
+#define NUM_VARS 2
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The dimension names. */
+char dim_name[NDIM][PIO_MAX_NAME + 1] = {"timestep", "x", "y"};
+
+/* Length of the dimensions in the sample data. */
+int dim_len[NDIM] = {NC_UNLIMITED, X_DIM_LEN, Y_DIM_LEN};
+
+/* The names of the variables in the netCDF output files. */
+char var_name[NUM_VARS][PIO_MAX_NAME + 1] = {"foo", "bar"};
+
+/**
+ * Write NUM_TIMESTEPS records of NUM_VARS int variables through
+ * write handles, syncing the file half way (which frees the write
+ * multi buffers the handles cache the data in). Check that the
+ * handles can not be used once the file is closed, then reopen the
+ * file and check the data.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_handle(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int dimids[NDIM];                /* The dimension IDs. */
+    int ncid;                        /* The ncid of the netCDF file. */
+    int varid[NUM_VARS];             /* The IDs of the netCDF varables. */
+    int handle[NUM_VARS];            /* The write handles of the variables. */
+    int fillvalue = NC_FILL_INT;
+    int test_data[NUM_TIMESTEPS][NUM_VARS][ARRAYLEN];
+    int test_data_in[ARRAYLEN];
+    int ret;                         /* Return code. */
+
+    /* Initialize some data. */
+    for (int t = 0; t < NUM_TIMESTEPS; t++)
+        for (int v = 0; v < NUM_VARS; v++)
+            for (int f = 0; f < ARRAYLEN; f++)
+                test_data[t][v][f] = t * 1000 + v * 100 + my_rank * 10 + f;
+
+    /* These should not work. */
+    if (PIOc_bind_darray(TEST_VAL_42, 0, ioid, NULL, &handle[0]) != PIO_EBADID)
+        ERR(ERR_WRONG);
+    if (PIOc_write_darray_handle(TEST_VAL_42, 0, test_data[0][0]) != PIO_EBADID)
+        ERR(ERR_WRONG);
+    if (PIOc_unbind_darray(TEST_VAL_42) != PIO_EBADID)
+        ERR(ERR_WRONG);
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        /* Create the filename. */
+        sprintf(filename, "data_%s_iotype_%d.nc", TEST_NAME, flavor[fmt]);
+
+        /* Create the netCDF output file. */
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+
+        /* Define netCDF dimensions and variables. */
+        for (int d = 0; d < NDIM; d++)
+            if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len[d], &dimids[d])))
+                ERR(ret);
+        for (int v = 0; v < NUM_VARS; v++)
+            if ((ret = PIOc_def_var(ncid, var_name[v], PIO_INT, NDIM, dimids, &varid[v])))
+                ERR(ret);
+
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* These should not work. */
+        if (PIOc_bind_darray(ncid, 0, ioid, NULL, NULL) != PIO_EINVAL)
+            ERR(ERR_WRONG);
+        if (PIOc_bind_darray(ncid, 0, TEST_VAL_42, NULL, &handle[0]) != PIO_EBADID)
+            ERR(ERR_WRONG);
+
+        /* Bind the variables, the first one with a fill value. */
+        for (int v = 0; v < NUM_VARS; v++)
+            if ((ret = PIOc_bind_darray(ncid, varid[v], ioid, v ? NULL : &fillvalue, &handle[v])))
+                ERR(ret);
+
+        for (int t = 0; t < NUM_TIMESTEPS; t++)
+        {
+            /* Free the write multi buffers half way. */
+            if (t == NUM_TIMESTEPS / 2)
+                if ((ret = PIOc_sync(ncid)))
+                    ERR(ret);
+
+            for (int v = 0; v < NUM_VARS; v++)
+                if ((ret = PIOc_write_darray_handle(handle[v], t, test_data[t][v])))
+                    ERR(ret);
+        }
+
+        /* Close the netCDF file, this flushes the data. */
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* The handles can not be used after the file is closed. */
+        if (PIOc_write_darray_handle(handle[0], 0, test_data[0][0]) != PIO_EBADID)
+            ERR(ERR_WRONG);
+        for (int v = 0; v < NUM_VARS; v++)
+            if ((ret = PIOc_unbind_darray(handle[v])))
+                ERR(ret);
+        if (PIOc_unbind_darray(handle[0]) != PIO_EBADID)
+            ERR(ERR_WRONG);
+
+        /* Reopen the file and check the data. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+
+        for (int t = 0; t < NUM_TIMESTEPS; t++)
+        {
+            for (int v = 0; v < NUM_VARS; v++)
+            {
+                if ((ret = PIOc_setframe(ncid, varid[v], t)))
+                    ERR(ret);
+                if ((ret = PIOc_read_darray(ncid, varid[v], ioid, ARRAYLEN, test_data_in)))
+                    ERR(ret);
+                for (int f = 0; f < ARRAYLEN; f++)
+                    if (test_data_in[f] != test_data[t][v][f])
+                        return ERR_WRONG;
+            }
+        }
+
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    } /* next iotype */
+
+    return PIO_NOERR;
+}
+
+/* Run tests for writing darrays through write handles. */
+int main(int argc, char **argv)
+{
+#define NUM_REARRANGERS_TO_TEST 2
+    int rearranger[NUM_REARRANGERS_TO_TEST] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    int my_rank;
+    int ntasks;
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              MIN_NTASKS, 3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+        int ioid;     /* The ID of the decomposition. */
+        int ioproc_stride = 1;    /* Stride in the mpi rank between io tasks. */
+        int ioproc_start = 0;     /* Zero based rank of first processor to be used for I/O. */
+        int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        for (int r = 0; r < NUM_REARRANGERS_TO_TEST; r++)
+        {
+            /* Initialize the PIO IO system. */
+            if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, ioproc_stride,
+                                           ioproc_start, rearranger[r], &iosysid)))
+                return ret;
+
+            /* Decompose the data over the tasks. */
+            if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                               &ioid, PIO_INT)))
+                return ret;
+
+            /* Run tests. */
+            if ((ret = test_darray_handle(iosysid, ioid, num_flavors, flavor, my_rank)))
+                return ret;
+
+            /* Free the PIO decomposition. */
+            if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                ERR(ret);
+
+            /* Finalize PIO system. */
+            if ((ret = PIOc_finalize(iosysid)))
+                return ret;
+        } /* next rearranger */
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Tests for writing compressed PIO distributed arrays with the
+ * parallel netCDF-4 iotype (PIO_IOTYPE_NETCDF4P).
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_darray_par_deflate"
+
+/* The number of dimensions in the example data. In this test, we
+ * are using three-dimensional data. */
+#define NDIM 3
+
+/* But sometimes we need arrays of the non-record dimensions. */
+#define NDIM2 2
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* The number of timesteps of data to write. */
+#define NUM_TIMESTEPS 2
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The names of the variables in the netCDF output files. */
+#define VAR_NAME "foo"
+#define VAR_NAME2 "bar"
+
+/* The dimension names. */
+char dim_name[NDIM][PIO_MAX_NAME + 1] = {"timestep", "x", "y"};
+
+/* Length of the dimensions in the sample data. */
+int dim_len[NDIM] = {NC_UNLIMITED, X_DIM_LEN, Y_DIM_LEN};
+
+/**
+ * Define two compressed record variables in a PIO_IOTYPE_NETCDF4P
+ * file. PIO chooses the chunk sizes of the first variable (the
+ * sample data is small, so one IO task writes all data and the
+ * chunks are the size of a record), the chunk sizes of the second
+ * variable are set by the user after turning on compression. Write
+ * some records, then reopen the file and check the data and the
+ * settings.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_par_deflate(int iosysid, int ioid, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int iotype = PIO_IOTYPE_NETCDF4P;
+    int dimids[NDIM];      /* The dimension IDs. */
+    int ncid;              /* The ncid of the netCDF file. */
+    int varid;             /* The ID of the var with chunks chosen by PIO. */
+    int varid2;            /* The ID of the var with chunks set by the user. */
+    PIO_Offset chunksize[NDIM] = {1, X_DIM_LEN, Y_DIM_LEN};
+    PIO_Offset chunksize2[NDIM] = {1, X_DIM_LEN / 2, Y_DIM_LEN};
+    PIO_Offset chunksize_in[NDIM];
+    int storage;
+    int shuffle, deflate, deflate_level;
+    int test_data[NUM_TIMESTEPS][ARRAYLEN];
+    int test_data_in[ARRAYLEN];
+    int ret;               /* Return code. */
+
+    /* Initialize some data. */
+    for (int t = 0; t < NUM_TIMESTEPS; t++)
+        for (int f = 0; f < ARRAYLEN; f++)
+            test_data[t][f] = t * 100 + my_rank * 10 + f;
+
+    /* Create the filename. */
+    sprintf(filename, "data_%s_iotype_%d.nc", TEST_NAME, iotype);
+
+    /* Create the netCDF output file. */
+    if ((ret = PIOc_createfile(iosysid, &ncid, &iotype, filename, PIO_CLOBBER)))
+        ERR(ret);
+
+    /* Define netCDF dimensions and variables. */
+    for (int d = 0; d < NDIM; d++)
+        if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len[d], &dimids[d])))
+            ERR(ret);
+    if ((ret = PIOc_def_var(ncid, VAR_NAME, PIO_INT, NDIM, dimids, &varid)))
+        ERR(ret);
+    if ((ret = PIOc_def_var(ncid, VAR_NAME2, PIO_INT, NDIM, dimids, &varid2)))
+        ERR(ret);
+
+    /* Turn on compression. */
+    if ((ret = PIOc_def_var_deflate(ncid, varid, 1, 1, 1)))
+        ERR(ret);
+    if ((ret = PIOc_def_var_deflate(ncid, varid2, 0, 1, 2)))
+        ERR(ret);
+
+    /* Override the chunk sizes of the second var. */
+    if ((ret = PIOc_def_var_chunking(ncid, varid2, NC_CHUNKED, chunksize2)))
+        ERR(ret);
+
+    if ((ret = PIOc_enddef(ncid)))
+        ERR(ret);
+
+    /* Write the data. */
+    for (int t = 0; t < NUM_TIMESTEPS; t++)
+    {
+        if ((ret = PIOc_setframe(ncid, varid, t)))
+            ERR(ret);
+        if ((ret = PIOc_setframe(ncid, varid2, t)))
+            ERR(ret);
+        if ((ret = PIOc_write_darray(ncid, varid, ioid, ARRAYLEN, test_data[t], NULL)))
+            ERR(ret);
+        if ((ret = PIOc_write_darray(ncid, varid2, ioid, ARRAYLEN, test_data[t], NULL)))
+            ERR(ret);
+    }
+
+    /* Close the netCDF file, this flushes the data. */
+    if ((ret = PIOc_closefile(ncid)))
+        ERR(ret);
+
+    /* Reopen the file and check the settings and the data. */
+    if ((ret = PIOc_openfile(iosysid, &ncid, &iotype, filename, PIO_NOWRITE)))
+        ERR(ret);
+
+    if ((ret = PIOc_inq_var_deflate(ncid, varid, &shuffle, &deflate, &deflate_level)))
+        ERR(ret);
+    if (!shuffle || !deflate || deflate_level != 1)
+        ERR(ERR_WRONG);
+    if ((ret = PIOc_inq_var_chunking(ncid, varid, &storage, chunksize_in)))
+        ERR(ret);
+    if (storage != NC_CHUNKED)
+        ERR(ERR_WRONG);
+    for (int d = 0; d < NDIM; d++)
+        if (chunksize_in[d] != chunksize[d])
+            ERR(ERR_WRONG);
+
+    if ((ret = PIOc_inq_var_deflate(ncid, varid2, &shuffle, &deflate, &deflate_level)))
+        ERR(ret);
+    if (shuffle || !deflate || deflate_level != 2)
+        ERR(ERR_WRONG);
+    if ((ret = PIOc_inq_var_chunking(ncid, varid2, &storage, chunksize_in)))
+        ERR(ret);
+    for (int d = 0; d < NDIM; d++)
+        if (chunksize_in[d] != chunksize2[d])
+            ERR(ERR_WRONG);
+
+    for (int t = 0; t < NUM_TIMESTEPS; t++)
+    {
+        if ((ret = PIOc_setframe(ncid, varid, t)))
+            ERR(ret);
+        if ((ret = PIOc_read_darray(ncid, varid, ioid, ARRAYLEN, test_data_in)))
+            ERR(ret);
+        for (int f = 0; f < ARRAYLEN; f++)
+            if (test_data_in[f] != test_data[t][f])
+                return ERR_WRONG;
+
+        if ((ret = PIOc_setframe(ncid, varid2, t)))
+            ERR(ret);
+        if ((ret = PIOc_read_darray(ncid, varid2, ioid, ARRAYLEN, test_data_in)))
+            ERR(ret);
+        for (int f = 0; f < ARRAYLEN; f++)
+            if (test_data_in[f] != test_data[t][f])
+                return ERR_WRONG;
+    }
+
+    if ((ret = PIOc_closefile(ncid)))
+        ERR(ret);
+
+    return PIO_NOERR;
+}
+
+/* Run tests for compressed darrays with the parallel netCDF-4 iotype. */
+int main(int argc, char **argv)
+{
+#define NUM_REARRANGERS_TO_TEST 2
+    int rearranger[NUM_REARRANGERS_TO_TEST] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    int my_rank;
+    int ntasks;
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    bool have_netcdf4p = false;
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              MIN_NTASKS, 3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Figure out iotypes. */
+    if ((ret = get_iotypes(&num_flavors, flavor)))
+        ERR(ret);
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+        if (flavor[fmt] == PIO_IOTYPE_NETCDF4P)
+            have_netcdf4p = true;
+
+    /* Only do something on max_ntasks tasks, if parallel compression
+     * is available. */
+    if (my_rank < TARGET_NTASKS && have_netcdf4p && PIO_HAS_PAR_FILTERS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+        int ioid;     /* The ID of the decomposition. */
+        int ioproc_stride = 1;    /* Stride in the mpi rank between io tasks. */
+        int ioproc_start = 0;     /* Zero based rank of first processor to be used for I/O. */
+        int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+
+        for (int r = 0; r < NUM_REARRANGERS_TO_TEST; r++)
+        {
+            /* Initialize the PIO IO system. */
+            if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, ioproc_stride,
+                                           ioproc_start, rearranger[r], &iosysid)))
+                return ret;
+
+            /* Decompose the data over the tasks. */
+            if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                               &ioid, PIO_INT)))
+                return ret;
+
+            /* Run tests. */
+            if ((ret = test_darray_par_deflate(iosysid, ioid, my_rank)))
+                return ret;
+
+            /* Free the PIO decomposition. */
+            if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                ERR(ret);
+
+            /* Finalize PIO system. */
+            if ((ret = PIOc_finalize(iosysid)))
+                return ret;
+        } /* next rearranger */
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * Tests for quantizing PIO distributed arrays of floats and doubles
+ * (PIOc_def_var_quantize()).
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+#include <float.h>
+#include <math.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_darray_quantize"
+
+/* The number of dimensions in the example data. */
+#define NDIM2 2
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The names of the variables in the netCDF output files. */
+#define FLOAT_VAR_NAME "foo_float"
+#define DOUBLE_VAR_NAME "foo_double"
+#define INT_VAR_NAME "foo_int"
+#define INT_DATA_VAR_NAME "foo_double_int_data"
+
+/* The number of significant bits kept for the PIO_FLOAT var, and the
+ * number of significant digits kept for the PIO_DOUBLE var. */
+#define NSB 8
+#define NSD 3
+
+/* Sample data that needs all bits of the significand. */
+#define PI 3.14159265358979323846
+
+/* The dimension names. */
+char dim_name[NDIM2][PIO_MAX_NAME + 1] = {"x", "y"};
+
+/**
+ * Write a PIO_FLOAT variable quantized with PIO_QUANTIZE_BITROUND and
+ * a PIO_DOUBLE variable quantized with PIO_QUANTIZE_BITGROOM, then
+ * read the variables back and check that the data was quantized
+ * within the expected precision, and that fill values were not
+ * quantized. Also write int data to a quantized PIO_DOUBLE variable,
+ * which is written without quantization.
+ *
+ * @param iosysid the IO system ID.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_darray_quantize(int iosysid, int num_flavors, int *flavor, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];    /* The dimension IDs. */
+    int ncid;             /* The ncid of the netCDF file. */
+    int varid_float;      /* The ID of the PIO_FLOAT variable. */
+    int varid_double;     /* The ID of the PIO_DOUBLE variable. */
+    int varid_int;        /* The ID of the PIO_INT variable. */
+    int varid_int_data;   /* The ID of the PIO_DOUBLE variable written with ints. */
+    int ioid_float;       /* Decomposition for floats. */
+    int ioid_double;      /* Decomposition for doubles. */
+    int ioid_int;         /* Decomposition for ints. */
+    float test_data_float[ARRAYLEN];
+    double test_data_double[ARRAYLEN];
+    float test_data_float_in[ARRAYLEN];
+    double test_data_double_in[ARRAYLEN];
+    int test_data_int[ARRAYLEN];
+    int test_data_int_in[ARRAYLEN];
+    int quantize_mode;
+    int nsd;
+    int ret;              /* Return code. */
+
+    /* Initialize some data, the last element on each task is the
+     * default fill value. */
+    for (int f = 0; f < ARRAYLEN; f++)
+    {
+        test_data_float[f] = (float)(PI * (my_rank * 10 + f + 1));
+        test_data_double[f] = PI * (my_rank * 10 + f + 1);
+        test_data_int[f] = 123456789 + my_rank * 10 + f;
+    }
+    test_data_float[ARRAYLEN - 1] = PIO_FILL_FLOAT;
+    test_data_double[ARRAYLEN - 1] = PIO_FILL_DOUBLE;
+
+    /* Decompose the data over the tasks. */
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                       &ioid_float, PIO_FLOAT)))
+        return ret;
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                       &ioid_double, PIO_DOUBLE)))
+        return ret;
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                       &ioid_int, PIO_INT)))
+        return ret;
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        /* Create the filename. */
+        sprintf(filename, "data_%s_iotype_%d.nc", TEST_NAME, flavor[fmt]);
+
+        /* Create the netCDF output file. */
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+
+        /* Define netCDF dimensions and variables. */
+        for (int d = 0; d < NDIM2; d++)
+            if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len_2d[d], &dimids[d])))
+                ERR(ret);
+        if ((ret = PIOc_def_var(ncid, FLOAT_VAR_NAME, PIO_FLOAT, NDIM2, dimids, &varid_float)))
+            ERR(ret);
+        if ((ret = PIOc_def_var(ncid, DOUBLE_VAR_NAME, PIO_DOUBLE, NDIM2, dimids, &varid_double)))
+            ERR(ret);
+        if ((ret = PIOc_def_var(ncid, INT_VAR_NAME, PIO_INT, NDIM2, dimids, &varid_int)))
+            ERR(ret);
+        if ((ret = PIOc_def_var(ncid, INT_DATA_VAR_NAME, PIO_DOUBLE, NDIM2, dimids,
+                                &varid_int_data)))
+            ERR(ret);
+
+        /* These should not work. */
+        if (PIOc_def_var_quantize(ncid, varid_int, PIO_QUANTIZE_BITROUND, NSB) != PIO_EINVAL)
+            ERR(ERR_WRONG);
+        if (PIOc_def_var_quantize(ncid, varid_float, PIO_QUANTIZE_BITGROOM, 8) != PIO_EINVAL)
+            ERR(ERR_WRONG);
+        if (PIOc_def_var_quantize(ncid, varid_float, PIO_QUANTIZE_BITROUND, 0) != PIO_EINVAL)
+            ERR(ERR_WRONG);
+        if (PIOc_def_var_quantize(ncid, varid_float, 2, NSB) != PIO_EINVAL)
+            ERR(ERR_WRONG);
+
+        /* Turn on quantization. */
+        if ((ret = PIOc_def_var_quantize(ncid, varid_float, PIO_QUANTIZE_BITROUND, NSB)))
+            ERR(ret);
+        if ((ret = PIOc_def_var_quantize(ncid, varid_double, PIO_QUANTIZE_BITGROOM, NSD)))
+            ERR(ret);
+        if ((ret = PIOc_def_var_quantize(ncid, varid_int_data, PIO_QUANTIZE_BITGROOM, NSD)))
+            ERR(ret);
+
+        /* Check the settings. */
+        if ((ret = PIOc_inq_var_quantize(ncid, varid_float, &quantize_mode, &nsd)))
+            ERR(ret);
+        if (quantize_mode != PIO_QUANTIZE_BITROUND || nsd != NSB)
+            ERR(ERR_WRONG);
+        if ((ret = PIOc_inq_var_quantize(ncid, varid_int, &quantize_mode, &nsd)))
+            ERR(ret);
+        if (quantize_mode != PIO_NOQUANTIZE || nsd != 0)
+            ERR(ERR_WRONG);
+
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* Write the data. */
+        if ((ret = PIOc_write_darray(ncid, varid_float, ioid_float, ARRAYLEN, test_data_float,
+                                     NULL)))
+            ERR(ret);
+        if ((ret = PIOc_write_darray(ncid, varid_double, ioid_double, ARRAYLEN, test_data_double,
+                                     NULL)))
+            ERR(ret);
+        if ((ret = PIOc_write_darray(ncid, varid_int_data, ioid_int, ARRAYLEN, test_data_int,
+                                     NULL)))
+            ERR(ret);
+
+        /* Close the netCDF file, this flushes the data. */
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* Reopen the file and check the data. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+
+        if ((ret = PIOc_read_darray(ncid, varid_float, ioid_float, ARRAYLEN, test_data_float_in)))
+            ERR(ret);
+        if ((ret = PIOc_read_darray(ncid, varid_double, ioid_double, ARRAYLEN, test_data_double_in)))
+            ERR(ret);
+        if ((ret = PIOc_read_darray(ncid, varid_int_data, ioid_int, ARRAYLEN, test_data_int_in)))
+            ERR(ret);
+
+        for (int f = 0; f < ARRAYLEN - 1; f++)
+        {
+            unsigned int u;
+
+            /* BitRound rounds to nearest, the trailing bits are 0. */
+            memcpy(&u, &test_data_float_in[f], sizeof(u));
+            if (u & ((1u << (FLT_MANT_DIG - 1 - NSB)) - 1))
+                return ERR_WRONG;
+            if (fabs(test_data_float_in[f] - test_data_float[f]) >
+                fabs(test_data_float[f]) / (1 << (NSB + 1)))
+                return ERR_WRONG;
+            if (fabs(test_data_double_in[f] - test_data_double[f]) >
+                fabs(test_data_double[f]) * pow(10.0, -NSD))
+                return ERR_WRONG;
+        }
+        if (test_data_float_in[ARRAYLEN - 1] != PIO_FILL_FLOAT)
+            return ERR_WRONG;
+        if (test_data_double_in[ARRAYLEN - 1] != PIO_FILL_DOUBLE)
+            return ERR_WRONG;
+
+        /* The int data was not quantized. */
+        for (int f = 0; f < ARRAYLEN; f++)
+            if (test_data_int_in[f] != test_data_int[f])
+                return ERR_WRONG;
+
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    } /* next iotype */
+
+    /* Free the PIO decompositions. */
+    if ((ret = PIOc_freedecomp(iosysid, ioid_float)))
+        ERR(ret);
+    if ((ret = PIOc_freedecomp(iosysid, ioid_double)))
+        ERR(ret);
+    if ((ret = PIOc_freedecomp(iosysid, ioid_int)))
+        ERR(ret);
+
+    return PIO_NOERR;
+}
+
+/* Run tests for quantizing darrays. */
+int main(int argc, char **argv)
+{
+#define NUM_REARRANGERS_TO_TEST 2
+    int rearranger[NUM_REARRANGERS_TO_TEST] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    int my_rank;
+    int ntasks;
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              MIN_NTASKS, 3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+        int ioproc_stride = 1;    /* Stride in the mpi rank between io tasks. */
+        int ioproc_start = 0;     /* Zero based rank of first processor to be used for I/O. */
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        for (int r = 0; r < NUM_REARRANGERS_TO_TEST; r++)
+        {
+            /* Initialize the PIO IO system. */
+            if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, ioproc_stride,
+                                           ioproc_start, rearranger[r], &iosysid)))
+                return ret;
+
+            /* Run tests. */
+            if ((ret = test_darray_quantize(iosysid, num_flavors, flavor, my_rank)))
+                return ret;
+
+            /* Finalize PIO system. */
+            if ((ret = PIOc_finalize(iosysid)))
+                return ret;
+        } /* next rearranger */
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
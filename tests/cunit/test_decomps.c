@@ -244,6 +244,285 @@ int test_decomp_bc(int iosysid, int my_rank, MPI_Comm test_comm)
     return 0;
 }
 
+/**
+ * Test the sharing of the rearranger setup of identical
+ * decompositions. Decompositions with the same map share the setup,
+ * even for different types, a decomposition with another map does
+ * not. The shared setup must still be usable after the decomposition
+ * it was computed for is freed.
+ *
+ * @param iosysid the IO system ID.
+ * @param my_rank the 0-based rank of this task.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_decomp_shared(int iosysid, int my_rank, int num_flavors, int *flavor)
+{
+#define NUM_SHARED 3
+    int shared_type[NUM_SHARED] = {PIO_INT, PIO_INT, PIO_DOUBLE};
+    int ioid[NUM_SHARED];
+    int ioid_other;
+    io_desc_t *iodesc[NUM_SHARED];
+    io_desc_t *iodesc_other;
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];
+    PIO_Offset compmap[X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS];
+    int maplen = X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS;
+    double test_data[X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS];
+    double test_data_in[X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS];
+    char filename[PIO_MAX_NAME + 1];
+    int ncid, varid;
+    int ret;
+
+    /* A block decomposition, and the same blocks in reverse order. */
+    for (int i = 0; i < maplen; i++)
+    {
+        compmap[i] = my_rank * maplen + i + 1;
+        test_data[i] = my_rank * 10 + i;
+    }
+
+    for (int d = 0; d < NUM_SHARED; d++)
+    {
+        if ((ret = PIOc_InitDecomp(iosysid, shared_type[d], NDIM2, dim_len_2d, maplen, compmap,
+                                   &ioid[d], NULL, NULL, NULL)))
+            return ret;
+        if (!(iodesc[d] = pio_get_iodesc_from_id(ioid[d])))
+            return ERR_WRONG;
+    }
+
+    for (int i = 0; i < maplen; i++)
+        compmap[i] = (TARGET_NTASKS - 1 - my_rank) * maplen + i + 1;
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM2, dim_len_2d, maplen, compmap,
+                               &ioid_other, NULL, NULL, NULL)))
+        return ret;
+    if (!(iodesc_other = pio_get_iodesc_from_id(ioid_other)))
+        return ERR_WRONG;
+
+    /* The decompositions with the same map share the setup. */
+    if (!iodesc[0]->nshared || *iodesc[0]->nshared != NUM_SHARED)
+        return ERR_WRONG;
+    for (int d = 1; d < NUM_SHARED; d++)
+        if (iodesc[d]->nshared != iodesc[0]->nshared ||
+            iodesc[d]->firstregion != iodesc[0]->firstregion ||
+            iodesc[d]->llen != iodesc[0]->llen || iodesc[d]->ndof != maplen)
+            return ERR_WRONG;
+    if (iodesc_other->nshared || iodesc_other->firstregion == iodesc[0]->firstregion)
+        return ERR_WRONG;
+
+    /* The type dependent parts are not shared. */
+    if (iodesc[2]->piotype != PIO_DOUBLE || iodesc[2]->mpitype_size != sizeof(double))
+        return ERR_WRONG;
+
+    /* Free the decomposition the setup was computed for. */
+    if ((ret = PIOc_freedecomp(iosysid, ioid[0])))
+        return ret;
+    if (*iodesc[1]->nshared != NUM_SHARED - 1)
+        return ERR_WRONG;
+
+    /* Write and read data with a decomposition sharing the setup. */
+    sprintf(filename, "%s_shared_%d.nc", TEST_NAME, flavor[0]);
+    if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[0], filename, PIO_CLOBBER)))
+        return ret;
+    if ((ret = PIOc_def_dim(ncid, "x", X_DIM_LEN, &dimids[0])))
+        return ret;
+    if ((ret = PIOc_def_dim(ncid, "y", Y_DIM_LEN, &dimids[1])))
+        return ret;
+    if ((ret = PIOc_def_var(ncid, "foo", PIO_DOUBLE, NDIM2, dimids, &varid)))
+        return ret;
+    if ((ret = PIOc_enddef(ncid)))
+        return ret;
+    if ((ret = PIOc_write_darray(ncid, varid, ioid[2], maplen, test_data, NULL)))
+        return ret;
+    if ((ret = PIOc_sync(ncid)))
+        return ret;
+    if ((ret = PIOc_read_darray(ncid, varid, ioid[2], maplen, test_data_in)))
+        return ret;
+    for (int i = 0; i < maplen; i++)
+        if (test_data_in[i] != test_data[i])
+            return ERR_WRONG;
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    for (int d = 1; d < NUM_SHARED; d++)
+        if ((ret = PIOc_freedecomp(iosysid, ioid[d])))
+            return ret;
+    if ((ret = PIOc_freedecomp(iosysid, ioid_other)))
+        return ret;
+
+    return 0;
+}
+
+/**
+ * Test the rearranger plan cache. The setup of a decomposition
+ * created again after being freed is loaded from the cache, and is
+ * the setup computed for the first decomposition.
+ *
+ * @param iosysid the IO system ID.
+ * @param my_rank the 0-based rank of this task.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_decomp_plan_cache(int iosysid, int my_rank, int num_flavors, int *flavor)
+{
+#define MAPLEN (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS)
+    int ioid;
+    io_desc_t *iodesc;
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];
+    PIO_Offset compmap[MAPLEN];
+    PIO_Offset sindex[MAPLEN];
+    PIO_Offset llen;
+    int nrecvs;
+    int test_data[MAPLEN];
+    int test_data_in[MAPLEN];
+    char filename[PIO_MAX_NAME + 1];
+    int ncid, varid;
+    int ret;
+
+    /* A cyclic decomposition. */
+    for (int i = 0; i < MAPLEN; i++)
+    {
+        compmap[i] = i * TARGET_NTASKS + my_rank + 1;
+        test_data[i] = my_rank * 10 + i;
+    }
+
+    if ((ret = PIOc_set_rearr_plan_cache(iosysid, ".")))
+        return ret;
+
+    /* The plan is saved to the cache, unless it was saved by an
+     * earlier run. */
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM2, dim_len_2d, MAPLEN, compmap, &ioid,
+                               NULL, NULL, NULL)))
+        return ret;
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return ERR_WRONG;
+    llen = iodesc->llen;
+    nrecvs = iodesc->nrecvs;
+    memcpy(sindex, iodesc->sindex, MAPLEN * sizeof(PIO_Offset));
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        return ret;
+
+    /* The plan is loaded from the cache. */
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM2, dim_len_2d, MAPLEN, compmap, &ioid,
+                               NULL, NULL, NULL)))
+        return ret;
+    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+        return ERR_WRONG;
+    if (iodesc->setup.load_time <= 0 || iodesc->llen != llen || iodesc->nrecvs != nrecvs ||
+        memcmp(iodesc->sindex, sindex, MAPLEN * sizeof(PIO_Offset)))
+        return ERR_WRONG;
+
+    /* Write and read data with the loaded plan. */
+    sprintf(filename, "%s_plan_cache_%d.nc", TEST_NAME, flavor[0]);
+    if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[0], filename, PIO_CLOBBER)))
+        return ret;
+    if ((ret = PIOc_def_dim(ncid, "x", X_DIM_LEN, &dimids[0])))
+        return ret;
+    if ((ret = PIOc_def_dim(ncid, "y", Y_DIM_LEN, &dimids[1])))
+        return ret;
+    if ((ret = PIOc_def_var(ncid, "foo", PIO_INT, NDIM2, dimids, &varid)))
+        return ret;
+    if ((ret = PIOc_enddef(ncid)))
+        return ret;
+    if ((ret = PIOc_write_darray(ncid, varid, ioid, MAPLEN, test_data, NULL)))
+        return ret;
+    if ((ret = PIOc_sync(ncid)))
+        return ret;
+    if ((ret = PIOc_read_darray(ncid, varid, ioid, MAPLEN, test_data_in)))
+        return ret;
+    for (int i = 0; i < MAPLEN; i++)
+        if (test_data_in[i] != test_data[i])
+            return ERR_WRONG;
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        return ret;
+    if ((ret = PIOc_set_rearr_plan_cache(iosysid, NULL)))
+        return ret;
+
+    return 0;
+}
+
+/**
+ * Test the merging of holes into the data regions. Every other
+ * element of the block of each task is a hole, so the holes and the
+ * data of a task are written in one region, with no fill regions.
+ *
+ * @param iosysid the IO system ID.
+ * @param my_rank the 0-based rank of this task.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_decomp_merged_holes(int iosysid, int my_rank, int num_flavors, int *flavor)
+{
+    int ioid;
+    iosystem_desc_t *ios;
+    io_desc_t *iodesc;
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];
+    PIO_Offset compmap[MAPLEN];
+    int test_data[MAPLEN];
+    int test_data_in[X_DIM_LEN * Y_DIM_LEN];
+    int fillvalue = -999;
+    char filename[PIO_MAX_NAME + 1];
+    int ncid, varid;
+    int ret;
+
+    /* A block decomposition with a hole in every other element. */
+    for (int i = 0; i < MAPLEN; i++)
+    {
+        compmap[i] = i % 2 ? 0 : my_rank * MAPLEN + i + 1;
+        test_data[i] = my_rank * 10 + i;
+    }
+
+    if ((ret = PIOc_InitDecomp(iosysid, PIO_INT, NDIM2, dim_len_2d, MAPLEN, compmap, &ioid,
+                               NULL, NULL, NULL)))
+        return ret;
+    if (!(ios = pio_get_iosystem_from_id(iosysid)) || !(iodesc = pio_get_iodesc_from_id(ioid)))
+        return ERR_WRONG;
+    if (!iodesc->needsfill || iodesc->maxfillregions)
+        return ERR_WRONG;
+    if (ios->ioproc && (iodesc->mergedholes != MAPLEN / 2 || iodesc->llen != MAPLEN ||
+                        iodesc->maxregions != 1))
+        return ERR_WRONG;
+
+    /* The holes get the fill value. */
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        sprintf(filename, "%s_merged_holes_%d.nc", TEST_NAME, flavor[fmt]);
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            return ret;
+        if ((ret = PIOc_def_dim(ncid, "x", X_DIM_LEN, &dimids[0])))
+            return ret;
+        if ((ret = PIOc_def_dim(ncid, "y", Y_DIM_LEN, &dimids[1])))
+            return ret;
+        if ((ret = PIOc_def_var(ncid, "foo", PIO_INT, NDIM2, dimids, &varid)))
+            return ret;
+        if ((ret = PIOc_enddef(ncid)))
+            return ret;
+        if ((ret = PIOc_write_darray(ncid, varid, ioid, MAPLEN, test_data, &fillvalue)))
+            return ret;
+        if ((ret = PIOc_sync(ncid)))
+            return ret;
+        if ((ret = PIOc_get_var_int(ncid, varid, test_data_in)))
+            return ret;
+        for (int i = 0; i < X_DIM_LEN * Y_DIM_LEN; i++)
+            if (test_data_in[i] != (i % 2 ? fillvalue : (i / MAPLEN) * 10 + i % MAPLEN))
+                return ERR_WRONG;
+        if ((ret = PIOc_closefile(ncid)))
+            return ret;
+    }
+
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        return ret;
+
+    return 0;
+}
+
 /** 
  * Test the decomp read/write functionality.
  *
@@ -385,6 +664,18 @@ int main(int argc, char **argv)
         if ((ret = test_decomp_bc(iosysid, my_rank, test_comm)))
             return ret;
 
+        /* Test the sharing of the setup of identical decompositions. */
+        if ((ret = test_decomp_shared(iosysid, my_rank, num_flavors, flavor)))
+            return ret;
+
+        /* Test the rearranger plan cache. */
+        if ((ret = test_decomp_plan_cache(iosysid, my_rank, num_flavors, flavor)))
+            return ret;
+
+        /* Test the merging of holes into the data regions. */
+        if ((ret = test_decomp_merged_holes(iosysid, my_rank, num_flavors, flavor)))
+            return ret;
+
         /* Decompose the data over the tasks. */
         if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d, &ioid,
                                            PIO_INT)))
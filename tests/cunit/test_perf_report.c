@@ -0,0 +1,232 @@
+/*
+ * Tests for the I/O performance reports written when files are
+ * closed (PIOc_set_perf_report()).
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_perf_report"
+
+/* The number of dimensions in the example data. */
+#define NDIM2 2
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The name of the variable in the netCDF output files. */
+#define VAR_NAME "foo"
+
+/* Max length of a line of a report. */
+#define MAX_LINE_LEN 4096
+
+/* The dimension names. */
+char dim_name[NDIM2][PIO_MAX_NAME + 1] = {"x", "y"};
+
+/**
+ * Turn on the I/O performance reports with the given format, then
+ * write and read a variable with each iotype, and check that a report
+ * was written for each file closed.
+ *
+ * The report of each file closed is a line in a JSON report. A CSV
+ * report has a header, and a line for the variable and a line for the
+ * totals of each file closed.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param format the format of the reports.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_perf_report(int iosysid, int ioid, int num_flavors, int *flavor, int format,
+                     int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    char rname[PIO_MAX_NAME + 1];    /* Name of the report file. */
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];    /* The dimension IDs. */
+    int ncid;             /* The ncid of the netCDF file. */
+    int varid;            /* The ID of the netCDF varable. */
+    int test_data[ARRAYLEN];
+    int test_data_in[ARRAYLEN];
+    int ret;              /* Return code. */
+
+    /* Initialize some data. */
+    for (int f = 0; f < ARRAYLEN; f++)
+        test_data[f] = my_rank * 10 + f;
+
+    /* Remove any old report, the reports are appended to the file. */
+    sprintf(rname, "pio_perf_report_%d.%s", iosysid,
+            (format == PIO_PERF_REPORT_CSV) ? "csv" : "json");
+    if (!my_rank)
+        remove(rname);
+
+    /* This should not work. */
+    if (PIOc_set_perf_report(iosysid, PIO_PERF_REPORT_CSV + 1) != PIO_EINVAL)
+        ERR(ERR_WRONG);
+
+    /* Turn on the reports. */
+    if ((ret = PIOc_set_perf_report(iosysid, format)))
+        ERR(ret);
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        /* Create the filename. */
+        sprintf(filename, "data_%s_iotype_%d.nc", TEST_NAME, flavor[fmt]);
+
+        /* Create the netCDF output file. */
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+
+        /* Define netCDF dimensions and variables. */
+        for (int d = 0; d < NDIM2; d++)
+            if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len_2d[d], &dimids[d])))
+                ERR(ret);
+        if ((ret = PIOc_def_var(ncid, VAR_NAME, PIO_INT, NDIM2, dimids, &varid)))
+            ERR(ret);
+
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        /* Write the data. */
+        if ((ret = PIOc_write_darray(ncid, varid, ioid, ARRAYLEN, test_data, NULL)))
+            ERR(ret);
+
+        /* Close the netCDF file, this writes a report. */
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+
+        /* Reopen the file and check the data. */
+        if ((ret = PIOc_openfile(iosysid, &ncid, &flavor[fmt], filename, PIO_NOWRITE)))
+            ERR(ret);
+
+        if ((ret = PIOc_read_darray(ncid, varid, ioid, ARRAYLEN, test_data_in)))
+            ERR(ret);
+        for (int f = 0; f < ARRAYLEN; f++)
+            if (test_data_in[f] != test_data[f])
+                return ERR_WRONG;
+
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    } /* next iotype */
+
+    /* Turn off the reports. */
+    if ((ret = PIOc_set_perf_report(iosysid, PIO_PERF_REPORT_NONE)))
+        ERR(ret);
+
+    /* The IO root (rank 0) writes the reports, check them. */
+    if (!my_rank)
+    {
+        char line[MAX_LINE_LEN];
+        int nlines = 0;
+        int nlines_var = 0;
+        FILE *fp;
+
+        if (!(fp = fopen(rname, "r")))
+            ERR(ERR_WRONG);
+        while (fgets(line, MAX_LINE_LEN, fp))
+        {
+            nlines++;
+            if (format == PIO_PERF_REPORT_JSON && strstr(line, "\"name\":\"" VAR_NAME "\""))
+                nlines_var++;
+            if (format == PIO_PERF_REPORT_CSV && strstr(line, ",\"" VAR_NAME "\","))
+                nlines_var++;
+        }
+        fclose(fp);
+
+        if (format == PIO_PERF_REPORT_JSON)
+        {
+            if (nlines != 2 * num_flavors || nlines_var != 2 * num_flavors)
+                ERR(ERR_WRONG);
+        }
+        else
+        {
+            if (nlines != 1 + 4 * num_flavors || nlines_var != 2 * num_flavors)
+                ERR(ERR_WRONG);
+        }
+    }
+
+    return PIO_NOERR;
+}
+
+/* Run tests for the I/O performance reports. */
+int main(int argc, char **argv)
+{
+#define NUM_FORMATS_TO_TEST 2
+    int format[NUM_FORMATS_TO_TEST] = {PIO_PERF_REPORT_JSON, PIO_PERF_REPORT_CSV};
+    int my_rank;
+    int ntasks;
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              MIN_NTASKS, 3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+        int ioid;     /* The ID of the decomposition. */
+        int ioproc_stride = 1;    /* Stride in the mpi rank between io tasks. */
+        int ioproc_start = 0;     /* Zero based rank of first processor to be used for I/O. */
+        int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        for (int f = 0; f < NUM_FORMATS_TO_TEST; f++)
+        {
+            /* Initialize the PIO IO system. */
+            if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, ioproc_stride,
+                                           ioproc_start, PIO_REARR_SUBSET, &iosysid)))
+                return ret;
+
+            /* Decompose the data over the tasks. */
+            if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                               &ioid, PIO_INT)))
+                return ret;
+
+            /* Run tests. */
+            if ((ret = test_perf_report(iosysid, ioid, num_flavors, flavor, format[f],
+                                        my_rank)))
+                return ret;
+
+            /* Free the PIO decomposition. */
+            if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                ERR(ret);
+
+            /* Finalize PIO system. */
+            if ((ret = PIOc_finalize(iosysid)))
+                return ret;
+        } /* next format */
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
@@ -1316,10 +1316,11 @@ int test_nc4(int iosysid, int num_flavors, int *flavor, int my_rank)
             if ((ret = PIOc_def_var_chunking(ncid, 0, NC_CHUNKED, chunksize)))
                 ERR(ret);
 
-            /* Setting deflate should not work with parallel iotype. */
+            /* Setting deflate should not work with parallel iotype,
+             * unless netCDF supports filters with parallel I/O. */
             printf("%d Defining deflate\n", my_rank);
             ret = PIOc_def_var_deflate(ncid, 0, 0, 1, 1);
-            if (flavor[fmt] == PIO_IOTYPE_NETCDF4P)
+            if (flavor[fmt] == PIO_IOTYPE_NETCDF4P && !PIO_HAS_PAR_FILTERS)
             {
                 if (ret == PIO_NOERR)
                     ERR(ERR_WRONG);
@@ -1356,12 +1357,14 @@ int test_nc4(int iosysid, int num_flavors, int *flavor, int my_rank)
                 ERR(ret);
 
             /* For serial netCDF-4 deflate is turned on by default */
-            if (flavor[fmt] == PIO_IOTYPE_NETCDF4C)
+            if (flavor[fmt] == PIO_IOTYPE_NETCDF4C ||
+                (flavor[fmt] == PIO_IOTYPE_NETCDF4P && PIO_HAS_PAR_FILTERS))
                 if (shuffle || !deflate || deflate_level != 1)
                     ERR(ERR_AWFUL);
 
-            /* For parallel netCDF-4, no compression available. :-( */
-            if (flavor[fmt] == PIO_IOTYPE_NETCDF4P)
+            /* For parallel netCDF-4, compression is only available
+             * if netCDF supports filters with parallel I/O. */
+            if (flavor[fmt] == PIO_IOTYPE_NETCDF4P && !PIO_HAS_PAR_FILTERS)
                 if (shuffle || deflate)
                     ERR(ERR_AWFUL);
 
@@ -251,6 +251,71 @@ int run_multiple_unlim_test(int iosysid, int ioid, int iotype, int my_rank,
     return PIO_NOERR;
 }
 
+/* Create and open several files at once, with the unlimited
+ * dimension at a different position in each file. */
+int run_openfiles_test(int iosysid, int iotype, int my_rank)
+{
+#define NUM_BATCH_FILES 3
+    char names[NUM_BATCH_FILES + 1][PIO_MAX_NAME + 1];
+    const char *filenames[NUM_BATCH_FILES + 1];
+    int ncids[NUM_BATCH_FILES + 1];
+    int old_eh;
+    int ret;
+
+    for (int f = 0; f <= NUM_BATCH_FILES; f++)
+    {
+        sprintf(names[f], "%s_batch_%d_iotype_%d.nc", TEST_NAME, f, iotype);
+        filenames[f] = names[f];
+    }
+
+    /* Create the files, the last one is never created. */
+    if ((ret = PIOc_createfiles(iosysid, NUM_BATCH_FILES, ncids, &iotype, filenames,
+                                PIO_CLOBBER)))
+        ERR(ret);
+    for (int f = 0; f < NUM_BATCH_FILES; f++)
+    {
+        int dimid;
+
+        for (int d = 0; d < f; d++)
+            if ((ret = PIOc_def_dim(ncids[f], dim_name[d + 1], (PIO_Offset)dim_len[d + 1], &dimid)))
+                ERR(ret);
+        if ((ret = PIOc_def_dim(ncids[f], dim_name[0], NC_UNLIMITED, &dimid)))
+            ERR(ret);
+        if ((ret = PIOc_closefile(ncids[f])))
+            ERR(ret);
+    }
+
+    /* Open the files and check their unlimited dimensions. */
+    if ((ret = PIOc_openfiles(iosysid, NUM_BATCH_FILES, ncids, &iotype, filenames, PIO_NOWRITE)))
+        ERR(ret);
+    for (int f = 0; f < NUM_BATCH_FILES; f++)
+    {
+        int nunlimdims;
+        int unlimdimid;
+
+        if (f && ncids[f] == ncids[f - 1])
+            ERR(ERR_WRONG);
+        if ((ret = PIOc_inq_unlimdims(ncids[f], &nunlimdims, &unlimdimid)))
+            ERR(ret);
+        if (nunlimdims != 1 || unlimdimid != f)
+            ERR(ERR_WRONG);
+        if ((ret = PIOc_closefile(ncids[f])))
+            ERR(ret);
+    }
+
+    /* Opening a batch with a missing file fails. */
+    if ((ret = PIOc_set_iosystem_error_handling(iosysid, PIO_BCAST_ERROR, &old_eh)))
+        ERR(ret);
+    if (PIOc_openfiles(iosysid, NUM_BATCH_FILES + 1, ncids, &iotype, filenames,
+                       PIO_NOWRITE) == PIO_NOERR)
+        ERR(ERR_WRONG);
+    if ((ret = PIOc_set_iosystem_error_handling(iosysid, old_eh, NULL)))
+        ERR(ret);
+
+    printf("%d %s batch of files with iotype %d ok\n", my_rank, TEST_NAME, iotype);
+    return PIO_NOERR;
+}
+
 /* Run all the tests. */
 int test_all(int iosysid, int num_flavors, int *flavor, int my_rank, MPI_Comm test_comm,
              int async)
@@ -298,6 +363,10 @@ int test_all(int iosysid, int num_flavors, int *flavor, int my_rank, MPI_Comm te
             if ((PIOc_closefile(ncid)))
                 return ret;
 
+            /* Create and open a batch of files. */
+            if ((ret = run_openfiles_test(iosysid, flavor[fmt], my_rank)))
+                return ret;
+
             /* Test file with multiple unlimited dims. Only netCDF-4
              * iotypes can run this test. */
             if (flavor[fmt] == PIO_IOTYPE_NETCDF4C || flavor[fmt] == PIO_IOTYPE_NETCDF4P)
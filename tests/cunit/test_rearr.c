@@ -105,6 +105,31 @@ int test_compare_offsets()
     return 0;
 }
 
+/* Test the merge_sorted_maps() function. */
+int test_merge_sorted_maps()
+{
+#define NRUNS 4
+#define MERGE_LEN 9
+    /* The last run is empty, the first and third have an equal offset. */
+    int runlen[NRUNS] = {3, 4, 2, 0};
+    int rundispls[NRUNS] = {0, 3, 7, 9};
+    PIO_Offset iomap[MERGE_LEN] = {2, 5, 9, 1, 3, 4, 8, 5, 6};
+    PIO_Offset srcindex[MERGE_LEN] = {10, 11, 12, 20, 21, 22, 23, 30, 31};
+    PIO_Offset expected_iomap[MERGE_LEN] = {1, 2, 3, 4, 5, 5, 6, 8, 9};
+    int expected_rfrom[MERGE_LEN] = {1, 0, 1, 1, 0, 2, 2, 1, 0};
+    PIO_Offset expected_soffset[MERGE_LEN] = {20, 10, 21, 22, 11, 30, 31, 23, 12};
+    mapsort map[MERGE_LEN];
+
+    if (merge_sorted_maps(NRUNS, runlen, rundispls, iomap, srcindex, map) != MERGE_LEN)
+        return ERR_WRONG;
+    for (int i = 0; i < MERGE_LEN; i++)
+        if (map[i].iomap != expected_iomap[i] || map[i].rfrom != expected_rfrom[i] ||
+            map[i].soffset != expected_soffset[i])
+            return ERR_WRONG;
+
+    return 0;
+}
+
 /* Test the ceil2() and pair() functions. */
 int test_ceil2_pair()
 {
@@ -217,6 +242,40 @@ int test_idx_to_dim_list()
     return 0;
 }
 
+/* Test the idx_to_dim_list_incr() function, the results must be the
+ * same as the results of idx_to_dim_list(). */
+int test_idx_to_dim_list_incr()
+{
+#define NDIM3 3
+    int gdims[NDIM3] = {3, 4, 5};
+    PIO_Offset gsize = 3 * 4 * 5;
+    PIO_Offset prev_dim_list[NDIM3];
+    PIO_Offset dim_list[NDIM3];
+    PIO_Offset expected[NDIM3];
+
+    /* Indices ahead of the previous one by up to more than the size of
+     * the fastest varying dimension, across the end of the array. */
+    for (PIO_Offset prev_idx = -1; prev_idx < gsize; prev_idx++)
+        for (PIO_Offset idx = max(prev_idx - 1, -1); idx < prev_idx + 2 * gdims[NDIM3 - 1] &&
+                 idx < gsize; idx++)
+        {
+            idx_to_dim_list(NDIM3, gdims, prev_idx, prev_dim_list);
+            idx_to_dim_list(NDIM3, gdims, idx, expected);
+            idx_to_dim_list_incr(NDIM3, gdims, idx, prev_idx, prev_dim_list, dim_list);
+            for (int d = 0; d < NDIM3; d++)
+                if (dim_list[d] != expected[d])
+                    return ERR_WRONG;
+
+            /* The previous coordinates may be updated in place. */
+            idx_to_dim_list_incr(NDIM3, gdims, idx, prev_idx, prev_dim_list, prev_dim_list);
+            for (int d = 0; d < NDIM3; d++)
+                if (prev_dim_list[d] != expected[d])
+                    return ERR_WRONG;
+        }
+
+    return 0;
+}
+
 /* Test the coord_to_lindex() function. */
 int test_coord_to_lindex()
 {
@@ -1269,6 +1328,10 @@ int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
     if ((ret = test_idx_to_dim_list()))
         return ret;
 
+    printf("%d running idx_to_dim_list_incr tests\n", my_rank);
+    if ((ret = test_idx_to_dim_list_incr()))
+        return ret;
+
     printf("%d running coord_to_lindex tests\n", my_rank);
     if ((ret = test_coord_to_lindex()))
         return ret;
@@ -1289,6 +1352,10 @@ int run_no_iosys_tests(int my_rank, MPI_Comm test_comm)
     if ((ret = test_find_region()))
         return ret;
 
+    printf("%d running tests for merge_sorted_maps()\n", my_rank);
+    if ((ret = test_merge_sorted_maps()))
+        return ret;
+
     printf("%d running tests for get_regions()\n", my_rank);
     if ((ret = test_get_regions(my_rank)))
         return ret;
@@ -0,0 +1,503 @@
+/*
+ * Stress tests for the thread-safe mode of the C API
+ * (PIOc_set_threadsafe()). Threads of each task create, define and
+ * write independent files concurrently, each on its own IO system
+ * (with PnetCDF only), then write different variables of the same
+ * file concurrently. Also tests the I/O thread
+ * (PIOc_set_io_thread()).
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+#include <pthread.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_threadsafe"
+
+/* The number of threads of each task. */
+#define NUM_THREADS 4
+
+/* The number of variables written by each thread to the shared
+ * file. */
+#define NUM_THREAD_VARS 3
+
+/* The number of records written of each variable. */
+#define NUM_FRAMES 3
+
+/* The number of dimensions in the example data. */
+#define NDIM2 2
+#define NDIM3 3
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The dimension names. */
+char dim_name[NDIM3][PIO_MAX_NAME + 1] = {"time", "x", "y"};
+
+/* Arguments and result of a thread. */
+typedef struct thread_arg_t
+{
+    /* Index of the thread. */
+    int t;
+
+    /* Rank of this task. */
+    int my_rank;
+
+    /* The IO system used by the thread. */
+    int iosysid;
+
+    /* The iotype of the files. */
+    int iotype;
+
+    /* The ncid of the shared file and the ID of its decomposition. */
+    int ncid;
+    int ioid;
+
+    /* Return code of the thread. */
+    int ret;
+} thread_arg_t;
+
+/* The value written at global index g of the record frame of the
+ * variable varid. */
+static int test_value(int varid, int frame, int g)
+{
+    return varid * 1000 + frame * 100 + g;
+}
+
+/**
+ * Check the values of a record of a variable of a file.
+ *
+ * @param ncid the ncid of the file.
+ * @param varid the ID of the variable.
+ * @param frame the record, -1 if the variable has no record
+ * dimension.
+ * @param value_varid the variable ID used to compute the values.
+ * @returns 0 for success, error code otherwise.
+ */
+static int check_var(int ncid, int varid, int frame, int value_varid)
+{
+    int data[X_DIM_LEN * Y_DIM_LEN];
+    PIO_Offset start[NDIM3] = {0, 0, 0};
+    PIO_Offset count[NDIM3] = {1, X_DIM_LEN, Y_DIM_LEN};
+    int ret;
+
+    if (frame >= 0)
+    {
+        start[0] = frame;
+        ret = PIOc_get_vara_int(ncid, varid, start, count, data);
+    }
+    else
+        ret = PIOc_get_var_int(ncid, varid, data);
+    if (ret)
+        return ret;
+
+    for (int g = 0; g < X_DIM_LEN * Y_DIM_LEN; g++)
+        if (data[g] != test_value(value_varid, (frame >= 0) ? frame : 0, g))
+            return ERR_WRONG;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Create, define, write and check a file on the IO system of a
+ * thread.
+ *
+ * @param arg pointer to the thread_arg_t of the thread.
+ * @returns NULL.
+ */
+static void *write_own_file(void *arg)
+{
+    thread_arg_t *targ = (thread_arg_t *)arg;
+    char filename[PIO_MAX_NAME + 1];
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];
+    int data[ARRAYLEN];
+    int ncid, varid, ioid;
+    int ret;
+
+    sprintf(filename, "%s_file_%d_iotype_%d.nc", TEST_NAME, targ->t, targ->iotype);
+
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, targ->my_rank, targ->iosysid,
+                                       dim_len_2d, &ioid, PIO_INT)))
+    {
+        targ->ret = ret;
+        return NULL;
+    }
+
+    for (int i = 0; i < ARRAYLEN; i++)
+        data[i] = test_value(targ->t, 0, targ->my_rank * ARRAYLEN + i);
+
+    if ((ret = PIOc_createfile(targ->iosysid, &ncid, &targ->iotype, filename, PIO_CLOBBER)))
+        targ->ret = ret;
+    for (int d = 0; !targ->ret && d < NDIM2; d++)
+        if ((ret = PIOc_def_dim(ncid, dim_name[d + 1], (PIO_Offset)dim_len_2d[d], &dimids[d])))
+            targ->ret = ret;
+    if (!targ->ret && (ret = PIOc_def_var(ncid, "foo", PIO_INT, NDIM2, dimids, &varid)))
+        targ->ret = ret;
+    if (!targ->ret && (ret = PIOc_enddef(ncid)))
+        targ->ret = ret;
+    if (!targ->ret && (ret = PIOc_write_darray(ncid, varid, ioid, ARRAYLEN, data, NULL)))
+        targ->ret = ret;
+    if (!targ->ret && (ret = PIOc_closefile(ncid)))
+        targ->ret = ret;
+
+    /* Check the file. */
+    if (!targ->ret && (ret = PIOc_openfile(targ->iosysid, &ncid, &targ->iotype, filename,
+                                           PIO_NOWRITE)))
+        targ->ret = ret;
+    if (!targ->ret)
+    {
+        targ->ret = check_var(ncid, 0, -1, targ->t);
+        if ((ret = PIOc_closefile(ncid)) && !targ->ret)
+            targ->ret = ret;
+    }
+
+    if ((ret = PIOc_freedecomp(targ->iosysid, ioid)) && !targ->ret)
+        targ->ret = ret;
+
+    return NULL;
+}
+
+/**
+ * Write the variables of a thread to the shared file, for all
+ * records. Odd tasks write the variables and records in the reverse
+ * order.
+ *
+ * @param arg pointer to the thread_arg_t of the thread.
+ * @returns NULL.
+ */
+static void *write_shared_vars(void *arg)
+{
+    thread_arg_t *targ = (thread_arg_t *)arg;
+    int data[ARRAYLEN];
+    int ret;
+
+    for (int n = 0; n < NUM_THREAD_VARS * NUM_FRAMES; n++)
+    {
+        int k = (targ->my_rank % 2) ? NUM_THREAD_VARS * NUM_FRAMES - 1 - n : n;
+        int varid = targ->t * NUM_THREAD_VARS + k / NUM_FRAMES;
+        int frame = k % NUM_FRAMES;
+
+        for (int i = 0; i < ARRAYLEN; i++)
+            data[i] = test_value(varid, frame, targ->my_rank * ARRAYLEN + i);
+
+        if ((ret = PIOc_setframe(targ->ncid, varid, frame)) ||
+            (ret = PIOc_write_darray(targ->ncid, varid, targ->ioid, ARRAYLEN, data, NULL)))
+        {
+            targ->ret = ret;
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Create and define independent files concurrently, one per thread,
+ * each thread with its own IO system.
+ *
+ * @param test_comm the communicator of the test.
+ * @param iotype the iotype of the files.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_threaded_files(MPI_Comm test_comm, int iotype, int my_rank)
+{
+    pthread_t threads[NUM_THREADS];
+    thread_arg_t targs[NUM_THREADS];
+    int ret;
+
+    /* Each thread uses its own IO system. */
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        targs[t].t = t;
+        targs[t].my_rank = my_rank;
+        targs[t].iotype = iotype;
+        targs[t].ret = PIO_NOERR;
+        if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, 1, 0, PIO_REARR_BOX,
+                                       &targs[t].iosysid)))
+            return ret;
+        if ((ret = PIOc_set_threadsafe(targs[t].iosysid, 1)))
+            return ret;
+    }
+
+    for (int t = 0; t < NUM_THREADS; t++)
+        if (pthread_create(&threads[t], NULL, write_own_file, &targs[t]))
+            return ERR_AWFUL;
+    for (int t = 0; t < NUM_THREADS; t++)
+        if (pthread_join(threads[t], NULL))
+            return ERR_AWFUL;
+
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        if (targs[t].ret)
+            return targs[t].ret;
+        if ((ret = PIOc_finalize(targs[t].iosysid)))
+            return ret;
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write different variables of the same file concurrently, each
+ * thread writes NUM_THREAD_VARS record variables.
+ *
+ * @param iosysid the IO system ID.
+ * @param iotype the iotype of the file.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_threaded_vars(int iosysid, int iotype, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1];
+    int dim_len_3d[NDIM3] = {NC_UNLIMITED, X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM3];
+    pthread_t threads[NUM_THREADS];
+    thread_arg_t targs[NUM_THREADS];
+    int ncid, ioid;
+    int ret;
+
+    sprintf(filename, "%s_shared_iotype_%d.nc", TEST_NAME, iotype);
+
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, &dim_len_3d[1],
+                                       &ioid, PIO_INT)))
+        return ret;
+
+    if ((ret = PIOc_createfile(iosysid, &ncid, &iotype, filename, PIO_CLOBBER)))
+        return ret;
+    for (int d = 0; d < NDIM3; d++)
+        if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len_3d[d], &dimids[d])))
+            return ret;
+    for (int v = 0; v < NUM_THREADS * NUM_THREAD_VARS; v++)
+    {
+        char var_name[PIO_MAX_NAME + 1];
+        int varid;
+
+        sprintf(var_name, "var_%d", v);
+        if ((ret = PIOc_def_var(ncid, var_name, PIO_INT, NDIM3, dimids, &varid)))
+            return ret;
+    }
+    if ((ret = PIOc_enddef(ncid)))
+        return ret;
+
+    if ((ret = PIOc_set_threadsafe(iosysid, 1)))
+        return ret;
+
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        targs[t].t = t;
+        targs[t].my_rank = my_rank;
+        targs[t].ncid = ncid;
+        targs[t].ioid = ioid;
+        targs[t].ret = PIO_NOERR;
+        if (pthread_create(&threads[t], NULL, write_shared_vars, &targs[t]))
+            return ERR_AWFUL;
+    }
+    for (int t = 0; t < NUM_THREADS; t++)
+        if (pthread_join(threads[t], NULL))
+            return ERR_AWFUL;
+    for (int t = 0; t < NUM_THREADS; t++)
+        if (targs[t].ret)
+            return targs[t].ret;
+
+    /* Flush the data cached by all the threads. */
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+    if ((ret = PIOc_set_threadsafe(iosysid, 0)))
+        return ret;
+
+    /* Check the file. */
+    if ((ret = PIOc_openfile(iosysid, &ncid, &iotype, filename, PIO_NOWRITE)))
+        return ret;
+    for (int v = 0; v < NUM_THREADS * NUM_THREAD_VARS; v++)
+        for (int f = 0; f < NUM_FRAMES; f++)
+            if ((ret = check_var(ncid, v, f, v)))
+                return ret;
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        return ret;
+
+    return PIO_NOERR;
+}
+
+/**
+ * Write records of a file with the I/O thread, syncing after each
+ * record, and read them back before and after closing the file.
+ *
+ * @param iosysid the IO system ID.
+ * @param iotype the iotype of the file.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_io_thread(int iosysid, int iotype, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1];
+    int dim_len_3d[NDIM3] = {NC_UNLIMITED, X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM3];
+    int data[ARRAYLEN];
+    int ncid, varid, ioid;
+    int ret;
+
+    sprintf(filename, "%s_io_thread_iotype_%d.nc", TEST_NAME, iotype);
+
+    /* The I/O thread is not supported with the micro timers. */
+    ret = PIOc_set_io_thread(iosysid, 1);
+    if (PIO_USE_MICRO_TIMING)
+        return ret == PIO_ENOTBUILT ? PIO_NOERR : ERR_WRONG;
+    if (ret)
+        return ret;
+
+    if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, &dim_len_3d[1],
+                                       &ioid, PIO_INT)))
+        return ret;
+
+    if ((ret = PIOc_createfile(iosysid, &ncid, &iotype, filename, PIO_CLOBBER)))
+        return ret;
+    for (int d = 0; d < NDIM3; d++)
+        if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len_3d[d], &dimids[d])))
+            return ret;
+    if ((ret = PIOc_def_var(ncid, "var_0", PIO_INT, NDIM3, dimids, &varid)))
+        return ret;
+    if ((ret = PIOc_enddef(ncid)))
+        return ret;
+
+    /* The wait for each record is handed off to the I/O thread, and
+     * completed before the sync returns. */
+    for (int f = 0; f < NUM_FRAMES; f++)
+    {
+        for (int i = 0; i < ARRAYLEN; i++)
+            data[i] = test_value(varid, f, my_rank * ARRAYLEN + i);
+        if ((ret = PIOc_setframe(ncid, varid, f)))
+            return ret;
+        if ((ret = PIOc_write_darray(ncid, varid, ioid, ARRAYLEN, data, NULL)))
+            return ret;
+        if ((ret = PIOc_sync(ncid)))
+            return ret;
+        if ((ret = check_var(ncid, varid, f, varid)))
+            return ret;
+    }
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    /* Check the file. */
+    if ((ret = PIOc_openfile(iosysid, &ncid, &iotype, filename, PIO_NOWRITE)))
+        return ret;
+    for (int f = 0; f < NUM_FRAMES; f++)
+        if ((ret = check_var(ncid, varid, f, varid)))
+            return ret;
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+
+    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+        return ret;
+
+    return PIOc_set_io_thread(iosysid, 0);
+}
+
+/* Run tests for the thread-safe mode. */
+int main(int argc, char **argv)
+{
+    int my_rank;
+    int ntasks;
+    int provided;    /* The thread level provided by MPI. */
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+#ifdef TIMING
+#ifndef TIMING_INTERNAL
+    /* Initialize the GPTL timing library. */
+    if ((ret = GPTLinitialize()))
+        return ERR_GPTL;
+#endif
+#endif
+
+    /* Initialize MPI, pio_test_init2() does not ask for a thread
+     * level. */
+    if ((ret = MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided)))
+        MPIERR(ret);
+    if ((ret = MPI_Comm_rank(MPI_COMM_WORLD, &my_rank)))
+        MPIERR(ret);
+    if ((ret = MPI_Comm_size(MPI_COMM_WORLD, &ntasks)))
+        MPIERR(ret);
+    if (ntasks < MIN_NTASKS)
+    {
+        fprintf(stderr, "ERROR: Number of processors must be at least %d for this test!\n",
+                MIN_NTASKS);
+        return ERR_AWFUL;
+    }
+    if ((ret = MPI_Comm_split(MPI_COMM_WORLD, (my_rank < TARGET_NTASKS) ? 0 : 1, my_rank,
+                              &test_comm)))
+        MPIERR(ret);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        /* Initialize the PIO IO system. */
+        if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, 1, 0, PIO_REARR_BOX,
+                                       &iosysid)))
+            return ret;
+
+        if (!PIO_USE_THREADSAFE || provided < MPI_THREAD_MULTIPLE)
+        {
+            /* The mode is not available. */
+            ret = PIOc_set_threadsafe(iosysid, 1);
+            if (ret != (PIO_USE_THREADSAFE ? PIO_EINVAL : PIO_ENOTBUILT))
+                ERR(ERR_WRONG);
+            ret = PIOc_set_io_thread(iosysid, 1);
+            if (ret != (PIO_USE_THREADSAFE && !PIO_USE_MICRO_TIMING ? PIO_EINVAL : PIO_ENOTBUILT))
+                ERR(ERR_WRONG);
+            printf("%d %s thread-safe mode not available, skipping tests\n", my_rank, TEST_NAME);
+        }
+        else
+        {
+            for (int fmt = 0; fmt < num_flavors; fmt++)
+            {
+                /* The netCDF library is not thread-safe, files are
+                 * only created concurrently with PnetCDF. */
+                if (flavor[fmt] == PIO_IOTYPE_PNETCDF)
+                    if ((ret = test_threaded_files(test_comm, flavor[fmt], my_rank)))
+                        ERR(ret);
+                if ((ret = test_threaded_vars(iosysid, flavor[fmt], my_rank)))
+                    ERR(ret);
+                if ((ret = test_io_thread(iosysid, flavor[fmt], my_rank)))
+                    ERR(ret);
+            }
+        }
+
+        /* Finalize PIO system. */
+        if ((ret = PIOc_finalize(iosysid)))
+            return ret;
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Tests for the event tracer (PIOc_set_trace()).
+ */
+#include <pio.h>
+#include <pio_internal.h>
+#include <pio_tests.h>
+
+/* The number of tasks this test should run on. */
+#define TARGET_NTASKS 4
+
+/* The minimum number of tasks this test should run on. */
+#define MIN_NTASKS 4
+
+/* The name of this test. */
+#define TEST_NAME "test_trace"
+
+/* The number of dimensions in the example data. */
+#define NDIM2 2
+
+/* The length of our sample data along each dimension. */
+#define X_DIM_LEN 4
+#define Y_DIM_LEN 4
+
+/* Length of the local arrays (X_DIM_LEN * Y_DIM_LEN / TARGET_NTASKS). */
+#define ARRAYLEN 4
+
+/* The name of the variable in the netCDF output files. */
+#define VAR_NAME "foo"
+
+/* Max length of a line of a trace. */
+#define MAX_LINE_LEN 4096
+
+/* The dimension names. */
+char dim_name[NDIM2][PIO_MAX_NAME + 1] = {"x", "y"};
+
+/**
+ * Write a variable with each iotype.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param flavor array of available iotypes.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int test_write(int iosysid, int ioid, int num_flavors, int *flavor, int my_rank)
+{
+    char filename[PIO_MAX_NAME + 1]; /* Name for the output files. */
+    int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+    int dimids[NDIM2];    /* The dimension IDs. */
+    int ncid;             /* The ncid of the netCDF file. */
+    int varid;            /* The ID of the netCDF varable. */
+    int test_data[ARRAYLEN];
+    int ret;              /* Return code. */
+
+    /* Initialize some data. */
+    for (int f = 0; f < ARRAYLEN; f++)
+        test_data[f] = my_rank * 10 + f;
+
+    for (int fmt = 0; fmt < num_flavors; fmt++)
+    {
+        sprintf(filename, "data_%s_iotype_%d.nc", TEST_NAME, flavor[fmt]);
+
+        if ((ret = PIOc_createfile(iosysid, &ncid, &flavor[fmt], filename, PIO_CLOBBER)))
+            ERR(ret);
+        for (int d = 0; d < NDIM2; d++)
+            if ((ret = PIOc_def_dim(ncid, dim_name[d], (PIO_Offset)dim_len_2d[d], &dimids[d])))
+                ERR(ret);
+        if ((ret = PIOc_def_var(ncid, VAR_NAME, PIO_INT, NDIM2, dimids, &varid)))
+            ERR(ret);
+        if ((ret = PIOc_enddef(ncid)))
+            ERR(ret);
+
+        if ((ret = PIOc_write_darray(ncid, varid, ioid, ARRAYLEN, test_data, NULL)))
+            ERR(ret);
+
+        if ((ret = PIOc_closefile(ncid)))
+            ERR(ret);
+    }
+
+    return PIO_NOERR;
+}
+
+/**
+ * Check the trace written by this task when the library was
+ * finalized. Each darray write and file create/close is traced.
+ *
+ * @param num_flavors the number of IOTYPES available in this build.
+ * @param my_rank rank of this task.
+ * @returns 0 for success, error code otherwise.
+ */
+int check_trace(int num_flavors, int my_rank)
+{
+    char tname[PIO_MAX_NAME + 1];
+    char line[MAX_LINE_LEN];
+    int nbegin_write = 0, nend_write = 0;
+    int nbegin_close = 0;
+    FILE *fp;
+
+    sprintf(tname, "pio_trace_%d.json", my_rank);
+    if (!(fp = fopen(tname, "r")))
+        return ERR_WRONG;
+    while (fgets(line, MAX_LINE_LEN, fp))
+    {
+        if (strstr(line, "\"name\":\"PIOc_write_darray\",\"cat\":\"pio\",\"ph\":\"B\""))
+            nbegin_write++;
+        if (strstr(line, "\"name\":\"PIOc_write_darray\",\"cat\":\"pio\",\"ph\":\"E\""))
+            nend_write++;
+        if (strstr(line, "\"name\":\"PIOc_closefile\",\"cat\":\"pio\",\"ph\":\"B\""))
+            nbegin_close++;
+    }
+    fclose(fp);
+
+    if (nbegin_write != num_flavors || nend_write != num_flavors || nbegin_close != num_flavors)
+        return ERR_WRONG;
+
+    return PIO_NOERR;
+}
+
+/* Run tests for the event tracer. */
+int main(int argc, char **argv)
+{
+    int my_rank;
+    int ntasks;
+    int num_flavors; /* Number of PIO netCDF flavors in this build. */
+    int flavor[NUM_FLAVORS]; /* iotypes for the supported netCDF IO flavors. */
+    MPI_Comm test_comm; /* A communicator for this test. */
+    int ret;         /* Return code. */
+
+    /* Initialize test. */
+    if ((ret = pio_test_init2(argc, argv, &my_rank, &ntasks, MIN_NTASKS,
+                              MIN_NTASKS, 3, &test_comm)))
+        ERR(ERR_INIT);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        return ret;
+
+    /* Only do something on max_ntasks tasks. */
+    if (my_rank < TARGET_NTASKS)
+    {
+        int iosysid;  /* The ID for the parallel I/O system. */
+        int ioid;     /* The ID of the decomposition. */
+        int ioproc_stride = 1;    /* Stride in the mpi rank between io tasks. */
+        int ioproc_start = 0;     /* Zero based rank of first processor to be used for I/O. */
+        int dim_len_2d[NDIM2] = {X_DIM_LEN, Y_DIM_LEN};
+
+        /* Figure out iotypes. */
+        if ((ret = get_iotypes(&num_flavors, flavor)))
+            ERR(ret);
+
+        /* Turn on the tracer. */
+        if (PIOc_set_trace(1) != 0)
+            ERR(ERR_WRONG);
+
+        /* Initialize the PIO IO system. */
+        if ((ret = PIOc_Init_Intracomm(test_comm, TARGET_NTASKS, ioproc_stride,
+                                       ioproc_start, PIO_REARR_BOX, &iosysid)))
+            return ret;
+
+        /* Decompose the data over the tasks. */
+        if ((ret = create_decomposition_2d(TARGET_NTASKS, my_rank, iosysid, dim_len_2d,
+                                           &ioid, PIO_INT)))
+            return ret;
+
+        /* Run tests. */
+        if ((ret = test_write(iosysid, ioid, num_flavors, flavor, my_rank)))
+            return ret;
+
+        /* Free the PIO decomposition. */
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            ERR(ret);
+
+        /* Finalize PIO system, this writes the trace. */
+        if ((ret = PIOc_finalize(iosysid)))
+            return ret;
+
+        /* Turn off the tracer. */
+        if (PIOc_set_trace(0) != 1)
+            ERR(ERR_WRONG);
+
+        /* The trace is only written if the tracer is built. */
+        if (PIO_USE_TRACE)
+            if ((ret = check_trace(num_flavors, my_rank)))
+                ERR(ret);
+    } /* endif my_rank < TARGET_NTASKS */
+
+    /* Finalize the MPI library. */
+    printf("%d %s Finalizing...\n", my_rank, TEST_NAME);
+    if ((ret = pio_test_finalize(&test_comm)))
+        return ret;
+
+    printf("%d %s SUCCESS!!\n", my_rank, TEST_NAME);
+    return 0;
+}
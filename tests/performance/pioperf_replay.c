@@ -0,0 +1,742 @@
+/*
+ * I/O benchmark driver that replays decompositions.
+ *
+ * The decompositions are read from text decomposition files (written
+ * by PIOc_writemap()), from netCDF decomposition files (written by
+ * PIOc_write_nc_decomp()), or generated. For each decomposition the
+ * driver sweeps over the requested iotypes, rearrangers, rearranger
+ * options, number of IO tasks and number of variables. For each
+ * configuration a few frames of all the variables are written, and
+ * the time spent rearranging the data, the time spent in the I/O
+ * backend, and the total time of each frame are collected (the max
+ * over all tasks). The percentiles of these times and the
+ * corresponding bandwidths are printed, and appended to a CSV file.
+ *
+ * Usage:
+ *   mpiexec -n <ntasks> ./pioperf_replay [options]
+ *
+ * Options (the lists are comma separated):
+ *   --decomp=<file>           Replay the decomposition in file, a netCDF
+ *                             decomposition if the name ends with .nc.
+ *                             Can be repeated.
+ *   --gen=<NX>x<NY>[x<NZ>][:cyclic]
+ *                             Generate a block (or cyclic) decomposition
+ *                             of a NX x NY x NZ array. Can be repeated.
+ *                             The default, if no decomposition is given,
+ *                             is 256x256x16.
+ *   --iotypes=<list>          pnetcdf,netcdf,netcdf4c,netcdf4p (default:
+ *                             all the iotypes available).
+ *   --rearrs=<list>           box,subset (default: box,subset).
+ *   --comm-types=<list>       p2p,coll (default: p2p,coll).
+ *   --fc=<list>               off,on, flow control with handshakes and
+ *                             --max-pend-req pending requests (default:
+ *                             off).
+ *   --max-pend-req=<n>        Pending requests with flow control (default:
+ *                             64).
+ *   --niotasks=<list>         Number of IO tasks (default: ntasks).
+ *   --nvars=<list>            Number of variables (default: 1).
+ *   --nframes=<n>             Number of frames written (default: 3).
+ *   --type=<type>             int,float,double (default: double).
+ *   --csv=<file>              Append the results to file (default:
+ *                             pioperf_replay.csv).
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+
+/* The max number of entries in an option list. */
+#define MAX_LIST_LEN 16
+
+/* The max number of decompositions replayed. */
+#define MAX_DECOMPS 16
+
+/* The max number of dimensions of a generated decomposition. */
+#define MAX_GEN_DIMS 3
+
+/* The max length of a line of a report. */
+#define MAX_LINE_LEN 1024
+
+/* The number of percentiles reported. */
+#define NUM_PCTS 4
+
+/* The timers of each frame. */
+#define TIMER_REARR 0
+#define TIMER_IO 1
+#define TIMER_TOTAL 2
+#define NUM_TIMERS 3
+
+/* Print an error, with the rank and location, and abort. */
+#define BENCH_ERR(e) do {                                               \
+        fprintf(stderr, "%d Error %d in %s, line %d\n", my_rank, e, __FILE__, __LINE__); \
+        MPI_Abort(MPI_COMM_WORLD, e);                                   \
+    } while (0)
+
+/* The rank of this task in MPI_COMM_WORLD. */
+int my_rank;
+
+/* The percentiles reported. */
+int pcts[NUM_PCTS] = {0, 50, 90, 100};
+
+/* The names of the timers. */
+char timer_name[NUM_TIMERS][PIO_MAX_NAME + 1] = {"rearr", "io", "total"};
+
+/* A decomposition to replay. */
+typedef struct bench_decomp_t
+{
+    /* The name of the decomposition in the reports. */
+    char name[PIO_MAX_NAME + 1];
+
+    /* Name of the netCDF decomposition file, or empty. */
+    char ncfile[PIO_MAX_NAME + 1];
+
+    /* The number of dimensions. */
+    int ndims;
+
+    /* The global dimensions. */
+    int *gdims;
+
+    /* The length of the map of this task. */
+    PIO_Offset maplen;
+
+    /* The map of this task (1-based). */
+    PIO_Offset *map;
+} bench_decomp_t;
+
+/* The options of the benchmark. */
+typedef struct bench_opts_t
+{
+    int ndecomps;
+    bench_decomp_t decomp[MAX_DECOMPS];
+    int niotypes;
+    int iotype[MAX_LIST_LEN];
+    int nrearrs;
+    int rearr[MAX_LIST_LEN];
+    int ncomm_types;
+    int comm_type[MAX_LIST_LEN];
+    int nfcs;
+    int fc[MAX_LIST_LEN];
+    int max_pend_req;
+    int nniotasks;
+    int niotasks[MAX_LIST_LEN];
+    int nnvars;
+    int nvars[MAX_LIST_LEN];
+    int nframes;
+    int pio_type;
+    char csv[PIO_MAX_NAME + 1];
+} bench_opts_t;
+
+/*
+ * Convert a name in a list of names to a value.
+ *
+ * @param name the name.
+ * @param nnames the number of names.
+ * @param names the names.
+ * @param values the values of the names.
+ * @param value pointer that gets the value of name.
+ * @returns 0 for success, PIO_EINVAL if the name is unknown.
+ */
+static int name_to_value(const char *name, int nnames, const char **names, const int *values,
+                         int *value)
+{
+    for (int i = 0; i < nnames; i++)
+        if (!strcmp(name, names[i]))
+        {
+            *value = values[i];
+            return PIO_NOERR;
+        }
+    fprintf(stderr, "Unknown option value %s\n", name);
+    return PIO_EINVAL;
+}
+
+/*
+ * Parse a comma separated list of names, or of integers if names is
+ * NULL.
+ *
+ * @param str the list.
+ * @param nnames the number of names.
+ * @param names the names, or NULL.
+ * @param values the values of the names.
+ * @param nlist pointer that gets the number of entries in the list.
+ * @param list array that gets the values of the entries.
+ * @returns 0 for success, PIO_EINVAL otherwise.
+ */
+static int parse_list(const char *str, int nnames, const char **names, const int *values,
+                      int *nlist, int *list)
+{
+    char buf[MAX_LINE_LEN];
+    char *tok;
+    int ret;
+
+    strncpy(buf, str, MAX_LINE_LEN - 1);
+    buf[MAX_LINE_LEN - 1] = '\0';
+    *nlist = 0;
+    for (tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+    {
+        if (*nlist == MAX_LIST_LEN)
+            return PIO_EINVAL;
+        if (names)
+        {
+            if ((ret = name_to_value(tok, nnames, names, values, &list[*nlist])))
+                return ret;
+        }
+        else if ((list[*nlist] = atoi(tok)) <= 0)
+            return PIO_EINVAL;
+        (*nlist)++;
+    }
+
+    return *nlist ? PIO_NOERR : PIO_EINVAL;
+}
+
+/*
+ * Generate a block, or cyclic, decomposition of a NX x NY [x NZ]
+ * array over the tasks in comm. The block decomposition gives each
+ * task a contiguous range of the array, the cyclic decomposition
+ * deals the elements of the array to the tasks round-robin.
+ *
+ * @param spec the specification of the decomposition,
+ * NX x NY [x NZ] [:cyclic].
+ * @param comm the communicator of the decomposition.
+ * @param decomp pointer to the decomposition.
+ * @returns 0 for success, error code otherwise.
+ */
+static int gen_decomp(const char *spec, MPI_Comm comm, bench_decomp_t *decomp)
+{
+    char buf[PIO_MAX_NAME + 1];
+    char *tok;
+    char *cyclic;
+    PIO_Offset gsize = 1;
+    int ntasks, rank;
+
+    MPI_Comm_size(comm, &ntasks);
+    MPI_Comm_rank(comm, &rank);
+
+    strncpy(buf, spec, PIO_MAX_NAME);
+    buf[PIO_MAX_NAME] = '\0';
+    if ((cyclic = strchr(buf, ':')))
+    {
+        if (strcmp(cyclic, ":cyclic"))
+            return PIO_EINVAL;
+        *cyclic = '\0';
+    }
+
+    if (!(decomp->gdims = calloc(MAX_GEN_DIMS, sizeof(int))))
+        return PIO_ENOMEM;
+    decomp->ndims = 0;
+    for (tok = strtok(buf, "x"); tok; tok = strtok(NULL, "x"))
+    {
+        if (decomp->ndims == MAX_GEN_DIMS || atoi(tok) <= 0)
+            return PIO_EINVAL;
+        decomp->gdims[decomp->ndims] = atoi(tok);
+        gsize *= decomp->gdims[decomp->ndims++];
+    }
+    if (decomp->ndims < 2)
+        return PIO_EINVAL;
+
+    /* The first gsize % ntasks tasks get one more element. */
+    decomp->maplen = gsize / ntasks + ((rank < gsize % ntasks) ? 1 : 0);
+    if (!(decomp->map = malloc((decomp->maplen ? decomp->maplen : 1) * sizeof(PIO_Offset))))
+        return PIO_ENOMEM;
+    for (PIO_Offset e = 0; e < decomp->maplen; e++)
+    {
+        if (cyclic)
+            decomp->map[e] = e * ntasks + rank + 1;
+        else
+            decomp->map[e] = rank * (gsize / ntasks) + ((rank < gsize % ntasks) ? rank : gsize % ntasks) + e + 1;
+    }
+
+    snprintf(decomp->name, PIO_MAX_NAME + 1, "gen_%s", spec);
+
+    return PIO_NOERR;
+}
+
+/*
+ * Read a text, or netCDF, decomposition file. The netCDF
+ * decompositions are only read when the IO system is initialized.
+ *
+ * @param file the name of the decomposition file.
+ * @param comm the communicator of the decomposition.
+ * @param decomp pointer to the decomposition.
+ * @returns 0 for success, error code otherwise.
+ */
+static int read_decomp(const char *file, MPI_Comm comm, bench_decomp_t *decomp)
+{
+    const char *base = strrchr(file, '/');
+    size_t len = strlen(file);
+    int ret;
+
+    strncpy(decomp->name, base ? base + 1 : file, PIO_MAX_NAME);
+    decomp->name[PIO_MAX_NAME] = '\0';
+
+    if (len > 3 && !strcmp(file + len - 3, ".nc"))
+    {
+        strncpy(decomp->ncfile, file, PIO_MAX_NAME);
+        decomp->ncfile[PIO_MAX_NAME] = '\0';
+        return PIO_NOERR;
+    }
+
+    if ((ret = PIOc_readmap(file, &decomp->ndims, &decomp->gdims, &decomp->maplen,
+                            &decomp->map, comm)))
+        return ret;
+
+    /* The tasks not in the decomposition file get an empty map. */
+    if (!decomp->maplen && !decomp->map)
+        if (!(decomp->map = malloc(sizeof(PIO_Offset))))
+            return PIO_ENOMEM;
+
+    return PIO_NOERR;
+}
+
+/*
+ * Parse the command line options.
+ *
+ * @param argc the number of arguments.
+ * @param argv the arguments.
+ * @param opts pointer that gets the options.
+ * @returns 0 for success, error code otherwise.
+ */
+static int parse_opts(int argc, char **argv, bench_opts_t *opts)
+{
+    const char *iotype_names[] = {"pnetcdf", "netcdf", "netcdf4c", "netcdf4p"};
+    const int iotypes[] = {PIO_IOTYPE_PNETCDF, PIO_IOTYPE_NETCDF, PIO_IOTYPE_NETCDF4C,
+                           PIO_IOTYPE_NETCDF4P};
+    const char *rearr_names[] = {"box", "subset"};
+    const int rearrs[] = {PIO_REARR_BOX, PIO_REARR_SUBSET};
+    const char *comm_type_names[] = {"p2p", "coll"};
+    const int comm_types[] = {PIO_REARR_COMM_P2P, PIO_REARR_COMM_COLL};
+    const char *fc_names[] = {"off", "on"};
+    const int fcs[] = {0, 1};
+    const char *type_names[] = {"int", "float", "double"};
+    const int types[] = {PIO_INT, PIO_FLOAT, PIO_DOUBLE};
+    int ntasks;
+    int ntypes;
+    int ret = PIO_NOERR;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &ntasks);
+
+    /* The defaults. */
+    memset(opts, 0, sizeof(bench_opts_t));
+    for (int i = 0; i < 4; i++)
+        if (PIOc_iotype_available(iotypes[i]))
+            opts->iotype[opts->niotypes++] = iotypes[i];
+    opts->nrearrs = 2;
+    opts->rearr[0] = PIO_REARR_BOX;
+    opts->rearr[1] = PIO_REARR_SUBSET;
+    opts->ncomm_types = 2;
+    opts->comm_type[0] = PIO_REARR_COMM_P2P;
+    opts->comm_type[1] = PIO_REARR_COMM_COLL;
+    opts->nfcs = 1;
+    opts->max_pend_req = 64;
+    opts->nniotasks = 1;
+    opts->niotasks[0] = ntasks;
+    opts->nnvars = 1;
+    opts->nvars[0] = 1;
+    opts->nframes = 3;
+    opts->pio_type = PIO_DOUBLE;
+    strcpy(opts->csv, "pioperf_replay.csv");
+
+    for (int a = 1; a < argc && !ret; a++)
+    {
+        char *val = strchr(argv[a], '=');
+
+        if (!val)
+        {
+            fprintf(stderr, "Invalid option %s\n", argv[a]);
+            return PIO_EINVAL;
+        }
+        val++;
+
+        if (!strncmp(argv[a], "--decomp=", 9) || !strncmp(argv[a], "--gen=", 6))
+        {
+            if (opts->ndecomps == MAX_DECOMPS)
+                return PIO_EINVAL;
+            if (argv[a][2] == 'd')
+                ret = read_decomp(val, MPI_COMM_WORLD, &opts->decomp[opts->ndecomps++]);
+            else
+                ret = gen_decomp(val, MPI_COMM_WORLD, &opts->decomp[opts->ndecomps++]);
+        }
+        else if (!strncmp(argv[a], "--iotypes=", 10))
+            ret = parse_list(val, 4, iotype_names, iotypes, &opts->niotypes, opts->iotype);
+        else if (!strncmp(argv[a], "--rearrs=", 9))
+            ret = parse_list(val, 2, rearr_names, rearrs, &opts->nrearrs, opts->rearr);
+        else if (!strncmp(argv[a], "--comm-types=", 13))
+            ret = parse_list(val, 2, comm_type_names, comm_types, &opts->ncomm_types,
+                             opts->comm_type);
+        else if (!strncmp(argv[a], "--fc=", 5))
+            ret = parse_list(val, 2, fc_names, fcs, &opts->nfcs, opts->fc);
+        else if (!strncmp(argv[a], "--max-pend-req=", 15))
+            opts->max_pend_req = atoi(val);
+        else if (!strncmp(argv[a], "--niotasks=", 11))
+            ret = parse_list(val, 0, NULL, NULL, &opts->nniotasks, opts->niotasks);
+        else if (!strncmp(argv[a], "--nvars=", 8))
+            ret = parse_list(val, 0, NULL, NULL, &opts->nnvars, opts->nvars);
+        else if (!strncmp(argv[a], "--nframes=", 10))
+            ret = ((opts->nframes = atoi(val)) > 0) ? PIO_NOERR : PIO_EINVAL;
+        else if (!strncmp(argv[a], "--type=", 7))
+            ret = parse_list(val, 3, type_names, types, &ntypes, &opts->pio_type);
+        else if (!strncmp(argv[a], "--csv=", 6))
+        {
+            strncpy(opts->csv, val, PIO_MAX_NAME);
+            opts->csv[PIO_MAX_NAME] = '\0';
+        }
+        else
+        {
+            fprintf(stderr, "Invalid option %s\n", argv[a]);
+            ret = PIO_EINVAL;
+        }
+    }
+    if (ret)
+        return ret;
+
+    if (!opts->ndecomps)
+        if ((ret = gen_decomp("256x256x16", MPI_COMM_WORLD, &opts->decomp[opts->ndecomps++])))
+            return ret;
+
+    for (int i = 0; i < opts->nniotasks; i++)
+        if (opts->niotasks[i] > ntasks)
+            return PIO_EINVAL;
+
+    return PIO_NOERR;
+}
+
+/*
+ * Get the sum of the write times of the variables of a file (the time
+ * rearranging the data and the time in the I/O backend, including the
+ * time waiting for the pending requests of the file).
+ *
+ * @param ncid the ncid of the file.
+ * @param nvars the number of variables.
+ * @param varids the IDs of the variables.
+ * @param rearr_time pointer that gets the rearrangement time.
+ * @param io_time pointer that gets the I/O backend time.
+ * @returns 0 for success, error code otherwise.
+ */
+static int get_write_times(int ncid, int nvars, const int *varids, double *rearr_time,
+                           double *io_time)
+{
+    file_desc_t *file;
+    int ret;
+
+    if ((ret = pio_get_file(ncid, &file)))
+        return ret;
+
+    *rearr_time = 0;
+    *io_time = file->perf.wait_time;
+    for (int v = 0; v < nvars; v++)
+    {
+        *rearr_time += file->varlist[varids[v]].perf.wr_rearr_time;
+        *io_time += file->varlist[varids[v]].perf.wr_io_time;
+    }
+
+    return PIO_NOERR;
+}
+
+/*
+ * Compare two doubles, for qsort().
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+/*
+ * Write nframes of nvars variables with a decomposition, and collect
+ * the times of each frame.
+ *
+ * @param iosysid the IO system ID.
+ * @param ioid the ID of the decomposition.
+ * @param iotype the iotype.
+ * @param ndims the number of dimensions of the variables (except the
+ * record dimension).
+ * @param gdims the dimensions of the variables.
+ * @param maplen the length of the map of this task.
+ * @param nvars the number of variables.
+ * @param opts pointer to the options.
+ * @param times array of NUM_TIMERS * nframes that gets the max times,
+ * over all tasks, of each frame.
+ * @returns 0 for success, error code otherwise.
+ */
+static int run_bench(int iosysid, int ioid, int iotype, int ndims, const int *gdims,
+                     PIO_Offset maplen, int nvars, bench_opts_t *opts, double *times)
+{
+    char filename[PIO_MAX_NAME + 1];
+    char name[PIO_MAX_NAME + 1];
+    int dimids[ndims + 1];
+    int varids[nvars];
+    int type_size;
+    void *buf;
+    int ncid;
+    int ret;
+
+    type_size = (opts->pio_type == PIO_DOUBLE) ? sizeof(double) :
+        ((opts->pio_type == PIO_FLOAT) ? sizeof(float) : sizeof(int));
+
+    /* The data written, a ramp. */
+    if (!(buf = malloc((maplen ? maplen : 1) * type_size)))
+        return PIO_ENOMEM;
+    for (PIO_Offset e = 0; e < maplen; e++)
+    {
+        if (opts->pio_type == PIO_DOUBLE)
+            ((double *)buf)[e] = my_rank + e * 0.001;
+        else if (opts->pio_type == PIO_FLOAT)
+            ((float *)buf)[e] = my_rank + e * 0.001;
+        else
+            ((int *)buf)[e] = my_rank + e;
+    }
+
+    sprintf(filename, "pioperf_replay_%d.nc", iotype);
+    if ((ret = PIOc_createfile(iosysid, &ncid, &iotype, filename, PIO_CLOBBER)))
+        return ret;
+    if ((ret = PIOc_def_dim(ncid, "time", PIO_UNLIMITED, &dimids[0])))
+        return ret;
+    for (int d = 0; d < ndims; d++)
+    {
+        sprintf(name, "dim%03d", d);
+        if ((ret = PIOc_def_dim(ncid, name, gdims[d], &dimids[d + 1])))
+            return ret;
+    }
+    for (int v = 0; v < nvars; v++)
+    {
+        sprintf(name, "var%04d", v);
+        if ((ret = PIOc_def_var(ncid, name, opts->pio_type, ndims + 1, dimids, &varids[v])))
+            return ret;
+    }
+    if ((ret = PIOc_enddef(ncid)))
+        return ret;
+
+    for (int f = 0; f < opts->nframes; f++)
+    {
+        double ftimes[NUM_TIMERS];
+        double rearr_start, io_start;
+        double rearr_end, io_end;
+
+        if ((ret = get_write_times(ncid, nvars, varids, &rearr_start, &io_start)))
+            return ret;
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        ftimes[TIMER_TOTAL] = MPI_Wtime();
+        for (int v = 0; v < nvars; v++)
+        {
+            if ((ret = PIOc_setframe(ncid, varids[v], f)))
+                return ret;
+            if ((ret = PIOc_write_darray(ncid, varids[v], ioid, maplen, buf, NULL)))
+                return ret;
+        }
+        if ((ret = PIOc_sync(ncid)))
+            return ret;
+        ftimes[TIMER_TOTAL] = MPI_Wtime() - ftimes[TIMER_TOTAL];
+
+        if ((ret = get_write_times(ncid, nvars, varids, &rearr_end, &io_end)))
+            return ret;
+        ftimes[TIMER_REARR] = rearr_end - rearr_start;
+        ftimes[TIMER_IO] = io_end - io_start;
+
+        /* The time of the frame is the time of the slowest task. */
+        MPI_Allreduce(MPI_IN_PLACE, ftimes, NUM_TIMERS, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        for (int t = 0; t < NUM_TIMERS; t++)
+            times[t * opts->nframes + f] = ftimes[t];
+    }
+
+    if ((ret = PIOc_closefile(ncid)))
+        return ret;
+    if (!my_rank)
+        remove(filename);
+    free(buf);
+
+    return PIO_NOERR;
+}
+
+/*
+ * Print the results of a configuration, and append them to the CSV
+ * file. Only called on rank 0.
+ *
+ * @param opts pointer to the options.
+ * @param decomp pointer to the decomposition.
+ * @param config the configuration, as a comma separated list.
+ * @param bytes the number of bytes written in each frame.
+ * @param times array of NUM_TIMERS * nframes with the times of each
+ * frame.
+ * @returns 0 for success, error code otherwise.
+ */
+static int report(bench_opts_t *opts, bench_decomp_t *decomp, const char *config,
+                  PIO_Offset bytes, double *times)
+{
+    char line[MAX_LINE_LEN];
+    int len;
+    FILE *fp;
+    bool new_file;
+
+    len = snprintf(line, MAX_LINE_LEN, "%s,%s,%d,%lld", decomp->name, config, opts->nframes,
+                   (long long)bytes);
+    for (int t = 0; t < NUM_TIMERS; t++)
+    {
+        double *ttimes = &times[t * opts->nframes];
+
+        /* Nearest rank percentiles of the times. */
+        qsort(ttimes, opts->nframes, sizeof(double), cmp_double);
+        for (int p = 0; p < NUM_PCTS; p++)
+        {
+            int rank = (pcts[p] * opts->nframes + 99) / 100;
+
+            len += snprintf(line + len, MAX_LINE_LEN - len, ",%g",
+                            ttimes[rank ? rank - 1 : 0]);
+        }
+
+        /* The bandwidth (MB/s) of the median and of the fastest frame. */
+        for (int p = 1; p >= 0; p--)
+        {
+            int rank = (pcts[p] * opts->nframes + 99) / 100;
+            double t = ttimes[rank ? rank - 1 : 0];
+
+            len += snprintf(line + len, MAX_LINE_LEN - len, ",%g",
+                            (t > 0) ? bytes / t / 1.0e6 : 0);
+        }
+    }
+    printf("%s\n", line);
+
+    if ((fp = fopen(opts->csv, "r")))
+        fclose(fp);
+    new_file = !fp;
+    if (!(fp = fopen(opts->csv, "a")))
+        return PIO_EIO;
+    if (new_file)
+    {
+        fprintf(fp, "decomp,ntasks,niotasks,iotype,rearr,comm_type,fc,nvars,nframes,bytes");
+        for (int t = 0; t < NUM_TIMERS; t++)
+        {
+            for (int p = 0; p < NUM_PCTS; p++)
+                fprintf(fp, ",%s_time_p%d", timer_name[t], pcts[p]);
+            fprintf(fp, ",%s_bw_p50,%s_bw_max", timer_name[t], timer_name[t]);
+        }
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "%s\n", line);
+    fclose(fp);
+
+    return PIO_NOERR;
+}
+
+/*
+ * Replay a decomposition with all the configurations of the
+ * options.
+ *
+ * @param opts pointer to the options.
+ * @param decomp pointer to the decomposition.
+ * @returns 0 for success, error code otherwise.
+ */
+static int replay_decomp(bench_opts_t *opts, bench_decomp_t *decomp)
+{
+    const char *rearr_names[] = {"", "box", "subset"};
+    const char *comm_type_names[] = {"p2p", "coll"};
+    double times[NUM_TIMERS * opts->nframes];
+    char config[MAX_LINE_LEN];
+    int ntasks;
+    int ret;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &ntasks);
+
+    for (int n = 0; n < opts->nniotasks; n++)
+        for (int r = 0; r < opts->nrearrs; r++)
+            for (int c = 0; c < opts->ncomm_types; c++)
+                for (int fc = 0; fc < opts->nfcs; fc++)
+                {
+                    int max_pend_req = opts->fc[fc] ? opts->max_pend_req :
+                        PIO_REARR_COMM_UNLIMITED_PEND_REQ;
+                    int fcd = opts->fc[fc] ? PIO_REARR_COMM_FC_2D_ENABLE :
+                        PIO_REARR_COMM_FC_2D_DISABLE;
+                    io_desc_t *iodesc;
+                    PIO_Offset maplen;
+                    int iosysid;
+                    int ioid;
+
+                    if ((ret = PIOc_Init_Intracomm(MPI_COMM_WORLD, opts->niotasks[n],
+                                                   ntasks / opts->niotasks[n], 0,
+                                                   opts->rearr[r], &iosysid)))
+                        return ret;
+                    if ((ret = PIOc_set_rearr_opts(iosysid, opts->comm_type[c], fcd,
+                                                   opts->fc[fc], true, max_pend_req,
+                                                   opts->fc[fc], true, max_pend_req)))
+                        return ret;
+
+                    /* The decomposition is created after setting the
+                     * rearranger options, that are copied to it. */
+                    if (strlen(decomp->ncfile))
+                        ret = PIOc_read_nc_decomp(iosysid, decomp->ncfile, &ioid,
+                                                  MPI_COMM_WORLD, opts->pio_type, NULL, NULL,
+                                                  NULL);
+                    else
+                        ret = PIOc_InitDecomp(iosysid, opts->pio_type, decomp->ndims,
+                                              decomp->gdims, decomp->maplen, decomp->map,
+                                              &ioid, NULL, NULL, NULL);
+                    if (ret)
+                        return ret;
+                    if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+                        return PIO_EBADID;
+                    maplen = iodesc->ndof;
+
+                    for (int i = 0; i < opts->niotypes; i++)
+                        for (int v = 0; v < opts->nnvars; v++)
+                        {
+                            PIO_Offset bytes = maplen * opts->nvars[v] * iodesc->piotype_size;
+
+                            if ((ret = run_bench(iosysid, ioid, opts->iotype[i], iodesc->ndims,
+                                                 iodesc->dimlen, maplen, opts->nvars[v], opts,
+                                                 times)))
+                                return ret;
+
+                            MPI_Allreduce(MPI_IN_PLACE, &bytes, 1, PIO_OFFSET, MPI_SUM,
+                                          MPI_COMM_WORLD);
+                            if (!my_rank)
+                            {
+                                snprintf(config, MAX_LINE_LEN, "%d,%d,%s,%s,%s,%s,%d", ntasks,
+                                         opts->niotasks[n],
+                                         pio_iotype_to_string(opts->iotype[i]),
+                                         rearr_names[opts->rearr[r]],
+                                         comm_type_names[opts->comm_type[c]],
+                                         opts->fc[fc] ? "on" : "off", opts->nvars[v]);
+                                if ((ret = report(opts, decomp, config, bytes, times)))
+                                    return ret;
+                            }
+                        }
+
+                    if ((ret = PIOc_freedecomp(iosysid, ioid)))
+                        return ret;
+                    if ((ret = PIOc_finalize(iosysid)))
+                        return ret;
+                }
+
+    return PIO_NOERR;
+}
+
+/* Run the benchmark. */
+int main(int argc, char **argv)
+{
+    bench_opts_t opts;
+    int ret;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        BENCH_ERR(ret);
+
+    if ((ret = parse_opts(argc, argv, &opts)))
+        BENCH_ERR(ret);
+
+    if (!my_rank)
+        printf("decomp,ntasks,niotasks,iotype,rearr,comm_type,fc,nvars,nframes,bytes,"
+               "{rearr,io,total}x{time_p0,time_p50,time_p90,time_p100,bw_p50,bw_max}\n");
+
+    for (int d = 0; d < opts.ndecomps; d++)
+    {
+        if ((ret = replay_decomp(&opts, &opts.decomp[d])))
+            BENCH_ERR(ret);
+        free(opts.decomp[d].gdims);
+        free(opts.decomp[d].map);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
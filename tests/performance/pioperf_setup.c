@@ -0,0 +1,489 @@
+/*
+ * Benchmark of the setup cost of decompositions (PIOc_InitDecomp()).
+ *
+ * Decompositions of a NX x NX array with increasing sizes and
+ * irregularity are created with each rearranger. The time spent on
+ * each phase of the setup (see pio_setup_stats_t), including the
+ * definition of the MPI datatypes that is otherwise done by the first
+ * rearrangement of data, and the memory used by the decomposition are
+ * collected. The median and max times (of the max over all tasks) of
+ * the repetitions are printed, and appended to a CSV file.
+ *
+ * The decompositions are:
+ *   block    each task gets a contiguous range of the array.
+ *   cyclic   the elements are dealt to the tasks round-robin.
+ *   random   each task gets a block of a random permutation of the
+ *            elements of the array.
+ *   holes    like block, with every 8th element of the array not
+ *            written by any task.
+ *
+ * Usage:
+ *   mpiexec -n <ntasks> ./pioperf_setup [options]
+ *
+ * Options (the lists are comma separated):
+ *   --decomps=<list>   block,cyclic,random,holes (default: all).
+ *   --sizes=<list>     NX, the array is NX x NX (default:
+ *                      128,256,512,1024).
+ *   --rearrs=<list>    box,subset (default: box,subset).
+ *   --niotasks=<list>  Number of IO tasks (default: ntasks).
+ *   --nreps=<n>        Number of decompositions created for each
+ *                      configuration (default: 5).
+ *   --csv=<file>       Append the results to file (default:
+ *                      pioperf_setup.csv).
+ *   --plan-cache=<dir> Use the rearranger plan cache in dir (see
+ *                      PIOc_set_rearr_plan_cache()), the first
+ *                      repetition saves the plans (unless saved by an
+ *                      earlier run) and the others load them.
+ */
+#include <pio_config.h>
+#include <pio.h>
+#include <pio_internal.h>
+
+/* The max number of entries in an option list. */
+#define MAX_LIST_LEN 16
+
+/* The max length of a line of a report. */
+#define MAX_LINE_LEN 1024
+
+/* The number of dimensions of the array. */
+#define NDIM2 2
+
+/* Every HOLE_STRIDE element of the array is a hole in the holes
+ * decomposition. */
+#define HOLE_STRIDE 8
+
+/* The decompositions. */
+#define DECOMP_BLOCK 0
+#define DECOMP_CYCLIC 1
+#define DECOMP_RANDOM 2
+#define DECOMP_HOLES 3
+#define NUM_DECOMPS 4
+
+/* The phases of the setup timed, in the order of the
+ * pio_setup_stats_t fields. */
+#define NUM_PHASES 8
+
+/* Print an error, with the rank and location, and abort. */
+#define BENCH_ERR(e) do {                                               \
+        fprintf(stderr, "%d Error %d in %s, line %d\n", my_rank, e, __FILE__, __LINE__); \
+        MPI_Abort(MPI_COMM_WORLD, e);                                   \
+    } while (0)
+
+/* The rank of this task in MPI_COMM_WORLD. */
+int my_rank;
+
+/* The names of the decompositions. */
+const char *decomp_names[NUM_DECOMPS] = {"block", "cyclic", "random", "holes"};
+
+/* The names of the phases of the setup. */
+const char *phase_names[NUM_PHASES] = {"partition", "fill", "exchange", "map", "counts",
+                                       "datatypes", "load", "total"};
+
+/* The options of the benchmark. */
+typedef struct bench_opts_t
+{
+    int ndecomps;
+    int decomp[MAX_LIST_LEN];
+    int nsizes;
+    int size[MAX_LIST_LEN];
+    int nrearrs;
+    int rearr[MAX_LIST_LEN];
+    int nniotasks;
+    int niotasks[MAX_LIST_LEN];
+    int nreps;
+    char csv[PIO_MAX_NAME + 1];
+    char plan_cache[PIO_MAX_NAME + 1];
+} bench_opts_t;
+
+/*
+ * Parse a comma separated list of names, or of integers if names is
+ * NULL. The value of a name is its index in names.
+ *
+ * @param str the list.
+ * @param nnames the number of names.
+ * @param names the names, or NULL.
+ * @param nlist pointer that gets the number of entries in the list.
+ * @param list array that gets the values of the entries.
+ * @returns 0 for success, PIO_EINVAL otherwise.
+ */
+static int parse_list(const char *str, int nnames, const char **names, int *nlist, int *list)
+{
+    char buf[MAX_LINE_LEN];
+    char *tok;
+
+    strncpy(buf, str, MAX_LINE_LEN - 1);
+    buf[MAX_LINE_LEN - 1] = '\0';
+    *nlist = 0;
+    for (tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+    {
+        if (*nlist == MAX_LIST_LEN)
+            return PIO_EINVAL;
+        if (names)
+        {
+            int i;
+
+            for (i = 0; i < nnames; i++)
+                if (!strcmp(tok, names[i]))
+                    break;
+            if (i == nnames)
+            {
+                fprintf(stderr, "Unknown option value %s\n", tok);
+                return PIO_EINVAL;
+            }
+            list[*nlist] = i;
+        }
+        else if ((list[*nlist] = atoi(tok)) <= 0)
+            return PIO_EINVAL;
+        (*nlist)++;
+    }
+
+    return *nlist ? PIO_NOERR : PIO_EINVAL;
+}
+
+/*
+ * Parse the command line options.
+ *
+ * @param argc the number of arguments.
+ * @param argv the arguments.
+ * @param opts pointer that gets the options.
+ * @returns 0 for success, error code otherwise.
+ */
+static int parse_opts(int argc, char **argv, bench_opts_t *opts)
+{
+    const char *rearr_names[] = {"box", "subset"};
+    int ntasks;
+    int ret = PIO_NOERR;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &ntasks);
+
+    /* The defaults. */
+    memset(opts, 0, sizeof(bench_opts_t));
+    opts->ndecomps = NUM_DECOMPS;
+    for (int d = 0; d < NUM_DECOMPS; d++)
+        opts->decomp[d] = d;
+    opts->nsizes = 4;
+    for (int s = 0; s < opts->nsizes; s++)
+        opts->size[s] = 128 << s;
+    opts->nrearrs = 2;
+    opts->rearr[0] = 0;
+    opts->rearr[1] = 1;
+    opts->nniotasks = 1;
+    opts->niotasks[0] = ntasks;
+    opts->nreps = 5;
+    strcpy(opts->csv, "pioperf_setup.csv");
+    opts->plan_cache[0] = '\0';
+
+    for (int a = 1; a < argc && !ret; a++)
+    {
+        char *val = strchr(argv[a], '=');
+
+        if (!val)
+        {
+            fprintf(stderr, "Invalid option %s\n", argv[a]);
+            return PIO_EINVAL;
+        }
+        val++;
+
+        if (!strncmp(argv[a], "--decomps=", 10))
+            ret = parse_list(val, NUM_DECOMPS, decomp_names, &opts->ndecomps, opts->decomp);
+        else if (!strncmp(argv[a], "--sizes=", 8))
+            ret = parse_list(val, 0, NULL, &opts->nsizes, opts->size);
+        else if (!strncmp(argv[a], "--rearrs=", 9))
+            ret = parse_list(val, 2, rearr_names, &opts->nrearrs, opts->rearr);
+        else if (!strncmp(argv[a], "--niotasks=", 11))
+            ret = parse_list(val, 0, NULL, &opts->nniotasks, opts->niotasks);
+        else if (!strncmp(argv[a], "--nreps=", 8))
+            ret = ((opts->nreps = atoi(val)) > 0) ? PIO_NOERR : PIO_EINVAL;
+        else if (!strncmp(argv[a], "--csv=", 6))
+        {
+            strncpy(opts->csv, val, PIO_MAX_NAME);
+            opts->csv[PIO_MAX_NAME] = '\0';
+        }
+        else if (!strncmp(argv[a], "--plan-cache=", 13))
+        {
+            strncpy(opts->plan_cache, val, PIO_MAX_NAME);
+            opts->plan_cache[PIO_MAX_NAME] = '\0';
+        }
+        else
+        {
+            fprintf(stderr, "Invalid option %s\n", argv[a]);
+            ret = PIO_EINVAL;
+        }
+    }
+    if (ret)
+        return ret;
+
+    /* The rearrangers were parsed as indices of rearr_names. */
+    for (int r = 0; r < opts->nrearrs; r++)
+        opts->rearr[r] = opts->rearr[r] ? PIO_REARR_SUBSET : PIO_REARR_BOX;
+
+    for (int i = 0; i < opts->nniotasks; i++)
+        if (opts->niotasks[i] > ntasks)
+            return PIO_EINVAL;
+
+    return PIO_NOERR;
+}
+
+/*
+ * Get the greatest common divisor of two numbers.
+ */
+static PIO_Offset offset_gcd(PIO_Offset a, PIO_Offset b)
+{
+    while (b)
+    {
+        PIO_Offset t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * Create the map of this task for a decomposition of an array.
+ *
+ * @param decomp the decomposition, DECOMP_BLOCK, DECOMP_CYCLIC,
+ * DECOMP_RANDOM or DECOMP_HOLES.
+ * @param gsize the number of elements of the array.
+ * @param ntasks the number of tasks.
+ * @param maplen pointer that gets the length of the map.
+ * @param map pointer that gets the map (1-based), that must be freed
+ * by the caller.
+ * @returns 0 for success, error code otherwise.
+ */
+static int create_map(int decomp, PIO_Offset gsize, int ntasks, int *maplen,
+                      PIO_Offset **map)
+{
+    PIO_Offset first = my_rank * (gsize / ntasks) + min(my_rank, gsize % ntasks);
+    PIO_Offset mult = 2654435761LL % gsize;
+
+    /* The first gsize % ntasks tasks get one more element. */
+    *maplen = gsize / ntasks + ((my_rank < gsize % ntasks) ? 1 : 0);
+    if (!(*map = malloc(max(1, *maplen) * sizeof(PIO_Offset))))
+        return PIO_ENOMEM;
+
+    /* The random permutation maps i to (mult * i + 1) % gsize, with
+     * mult and gsize coprime. */
+    while (decomp == DECOMP_RANDOM && offset_gcd(mult, gsize) != 1)
+        mult++;
+
+    for (PIO_Offset e = 0; e < *maplen; e++)
+    {
+        switch (decomp)
+        {
+        case DECOMP_BLOCK:
+            (*map)[e] = first + e + 1;
+            break;
+        case DECOMP_CYCLIC:
+            (*map)[e] = e * ntasks + my_rank + 1;
+            break;
+        case DECOMP_RANDOM:
+            (*map)[e] = (mult * (first + e) + 1) % gsize + 1;
+            break;
+        case DECOMP_HOLES:
+            (*map)[e] = ((first + e) % HOLE_STRIDE == HOLE_STRIDE - 1) ? 0 : first + e + 1;
+            break;
+        }
+    }
+
+    return PIO_NOERR;
+}
+
+/*
+ * Compare two doubles, for qsort().
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+/*
+ * Create and free a decomposition nreps times, and collect the setup
+ * times and the memory used.
+ *
+ * @param iosysid the IO system ID.
+ * @param gdims the dimensions of the array.
+ * @param maplen the length of the map of this task.
+ * @param map the map of this task.
+ * @param nreps the number of repetitions.
+ * @param times array of NUM_PHASES * nreps that gets the max times,
+ * over all tasks, of each phase of each repetition.
+ * @param mem array of 2 that gets the sum and max, over all tasks, of
+ * the memory used by the decomposition.
+ * @returns 0 for success, error code otherwise.
+ */
+static int time_setup(int iosysid, int *gdims, int maplen, PIO_Offset *map, int nreps,
+                      double *times, PIO_Offset *mem)
+{
+    iosystem_desc_t *ios;
+    int ret;
+
+    if (!(ios = pio_get_iosystem_from_id(iosysid)))
+        return PIO_EBADID;
+
+    for (int r = 0; r < nreps; r++)
+    {
+        double rtimes[NUM_PHASES];
+        io_desc_t *iodesc;
+        int ioid;
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        if ((ret = PIOc_InitDecomp(iosysid, PIO_DOUBLE, NDIM2, gdims, maplen, map, &ioid,
+                                   NULL, NULL, NULL)))
+            return ret;
+        if (!(iodesc = pio_get_iodesc_from_id(ioid)))
+            return PIO_EBADID;
+
+        /* The MPI datatypes are otherwise defined by the first
+         * rearrangement of data. */
+        if ((ret = define_iodesc_datatypes(ios, iodesc)))
+            return ret;
+
+        rtimes[0] = iodesc->setup.partition_time;
+        rtimes[1] = iodesc->setup.fill_time;
+        rtimes[2] = iodesc->setup.exchange_time;
+        rtimes[3] = iodesc->setup.map_time;
+        rtimes[4] = iodesc->setup.counts_time;
+        rtimes[5] = iodesc->setup.datatypes_time;
+        rtimes[6] = iodesc->setup.load_time;
+        rtimes[7] = iodesc->setup.total_time + iodesc->setup.datatypes_time;
+        MPI_Allreduce(MPI_IN_PLACE, rtimes, NUM_PHASES, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        for (int p = 0; p < NUM_PHASES; p++)
+            times[p * nreps + r] = rtimes[p];
+
+        mem[0] = mem[1] = pio_iodesc_mem_size(iodesc);
+
+        if ((ret = PIOc_freedecomp(iosysid, ioid)))
+            return ret;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &mem[0], 1, PIO_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &mem[1], 1, PIO_OFFSET, MPI_MAX, MPI_COMM_WORLD);
+
+    return PIO_NOERR;
+}
+
+/*
+ * Print the results of a configuration, and append them to the CSV
+ * file. Only called on rank 0.
+ *
+ * @param opts pointer to the options.
+ * @param config the configuration, as a comma separated list.
+ * @param times array of NUM_PHASES * nreps with the times of each
+ * repetition.
+ * @param mem the sum and max of the memory used by the decomposition.
+ * @returns 0 for success, error code otherwise.
+ */
+static int report(bench_opts_t *opts, const char *config, double *times, PIO_Offset *mem)
+{
+    char line[MAX_LINE_LEN];
+    bool new_file;
+    int len;
+    FILE *fp;
+
+    len = snprintf(line, MAX_LINE_LEN, "%s,%d", config, opts->nreps);
+    for (int p = 0; p < NUM_PHASES; p++)
+    {
+        double *ptimes = &times[p * opts->nreps];
+
+        qsort(ptimes, opts->nreps, sizeof(double), cmp_double);
+        len += snprintf(line + len, MAX_LINE_LEN - len, ",%g,%g",
+                        ptimes[(opts->nreps - 1) / 2], ptimes[opts->nreps - 1]);
+    }
+    snprintf(line + len, MAX_LINE_LEN - len, ",%lld,%lld", (long long)mem[0],
+             (long long)mem[1]);
+    printf("%s\n", line);
+
+    if ((fp = fopen(opts->csv, "r")))
+        fclose(fp);
+    new_file = !fp;
+    if (!(fp = fopen(opts->csv, "a")))
+        return PIO_EIO;
+    if (new_file)
+    {
+        fprintf(fp, "decomp,gsize,ntasks,niotasks,rearr,nreps");
+        for (int p = 0; p < NUM_PHASES; p++)
+            fprintf(fp, ",%s_time_p50,%s_time_max", phase_names[p], phase_names[p]);
+        fprintf(fp, ",mem_sum,mem_max\n");
+    }
+    fprintf(fp, "%s\n", line);
+    fclose(fp);
+
+    return PIO_NOERR;
+}
+
+/* Run the benchmark. */
+int main(int argc, char **argv)
+{
+    bench_opts_t opts;
+    int ntasks;
+    int ret;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ntasks);
+
+    if ((ret = PIOc_set_iosystem_error_handling(PIO_DEFAULT, PIO_RETURN_ERROR, NULL)))
+        BENCH_ERR(ret);
+
+    if ((ret = parse_opts(argc, argv, &opts)))
+        BENCH_ERR(ret);
+
+    if (!my_rank)
+        printf("decomp,gsize,ntasks,niotasks,rearr,nreps,"
+               "{partition,fill,exchange,map,counts,datatypes,load,total}x{time_p50,time_max},"
+               "mem_sum,mem_max\n");
+
+    for (int d = 0; d < opts.ndecomps; d++)
+        for (int s = 0; s < opts.nsizes; s++)
+        {
+            int gdims[NDIM2] = {opts.size[s], opts.size[s]};
+            PIO_Offset gsize = (PIO_Offset)opts.size[s] * opts.size[s];
+            PIO_Offset *map;
+            int maplen;
+
+            if ((ret = create_map(opts.decomp[d], gsize, ntasks, &maplen, &map)))
+                BENCH_ERR(ret);
+
+            for (int n = 0; n < opts.nniotasks; n++)
+                for (int r = 0; r < opts.nrearrs; r++)
+                {
+                    double times[NUM_PHASES * opts.nreps];
+                    char config[MAX_LINE_LEN];
+                    PIO_Offset mem[2];
+                    int iosysid;
+
+                    if ((ret = PIOc_Init_Intracomm(MPI_COMM_WORLD, opts.niotasks[n],
+                                                   ntasks / opts.niotasks[n], 0, opts.rearr[r],
+                                                   &iosysid)))
+                        BENCH_ERR(ret);
+
+                    if (opts.plan_cache[0])
+                        if ((ret = PIOc_set_rearr_plan_cache(iosysid, opts.plan_cache)))
+                            BENCH_ERR(ret);
+
+                    if ((ret = time_setup(iosysid, gdims, maplen, map, opts.nreps, times, mem)))
+                        BENCH_ERR(ret);
+
+                    if (!my_rank)
+                    {
+                        snprintf(config, MAX_LINE_LEN, "%s,%lld,%d,%d,%s",
+                                 decomp_names[opts.decomp[d]], (long long)gsize, ntasks,
+                                 opts.niotasks[n],
+                                 (opts.rearr[r] == PIO_REARR_BOX) ? "box" : "subset");
+                        if ((ret = report(&opts, config, times, mem)))
+                            BENCH_ERR(ret);
+                    }
+
+                    if ((ret = PIOc_finalize(iosysid)))
+                        BENCH_ERR(ret);
+                }
+
+            free(map);
+        }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include <unistd.h> // usleep
 #include <mpi.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
 #include <adios2.h>
@@ -319,31 +320,98 @@ int GlobalMaxSteps_nm(int nsteps_in = 0)
     return nsteps_current;
 }
 
-std::vector<int> AssignWriteRanks(int n_bp_writers, MPI_Comm comm, int mpirank, int nproc)
+/* Get the size (in bytes) of a file, or of the files in a directory
+ */
+static long long GetPathSize(const string &path)
+{
+    struct stat sb;
+    long long size = 0;
+
+    if (stat(path.c_str(), &sb) != 0)
+        return 0;
+    if (S_ISREG(sb.st_mode))
+        return sb.st_size;
+    if (!S_ISDIR(sb.st_mode))
+        return 0;
+
+    DIR* dirp = opendir(path.c_str());
+    if (!dirp)
+        return 0;
+
+    struct dirent * dp;
+    while ((dp = readdir(dirp)) != NULL)
+    {
+        if (stat((path + "/" + dp->d_name).c_str(), &sb) == 0 && S_ISREG(sb.st_mode))
+            size += sb.st_size;
+    }
+
+    closedir(dirp);
+
+    return size;
+}
+
+/* Assign the BP files, named "bpfileprefix.X" and written by
+ * n_bp_writers writers, to the converter processes. Each process gets a contiguous range of files,
+ * so that its data is usually a contiguous part of the global arrays
+ * (that matches the part owned by the process as an IO task with the
+ * box rearranger). The ranges are balanced by the size of the files,
+ * using the prefix sums of the sizes, and each process gets at least
+ * one file.
+ */
+std::vector<int> AssignWriteRanks(const string &bpfileprefix, int n_bp_writers,
+                                  MPI_Comm comm, int mpirank, int nproc)
 {
     if (!mpirank && debug_out)
         cout << "The BP file was written by " << n_bp_writers << " processes\n";
 
-    int nwb = n_bp_writers / nproc; // Number of blocks to process
-    int start_wb; // Starting wb (in [0 .. nwb-1])
+    /* Prefix sums of the file sizes, computed on rank 0 */
+    std::vector<long long> psum(n_bp_writers + 1, 0);
+    if (mpirank == 0)
+    {
+        for (int i = 0; i < n_bp_writers; i++)
+        {
+            string filei = bpfileprefix + "." + std::to_string(i);
+
+            /* Empty files still need to be read */
+            psum[i + 1] = psum[i] + GetPathSize(filei) + 1;
+        }
+    }
+    MPI_Bcast(psum.data(), n_bp_writers + 1, MPI_LONG_LONG, 0, comm);
 
-    if (mpirank < n_bp_writers % nproc)
-        nwb++;
+    /* The first file of process p is the first one that ends after
+     * p/nproc of the total size */
+    std::vector<int> start_wb(nproc + 1);
+    long long total = psum[n_bp_writers];
+    for (int p = 0; p <= nproc; p++)
+    {
+        if (p == nproc)
+        {
+            start_wb[p] = n_bp_writers;
+            continue;
+        }
+        long long target = (long long)((double)total * p / nproc);
+        int wb = std::upper_bound(psum.begin() + 1, psum.end(), target) - (psum.begin() + 1);
 
-    if (mpirank < n_bp_writers % nproc)
-        start_wb = mpirank * nwb;
-    else
-        start_wb = mpirank * nwb + n_bp_writers % nproc;
+        /* Leave at least one file for each process */
+        if (p > 0 && wb <= start_wb[p - 1])
+            wb = start_wb[p - 1] + 1;
+        if (wb > n_bp_writers - (nproc - p))
+            wb = n_bp_writers - (nproc - p);
+        start_wb[p] = wb;
+    }
+
+    int nwb = start_wb[mpirank + 1] - start_wb[mpirank]; // Number of blocks to process
 
     if (debug_out)
-        cout << "Process " << mpirank << " start block = " << start_wb <<
-                " number of blocks = " << nwb << endl;
+        cout << "Process " << mpirank << " start block = " << start_wb[mpirank] <<
+                " number of blocks = " << nwb << " bytes = " <<
+                psum[start_wb[mpirank + 1]] - psum[start_wb[mpirank]] << endl;
 
     FlushStdout_nm(comm);
 
     std::vector<int> blocks(nwb);
     for (int i = 0; i < nwb; ++i)
-        blocks[i] = start_wb + i;
+        blocks[i] = start_wb[mpirank] + i;
 
     return blocks;
 }
@@ -1669,6 +1737,8 @@ int adios2_ConvertVariableDarray(adios2::Variable<T> *v_base, std::vector<T> v_v
     sprintf(fillval_varname, "fillval_id/%s", varname.c_str());
     int decomp_id, frame_id, fillval_exist;
     char fillval_id[PIO_MAX_NAME];
+    Decomposition decomp = {BP2PIO_ERROR, BP2PIO_ERROR};
+    int cur_decomp_id = -1; /* The decomposition kept with mem_opt */
 
     // TAHSIN -- THIS IS GETTING CONFUSING. NEED TO THINK ABOUT time steps.
     for (; ts < nsteps; ++ts)
@@ -1694,18 +1764,25 @@ int adios2_ConvertVariableDarray(adios2::Variable<T> *v_base, std::vector<T> v_v
 
             TimerStart(read);
 
-            /* Read local data for each file */
-            int elemsize = adios2_type_size_a2(v_base->Type());
-            assert(elemsize > 0);
+            /* Read local data for each file. The Gets of all blocks of
+             * this step are deferred and performed together, one
+             * PerformGets() for each file. */
             /* Allocate +1 to prevent d.data() from returning NULL. Otherwise, read/write operations fail */
             /* nelems may be 0, when some processes do not have any data */
-            std::vector<char> d((nelems + 1) * elemsize);
+            std::vector<T> d(nelems + 1);
             uint64_t offset = 0;
+            size_t last_file = 0, last_blockid = 0;
+            decomp_id = frame_id = -1;
+            fillval_exist = 0;
             for (size_t i = 1; i <= wfiles.size(); i++)
             {
                 *v_base = bpIO[i].InquireVariable<T>(varname);
                 const auto vb_blocks = bpReader[i].BlocksInfo(*v_base, 0);
+                adios2::Variable<int> v_decomp = bpIO[i].InquireVariable<int>(decomp_varname);
+                adios2::Variable<int> v_frame = bpIO[i].InquireVariable<int>(frame_varname);
                 l_nwriters = vb_blocks.size() / nsteps;
+                std::vector<int> decomp_ids(l_nwriters), frame_ids(l_nwriters);
+                int nblocks = 0;
                 for (int j = 0; j < l_nwriters; j++)
                 {
                     size_t blockid = j*nsteps + ts;
@@ -1713,56 +1790,99 @@ int adios2_ConvertVariableDarray(adios2::Variable<T> *v_base, std::vector<T> v_v
                     {
                         v_base->SetBlockSelection(blockid);
                         v_base->SetSelection({vb_blocks[blockid].Start, vb_blocks[blockid].Count});
-                        bpReader[i].Get(*v_base, v_value, adios2::Mode::Sync);
-                        memcpy(d.data() + offset, v_value.data(), v_value.size()*elemsize);
-
-                        std::vector<int> v_tmp;
-                        adios2::Variable<int> v_var;
-                        v_var = bpIO[i].InquireVariable<int>(decomp_varname);
-                        v_var.SetBlockSelection(blockid);
-                        bpReader[i].Get(v_var, v_tmp, adios2::Mode::Sync);
-                        memcpy(&decomp_id, v_tmp.data(), sizeof(int));
-
-                        v_var = bpIO[i].InquireVariable<int>(frame_varname);
-                        v_var.SetBlockSelection(blockid);
-                        bpReader[i].Get(v_var, v_tmp, adios2::Mode::Sync);
-                        memcpy(&frame_id, v_tmp.data(), sizeof(int));
-
-                        /* Fix for NUM_FRAMES */
-                        if (!var.is_timed && frame_id >= 0)
-                            var.is_timed = true;
-
-                        if (decomp_id > 0)
-                        {
-                            adios2::Variable<T> v1_var = bpIO[i].InquireVariable<T>(fillval_varname);
-                            std::vector<T> v1_tmp;
-                            v1_var.SetBlockSelection(blockid);
-                            bpReader[i].Get(v1_var, v1_tmp, adios2::Mode::Sync);
-                            memcpy(fillval_id, v1_tmp.data(), v1_tmp.size()*sizeof(T));
-                            fillval_exist = 1;
-                        }
-                        else
-                        {
-                            decomp_id = -decomp_id;
-                            fillval_exist = 0;
-                        }
-                        offset += vb_blocks[blockid].Count[0] * elemsize;
+                        bpReader[i].Get(*v_base, d.data() + offset, adios2::Mode::Deferred);
+
+                        v_decomp.SetBlockSelection(blockid);
+                        bpReader[i].Get(v_decomp, &decomp_ids[nblocks], adios2::Mode::Deferred);
+
+                        v_frame.SetBlockSelection(blockid);
+                        bpReader[i].Get(v_frame, &frame_ids[nblocks], adios2::Mode::Deferred);
+
+                        offset += vb_blocks[blockid].Count[0];
+                        last_file = i;
+                        last_blockid = blockid;
+                        nblocks++;
                     }
                 }
+                bpReader[i].PerformGets();
+
+                for (int j = 0; j < nblocks; j++)
+                {
+                    /* Fix for NUM_FRAMES */
+                    if (!var.is_timed && frame_ids[j] >= 0)
+                        var.is_timed = true;
+                }
+
+                /* The ids of the last block are used. */
+                if (nblocks > 0)
+                {
+                    decomp_id = decomp_ids[nblocks - 1];
+                    frame_id = frame_ids[nblocks - 1];
+                }
+            }
+
+            /* The fill value of the last block, if it has one. */
+            if (last_file > 0)
+            {
+                if (decomp_id > 0)
+                {
+                    adios2::Variable<T> v1_var = bpIO[last_file].InquireVariable<T>(fillval_varname);
+                    std::vector<T> v1_tmp;
+                    v1_var.SetBlockSelection(last_blockid);
+                    bpReader[last_file].Get(v1_var, v1_tmp, adios2::Mode::Sync);
+                    memcpy(fillval_id, v1_tmp.data(), v1_tmp.size()*sizeof(T));
+                    fillval_exist = 1;
+                }
+                else
+                {
+                    decomp_id = -decomp_id;
+                    fillval_exist = 0;
+                }
             }
 
             TimerStop(read);
 
             TimerStart(write);
 
-            Decomposition decomp;
-            if (mem_opt)
+            /* Tasks without blocks in this step use the decomposition
+             * of the other tasks, all tasks must agree on it. */
+            MPI_Allreduce(MPI_IN_PLACE, &decomp_id, 1, MPI_INT, MPI_MAX, comm);
+
+            /* With mem_opt only the decomposition in use is kept, it
+             * is replaced when the decomposition changes. */
+            if (mem_opt && decomp_id != cur_decomp_id)
             {
+                if (cur_decomp_id >= 0)
+                {
+                    /* Buffered writes of the decomposition must be
+                     * flushed before it is freed. */
+                    ret = PIOc_sync(ncid);
+                    if (ret != PIO_NOERR)
+                    {
+                        ierr = BP2PIO_ERROR;
+                        break;
+                    }
+
+                    ret = PIOc_freedecomp(iosysid, decomp.ioid);
+                    if (ret != PIO_NOERR)
+                    {
+                        ierr = BP2PIO_ERROR;
+                        break;
+                    }
+                    cur_decomp_id = -1;
+                }
+
                 sprintf(decompname, "/__pio__/decomp/%d", decomp_id);
                 decomp = ProcessOneDecomposition(bpIO, bpReader, ncid, decompname, wfiles,
                                                  iosysid, mpirank, nproc, comm);
+                if (decomp.ioid == BP2PIO_ERROR)
+                {
+                    ierr = BP2PIO_ERROR;
+                    break;
+                }
+                cur_decomp_id = decomp_id;
             }
-            else
+            else if (!mem_opt)
             {
                 sprintf(decompname, "%d", decomp_id);
                 decomp = decomp_map[decompname];
@@ -1785,9 +1905,12 @@ int adios2_ConvertVariableDarray(adios2::Variable<T> *v_base, std::vector<T> v_v
                         ierr = BP2PIO_ERROR;
                         break;
                     }
+                    cur_decomp_id = -1;
 
                     decomp = ProcessOneDecomposition(bpIO, bpReader, ncid, decompname, wfiles,
                                                      iosysid, mpirank, nproc, comm, var.nctype);
+                    if (decomp.ioid != BP2PIO_ERROR)
+                        cur_decomp_id = decomp_id;
                 }
                 else
                 {
@@ -1819,6 +1942,8 @@ int adios2_ConvertVariableDarray(adios2::Variable<T> *v_base, std::vector<T> v_v
                     }
                 }
 
+                /* The data is buffered by PIO, and flushed when the
+                 * buffer is full or the file is synced. */
                 if (fillval_exist)
                 {
                     ret = PIOc_write_darray(ncid, var.nc_varid, decomp.ioid, (PIO_Offset)nelems,
@@ -1837,23 +1962,6 @@ int adios2_ConvertVariableDarray(adios2::Variable<T> *v_base, std::vector<T> v_v
                 break;
             }
 
-            if (mem_opt)
-            {
-                ret = PIOc_sync(ncid);
-                if (ret != PIO_NOERR)
-                {
-                    ierr = BP2PIO_ERROR;
-                    break;
-                }
-
-                ret = PIOc_freedecomp(iosysid, decomp.ioid);
-                if (ret != PIO_NOERR)
-                {
-                    ierr = BP2PIO_ERROR;
-                    break;
-                }
-            }
-
             TimerStop(write);
         }
         catch (const std::exception &e)
@@ -1869,6 +1977,20 @@ int adios2_ConvertVariableDarray(adios2::Variable<T> *v_base, std::vector<T> v_v
     }
     ERROR_CHECK_RETURN(ierr, err_val, err_cnt, comm)
 
+    /* Free the decomposition kept with mem_opt, after its buffered
+     * writes are flushed. */
+    if (mem_opt && cur_decomp_id >= 0)
+    {
+        TimerStart(write);
+        ret = PIOc_sync(ncid);
+        if (ret == PIO_NOERR)
+            ret = PIOc_freedecomp(iosysid, decomp.ioid);
+        if (ret != PIO_NOERR)
+            ierr = BP2PIO_ERROR;
+        TimerStop(write);
+    }
+    ERROR_CHECK_RETURN(ierr, err_val, err_cnt, comm)
+
     return BP2PIO_NOERR;
 }
 
@@ -2009,7 +2131,8 @@ int ConvertBPFile(const string &infilepath, const string &outfilename,
 
         /* Number of BP file writers != number of converter processes here */
         std::vector<int> wfiles;
-        wfiles = AssignWriteRanks(n_bp_files, comm, mpirank, nproc);
+        wfiles = AssignWriteRanks(infilepath + ".dir/" + basefilename, n_bp_files,
+                                  comm, mpirank, nproc);
         if (debug_out)
         {
             for (auto nb: wfiles)
@@ -2222,10 +2345,9 @@ int ConvertBPFile(const string &infilepath, const string &outfilename,
 
             FlushStdout_nm(comm);
 
-            ret = PIOc_sync(ncid); /* FIXME: flush after each variable until development is done. Remove for efficiency */
-            if (ret != PIO_NOERR)
-                ierr = BP2PIO_ERROR;
-            ERROR_CHECK_THROW(ierr, err_val, err_cnt, comm, "PIOc_sync failed.");
+            /* The darray writes stay buffered across variables, PIO
+             * flushes them when its buffer is full and at the sync
+             * below. */
         }
 
         TimerStart(write);
@@ -2432,23 +2554,93 @@ static int FindBPDirs(const string &bppdir,
     return BP2PIO_NOERR;
 }
 
+/* Get the total size (in bytes) of the BP files of a BP file
+ * "infilename", in the folder "infilename.dir"
+ */
+static long long GetBPDirSize(const string &infilename)
+{
+    long long size = 0;
+    string foldername = infilename + ".dir/";
+
+    DIR* dirp = opendir(foldername.c_str());
+    if (!dirp)
+        return 0;
+
+    /* The BP files may be directories of data files */
+    struct dirent * dp;
+    while ((dp = readdir(dirp)) != NULL)
+    {
+        string name(dp->d_name);
+        if (name != "." && name != "..")
+            size += GetPathSize(foldername + name);
+    }
+
+    closedir(dirp);
+
+    return size;
+}
+
+/* Assign the BP files to ngroups groups of processes. The files are
+ * taken from the largest to the smallest, and each file is assigned
+ * to the group with the smallest total size of files so far.
+ * bpdirs:  The BP files
+ * ngroups: The number of groups
+ * Returns the group of each file
+ */
+static vector<int> ScheduleBPFiles(const vector<string> &bpdirs, int ngroups)
+{
+    vector<long long> sizes(bpdirs.size());
+    vector<size_t> order(bpdirs.size());
+    vector<long long> load(ngroups, 0);
+    vector<int> groups(bpdirs.size(), 0);
+
+    for (size_t i = 0; i < bpdirs.size(); i++)
+    {
+        sizes[i] = GetBPDirSize(bpdirs[i]);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        int g = std::min_element(load.begin(), load.end()) - load.begin();
+        groups[order[i]] = g;
+        load[g] += sizes[order[i]];
+        if (debug_out)
+            printf("Converting %s (%lld bytes) in group %d\n", bpdirs[order[i]].c_str(),
+                   sizes[order[i]], g);
+    }
+
+    return groups;
+}
+
 /* Convert all BP files in "bppdir" to NetCDF files
  * bppdir:  Directory containing multiple directories, named "*.bp.dir",
  *          each directory containing BP files corresponding to a single
  *          file. This is the "BP Parent Directory".
  * piotype: The PIO IO type used for converting BP files to NetCDF using PIO
+ * nconc:   The number of files converted concurrently, 0 to convert
+ *          as many files concurrently as possible
  * comm:    The MPI communicator to be used for conversion
  *
  * The function looks for all directories in bppdir named "*.bp.dir"
- * and converts them, one at a time, to NetCDF files
+ * and converts them to NetCDF files. The processes in comm are split
+ * into nconc groups, the files are assigned to the groups by size and
+ * each group converts its files, one at a time, with its own PIO
+ * iosystem.
  */
 int MConvertBPToNC(const string &bppdir, const string &piotype, int mem_opt,
-                    MPI_Comm comm)
+                    int nconc, MPI_Comm comm)
 {
     int ierr = BP2PIO_NOERR;
     vector<string> bpdirs;
     vector<string> conv_fname_prefixes;
     const std::string CONV_FNAME_SUFFIX(".nc");
+    int mpirank, nproc;
+
+    MPI_Comm_rank(comm, &mpirank);
+    MPI_Comm_size(comm, &nproc);
 
     ierr = FindBPDirs(bppdir, bpdirs, conv_fname_prefixes);
     if (ierr != BP2PIO_NOERR)
@@ -2458,22 +2650,53 @@ int MConvertBPToNC(const string &bppdir, const string &piotype, int mem_opt,
     }
 
     assert(bpdirs.size() == conv_fname_prefixes.size());
+    if (bpdirs.size() == 0)
+        return BP2PIO_NOERR;
+
+    /* One group of processes for each concurrent conversion */
+    int ngroups = (nconc > 0) ? nconc : nproc;
+    if (ngroups > nproc)
+        ngroups = nproc;
+    if (ngroups > (int)bpdirs.size())
+        ngroups = (int)bpdirs.size();
+
+    /* The schedule is computed on rank 0, so that all processes agree
+     * on it */
+    vector<int> groups(bpdirs.size(), 0);
+    if (mpirank == 0)
+        groups = ScheduleBPFiles(bpdirs, ngroups);
+    MPI_Bcast(groups.data(), (int)groups.size(), MPI_INT, 0, comm);
+
+    /* Contiguous ranks form a group */
+    int color = (int)(((long long)mpirank * ngroups) / nproc);
+    MPI_Comm gcomm;
+    MPI_Comm_split(comm, color, mpirank, &gcomm);
+
     for (size_t i = 0; i < bpdirs.size(); i++)
     {
-        MPI_Barrier(comm);
+        if (groups[i] != color)
+            continue;
+
+        MPI_Barrier(gcomm);
         ierr = ConvertBPToNC(bpdirs[i],
                 conv_fname_prefixes[i] + CONV_FNAME_SUFFIX,
-                piotype, mem_opt, comm);
-        MPI_Barrier(comm);
+                piotype, mem_opt, gcomm);
+        MPI_Barrier(gcomm);
         if (ierr != BP2PIO_NOERR)
         {
             fprintf(stderr, "Unable to convert BP file (%s) to NetCDF\n",
                     bpdirs[i].c_str());
-            return ierr;
+            break;
         }
     }
 
-    return BP2PIO_NOERR;
+    MPI_Comm_free(&gcomm);
+
+    /* The conversion fails if any group failed */
+    int err_val = (ierr != BP2PIO_NOERR) ? 1 : 0, err_cnt = 0;
+    MPI_Allreduce(&err_val, &err_cnt, 1, MPI_INT, MPI_SUM, comm);
+
+    return (err_cnt != 0) ? BP2PIO_ERROR : BP2PIO_NOERR;
 }
 
 #ifdef __cplusplus
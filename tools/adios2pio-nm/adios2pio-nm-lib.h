@@ -10,7 +10,7 @@ int ConvertBPToNC(const string &infilepath,
                   const string &outfilename,
                   const string &piotype, int mem_opt, MPI_Comm comm_in);
 int MConvertBPToNC(const string &bppdir, const string &piotype, int mem_opt,
-                    MPI_Comm comm);
+                    int nconc, MPI_Comm comm);
 void SetDebugOutput(int val);
 
 #endif /* #ifndef _ADIOS2PIO_NM_LIB_H_ */
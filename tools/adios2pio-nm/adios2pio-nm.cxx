@@ -14,6 +14,7 @@ static void init_user_options(spio_tool_utils::ArgParser &ap)
       .add_opt("nc-file", "output file name after conversion")
       .add_opt("pio-format", "output PIO_IO_TYPE. Supported parameters: \"pnetcdf\",  \"netcdf\",  \"netcdf4c\",  \"netcdf4p\"")
       .add_opt("reduce-memory-usage", "Reduce memory usage (execution time will likely increase)")
+      .add_opt("concurrent-files", "Number of files in idir converted concurrently, 0 for as many as possible (default: 1)")
       .add_opt("verbose", "Turn on verbose info messages");
 }
 
@@ -24,10 +25,12 @@ static int get_user_options(
               std::string &ifile, std::string &ofile,
               std::string &otype,
               int &mem_opt,
+              int &nconc,
               int &debug_lvl)
 {
     const std::string DEFAULT_PIO_FORMAT("pnetcdf");
     mem_opt = 0;
+    nconc = 1;
     debug_lvl = 0;
 
     ap.parse(argc, argv);
@@ -80,6 +83,16 @@ static int get_user_options(
         mem_opt = 1;
     }
 
+    if (ap.has_arg("concurrent-files"))
+    {
+        nconc = ap.get_arg<int>("concurrent-files");
+        if (nconc < 0)
+        {
+            ap.print_usage(std::cerr);
+            return 1;
+        }
+    }
+
     if (ap.has_arg("verbose"))
     {
         debug_lvl = 1;
@@ -104,10 +117,11 @@ int main(int argc, char *argv[])
     /* Parse the user options */
     string idir, infilepath, outfilename, piotype;
     int mem_opt = 0;
+    int nconc = 1;
     int debug_lvl = 0;
     ret = get_user_options(ap, argc, argv,
                             idir, infilepath, outfilename,
-                            piotype, mem_opt, debug_lvl);
+                            piotype, mem_opt, nconc, debug_lvl);
 
     if (ret != 0)
     {
@@ -128,7 +142,7 @@ int main(int argc, char *argv[])
     }
     else
     {
-        ret = MConvertBPToNC(idir, piotype, mem_opt, comm_in);
+        ret = MConvertBPToNC(idir, piotype, mem_opt, nconc, comm_in);
     }
     MPI_Barrier(comm_in);
 